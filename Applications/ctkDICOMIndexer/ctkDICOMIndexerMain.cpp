@@ -26,6 +26,7 @@
 // CTK includes
 #include <ctkDICOMIndexer.h>
 #include <ctkDICOMDatabase.h>
+#include <ctkDICOMThumbnailGenerator.h>
 
 // STD includes
 #include <cstdlib>
@@ -43,6 +44,10 @@ void print_usage()
   std::cerr << "     Reinitialize the database. Uses default schema or the provided sqlScript file.\n";
   std::cerr << "  3. ctkDICOMIndexer --cleanup <database.db>\n";
   std::cerr << "     Remove non-existent files from the database.\n";
+  std::cerr << "  4. ctkDICOMIndexer --thumbnails <database.db> [--all] [--force]\n";
+  std::cerr << "     Regenerate the missing and out of date thumbnails, of one instance per\n";
+  std::cerr << "     series or of all the instances with --all. --force regenerates them all;\n";
+  std::cerr << "     if interrupted, run again without --force to resume.\n";
   return;
 }
 
@@ -59,7 +64,8 @@ int main(int argc, char** argv)
     return EXIT_FAILURE;
   }
 
-  QCoreApplication app(argc, argv);
+  // thumbnails are rendered into QImages, no display is needed
+  QApplication app(argc, argv, false);
   QTextStream out(stdout);
 
   ctkDICOMIndexer idx;
@@ -80,6 +86,7 @@ int main(int argc, char** argv)
         {
           idx.addDirectory(myCTK,argv[3]);
         }
+        idx.waitForImportFinished();
       }
     }
     else if (std::string("--init") == argv[1])
@@ -98,6 +105,42 @@ int main(int argc, char** argv)
     {
       // TODO
     }
+    else if (std::string("--thumbnails") == argv[1])
+    {
+      bool allInstances = false;
+      bool force = false;
+      for (int i = 3; i < argc; ++i)
+      {
+        if (std::string("--all") == argv[i])
+        {
+          allInstances = true;
+        }
+        else if (std::string("--force") == argv[i])
+        {
+          force = true;
+        }
+        else
+        {
+          print_usage();
+          return EXIT_FAILURE;
+        }
+      }
+      myCTK.openDatabase( argv[2] );
+      ctkDICOMThumbnailGenerator generator;
+      myCTK.setThumbnailGenerator(&generator);
+      idx.setInstrumentationLevel(ctkDICOMIndexer::TimersInstrumentation);
+      idx.regenerateThumbnails(myCTK, allInstances, force);
+      // the rows are written here, there is no event loop to do it
+      const bool stored = idx.waitForThumbnails();
+      myCTK.setThumbnailGenerator(0);
+      out << idx.statisticsSummary() << "\n";
+      if (!stored)
+      {
+        std::cerr << "Could not store all the thumbnails: "
+                  << qPrintable(myCTK.lastError()) << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
     else
     {
       print_usage();
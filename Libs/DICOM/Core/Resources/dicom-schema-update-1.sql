@@ -0,0 +1,26 @@
+-- 
+-- Upgrades a DICOM database created without version information to
+-- version 1 of dicom-schema.sql: directory manifest and secondary indexes.
+-- 
+-- Note: the semicolon at the end is necessary for the simple parser to separate
+--       the statements since the SQlite driver does not handle multiple
+--       commands per QSqlQuery::exec call!
+-- ;
+
+CREATE TABLE IF NOT EXISTS 'DirectoryFiles' (
+  'Filename' VARCHAR(1024) NOT NULL ,
+  'Dirname' VARCHAR(1024) NOT NULL ,
+  'FileSize' INTEGER NOT NULL ,
+  'ModifiedTime' INTEGER NOT NULL ,
+  PRIMARY KEY ('Filename') );
+
+CREATE INDEX IF NOT EXISTS 'ImagesFilenameIndex' ON 'Images' ('Filename') ;
+CREATE INDEX IF NOT EXISTS 'ImagesSeriesIndex' ON 'Images' ('SeriesInstanceUID') ;
+CREATE INDEX IF NOT EXISTS 'SeriesStudyIndex' ON 'Series' ('StudyInstanceUID') ;
+CREATE INDEX IF NOT EXISTS 'StudiesPatientIndex' ON 'Studies' ('PatientsUID') ;
+CREATE INDEX IF NOT EXISTS 'PatientsIDNameIndex' ON 'Patients' ('PatientID', 'PatientsName') ;
+CREATE INDEX IF NOT EXISTS 'DirectoryFilesDirnameIndex' ON 'DirectoryFiles' ('Dirname') ;
+
+CREATE TABLE 'SchemaInfo' (
+  'Version' INTEGER NOT NULL );
+INSERT INTO 'SchemaInfo' ( 'Version' ) VALUES ( 1 );
@@ -0,0 +1,20 @@
+-- 
+-- Upgrades a DICOM database from version 1 to version 2 of dicom-schema.sql:
+-- index of the thumbnails packed in a single file.
+-- 
+-- Note: the semicolon at the end is necessary for the simple parser to separate
+--       the statements since the SQlite driver does not handle multiple
+--       commands per QSqlQuery::exec call!
+-- ;
+
+CREATE TABLE IF NOT EXISTS 'Thumbnails' (
+  'SOPInstanceUID' VARCHAR(64) NOT NULL ,
+  'SeriesInstanceUID' VARCHAR(64) NOT NULL ,
+  'DataOffset' INTEGER NOT NULL ,
+  'DataSize' INTEGER NOT NULL ,
+  'ModifiedTime' INTEGER NOT NULL ,
+  PRIMARY KEY ('SOPInstanceUID') );
+
+CREATE INDEX IF NOT EXISTS 'ThumbnailsSeriesIndex' ON 'Thumbnails' ('SeriesInstanceUID') ;
+
+UPDATE 'SchemaInfo' SET 'Version' = 2 ;
@@ -0,0 +1,121 @@
+-- 
+-- Upgrades a DICOM database from version 2 to version 3 of dicom-schema.sql:
+-- counts and total file sizes of patients, studies and series, maintained
+-- by triggers. The size of the files indexed before the update is unknown
+-- and counts as 0.
+-- 
+-- Note: the semicolon at the end is necessary for the simple parser to separate
+--       the statements since the SQlite driver does not handle multiple
+--       commands per QSqlQuery::exec call!
+-- ;
+
+ALTER TABLE 'Images' ADD COLUMN 'FileSize' INTEGER NOT NULL DEFAULT 0 ;
+ALTER TABLE 'Patients' ADD COLUMN 'StudyCount' INTEGER NOT NULL DEFAULT 0 ;
+ALTER TABLE 'Patients' ADD COLUMN 'SeriesCount' INTEGER NOT NULL DEFAULT 0 ;
+ALTER TABLE 'Patients' ADD COLUMN 'ImageCount' INTEGER NOT NULL DEFAULT 0 ;
+ALTER TABLE 'Patients' ADD COLUMN 'TotalFileSize' INTEGER NOT NULL DEFAULT 0 ;
+ALTER TABLE 'Studies' ADD COLUMN 'SeriesCount' INTEGER NOT NULL DEFAULT 0 ;
+ALTER TABLE 'Studies' ADD COLUMN 'ImageCount' INTEGER NOT NULL DEFAULT 0 ;
+ALTER TABLE 'Studies' ADD COLUMN 'TotalFileSize' INTEGER NOT NULL DEFAULT 0 ;
+ALTER TABLE 'Series' ADD COLUMN 'ImageCount' INTEGER NOT NULL DEFAULT 0 ;
+ALTER TABLE 'Series' ADD COLUMN 'TotalFileSize' INTEGER NOT NULL DEFAULT 0 ;
+
+-- counted once before the triggers exist
+-- ;
+
+UPDATE Series SET ImageCount = ( SELECT COUNT(*) FROM Images WHERE Images.SeriesInstanceUID = Series.SeriesInstanceUID ) ;
+UPDATE Studies SET
+  SeriesCount = ( SELECT COUNT(*) FROM Series WHERE Series.StudyInstanceUID = Studies.StudyInstanceUID ) ,
+  ImageCount = ( SELECT TOTAL(ImageCount) FROM Series WHERE Series.StudyInstanceUID = Studies.StudyInstanceUID ) ;
+UPDATE Patients SET
+  StudyCount = ( SELECT COUNT(*) FROM Studies WHERE Studies.PatientsUID = Patients.UID ) ,
+  SeriesCount = ( SELECT TOTAL(SeriesCount) FROM Studies WHERE Studies.PatientsUID = Patients.UID ) ,
+  ImageCount = ( SELECT TOTAL(ImageCount) FROM Studies WHERE Studies.PatientsUID = Patients.UID ) ;
+
+CREATE TRIGGER 'ImagesInsertCounts' AFTER INSERT ON 'Images'
+BEGIN
+  UPDATE Series SET ImageCount = ImageCount + 1, TotalFileSize = TotalFileSize + NEW.FileSize
+    WHERE SeriesInstanceUID = NEW.SeriesInstanceUID;
+END;
+CREATE TRIGGER 'ImagesDeleteCounts' AFTER DELETE ON 'Images'
+BEGIN
+  UPDATE Series SET ImageCount = ImageCount - 1, TotalFileSize = TotalFileSize - OLD.FileSize
+    WHERE SeriesInstanceUID = OLD.SeriesInstanceUID;
+END;
+CREATE TRIGGER 'ImagesUpdateCounts' AFTER UPDATE OF FileSize ON 'Images'
+  WHEN OLD.SeriesInstanceUID = NEW.SeriesInstanceUID
+BEGIN
+  UPDATE Series SET TotalFileSize = TotalFileSize + NEW.FileSize - OLD.FileSize
+    WHERE SeriesInstanceUID = NEW.SeriesInstanceUID;
+END;
+CREATE TRIGGER 'ImagesMoveCounts' AFTER UPDATE OF SeriesInstanceUID ON 'Images'
+  WHEN OLD.SeriesInstanceUID != NEW.SeriesInstanceUID
+BEGIN
+  UPDATE Series SET ImageCount = ImageCount - 1, TotalFileSize = TotalFileSize - OLD.FileSize
+    WHERE SeriesInstanceUID = OLD.SeriesInstanceUID;
+  UPDATE Series SET ImageCount = ImageCount + 1, TotalFileSize = TotalFileSize + NEW.FileSize
+    WHERE SeriesInstanceUID = NEW.SeriesInstanceUID;
+END;
+
+CREATE TRIGGER 'SeriesInsertCounts' AFTER INSERT ON 'Series'
+BEGIN
+  UPDATE Studies SET SeriesCount = SeriesCount + 1, ImageCount = ImageCount + NEW.ImageCount,
+      TotalFileSize = TotalFileSize + NEW.TotalFileSize
+    WHERE StudyInstanceUID = NEW.StudyInstanceUID;
+END;
+CREATE TRIGGER 'SeriesDeleteCounts' AFTER DELETE ON 'Series'
+BEGIN
+  UPDATE Studies SET SeriesCount = SeriesCount - 1, ImageCount = ImageCount - OLD.ImageCount,
+      TotalFileSize = TotalFileSize - OLD.TotalFileSize
+    WHERE StudyInstanceUID = OLD.StudyInstanceUID;
+END;
+CREATE TRIGGER 'SeriesUpdateCounts' AFTER UPDATE OF ImageCount, TotalFileSize ON 'Series'
+  WHEN OLD.StudyInstanceUID = NEW.StudyInstanceUID
+BEGIN
+  UPDATE Studies SET ImageCount = ImageCount + NEW.ImageCount - OLD.ImageCount,
+      TotalFileSize = TotalFileSize + NEW.TotalFileSize - OLD.TotalFileSize
+    WHERE StudyInstanceUID = NEW.StudyInstanceUID;
+END;
+CREATE TRIGGER 'SeriesMoveCounts' AFTER UPDATE OF StudyInstanceUID ON 'Series'
+  WHEN OLD.StudyInstanceUID != NEW.StudyInstanceUID
+BEGIN
+  UPDATE Studies SET SeriesCount = SeriesCount - 1, ImageCount = ImageCount - OLD.ImageCount,
+      TotalFileSize = TotalFileSize - OLD.TotalFileSize
+    WHERE StudyInstanceUID = OLD.StudyInstanceUID;
+  UPDATE Studies SET SeriesCount = SeriesCount + 1, ImageCount = ImageCount + NEW.ImageCount,
+      TotalFileSize = TotalFileSize + NEW.TotalFileSize
+    WHERE StudyInstanceUID = NEW.StudyInstanceUID;
+END;
+
+CREATE TRIGGER 'StudiesInsertCounts' AFTER INSERT ON 'Studies'
+BEGIN
+  UPDATE Patients SET StudyCount = StudyCount + 1, SeriesCount = SeriesCount + NEW.SeriesCount,
+      ImageCount = ImageCount + NEW.ImageCount, TotalFileSize = TotalFileSize + NEW.TotalFileSize
+    WHERE UID = NEW.PatientsUID;
+END;
+CREATE TRIGGER 'StudiesDeleteCounts' AFTER DELETE ON 'Studies'
+BEGIN
+  UPDATE Patients SET StudyCount = StudyCount - 1, SeriesCount = SeriesCount - OLD.SeriesCount,
+      ImageCount = ImageCount - OLD.ImageCount, TotalFileSize = TotalFileSize - OLD.TotalFileSize
+    WHERE UID = OLD.PatientsUID;
+END;
+CREATE TRIGGER 'StudiesUpdateCounts' AFTER UPDATE OF SeriesCount, ImageCount, TotalFileSize ON 'Studies'
+  WHEN OLD.PatientsUID = NEW.PatientsUID
+BEGIN
+  UPDATE Patients SET SeriesCount = SeriesCount + NEW.SeriesCount - OLD.SeriesCount,
+      ImageCount = ImageCount + NEW.ImageCount - OLD.ImageCount,
+      TotalFileSize = TotalFileSize + NEW.TotalFileSize - OLD.TotalFileSize
+    WHERE UID = NEW.PatientsUID;
+END;
+CREATE TRIGGER 'StudiesMoveCounts' AFTER UPDATE OF PatientsUID ON 'Studies'
+  WHEN OLD.PatientsUID != NEW.PatientsUID
+BEGIN
+  UPDATE Patients SET StudyCount = StudyCount - 1, SeriesCount = SeriesCount - OLD.SeriesCount,
+      ImageCount = ImageCount - OLD.ImageCount, TotalFileSize = TotalFileSize - OLD.TotalFileSize
+    WHERE UID = OLD.PatientsUID;
+  UPDATE Patients SET StudyCount = StudyCount + 1, SeriesCount = SeriesCount + NEW.SeriesCount,
+      ImageCount = ImageCount + NEW.ImageCount, TotalFileSize = TotalFileSize + NEW.TotalFileSize
+    WHERE UID = NEW.PatientsUID;
+END;
+
+UPDATE 'SchemaInfo' SET 'Version' = 3 ;
@@ -0,0 +1,13 @@
+-- 
+-- Upgrades a DICOM database from version 3 to version 4 of dicom-schema.sql:
+-- path of the copy stored in the database directory of the files of the
+-- directory manifest. Unknown for the files indexed before the update.
+-- 
+-- Note: the semicolon at the end is necessary for the simple parser to separate
+--       the statements since the SQlite driver does not handle multiple
+--       commands per QSqlQuery::exec call!
+-- ;
+
+ALTER TABLE 'DirectoryFiles' ADD COLUMN 'StoredFilename' VARCHAR(1024) ;
+
+UPDATE 'SchemaInfo' SET 'Version' = 4 ;
@@ -4,6 +4,10 @@
 -- Note: the semicolon at the end is necessary for the simple parser to separate
 --       the statements since the SQlite driver does not handle multiple
 --       commands per QSqlQuery::exec call!
+--
+-- Note: when changing the schema, increase the version in the SchemaInfo
+--       table below and in ctkDICOMDatabase::schemaVersion(), and add a
+--       dicom-schema-update-<version>.sql script upgrading existing databases.
 -- ;
 
 DROP TABLE IF EXISTS 'Images' ;
@@ -11,12 +15,16 @@ DROP TABLE IF EXISTS 'Patients' ;
 DROP TABLE IF EXISTS 'Series' ;
 DROP TABLE IF EXISTS 'Studies' ;
 DROP TABLE IF EXISTS 'Directories' ;
+DROP TABLE IF EXISTS 'DirectoryFiles' ;
+DROP TABLE IF EXISTS 'Thumbnails' ;
+DROP TABLE IF EXISTS 'SchemaInfo' ;
 
 CREATE TABLE 'Images' (
   'SOPInstanceUID' VARCHAR(64) NOT NULL,
   'Filename' VARCHAR(1024) NOT NULL ,
   'SeriesInstanceUID' VARCHAR(64) NOT NULL ,
   'InsertTimestamp' VARCHAR(20) NOT NULL ,
+  'FileSize' INTEGER NOT NULL DEFAULT 0 ,
   PRIMARY KEY ('SOPInstanceUID') );
 CREATE TABLE 'Patients' (
   'UID' INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -26,7 +34,11 @@ CREATE TABLE 'Patients' (
   'PatientsBirthTime' TIME NULL ,
   'PatientsSex' varchar(1) NULL ,
   'PatientsAge' varchar(10) NULL ,
-  'PatientsComments' VARCHAR(255) NULL );
+  'PatientsComments' VARCHAR(255) NULL ,
+  'StudyCount' INTEGER NOT NULL DEFAULT 0 ,
+  'SeriesCount' INTEGER NOT NULL DEFAULT 0 ,
+  'ImageCount' INTEGER NOT NULL DEFAULT 0 ,
+  'TotalFileSize' INTEGER NOT NULL DEFAULT 0 );
 CREATE TABLE 'Series' (
   'SeriesInstanceUID' VARCHAR(64) NOT NULL ,
   'StudyInstanceUID' VARCHAR(64) NOT NULL ,
@@ -41,6 +53,8 @@ CREATE TABLE 'Series' (
   'ScanningSequence' VARCHAR(45) NULL ,
   'EchoNumber' INT NULL ,
   'TemporalPosition' INT NULL ,
+  'ImageCount' INTEGER NOT NULL DEFAULT 0 ,
+  'TotalFileSize' INTEGER NOT NULL DEFAULT 0 ,
   PRIMARY KEY ('SeriesInstanceUID') );
 CREATE TABLE 'Studies' (
   'StudyInstanceUID' VARCHAR(64) NOT NULL ,
@@ -54,8 +68,130 @@ CREATE TABLE 'Studies' (
   'ReferringPhysician' VARCHAR(255) NULL ,
   'PerformingPhysiciansName' VARCHAR(255) NULL ,
   'StudyDescription' VARCHAR(255) NULL ,
+  'SeriesCount' INTEGER NOT NULL DEFAULT 0 ,
+  'ImageCount' INTEGER NOT NULL DEFAULT 0 ,
+  'TotalFileSize' INTEGER NOT NULL DEFAULT 0 ,
   PRIMARY KEY ('StudyInstanceUID') );
 
 CREATE TABLE 'Directories' (
   'Dirname' VARCHAR(1024) ,
   PRIMARY KEY ('Dirname') );
+
+CREATE TABLE 'DirectoryFiles' (
+  'Filename' VARCHAR(1024) NOT NULL ,
+  'Dirname' VARCHAR(1024) NOT NULL ,
+  'FileSize' INTEGER NOT NULL ,
+  'ModifiedTime' INTEGER NOT NULL ,
+  'StoredFilename' VARCHAR(1024) ,
+  PRIMARY KEY ('Filename') );
+
+CREATE TABLE 'Thumbnails' (
+  'SOPInstanceUID' VARCHAR(64) NOT NULL ,
+  'SeriesInstanceUID' VARCHAR(64) NOT NULL ,
+  'DataOffset' INTEGER NOT NULL ,
+  'DataSize' INTEGER NOT NULL ,
+  'ModifiedTime' INTEGER NOT NULL ,
+  PRIMARY KEY ('SOPInstanceUID') );
+
+CREATE INDEX 'ImagesFilenameIndex' ON 'Images' ('Filename') ;
+CREATE INDEX 'ImagesSeriesIndex' ON 'Images' ('SeriesInstanceUID') ;
+CREATE INDEX 'SeriesStudyIndex' ON 'Series' ('StudyInstanceUID') ;
+CREATE INDEX 'StudiesPatientIndex' ON 'Studies' ('PatientsUID') ;
+CREATE INDEX 'PatientsIDNameIndex' ON 'Patients' ('PatientID', 'PatientsName') ;
+CREATE INDEX 'DirectoryFilesDirnameIndex' ON 'DirectoryFiles' ('Dirname') ;
+CREATE INDEX 'ThumbnailsSeriesIndex' ON 'Thumbnails' ('SeriesInstanceUID') ;
+
+-- The counts and total file sizes of Patients, Studies and Series are
+-- maintained by the triggers below: images update their series, series
+-- their study and studies their patient.
+-- ;
+
+CREATE TRIGGER 'ImagesInsertCounts' AFTER INSERT ON 'Images'
+BEGIN
+  UPDATE Series SET ImageCount = ImageCount + 1, TotalFileSize = TotalFileSize + NEW.FileSize
+    WHERE SeriesInstanceUID = NEW.SeriesInstanceUID;
+END;
+CREATE TRIGGER 'ImagesDeleteCounts' AFTER DELETE ON 'Images'
+BEGIN
+  UPDATE Series SET ImageCount = ImageCount - 1, TotalFileSize = TotalFileSize - OLD.FileSize
+    WHERE SeriesInstanceUID = OLD.SeriesInstanceUID;
+END;
+CREATE TRIGGER 'ImagesUpdateCounts' AFTER UPDATE OF FileSize ON 'Images'
+  WHEN OLD.SeriesInstanceUID = NEW.SeriesInstanceUID
+BEGIN
+  UPDATE Series SET TotalFileSize = TotalFileSize + NEW.FileSize - OLD.FileSize
+    WHERE SeriesInstanceUID = NEW.SeriesInstanceUID;
+END;
+CREATE TRIGGER 'ImagesMoveCounts' AFTER UPDATE OF SeriesInstanceUID ON 'Images'
+  WHEN OLD.SeriesInstanceUID != NEW.SeriesInstanceUID
+BEGIN
+  UPDATE Series SET ImageCount = ImageCount - 1, TotalFileSize = TotalFileSize - OLD.FileSize
+    WHERE SeriesInstanceUID = OLD.SeriesInstanceUID;
+  UPDATE Series SET ImageCount = ImageCount + 1, TotalFileSize = TotalFileSize + NEW.FileSize
+    WHERE SeriesInstanceUID = NEW.SeriesInstanceUID;
+END;
+
+CREATE TRIGGER 'SeriesInsertCounts' AFTER INSERT ON 'Series'
+BEGIN
+  UPDATE Studies SET SeriesCount = SeriesCount + 1, ImageCount = ImageCount + NEW.ImageCount,
+      TotalFileSize = TotalFileSize + NEW.TotalFileSize
+    WHERE StudyInstanceUID = NEW.StudyInstanceUID;
+END;
+CREATE TRIGGER 'SeriesDeleteCounts' AFTER DELETE ON 'Series'
+BEGIN
+  UPDATE Studies SET SeriesCount = SeriesCount - 1, ImageCount = ImageCount - OLD.ImageCount,
+      TotalFileSize = TotalFileSize - OLD.TotalFileSize
+    WHERE StudyInstanceUID = OLD.StudyInstanceUID;
+END;
+CREATE TRIGGER 'SeriesUpdateCounts' AFTER UPDATE OF ImageCount, TotalFileSize ON 'Series'
+  WHEN OLD.StudyInstanceUID = NEW.StudyInstanceUID
+BEGIN
+  UPDATE Studies SET ImageCount = ImageCount + NEW.ImageCount - OLD.ImageCount,
+      TotalFileSize = TotalFileSize + NEW.TotalFileSize - OLD.TotalFileSize
+    WHERE StudyInstanceUID = NEW.StudyInstanceUID;
+END;
+CREATE TRIGGER 'SeriesMoveCounts' AFTER UPDATE OF StudyInstanceUID ON 'Series'
+  WHEN OLD.StudyInstanceUID != NEW.StudyInstanceUID
+BEGIN
+  UPDATE Studies SET SeriesCount = SeriesCount - 1, ImageCount = ImageCount - OLD.ImageCount,
+      TotalFileSize = TotalFileSize - OLD.TotalFileSize
+    WHERE StudyInstanceUID = OLD.StudyInstanceUID;
+  UPDATE Studies SET SeriesCount = SeriesCount + 1, ImageCount = ImageCount + NEW.ImageCount,
+      TotalFileSize = TotalFileSize + NEW.TotalFileSize
+    WHERE StudyInstanceUID = NEW.StudyInstanceUID;
+END;
+
+CREATE TRIGGER 'StudiesInsertCounts' AFTER INSERT ON 'Studies'
+BEGIN
+  UPDATE Patients SET StudyCount = StudyCount + 1, SeriesCount = SeriesCount + NEW.SeriesCount,
+      ImageCount = ImageCount + NEW.ImageCount, TotalFileSize = TotalFileSize + NEW.TotalFileSize
+    WHERE UID = NEW.PatientsUID;
+END;
+CREATE TRIGGER 'StudiesDeleteCounts' AFTER DELETE ON 'Studies'
+BEGIN
+  UPDATE Patients SET StudyCount = StudyCount - 1, SeriesCount = SeriesCount - OLD.SeriesCount,
+      ImageCount = ImageCount - OLD.ImageCount, TotalFileSize = TotalFileSize - OLD.TotalFileSize
+    WHERE UID = OLD.PatientsUID;
+END;
+CREATE TRIGGER 'StudiesUpdateCounts' AFTER UPDATE OF SeriesCount, ImageCount, TotalFileSize ON 'Studies'
+  WHEN OLD.PatientsUID = NEW.PatientsUID
+BEGIN
+  UPDATE Patients SET SeriesCount = SeriesCount + NEW.SeriesCount - OLD.SeriesCount,
+      ImageCount = ImageCount + NEW.ImageCount - OLD.ImageCount,
+      TotalFileSize = TotalFileSize + NEW.TotalFileSize - OLD.TotalFileSize
+    WHERE UID = NEW.PatientsUID;
+END;
+CREATE TRIGGER 'StudiesMoveCounts' AFTER UPDATE OF PatientsUID ON 'Studies'
+  WHEN OLD.PatientsUID != NEW.PatientsUID
+BEGIN
+  UPDATE Patients SET StudyCount = StudyCount - 1, SeriesCount = SeriesCount - OLD.SeriesCount,
+      ImageCount = ImageCount - OLD.ImageCount, TotalFileSize = TotalFileSize - OLD.TotalFileSize
+    WHERE UID = OLD.PatientsUID;
+  UPDATE Patients SET StudyCount = StudyCount + 1, SeriesCount = SeriesCount + NEW.SeriesCount,
+      ImageCount = ImageCount + NEW.ImageCount, TotalFileSize = TotalFileSize + NEW.TotalFileSize
+    WHERE UID = NEW.PatientsUID;
+END;
+
+CREATE TABLE 'SchemaInfo' (
+  'Version' INTEGER NOT NULL );
+INSERT INTO 'SchemaInfo' ( 'Version' ) VALUES ( 4 );
@@ -0,0 +1,83 @@
+--
+-- Full text search index of the descriptors of patients, studies and series,
+-- built by ctkDICOMDatabase::rebuildSearchIndex(). It is not part of
+-- dicom-schema.sql because it needs an SQLite built with the FTS4 module.
+--
+-- The entries of patients have the UID of the patient as docid. Studies and
+-- series have a VARCHAR primary key, their rowid can be renumbered (e.g. by
+-- VACUUM): their entries are found by UID. The triggers keep the index up
+-- to date when rows are inserted, updated or removed.
+--
+-- Note: the semicolon at the end is necessary for the simple parser to separate
+--       the statements since the SQlite driver does not handle multiple
+--       commands per QSqlQuery::exec call!
+-- ;
+
+DROP TRIGGER IF EXISTS 'PatientsSearchInsert' ;
+DROP TRIGGER IF EXISTS 'PatientsSearchDelete' ;
+DROP TRIGGER IF EXISTS 'PatientsSearchUpdate' ;
+DROP TRIGGER IF EXISTS 'StudiesSearchInsert' ;
+DROP TRIGGER IF EXISTS 'StudiesSearchDelete' ;
+DROP TRIGGER IF EXISTS 'StudiesSearchUpdate' ;
+DROP TRIGGER IF EXISTS 'SeriesSearchInsert' ;
+DROP TRIGGER IF EXISTS 'SeriesSearchDelete' ;
+DROP TRIGGER IF EXISTS 'SeriesSearchUpdate' ;
+DROP TABLE IF EXISTS 'PatientsSearch' ;
+DROP TABLE IF EXISTS 'StudiesSearch' ;
+DROP TABLE IF EXISTS 'SeriesSearch' ;
+
+CREATE VIRTUAL TABLE PatientsSearch USING fts4(UID, Content) ;
+CREATE VIRTUAL TABLE StudiesSearch USING fts4(UID, Content) ;
+CREATE VIRTUAL TABLE SeriesSearch USING fts4(UID, Content) ;
+
+INSERT INTO PatientsSearch ( docid, UID, Content )
+  SELECT UID, UID, COALESCE(PatientsName, '') || ' ' || COALESCE(PatientID, '') FROM Patients ;
+INSERT INTO StudiesSearch ( UID, Content )
+  SELECT StudyInstanceUID, COALESCE(StudyDescription, '') || ' ' || COALESCE(AccessionNumber, '') FROM Studies ;
+INSERT INTO SeriesSearch ( UID, Content )
+  SELECT SeriesInstanceUID, COALESCE(SeriesDescription, '') || ' ' || COALESCE(BodyPartExamined, '') FROM Series ;
+
+CREATE TRIGGER 'PatientsSearchInsert' AFTER INSERT ON 'Patients'
+BEGIN
+  INSERT INTO PatientsSearch ( docid, UID, Content )
+    VALUES ( NEW.UID, NEW.UID, COALESCE(NEW.PatientsName, '') || ' ' || COALESCE(NEW.PatientID, '') );
+END;
+CREATE TRIGGER 'PatientsSearchDelete' AFTER DELETE ON 'Patients'
+BEGIN
+  DELETE FROM PatientsSearch WHERE docid = OLD.UID;
+END;
+CREATE TRIGGER 'PatientsSearchUpdate' AFTER UPDATE OF PatientsName, PatientID ON 'Patients'
+BEGIN
+  UPDATE PatientsSearch SET Content = COALESCE(NEW.PatientsName, '') || ' ' || COALESCE(NEW.PatientID, '')
+    WHERE docid = NEW.UID;
+END;
+
+CREATE TRIGGER 'StudiesSearchInsert' AFTER INSERT ON 'Studies'
+BEGIN
+  INSERT INTO StudiesSearch ( UID, Content )
+    VALUES ( NEW.StudyInstanceUID, COALESCE(NEW.StudyDescription, '') || ' ' || COALESCE(NEW.AccessionNumber, '') );
+END;
+CREATE TRIGGER 'StudiesSearchDelete' AFTER DELETE ON 'Studies'
+BEGIN
+  DELETE FROM StudiesSearch WHERE UID = OLD.StudyInstanceUID;
+END;
+CREATE TRIGGER 'StudiesSearchUpdate' AFTER UPDATE OF StudyDescription, AccessionNumber ON 'Studies'
+BEGIN
+  UPDATE StudiesSearch SET Content = COALESCE(NEW.StudyDescription, '') || ' ' || COALESCE(NEW.AccessionNumber, '')
+    WHERE UID = NEW.StudyInstanceUID;
+END;
+
+CREATE TRIGGER 'SeriesSearchInsert' AFTER INSERT ON 'Series'
+BEGIN
+  INSERT INTO SeriesSearch ( UID, Content )
+    VALUES ( NEW.SeriesInstanceUID, COALESCE(NEW.SeriesDescription, '') || ' ' || COALESCE(NEW.BodyPartExamined, '') );
+END;
+CREATE TRIGGER 'SeriesSearchDelete' AFTER DELETE ON 'Series'
+BEGIN
+  DELETE FROM SeriesSearch WHERE UID = OLD.SeriesInstanceUID;
+END;
+CREATE TRIGGER 'SeriesSearchUpdate' AFTER UPDATE OF SeriesDescription, BodyPartExamined ON 'Series'
+BEGIN
+  UPDATE SeriesSearch SET Content = COALESCE(NEW.SeriesDescription, '') || ' ' || COALESCE(NEW.BodyPartExamined, '')
+    WHERE UID = NEW.SeriesInstanceUID;
+END;
@@ -21,7 +21,9 @@
 // Qt includes
 #include <QCoreApplication>
 #include <QDir>
+#include <QSqlQuery>
 #include <QTimer>
+#include <QVariant>
 
 // ctkDICOMCore includes
 #include "ctkDICOMDatabase.h"
@@ -83,6 +85,71 @@ int ctkDICOMDatabaseTest1( int argc, char * argv [] )
     return EXIT_FAILURE;
     }
 
+  // performance profile and read-only connection
+  if (database.performanceProfile() != ctkDICOMDatabase::BalancedProfile)
+    {
+    std::cerr << "ctkDICOMDatabase::performanceProfile() failed: "
+              << "BalancedProfile expected by default" << std::endl;
+    return EXIT_FAILURE;
+    }
+  QSqlQuery journalMode(database.database());
+  if (!journalMode.exec("PRAGMA journal_mode") || !journalMode.next()
+      || journalMode.value(0).toString().toLower() != "wal")
+    {
+    std::cerr << "ctkDICOMDatabase::openDatabase() failed: "
+              << "BalancedProfile should enable WAL" << std::endl;
+    return EXIT_FAILURE;
+    }
+  journalMode.finish();
+
+  {
+    QSqlDatabase readOnlyDatabase = database.readOnlyDatabase();
+    if (!readOnlyDatabase.isOpen()
+        || readOnlyDatabase.connectionName() == database.database().connectionName())
+      {
+      std::cerr << "ctkDICOMDatabase::readOnlyDatabase() failed: "
+                << "no separate connection" << std::endl;
+      return EXIT_FAILURE;
+      }
+    QSqlQuery readOnlyWrite(readOnlyDatabase);
+    if (readOnlyWrite.exec("INSERT INTO Directories ( 'Dirname' ) VALUES ( 'readonly' )"))
+      {
+      std::cerr << "ctkDICOMDatabase::readOnlyDatabase() failed: "
+                << "connection is writable" << std::endl;
+      return EXIT_FAILURE;
+      }
+    // readers are not blocked by a pending write transaction
+    database.database().transaction();
+    QSqlQuery write(database.database());
+    write.exec("INSERT INTO Directories ( 'Dirname' ) VALUES ( 'pending' )");
+    QSqlQuery read(readOnlyDatabase);
+    if (!read.exec("SELECT COUNT(*) FROM Directories") || !read.next()
+        || read.value(0).toInt() != 0)
+      {
+      std::cerr << "ctkDICOMDatabase::readOnlyDatabase() failed: "
+                << "read blocked by the writer or uncommitted data visible" << std::endl;
+      return EXIT_FAILURE;
+      }
+    read.finish();
+    database.database().rollback();
+  }
+
+  // leaving WAL needs the database to be closed by the readers first
+  journalMode = QSqlQuery();
+  database.closeDatabase();
+  database.setPerformanceProfile(ctkDICOMDatabase::CompatibilityProfile);
+  database.openDatabase(databaseFile.absoluteFilePath());
+  journalMode = QSqlQuery(database.database());
+  if (!journalMode.exec("PRAGMA journal_mode") || !journalMode.next()
+      || journalMode.value(0).toString().toLower() != "delete")
+    {
+    std::cerr << "ctkDICOMDatabase::setPerformanceProfile() failed: "
+              << "CompatibilityProfile should use the rollback journal" << std::endl;
+    return EXIT_FAILURE;
+    }
+  journalMode.finish();
+  database.setPerformanceProfile(ctkDICOMDatabase::BalancedProfile);
+
   // check if it doesn't crash
   database.insert(0, true, true);
   database.insert(0, true, false);
@@ -185,6 +185,40 @@ int ctkDICOMDatabaseTest2( int argc, char * argv [] )
     return EXIT_FAILURE;
     }
 
+  //
+  // Test the in-memory tier and the batch lookup
+  //
+  database.resetTagCacheStatistics();
+  database.instanceValue(instanceUID, tag);
+  if (database.tagCacheMemoryHits() != 1 || database.tagCacheMisses() != 0)
+    {
+    std::cerr << "ctkDICOMDatabase: cached tag should be found in memory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QStringList tags;
+  tags << tag << "0010,0010";
+  QMap<QString, QStringList> values = database.instanceValues(QStringList(instanceUID), tags);
+  if (values.value(instanceUID).count() != 2
+      || values.value(instanceUID)[0] != knownSeriesDescription
+      || database.tagCacheMisses() != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: invalid values returned by instanceValues()" << std::endl;
+    return EXIT_FAILURE;
+    }
+  QString patientsName = values.value(instanceUID)[1];
+
+  // the memory tier is emptied, the values come from the TagCache table
+  database.setTagCacheMemorySize(0);
+  database.setTagCacheMemorySize(100);
+  database.resetTagCacheStatistics();
+  if (database.instanceValue(instanceUID, "0010,0010") != patientsName
+      || database.tagCacheTableHits() != 1 || database.tagCacheMisses() != 0)
+    {
+    std::cerr << "ctkDICOMDatabase: value written by instanceValues() not found in the TagCache table" << std::endl;
+    return EXIT_FAILURE;
+    }
+
   database.closeDatabase();
   database.initializeDatabase();
 
@@ -0,0 +1,307 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QTime>
+
+// ctkDICOMCore includes
+#include "ctkDICOMAbstractThumbnailGenerator.h"
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMTester.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/// Writes fake thumbnails and counts them
+class ctkDICOMCountingThumbnailGenerator : public ctkDICOMAbstractThumbnailGenerator
+{
+public:
+  ctkDICOMCountingThumbnailGenerator() : Count(0) {}
+  virtual bool generateThumbnail(DicomImage* dcmImage, const QString& path)
+  {
+    QByteArray data;
+    QFile thumbnail(path);
+    return this->generateThumbnailData(dcmImage, data)
+      && thumbnail.open(QIODevice::WriteOnly) && thumbnail.write(data) == data.size();
+  }
+  virtual bool generateThumbnailData(DicomImage* dcmImage, QByteArray& data)
+  {
+    Q_UNUSED(dcmImage);
+    QMutexLocker locker(&this->Mutex);
+    ++this->Count;
+    data = "thumbnail";
+    return true;
+  }
+  int count()
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->Count;
+  }
+private:
+  QMutex Mutex;
+  int Count;
+};
+
+//------------------------------------------------------------------------------
+bool openEmptyDatabase(ctkDICOMDatabase& database, const QDir& directory,
+                       const QString& fileName)
+{
+  directory.remove(fileName);
+  database.openDatabase(directory.absoluteFilePath(fileName), fileName);
+  if (!database.lastError().isEmpty() || !database.initializeDatabase())
+    {
+    std::cerr << "Can't open database " << qPrintable(fileName) << ": "
+              << qPrintable(database.lastError()) << std::endl;
+    return false;
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void printRate(const char* label, int instances, int msecs)
+{
+  std::cout << label << ": " << instances << " instances in " << msecs << " ms ("
+            << (msecs > 0 ? (1000. * instances) / msecs : 0.) << " instances/s)"
+            << std::endl;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Benchmark of ctkDICOMDatabase::insert with and without batch insert.
+// Usage: ctkDICOMDatabaseTest3 [number of images per series]
+int ctkDICOMDatabaseTest3( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  int imagesPerSeries = 100;
+  if (argc > 1)
+    {
+    imagesPerSeries = QString(argv[1]).toInt();
+    }
+
+  QDir tempDir = QDir::temp();
+  QString dataDirectory = tempDir.absoluteFilePath("ctkDICOMDatabaseTest3");
+  QDir(dataDirectory).mkpath(".");
+
+  // 4 patients x 2 studies x 5 series
+  QStringList files = ctkDICOMTester::generateDICOMFiles(
+    dataDirectory + "/data", 4, 2, 5, imagesPerSeries);
+  if (files.count() != 4 * 2 * 5 * imagesPerSeries)
+    {
+    std::cerr << "Failed to generate synthetic data: only "
+              << files.count() << " files written" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Reference: one transaction per instance on a subset of the files
+  QStringList referenceFiles = files.mid(0, qMin(200, files.count()));
+  ctkDICOMDatabase referenceDatabase;
+  if (!openEmptyDatabase(referenceDatabase, QDir(dataDirectory), "reference.sql"))
+    {
+    return EXIT_FAILURE;
+    }
+  QTime timer;
+  timer.start();
+  foreach(const QString& file, referenceFiles)
+    {
+    referenceDatabase.insert(file, false, false);
+    }
+  printRate("insert", referenceFiles.count(), timer.elapsed());
+  if (ctkDICOMTester::imageCount(referenceDatabase) != referenceFiles.count())
+    {
+    std::cerr << "insert: wrong number of images in the database" << std::endl;
+    return EXIT_FAILURE;
+    }
+  referenceDatabase.closeDatabase();
+
+  // Batch insert of all the files
+  ctkDICOMDatabase database;
+  if (!openEmptyDatabase(database, QDir(dataDirectory), "batch.sql"))
+    {
+    return EXIT_FAILURE;
+    }
+  timer.start();
+  if (!database.beginBatchInsert())
+    {
+    std::cerr << "beginBatchInsert failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (database.beginBatchInsert())
+    {
+    std::cerr << "beginBatchInsert should fail when a batch is open" << std::endl;
+    return EXIT_FAILURE;
+    }
+  foreach(const QString& file, files)
+    {
+    database.insert(file, false, false);
+    }
+  if (!database.commitBatchInsert())
+    {
+    std::cerr << "commitBatchInsert failed: "
+              << qPrintable(database.lastError()) << std::endl;
+    return EXIT_FAILURE;
+    }
+  printRate("batch insert", files.count(), timer.elapsed());
+
+  if (database.patients().count() != 4)
+    {
+    std::cerr << "batch insert: patients were not de-duplicated" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (ctkDICOMTester::imageCount(database) != files.count())
+    {
+    std::cerr << "batch insert: wrong number of images in the database" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Re-inserting the same files must not create duplicates
+  database.insertFiles(files, false, false);
+  if (ctkDICOMTester::imageCount(database) != files.count())
+    {
+    std::cerr << "insertFiles: duplicated images in the database" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Rolled back inserts must not be visible
+  QStringList extraFiles = ctkDICOMTester::generateDICOMFiles(
+    dataDirectory + "/extra", 1, 1, 1, 10);
+  database.beginBatchInsert();
+  database.insertFiles(extraFiles, false, false);
+  database.rollbackBatchInsert();
+  if (ctkDICOMTester::imageCount(database) != files.count() || database.patients().count() != 4)
+    {
+    std::cerr << "rollbackBatchInsert: rolled back images are in the database" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Thumbnails are queued by the inserts and generated in the background,
+  // once per instance
+  ctkDICOMCountingThumbnailGenerator generator;
+  database.setThumbnailGenerator(&generator);
+  database.setThumbnailThreadCount(2);
+  timer.start();
+  database.insertFiles(extraFiles, false, true);
+  database.insertFiles(extraFiles, false, true);
+  printRate("batch insert with thumbnails", 2 * extraFiles.count(), timer.elapsed());
+  database.waitForThumbnails();
+  if (generator.count() != extraFiles.count() || database.pendingThumbnailCount() != 0)
+    {
+    std::cerr << "thumbnails: " << generator.count() << " generated for "
+              << extraFiles.count() << " instances" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // up to date thumbnails are not generated again
+  database.requestThumbnail(database.instanceForFile(extraFiles[0]));
+  database.waitForThumbnails();
+  if (generator.count() != extraFiles.count())
+    {
+    std::cerr << "requestThumbnail regenerated an up to date thumbnail" << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.setThumbnailGenerator(0);
+
+  // Thumbnails are read back from the thumbnail file
+  const QString extraInstance = database.instanceForFile(extraFiles[0]);
+  const QString extraSeries = database.instanceValue(extraInstance, "0020,000e");
+  if (database.thumbnailData(extraInstance) != "thumbnail"
+      || database.seriesThumbnailData(extraSeries).count() != extraFiles.count())
+    {
+    std::cerr << "thumbnailData: stored thumbnails not found" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // PNG files of older databases are readable and can be migrated
+  const QString study = database.studiesForPatient(database.patients()[0])[0];
+  const QString series = database.seriesForStudy(study)[0];
+  const QString instance = database.instanceForFile(database.filesForSeries(series)[0]);
+  const QString legacyPath = database.databaseDirectory() + "/thumbs/" + study + "/" + series;
+  QDir().mkpath(legacyPath);
+  QFile legacyThumbnail(legacyPath + "/" + instance + ".png");
+  legacyThumbnail.open(QIODevice::WriteOnly);
+  legacyThumbnail.write("legacy");
+  legacyThumbnail.close();
+  if (database.thumbnailData(instance) != "legacy")
+    {
+    std::cerr << "thumbnailData: PNG file not found" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (database.migrateThumbnailFiles() != 1 || legacyThumbnail.exists()
+      || database.thumbnailData(instance) != "legacy")
+    {
+    std::cerr << "migrateThumbnailFiles failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Compaction drops the thumbnails of removed instances
+  database.removeSeries(series);
+  if (!database.compactThumbnails()
+      || database.thumbnailData(extraInstance) != "thumbnail"
+      || !database.thumbnailData(instance).isEmpty())
+    {
+    std::cerr << "compactThumbnails failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Regeneration: one thumbnail per series, the up to date ones skipped
+  database.setThumbnailGenerator(&generator);
+  int generated = generator.count();
+  timer.start();
+  const int queued = database.regenerateThumbnails();
+  database.waitForThumbnails();
+  printRate("regenerate series thumbnails", queued, timer.elapsed());
+  if (queued <= 0 || generator.count() - generated != queued
+      || database.regenerateThumbnails() != 0)
+    {
+    std::cerr << "regenerateThumbnails: " << queued << " queued, "
+              << generator.count() - generated << " generated" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // forced, canceled, then resumed without forcing
+  const int instances = ctkDICOMTester::imageCount(database);
+  if (database.regenerateThumbnails(true, true) != instances)
+    {
+    std::cerr << "regenerateThumbnails: not all the thumbnails forced" << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.cancelThumbnails();
+  database.waitForThumbnails();
+  const int resumed = database.regenerateThumbnails(true, false);
+  database.waitForThumbnails();
+  if (resumed > instances || database.regenerateThumbnails(true, false) != 0)
+    {
+    std::cerr << "regenerateThumbnails: resumed " << resumed << " thumbnails out of "
+              << instances << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.setThumbnailGenerator(0);
+
+  database.closeDatabase();
+  return EXIT_SUCCESS;
+}
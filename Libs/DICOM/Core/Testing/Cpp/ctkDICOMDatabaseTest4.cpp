@@ -0,0 +1,441 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QTime>
+#include <QVariant>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+const int StudiesPerPatient = 2;
+const int SeriesPerStudy = 5;
+const int ImagesPerSeries = 100;
+const int LookupsPerQuery = 100;
+
+//------------------------------------------------------------------------------
+QString studyUID(int patient, int study)
+{
+  return QString("1.2.826.0.1.3680043.2.1125.1.%1.%2").arg(patient).arg(study);
+}
+
+//------------------------------------------------------------------------------
+QString seriesUID(int patient, int study, int series)
+{
+  return QString("1.2.826.0.1.3680043.2.1125.2.%1.%2.%3").arg(patient).arg(study).arg(series);
+}
+
+//------------------------------------------------------------------------------
+QString imageFilename(int patient, int study, int series, int image)
+{
+  return QString("/data/%1/%2/%3/IMG%4.dcm").arg(patient).arg(study).arg(series).arg(image, 5, 10, QChar('0'));
+}
+
+//------------------------------------------------------------------------------
+/// Fill the tables directly, going through ctkDICOMDatabase::insert would
+/// need real files and take much longer
+bool populate(QSqlDatabase db, int patients)
+{
+  db.transaction();
+  QSqlQuery insertPatient(db);
+  insertPatient.prepare("INSERT INTO Patients ( 'UID', 'PatientsName', 'PatientID' ) VALUES ( ?, ?, ? )");
+  QSqlQuery insertStudy(db);
+  insertStudy.prepare("INSERT INTO Studies ( 'StudyInstanceUID', 'PatientsUID', 'StudyDescription' ) VALUES ( ?, ?, ? )");
+  QSqlQuery insertSeries(db);
+  insertSeries.prepare("INSERT INTO Series ( 'SeriesInstanceUID', 'StudyInstanceUID', 'SeriesDescription' ) VALUES ( ?, ?, ? )");
+  QSqlQuery insertImage(db);
+  insertImage.prepare("INSERT INTO Images ( 'SOPInstanceUID', 'Filename', 'SeriesInstanceUID', 'InsertTimestamp' ) VALUES ( ?, ?, ?, ? )");
+  const QString timestamp = QDateTime::currentDateTime().toString(Qt::ISODate);
+
+  for (int p = 1; p <= patients; ++p)
+    {
+    insertPatient.bindValue(0, p);
+    insertPatient.bindValue(1, QString("Patient^%1").arg(p));
+    insertPatient.bindValue(2, QString("ID%1").arg(p));
+    if (!insertPatient.exec())
+      {
+      return false;
+      }
+    for (int st = 0; st < StudiesPerPatient; ++st)
+      {
+      insertStudy.bindValue(0, studyUID(p, st));
+      insertStudy.bindValue(1, p);
+      insertStudy.bindValue(2, QString("Study %1").arg(st));
+      if (!insertStudy.exec())
+        {
+        return false;
+        }
+      for (int se = 0; se < SeriesPerStudy; ++se)
+        {
+        insertSeries.bindValue(0, seriesUID(p, st, se));
+        insertSeries.bindValue(1, studyUID(p, st));
+        insertSeries.bindValue(2, QString("Series %1").arg(se));
+        if (!insertSeries.exec())
+          {
+          return false;
+          }
+        for (int i = 0; i < ImagesPerSeries; ++i)
+          {
+          insertImage.bindValue(0, seriesUID(p, st, se) + QString(".%1").arg(i));
+          insertImage.bindValue(1, imageFilename(p, st, se, i));
+          insertImage.bindValue(2, seriesUID(p, st, se));
+          insertImage.bindValue(3, timestamp);
+          if (!insertImage.exec())
+            {
+            return false;
+            }
+          }
+        }
+      }
+    }
+  return db.commit();
+}
+
+//------------------------------------------------------------------------------
+/// Rebuilds \a table with \a columns only. The triggers of the table are
+/// dropped with it.
+void stripColumns(QSqlQuery& query, const QString& table, const QString& columns)
+{
+  query.exec(QString("CREATE TABLE Old%1 AS SELECT %2 FROM %1").arg(table).arg(columns));
+  query.exec(QString("DROP TABLE %1").arg(table));
+  query.exec(QString("ALTER TABLE Old%1 RENAME TO %1").arg(table));
+}
+
+//------------------------------------------------------------------------------
+/// Brings the database back to the state it had before the schema was
+/// versioned: no secondary index, no Thumbnails and no SchemaInfo table, no
+/// cached counts
+void dropSchemaVersion(QSqlDatabase db)
+{
+  QSqlQuery query(db);
+  stripColumns(query, "Images", "SOPInstanceUID, Filename, SeriesInstanceUID, InsertTimestamp");
+  stripColumns(query, "Series", "SeriesInstanceUID, StudyInstanceUID, SeriesNumber, SeriesDate, SeriesTime, SeriesDescription, BodyPartExamined, FrameOfReferenceUID, AcquisitionNumber, ContrastAgent, ScanningSequence, EchoNumber, TemporalPosition");
+  stripColumns(query, "Studies", "StudyInstanceUID, PatientsUID, StudyID, StudyDate, StudyTime, AccessionNumber, ModalitiesInStudy, InstitutionName, ReferringPhysician, PerformingPhysiciansName, StudyDescription");
+  stripColumns(query, "Patients", "UID, PatientsName, PatientID, PatientsBirthDate, PatientsBirthTime, PatientsSex, PatientsAge, PatientsComments");
+  query.exec("DROP INDEX IF EXISTS 'ImagesFilenameIndex'");
+  query.exec("DROP INDEX IF EXISTS 'ImagesSeriesIndex'");
+  query.exec("DROP INDEX IF EXISTS 'SeriesStudyIndex'");
+  query.exec("DROP INDEX IF EXISTS 'StudiesPatientIndex'");
+  query.exec("DROP INDEX IF EXISTS 'PatientsIDNameIndex'");
+  query.exec("DROP INDEX IF EXISTS 'DirectoryFilesDirnameIndex'");
+  query.exec("DROP TABLE IF EXISTS 'DirectoryFiles'");
+  query.exec("DROP TABLE IF EXISTS 'Thumbnails'");
+  query.exec("DROP TABLE IF EXISTS 'SchemaInfo'");
+}
+
+//------------------------------------------------------------------------------
+int countRows(QSqlDatabase db, const QString& table)
+{
+  QSqlQuery query(db);
+  if (!query.exec("SELECT COUNT(*) FROM " + table) || !query.next())
+    {
+    return -1;
+    }
+  return query.value(0).toInt();
+}
+
+//------------------------------------------------------------------------------
+void printTime(const char* label, int msecs)
+{
+  std::cout << "  " << label << ": " << LookupsPerQuery << " lookups in "
+            << msecs << " ms" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+/// Times the accessors and the queries of ctkDICOMModel, returns false if
+/// a lookup does not find what it should
+bool benchmark(ctkDICOMDatabase& database, int patients)
+{
+  QTime timer;
+  bool result = true;
+
+  timer.start();
+  for (int i = 0; i < LookupsPerQuery; ++i)
+    {
+    int p = 1 + (i * 7919) % patients;
+    result = database.filesForSeries(seriesUID(p, i % StudiesPerPatient, i % SeriesPerStudy)).count()
+      == ImagesPerSeries && result;
+    }
+  printTime("filesForSeries", timer.elapsed());
+
+  timer.start();
+  for (int i = 0; i < LookupsPerQuery; ++i)
+    {
+    int p = 1 + (i * 7919) % patients;
+    result = database.seriesForStudy(studyUID(p, i % StudiesPerPatient)).count()
+      == SeriesPerStudy && result;
+    }
+  printTime("seriesForStudy", timer.elapsed());
+
+  timer.start();
+  for (int i = 0; i < LookupsPerQuery; ++i)
+    {
+    int p = 1 + (i * 7919) % patients;
+    result = database.studiesForPatient(QString::number(p)).count()
+      == StudiesPerPatient && result;
+    }
+  printTime("studiesForPatient", timer.elapsed());
+
+  timer.start();
+  for (int i = 0; i < LookupsPerQuery; ++i)
+    {
+    int p = 1 + (i * 7919) % patients;
+    result = !database.instanceForFile(imageFilename(p, 0, 0, i % ImagesPerSeries)).isEmpty()
+      && result;
+    }
+  printTime("instanceForFile", timer.elapsed());
+
+  // same statements as ctkDICOMModelPrivate::updateQueries()
+  timer.start();
+  for (int i = 0; i < LookupsPerQuery; ++i)
+    {
+    int p = 1 + (i * 7919) % patients;
+    QSqlQuery studies(QString("SELECT StudyInstanceUID as UID, StudyDescription as Name, ModalitiesInStudy as Scan, StudyDate as Date, AccessionNumber as Number, ReferringPhysician as Institution, ReferringPhysician as Referrer, PerformingPhysiciansName as Performer FROM Studies WHERE PatientsUID='%1'").arg(p), database.database());
+    int rows = 0;
+    while (studies.next())
+      {
+      ++rows;
+      }
+    result = rows == StudiesPerPatient && result;
+    }
+  printTime("model study query", timer.elapsed());
+
+  timer.start();
+  for (int i = 0; i < LookupsPerQuery; ++i)
+    {
+    int p = 1 + (i * 7919) % patients;
+    QSqlQuery series(QString("SELECT SeriesInstanceUID as UID, SeriesDescription as Name, BodyPartExamined as Scan, SeriesDate as Date, AcquisitionNumber as Number FROM Series WHERE StudyInstanceUID='%1'").arg(studyUID(p, i % StudiesPerPatient)), database.database());
+    int rows = 0;
+    while (series.next())
+      {
+      ++rows;
+      }
+    result = rows == SeriesPerStudy && result;
+    }
+  printTime("model series query", timer.elapsed());
+
+  return result;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Benchmark of the lookups on non-key columns before and after the schema
+// update adding the secondary indexes. Also checks that openDatabase()
+// upgrades an unversioned database in place, and times the set based
+// removal of half of the patients.
+// Usage: ctkDICOMDatabaseTest4 [number of images, 1000000 for the full benchmark]
+int ctkDICOMDatabaseTest4( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  int images = 100000;
+  if (argc > 1)
+    {
+    images = QString(argv[1]).toInt();
+    }
+  const int imagesPerPatient = StudiesPerPatient * SeriesPerStudy * ImagesPerSeries;
+  const int patients = qMax(1, images / imagesPerPatient);
+  images = patients * imagesPerPatient;
+
+  QDir testDirectory(QDir::temp().absoluteFilePath("ctkDICOMDatabaseTest4"));
+  testDirectory.mkpath(".");
+  testDirectory.remove("ctkDICOM.sql");
+  const QString databaseFile = testDirectory.absoluteFilePath("ctkDICOM.sql");
+
+  ctkDICOMDatabase database;
+  database.openDatabase(databaseFile, "ctkDICOMDatabaseTest4");
+  if (!database.lastError().isEmpty())
+    {
+    std::cerr << "Can't open database: " << qPrintable(database.lastError()) << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (database.schemaVersionLoaded() != ctkDICOMDatabase::schemaVersion())
+    {
+    std::cerr << "New database has schema version " << database.schemaVersionLoaded()
+              << " instead of " << ctkDICOMDatabase::schemaVersion() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QTime timer;
+  timer.start();
+  if (!populate(database.database(), patients))
+    {
+    std::cerr << "Failed to populate the database" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "Populated " << images << " images in " << timer.elapsed() << " ms" << std::endl;
+
+  dropSchemaVersion(database.database());
+  if (database.schemaVersionLoaded() != 0)
+    {
+    std::cerr << "Unversioned database reports version " << database.schemaVersionLoaded() << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "Without secondary indexes:" << std::endl;
+  if (!benchmark(database, patients))
+    {
+    std::cerr << "Lookup failed without secondary indexes" << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.closeDatabase();
+
+  timer.start();
+  database.openDatabase(databaseFile, "ctkDICOMDatabaseTest4-updated");
+  std::cout << "Schema update in " << timer.elapsed() << " ms" << std::endl;
+  if (!database.lastError().isEmpty()
+      || database.schemaVersionLoaded() != ctkDICOMDatabase::schemaVersion())
+    {
+    std::cerr << "Schema update failed: " << qPrintable(database.lastError()) << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (countRows(database.database(), "Images") != images
+      || countRows(database.database(), "Patients") != patients)
+    {
+    std::cerr << "Data lost during the schema update" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (database.studyCountForPatient("1") != StudiesPerPatient
+      || database.seriesCountForPatient("1") != StudiesPerPatient * SeriesPerStudy
+      || database.imageCountForPatient("1") != imagesPerPatient
+      || database.seriesCountForStudy(studyUID(1, 0)) != SeriesPerStudy
+      || database.imageCountForSeries(seriesUID(1, 0, 0)) != ImagesPerSeries)
+    {
+    std::cerr << "Wrong counts after the schema update: "
+              << database.imageCountForPatient("1") << " images in patient 1" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the search index lost its triggers with the rebuilt tables, it is
+  // rebuilt when the database is opened
+  if (database.searchIndexExists())
+    {
+    timer.start();
+    QList<ctkDICOMSearchMatch> matches;
+    for (int i = 0; i < LookupsPerQuery; ++i)
+      {
+      matches = database.search(QString("patient^%1").arg(1 + i % patients), 10);
+      }
+    printTime("full text search", timer.elapsed());
+    matches = database.search("Patient^1");
+    if (matches.isEmpty() || matches[0].MatchLevel != ctkDICOMSearchMatch::Patient
+        || matches[0].UID != "1")
+      {
+      std::cerr << "Patient 1 is not the best match of its name" << std::endl;
+      return EXIT_FAILURE;
+      }
+    matches = database.search("series", 1000000);
+    if (matches.count() != patients * StudiesPerPatient * SeriesPerStudy)
+      {
+      std::cerr << "Found " << matches.count() << " series instead of "
+                << patients * StudiesPerPatient * SeriesPerStudy << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  else
+    {
+    std::cout << "No full text search index, SQLite lacks the FTS4 module" << std::endl;
+    }
+
+  std::cout << "With secondary indexes:" << std::endl;
+  if (!benchmark(database, patients))
+    {
+    std::cerr << "Lookup failed with secondary indexes" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // set based removal of half of the patients
+  const int removedPatients = qMax(1, patients / 2);
+  QStringList patientUIDs;
+  for (int p = 1; p <= removedPatients; ++p)
+    {
+    patientUIDs << QString::number(p);
+    }
+  ctkDICOMRemovalReport report;
+  timer.start();
+  if (!database.removePatients(patientUIDs, &report, true /* dry run */)
+      || report.Patients != removedPatients
+      || report.Studies != removedPatients * StudiesPerPatient
+      || report.Series != removedPatients * StudiesPerPatient * SeriesPerStudy
+      || report.Images != removedPatients * imagesPerPatient
+      || countRows(database.database(), "Images") != images)
+    {
+    std::cerr << "Wrong removal report: " << report.Patients << " patients, "
+              << report.Images << " images" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "Removal report of " << removedPatients << " patients in "
+            << timer.elapsed() << " ms" << std::endl;
+
+  timer.start();
+  if (!database.removePatients(patientUIDs)
+      || countRows(database.database(), "Patients") != patients - removedPatients
+      || countRows(database.database(), "Studies") != (patients - removedPatients) * StudiesPerPatient
+      || countRows(database.database(), "Images") != images - removedPatients * imagesPerPatient)
+    {
+    std::cerr << "Removal of " << removedPatients << " patients failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (database.searchIndexExists())
+    {
+    foreach(const ctkDICOMSearchMatch& match, database.search("Patient^1"))
+      {
+      if (match.MatchLevel == ctkDICOMSearchMatch::Patient && match.UID == "1")
+        {
+        std::cerr << "Removed patient still in the search index" << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    }
+  std::cout << "Removed " << removedPatients << " patients in " << timer.elapsed() << " ms" << std::endl;
+
+  // the study of a removed series stays as long as it has other series
+  if (patients > removedPatients)
+    {
+    const int studies = countRows(database.database(), "Studies");
+    const int series = countRows(database.database(), "Series");
+    if (!database.removeSeries(QStringList() << seriesUID(patients, 0, 0))
+        || countRows(database.database(), "Studies") != studies
+        || countRows(database.database(), "Series") != series - 1
+        || database.seriesCountForStudy(studyUID(patients, 0)) != SeriesPerStudy - 1
+        || database.imageCountForStudy(studyUID(patients, 0)) != (SeriesPerStudy - 1) * ImagesPerSeries
+        || database.imageCountForPatient(QString::number(patients)) != imagesPerPatient - ImagesPerSeries)
+      {
+      std::cerr << "Removal of a series failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  database.waitForFileReclamation();
+
+  database.closeDatabase();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTime>
+#include <QVector>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMDataset.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcsequen.h>
+#include <dcmtk/dcmdata/dcuid.h>
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+const int Iterations = 5;
+const char* const StudyUID = "1.2.826.0.1.3680043.2.1125.3.1";
+
+//------------------------------------------------------------------------------
+/// Writes an enhanced CT object with one functional group item and one
+/// 512x512 16 bit image per frame
+bool writeEnhancedCT(const QString& fileName, int frames)
+{
+  DcmFileFormat fileFormat;
+  DcmDataset* dataset = fileFormat.getDataset();
+  dataset->putAndInsertString(DCM_SOPClassUID, UID_EnhancedCTImageStorage);
+  dataset->putAndInsertString(DCM_SOPInstanceUID, "1.2.826.0.1.3680043.2.1125.3.1.1.1");
+  dataset->putAndInsertString(DCM_StudyInstanceUID, StudyUID);
+  dataset->putAndInsertString(DCM_SeriesInstanceUID, "1.2.826.0.1.3680043.2.1125.3.1.1");
+  dataset->putAndInsertString(DCM_PatientName, "Enhanced^CT");
+  dataset->putAndInsertString(DCM_PatientID, "CTKENHANCEDCT");
+  dataset->putAndInsertString(DCM_Modality, "CT");
+  dataset->putAndInsertString(DCM_ImageType, "ORIGINAL\\PRIMARY\\AXIAL\\NONE");
+  dataset->putAndInsertUint16(DCM_SamplesPerPixel, 1);
+  dataset->putAndInsertString(DCM_PhotometricInterpretation, "MONOCHROME2");
+  dataset->putAndInsertString(DCM_NumberOfFrames, QString::number(frames).toLatin1().data());
+  dataset->putAndInsertUint16(DCM_Rows, 512);
+  dataset->putAndInsertUint16(DCM_Columns, 512);
+  dataset->putAndInsertUint16(DCM_BitsAllocated, 16);
+  dataset->putAndInsertUint16(DCM_BitsStored, 12);
+  dataset->putAndInsertUint16(DCM_HighBit, 11);
+  dataset->putAndInsertUint16(DCM_PixelRepresentation, 0);
+
+  for (int frame = 0; frame < frames; ++frame)
+    {
+    DcmItem* frameItem = 0;
+    dataset->findOrCreateSequenceItem(DCM_PerFrameFunctionalGroupsSequence, frameItem, -2);
+    DcmItem* contentItem = 0;
+    frameItem->findOrCreateSequenceItem(DCM_FrameContentSequence, contentItem);
+    contentItem->putAndInsertUint32(DCM_DimensionIndexValues, frame + 1);
+    DcmItem* positionItem = 0;
+    frameItem->findOrCreateSequenceItem(DCM_PlanePositionSequence, positionItem);
+    positionItem->putAndInsertString(DCM_ImagePositionPatient,
+      QString("-250\\-250\\%1").arg(frame * 0.625).toLatin1().data());
+    }
+
+  QVector<Uint16> pixels(512 * 512 * frames);
+  for (int i = 0; i < pixels.size(); ++i)
+    {
+    pixels[i] = static_cast<Uint16>(i % 4096);
+    }
+  dataset->putAndInsertUint16Array(DCM_PixelData, pixels.data(), pixels.size());
+
+  return fileFormat.saveFile(fileName.toLocal8Bit().data(), EXS_LittleEndianExplicit).good();
+}
+
+//------------------------------------------------------------------------------
+/// Bytes read by this process so far, -1 if the OS doesn't tell
+qint64 bytesRead()
+{
+  QFile io("/proc/self/io");
+  if (!io.open(QIODevice::ReadOnly))
+    {
+    return -1;
+    }
+  foreach(const QByteArray& line, io.readAll().split('\n'))
+    {
+    if (line.startsWith("rchar:"))
+      {
+      return line.mid(6).trimmed().toLongLong();
+      }
+    }
+  return -1;
+}
+
+//------------------------------------------------------------------------------
+enum LoadMode
+{
+  FullLoad,
+  HeaderLoad,
+  SubsetLoad
+};
+
+//------------------------------------------------------------------------------
+/// Loads the file Iterations times, prints the time and the bytes read per
+/// file and returns the bytes read per file
+qint64 benchmark(const QString& fileName, LoadMode mode, const char* label, bool& result)
+{
+  const QList<DcmTagKey> tags = ctkDICOMDatabase::indexedTags();
+  qint64 startBytes = bytesRead();
+  QTime timer;
+  timer.start();
+  for (int i = 0; i < Iterations; ++i)
+    {
+    ctkDICOMDataset dataset;
+    switch (mode)
+      {
+      case FullLoad:
+        // every value is read, as by InitializeFromFile() before it passed
+        // maxReadLength on to DCMTK
+        dataset.InitializeFromFile(fileName, EXS_Unknown, EGL_noChange, 0xffffffff);
+        break;
+      case HeaderLoad:
+        dataset.InitializeFromFileHeader(fileName);
+        break;
+      case SubsetLoad:
+        dataset.InitializeFromFileTags(fileName, tags);
+        break;
+      }
+    result = dataset.IsInitialized()
+      && dataset.GetStudyInstanceUID() == StudyUID && result;
+    DcmElement* element = 0;
+    bool hasPixelData = dataset.findAndGetElement(DCM_PixelData, element).good();
+    bool hasRows = dataset.findAndGetElement(DCM_Rows, element).good();
+    result = hasPixelData == (mode == FullLoad) && result;
+    result = hasRows == (mode != SubsetLoad) && result;
+    }
+  int msecs = timer.elapsed();
+  qint64 bytes = startBytes < 0 ? -1 : (bytesRead() - startBytes) / Iterations;
+  std::cout << "  " << label << ": " << static_cast<double>(msecs) / Iterations
+            << " ms and " << bytes << " bytes read per file" << std::endl;
+  return bytes;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Benchmark of the full, header-only and tag subset loads of a large
+// enhanced multi-frame CT object.
+// Usage: ctkDICOMDatasetTest2 [number of frames]
+int ctkDICOMDatasetTest2( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  int frames = 64;
+  if (argc > 1)
+    {
+    frames = qMax(1, QString(argv[1]).toInt());
+    }
+
+  QDir testDirectory(QDir::temp().absoluteFilePath("ctkDICOMDatasetTest2"));
+  testDirectory.mkpath(".");
+  const QString fileName = testDirectory.absoluteFilePath("EnhancedCT.dcm");
+  if (!writeEnhancedCT(fileName, frames))
+    {
+    std::cerr << "Can't write " << qPrintable(fileName) << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << frames << " frames, " << QFileInfo(fileName).size() << " bytes" << std::endl;
+
+  bool result = true;
+  qint64 fullBytes = benchmark(fileName, FullLoad, "full", result);
+  qint64 headerBytes = benchmark(fileName, HeaderLoad, "header", result);
+  qint64 subsetBytes = benchmark(fileName, SubsetLoad, "tag subset", result);
+  QFile::remove(fileName);
+
+  if (!result)
+    {
+    std::cerr << "Unexpected attributes in a loaded dataset" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // the pixel data is most of the file and must not be read
+  if (fullBytes >= 0 && (headerBytes * 4 > fullBytes || subsetBytes * 4 > fullBytes))
+    {
+    std::cerr << "Header and subset loads read the pixel data" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QBuffer>
+#include <QDataStream>
+#include <QTime>
+#include <QVector>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDataset.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdeftag.h>
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+const int Iterations = 10;
+const char* const StudyUID = "1.2.826.0.1.3680043.2.1125.4.1";
+
+//------------------------------------------------------------------------------
+/// Keeps its serialization in a string, as a database field would
+class ctkDICOMStringDataset : public ctkDICOMDataset
+{
+public:
+  QString Stored;
+protected:
+  virtual QString GetStoredSerialization() { return this->Stored; }
+  virtual void SetStoredSerialization(QString serializedDataset) { this->Stored = serializedDataset; }
+};
+
+//------------------------------------------------------------------------------
+/// 4 MB of pixel data, well over the size the string serialization used
+/// to silently truncate at
+DcmDataset* createDataset()
+{
+  DcmDataset* dataset = new DcmDataset;
+  dataset->putAndInsertString(DCM_SpecificCharacterSet, "ISO_IR 100");
+  dataset->putAndInsertString(DCM_StudyInstanceUID, StudyUID);
+  dataset->putAndInsertString(DCM_PatientName, "Serialization^Test");
+  dataset->putAndInsertUint16(DCM_Rows, 1024);
+  dataset->putAndInsertUint16(DCM_Columns, 1024);
+  QVector<Uint16> pixels(2 * 1024 * 1024);
+  for (int i = 0; i < pixels.size(); ++i)
+    {
+    pixels[i] = static_cast<Uint16>(i);
+    }
+  dataset->putAndInsertUint16Array(DCM_PixelData, pixels.data(), pixels.size());
+  return dataset;
+}
+
+//------------------------------------------------------------------------------
+bool isIntact(const ctkDICOMDataset& dataset)
+{
+  if (!dataset.IsInitialized()
+      || dataset.GetStudyInstanceUID() != StudyUID
+      || dataset.GetElementAsUnsignedShort(DCM_Rows) != 1024)
+    {
+    return false;
+    }
+  DcmElement* element = 0;
+  if (!dataset.findAndGetElement(DCM_PixelData, element).good() || !element)
+    {
+    return false;
+    }
+  Uint16* pixels = 0;
+  if (!element->getUint16Array(pixels).good() || element->getLength() != 4 * 1024 * 1024)
+    {
+    return false;
+    }
+  return pixels[0] == 0 && pixels[12345] == 12345;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Round trips of a dataset larger than 1 MB through the binary, streaming,
+// QDataStream and string serializations, with the time each one takes.
+int ctkDICOMDatasetTest3( int argc, char * argv [] )
+{
+  Q_UNUSED(argc);
+  Q_UNUSED(argv);
+
+  ctkDICOMDataset dataset;
+  dataset.InitializeFromDataset(createDataset(), true);
+  QTime timer;
+
+  timer.start();
+  QByteArray data;
+  for (int i = 0; i < Iterations; ++i)
+    {
+    data = dataset.SerializeToByteArray();
+    ctkDICOMDataset copy;
+    if (!copy.DeserializeFromByteArray(data) || !isIntact(copy))
+      {
+      std::cerr << "Binary serialization round trip failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  std::cout << "binary: " << data.size() << " bytes, "
+            << static_cast<double>(timer.elapsed()) / Iterations << " ms" << std::endl;
+
+  timer.start();
+  for (int i = 0; i < Iterations; ++i)
+    {
+    QBuffer buffer;
+    buffer.open(QIODevice::ReadWrite);
+    if (!dataset.SerializeToDevice(&buffer) || buffer.data() != data)
+      {
+      std::cerr << "Streaming serialization differs from the binary one" << std::endl;
+      return EXIT_FAILURE;
+      }
+    // the device may hold more than the dataset
+    buffer.write("trailing data");
+    buffer.seek(0);
+    ctkDICOMDataset copy;
+    if (!copy.DeserializeFromDevice(&buffer, data.size()) || !isIntact(copy)
+        || buffer.pos() != data.size())
+      {
+      std::cerr << "Streaming serialization round trip failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  std::cout << "streaming: " << static_cast<double>(timer.elapsed()) / Iterations
+            << " ms" << std::endl;
+
+  QByteArray streamData;
+  QDataStream out(&streamData, QIODevice::WriteOnly);
+  out << dataset << dataset;
+  QDataStream in(streamData);
+  ctkDICOMDataset first;
+  ctkDICOMDataset second;
+  in >> first >> second;
+  if (in.status() != QDataStream::Ok || !isIntact(first) || !isIntact(second))
+    {
+    std::cerr << "QDataStream round trip failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  timer.start();
+  for (int i = 0; i < Iterations; ++i)
+    {
+    ctkDICOMStringDataset stringDataset;
+    stringDataset.InitializeFromDataset(createDataset(), true);
+    stringDataset.Serialize();
+    ctkDICOMStringDataset copy;
+    copy.Stored = stringDataset.Stored;
+    copy.Deserialize();
+    if (!isIntact(copy))
+      {
+      std::cerr << "String serialization round trip failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  std::cout << "string: " << static_cast<double>(timer.elapsed()) / Iterations
+            << " ms" << std::endl;
+
+  ctkDICOMDataset truncated;
+  if (truncated.DeserializeFromByteArray(data.left(data.size() / 2)))
+    {
+    std::cerr << "Truncated data deserialized without error" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
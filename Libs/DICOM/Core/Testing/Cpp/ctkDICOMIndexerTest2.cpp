@@ -0,0 +1,226 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QThread>
+#include <QTime>
+
+// ctkDICOMCore includes
+#include "ctkDICOMAbstractThumbnailGenerator.h"
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMIndexer.h"
+#include "ctkDICOMTester.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+//------------------------------------------------------------------------------
+/// Writes fake thumbnails
+class ctkDICOMIndexerTest2ThumbnailGenerator : public ctkDICOMAbstractThumbnailGenerator
+{
+public:
+  virtual bool generateThumbnail(DicomImage* dcmImage, const QString& path)
+  {
+    Q_UNUSED(dcmImage);
+    QFile thumbnail(path);
+    return thumbnail.open(QIODevice::WriteOnly) && thumbnail.write("thumbnail") > 0;
+  }
+  virtual bool generateThumbnailData(DicomImage* dcmImage, QByteArray& data)
+  {
+    Q_UNUSED(dcmImage);
+    data = "thumbnail";
+    return true;
+  }
+};
+
+//------------------------------------------------------------------------------
+// Imports a synthetic tree with ctkDICOMIndexer::addDirectory and reports
+// the throughput of the parallel parsing pipeline.
+// Usage: ctkDICOMIndexerTest2 [number of images per series]
+int ctkDICOMIndexerTest2( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  int imagesPerSeries = 100;
+  if (argc > 1)
+    {
+    imagesPerSeries = QString(argv[1]).toInt();
+    }
+
+  QDir tempDir = QDir::temp();
+  QString testDirectory = tempDir.absoluteFilePath("ctkDICOMIndexerTest2");
+  QDir(testDirectory).remove("ctkDICOM.sql");
+  QDir(testDirectory).mkpath(".");
+
+  QStringList files = ctkDICOMTester::generateDICOMFiles(
+    testDirectory + "/data", 2, 2, 5, imagesPerSeries);
+  if (files.isEmpty())
+    {
+    std::cerr << "Failed to generate synthetic data" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMDatabase database;
+  database.openDatabase(testDirectory + "/ctkDICOM.sql");
+  if (!database.lastError().isEmpty() || !database.initializeDatabase())
+    {
+    std::cerr << "Can't open database: " << qPrintable(database.lastError()) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Rows and Modality are cached during the import
+  database.setTagsToPrecache(QStringList() << "0028,0010" << "0008,0060");
+
+  ctkDICOMIndexer indexer;
+  indexer.setInstrumentationLevel(ctkDICOMIndexer::TimersInstrumentation);
+
+  const int connectionCount = QSqlDatabase::connectionNames().count();
+  QTime timer;
+  timer.start();
+  indexer.addDirectory(database, testDirectory + "/data");
+  indexer.waitForImportFinished();
+  int msecs = timer.elapsed();
+  // the writer thread inserted through connections of its own, removed
+  // once done
+  if (QSqlDatabase::connectionNames().count() != connectionCount)
+    {
+    std::cerr << "Connections of the writer thread left open: "
+              << qPrintable(QSqlDatabase::connectionNames().join(", ")) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::cout << "addDirectory: " << files.count() << " files in " << msecs << " ms ("
+            << (msecs > 0 ? (1000. * files.count()) / msecs : 0.) << " files/s) using "
+            << QThread::idealThreadCount() << " parser threads" << std::endl;
+  std::cout << qPrintable(indexer.statisticsSummary()) << std::endl;
+
+  ctkDICOMIndexerStatistics statistics = indexer.statistics();
+  if (statistics.FilesScanned != files.count() || statistics.FilesParsed != files.count()
+      || statistics.FilesInserted != files.count() || statistics.FilesSkipped != 0
+      || statistics.BytesParsed <= 0)
+    {
+    std::cerr << "Wrong import statistics: " << qPrintable(indexer.statisticsSummary()) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  int count = ctkDICOMTester::imageCount(database);
+  if (count != files.count())
+    {
+    std::cerr << "Expected " << files.count() << " images in the database, found "
+              << count << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // precached tags don't need the file
+  QString instanceUID = database.instanceForFile(files.first());
+  database.resetTagCacheStatistics();
+  if (database.instanceValue(instanceUID, "0028,0010") != "64"
+      || database.tagCacheMisses() != 0)
+    {
+    std::cerr << "Rows of " << qPrintable(instanceUID) << " not precached" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // a tag added to the list is cached for the existing instances by the
+  // background backfill
+  database.setTagsToPrecache(database.tagsToPrecache() << "0028,0011");
+  database.backfillTagCache();
+  database.waitForTagCacheBackfill();
+  database.resetTagCacheStatistics();
+  if (database.instanceValue(instanceUID, "0028,0011") != "64"
+      || database.tagCacheMisses() != 0)
+    {
+    std::cerr << "Columns of " << qPrintable(instanceUID) << " not backfilled" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // nothing changed: the rescan only stats the files
+  timer.start();
+  indexer.refreshDatabase(database, testDirectory + "/data");
+  indexer.waitForImportFinished();
+  msecs = timer.elapsed();
+  std::cout << "refreshDatabase (unchanged): " << files.count() << " files in "
+            << msecs << " ms" << std::endl;
+  if (ctkDICOMTester::imageCount(database) != files.count())
+    {
+    std::cerr << "refreshDatabase() changed an unchanged directory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // one file deleted, one series added
+  QFile::remove(files.first());
+  QStringList newFiles = ctkDICOMTester::generateDICOMFiles(
+    testDirectory + "/data/new", 1, 1, 1, 3);
+  indexer.refreshDatabase(database, testDirectory + "/data");
+  indexer.waitForImportFinished();
+  count = ctkDICOMTester::imageCount(database);
+  if (count != files.count() - 1 + newFiles.count())
+    {
+    std::cerr << "Expected " << files.count() - 1 + newFiles.count()
+              << " images after refreshDatabase(), found " << count << std::endl;
+    return EXIT_FAILURE;
+    }
+  // only the new files are parsed
+  statistics = indexer.statistics();
+  if (statistics.FilesScanned != newFiles.count() || statistics.FilesInserted != newFiles.count())
+    {
+    std::cerr << "Wrong refresh statistics: " << qPrintable(indexer.statisticsSummary()) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // thumbnails of all the instances, committed in batches
+  ctkDICOMIndexerTest2ThumbnailGenerator generator;
+  if (indexer.regenerateThumbnails(database) != -1)
+    {
+    std::cerr << "Thumbnails regenerated without a generator" << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.setThumbnailGenerator(&generator);
+  int queued = indexer.regenerateThumbnails(database, true);
+  indexer.waitForThumbnails();
+  std::cout << qPrintable(indexer.statisticsSummary()) << std::endl;
+  statistics = indexer.statistics();
+  if (queued != count || statistics.ThumbnailsQueued != count
+      || statistics.ThumbnailsGenerated != count || database.isBatchInsertActive())
+    {
+    std::cerr << "Wrong thumbnail statistics: " << qPrintable(indexer.statisticsSummary()) << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (indexer.regenerateThumbnails(database, true) != 0)
+    {
+    std::cerr << "Up to date thumbnails regenerated" << std::endl;
+    return EXIT_FAILURE;
+    }
+  indexer.waitForThumbnails();
+  database.setThumbnailGenerator(0);
+
+  // cancel right away: the import must terminate
+  indexer.addDirectory(database, testDirectory + "/data");
+  indexer.cancel();
+  indexer.waitForImportFinished();
+
+  database.closeDatabase();
+  return EXIT_SUCCESS;
+}
@@ -23,6 +23,7 @@
 #include <QDebug>
 #include <QFileInfo>
 #include <QSqlQuery>
+#include <QTime>
 
 // ctkDICOMCore includes
 #include "ctkDICOMDatabase.h"
@@ -32,6 +33,23 @@
 // STD includes
 #include <iostream>
 
+namespace
+{
+
+//------------------------------------------------------------------------------
+/// the rows are fetched in a worker thread, wait for them
+bool waitForFetches(const ctkDICOMModel& model)
+{
+  QTime timer;
+  timer.start();
+  while (model.isFetching() && timer.elapsed() < 5000)
+    {
+    QCoreApplication::processEvents();
+    }
+  return !model.isFetching();
+}
+
+}
 
 /* Test from build directory:
  ./CTK-build/bin/CTKDICOMCoreCxxTests ctkDICOMModelTest1 test.db ../CTK/Libs/DICOM/Core/Resources/dicom-sample.sql
@@ -82,12 +100,66 @@ int ctkDICOMModelTest1( int argc, char * argv [] )
     model.setDatabase(QSqlDatabase());
 
     model.setDatabase(myCTK.database());
+    if (!waitForFetches(model))
+      {
+      std::cerr << "Fetching the patients did not finish" << std::endl;
+      return EXIT_FAILURE;
+      }
 
     model.rowCount();
 
     qDebug() << model.rowCount() << model.columnCount();
     qDebug() << model.index(0,0);
 
+    // rapid edits are applied once, after the search delay
+    const int patients = model.rowCount();
+    model.setSearchDelay(50);
+    QMap<QString, QVariant> parameters;
+    const char* edits[] = {"x", "x'", "x'\"", "x'\"%", "x'\" OR 1=1 --"};
+    for (int i = 0; i < 5; ++i)
+      {
+      parameters["Name"] = QString(edits[i]);
+      model.setSearchParameters(parameters);
+      }
+    if (!model.searchParameters().isEmpty())
+      {
+      std::cerr << "Search parameters applied before the search delay" << std::endl;
+      return EXIT_FAILURE;
+      }
+    QTime timer;
+    timer.start();
+    while (model.searchParameters() != parameters && timer.elapsed() < 5000)
+      {
+      QCoreApplication::processEvents();
+      }
+    waitForFetches(model);
+    // the quotes are part of the bound value, not of the statement
+    if (model.searchParameters() != parameters || model.rowCount() != 0)
+      {
+      std::cerr << "Search by a name with quotes failed: "
+                << model.rowCount() << " rows" << std::endl;
+      return EXIT_FAILURE;
+      }
+    model.setSearchParameters(QMap<QString, QVariant>());
+    model.applySearchParameters();
+    waitForFetches(model);
+    if (model.rowCount() != patients)
+      {
+      std::cerr << "Clearing the search parameters lost patients" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // the synchronous fetch gives the same rows
+    ctkDICOMModel syncModel;
+    syncModel.setBackgroundFetch(false);
+    syncModel.setDatabase(myCTK.database());
+    if (syncModel.isFetching() || syncModel.rowCount() != patients)
+      {
+      std::cerr << "Synchronous fetch differs: " << syncModel.rowCount()
+                << " patients instead of " << patients << std::endl;
+      return EXIT_FAILURE;
+      }
+
     return EXIT_SUCCESS;
   }
   catch (std::exception e)
@@ -56,12 +56,14 @@ int ctkDICOMQueryTest2( int argc, char * argv [] )
   tester.storeData(arguments);
 
   ctkDICOMDatabase database;
+  database.openDatabase(":memory:", "QUERY-DB");
 
   ctkDICOMQuery query;
   query.setCallingAETitle("CTK_AE");
   query.setCalledAETitle("CTK_AE");
   query.setHost("localhost");
   query.setPort(tester.dcmqrscpPort());
+  query.setCacheTimeToLive(60);
 
   bool res = query.query(database);
   if (!res)
@@ -75,5 +77,58 @@ int ctkDICOMQueryTest2( int argc, char * argv [] )
               << "No study instance retrieved" << std::endl;
     return EXIT_FAILURE;
     }
+
+  QString studyInstanceUID = query.studyInstanceUIDQueried().first();
+  QString seriesInstanceUID = database.seriesForStudy(studyInstanceUID).value(0);
+  if (!query.queryInstances(studyInstanceUID, seriesInstanceUID)
+      || query.sopInstanceUIDQueried().count() != arguments.count()
+      || query.resultsTruncated())
+    {
+    std::cout << "ctkDICOMQuery::queryInstances() failed, found "
+              << query.sopInstanceUIDQueried().count() << " instances" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the find is canceled past the maximum number of results
+  ctkDICOMQuery limitedQuery;
+  limitedQuery.setCallingAETitle("CTK_AE");
+  limitedQuery.setCalledAETitle("CTK_AE");
+  limitedQuery.setHost("localhost");
+  limitedQuery.setPort(tester.dcmqrscpPort());
+  limitedQuery.setMaximumResults(1);
+  if (!limitedQuery.queryInstances(studyInstanceUID, seriesInstanceUID)
+      || limitedQuery.sopInstanceUIDQueried().count() != 1
+      || limitedQuery.resultsTruncated() != (arguments.count() > 1))
+    {
+    std::cout << "ctkDICOMQuery::setMaximumResults() failed, found "
+              << limitedQuery.sopInstanceUIDQueried().count() << " instances" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the results of the first query are cached
+  tester.stopDCMQRSCP();
+  ctkDICOMDatabase cachedDatabase;
+  cachedDatabase.openDatabase(":memory:", "CACHED-QUERY-DB");
+  ctkDICOMQuery cachedQuery;
+  cachedQuery.setCallingAETitle("CTK_AE");
+  cachedQuery.setCalledAETitle("CTK_AE");
+  cachedQuery.setHost("localhost");
+  cachedQuery.setPort(tester.dcmqrscpPort());
+  cachedQuery.setCacheTimeToLive(60);
+  if (!cachedQuery.query(cachedDatabase)
+      || cachedQuery.studyInstanceUIDQueried() != query.studyInstanceUIDQueried()
+      || cachedDatabase.seriesForStudy(studyInstanceUID).count() !=
+         database.seriesForStudy(studyInstanceUID).count())
+    {
+    std::cout << "ctkDICOMQuery::query() didn't use the cached results" << std::endl;
+    return EXIT_FAILURE;
+    }
+  cachedQuery.setCacheTimeToLive(0);
+  if (cachedQuery.query(cachedDatabase))
+    {
+    std::cout << "ctkDICOMQuery::query() succeeded without cache nor server" << std::endl;
+    return EXIT_FAILURE;
+    }
+  ctkDICOMQuery::clearCache();
   return EXIT_SUCCESS;
 }
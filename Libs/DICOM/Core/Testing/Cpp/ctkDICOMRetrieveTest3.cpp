@@ -0,0 +1,153 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QStringList>
+#include <QTime>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMQuery.h"
+#include "ctkDICOMRetrieveScheduler.h"
+#include "ctkDICOMStorageReceiver.h"
+#include "ctkDICOMTester.h"
+
+// STD includes
+#include <iostream>
+
+void ctkDICOMRetrieveTest3PrintUsage()
+{
+  std::cout << " ctkDICOMRetrieveTest3 images" << std::endl;
+}
+
+// Moves the studies of a local dcmqrscp series by series over two
+// associations to a ctkDICOMStorageReceiver, then resumes the request.
+int ctkDICOMRetrieveTest3( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  QStringList arguments = app.arguments();
+  arguments.pop_front(); // remove application name
+  arguments.pop_front(); // remove test name
+  if (!arguments.count())
+    {
+    ctkDICOMRetrieveTest3PrintUsage();
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMTester tester;
+  tester.startDCMQRSCP();
+  tester.storeData(arguments);
+
+  ctkDICOMDatabase queryDatabase;
+  ctkDICOMQuery query;
+  query.setCallingAETitle("CTK_AE");
+  query.setCalledAETitle("CTK_AE");
+  query.setHost("localhost");
+  query.setPort(tester.dcmqrscpPort());
+  if (!query.query(queryDatabase) || query.studyInstanceUIDQueried().count() == 0)
+    {
+    std::cerr << "ctkDICOMQuery::query() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QString testDirectory = QDir::temp().absoluteFilePath("ctkDICOMRetrieveTest3");
+  QDir incomingDirectory(testDirectory + "/incoming");
+  foreach(const QString& file, incomingDirectory.entryList(QDir::Files))
+    {
+    incomingDirectory.remove(file);
+    }
+  QDir(testDirectory).remove("ctkDICOM.sql");
+  QDir(testDirectory).mkpath(".");
+  QSharedPointer<ctkDICOMDatabase> retrieveDatabase(new ctkDICOMDatabase);
+  retrieveDatabase->openDatabase(testDirectory + "/ctkDICOM.sql");
+  if (!retrieveDatabase->initializeDatabase())
+    {
+    std::cerr << "Can't open the retrieve database" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // move destination known by dcmqrscp.cfg
+  ctkDICOMStorageReceiver receiver;
+  receiver.setDatabase(retrieveDatabase);
+  receiver.setAETitle("CTK_CLIENT_AE");
+  receiver.setPort(11113);
+  if (!receiver.start())
+    {
+    std::cerr << "Can't start the storage receiver" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMRetrieveScheduler scheduler;
+  scheduler.setCallingAETitle("CTK_AE");
+  scheduler.setCalledAETitle("CTK_AE");
+  scheduler.setHost("localhost");
+  scheduler.setPort(tester.dcmqrscpPort());
+  scheduler.setMoveDestinationAETitle("CTK_CLIENT_AE");
+  scheduler.setMaximumAssociations(2);
+  scheduler.setDatabase(retrieveDatabase);
+
+  if (!scheduler.retrieveStudies(query.studyInstanceUIDQueried()))
+    {
+    std::cerr << "ctkDICOMRetrieveScheduler::retrieveStudies() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  scheduler.waitForFinished();
+  if (scheduler.seriesCount() == 0 || scheduler.failedSeriesCount() != 0
+      || scheduler.completedSeriesCount() != scheduler.seriesCount())
+    {
+    std::cerr << "Retrieved " << scheduler.completedSeriesCount() << " series out of "
+              << scheduler.seriesCount() << ", " << scheduler.failedSeriesCount()
+              << " failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QTime timer;
+  timer.start();
+  while (receiver.receivedCount() < arguments.count() && timer.elapsed() < 10000)
+    {
+    QCoreApplication::processEvents();
+    }
+  receiver.waitForIndexing();
+  if (receiver.indexedCount() != arguments.count())
+    {
+    std::cerr << "Received " << receiver.indexedCount() << " images out of "
+              << arguments.count() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // everything is in the database, nothing left to resume
+  if (!scheduler.resume())
+    {
+    std::cerr << "ctkDICOMRetrieveScheduler::resume() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  scheduler.waitForFinished();
+  if (scheduler.seriesCount() != 0)
+    {
+    std::cerr << "Resume retrieved " << scheduler.seriesCount()
+              << " complete series again" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTime>
+#include <QtConcurrentRun>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMStorageReceiver.h"
+#include "ctkDICOMTester.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmnet/scu.h>
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+bool connectSCU(DcmSCU& scu, int port)
+{
+  scu.setAETitle("CTKSTORESCU");
+  scu.setPeerAETitle("CTKSTORE");
+  scu.setPeerHostName("localhost");
+  scu.setPeerPort(port);
+  OFList<OFString> transferSyntaxes;
+  transferSyntaxes.push_back(UID_LittleEndianExplicitTransferSyntax);
+  scu.addPresentationContext(UID_SecondaryCaptureImageStorage, transferSyntaxes);
+  return scu.initNetwork().good() && scu.negotiateAssociation().good();
+}
+
+//------------------------------------------------------------------------------
+/// \returns the number of files that were not stored
+int sendFiles(DcmSCU* scu, QStringList files)
+{
+  int failures = 0;
+  T_ASC_PresentationContextID presentationContextID =
+    scu->findPresentationContextID(UID_SecondaryCaptureImageStorage, "");
+  foreach(const QString& file, files)
+    {
+    Uint16 status = 0;
+    if (scu->sendSTORERequest(presentationContextID, QDir::toNativeSeparators(file).toLatin1().data(),
+                              0, status).bad() || status != STATUS_Success)
+      {
+      ++failures;
+      }
+    }
+  return failures;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Pushes a synthetic study tree to a ctkDICOMStorageReceiver from two SCUs
+// of the same process and reports the throughput.
+// Usage: ctkDICOMStorageReceiverTest1 [number of images per series] [port]
+int ctkDICOMStorageReceiverTest1( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  int imagesPerSeries = 200;
+  int port = 11120;
+  if (argc > 1)
+    {
+    imagesPerSeries = QString(argv[1]).toInt();
+    }
+  if (argc > 2)
+    {
+    port = QString(argv[2]).toInt();
+    }
+
+  QString testDirectory = QDir::temp().absoluteFilePath("ctkDICOMStorageReceiverTest1");
+  QDir incomingDirectory(testDirectory + "/incoming");
+  foreach(const QString& file, incomingDirectory.entryList(QDir::Files))
+    {
+    incomingDirectory.remove(file);
+    }
+  QDir(testDirectory).remove("ctkDICOM.sql");
+  QDir(testDirectory).mkpath(".");
+
+  QStringList files = ctkDICOMTester::generateDICOMFiles(
+    testDirectory + "/data", 1, 2, 5, imagesPerSeries, 16, 16);
+  if (files.isEmpty())
+    {
+    std::cerr << "Failed to generate synthetic data" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QSharedPointer<ctkDICOMDatabase> database(new ctkDICOMDatabase);
+  database->openDatabase(testDirectory + "/ctkDICOM.sql");
+  if (!database->lastError().isEmpty() || !database->initializeDatabase())
+    {
+    std::cerr << "Can't open database: " << qPrintable(database->lastError()) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMStorageReceiver receiver;
+  if (receiver.start())
+    {
+    std::cerr << "Started without a database" << std::endl;
+    return EXIT_FAILURE;
+    }
+  receiver.setDatabase(database);
+  receiver.setPort(port);
+  receiver.setMaximumAssociations(2);
+  if (!receiver.start() || !receiver.isListening())
+    {
+    std::cerr << "Can't listen to port " << port << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  DcmSCU firstSCU;
+  DcmSCU secondSCU;
+  if (!connectSCU(firstSCU, port) || !connectSCU(secondSCU, port))
+    {
+    std::cerr << "Can't connect to the storage receiver" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // a third association is over the limit
+  DcmSCU thirdSCU;
+  if (connectSCU(thirdSCU, port))
+    {
+    std::cerr << "Association accepted over the maximum" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the instance UID names the received file, anything else than a UID is
+  // refused
+  QString invalidFilePath = testDirectory + "/invalid.dcm";
+  QString escapedFilePath = testDirectory + "/escaped.dcm";
+  QFile::remove(escapedFilePath);
+  DcmFileFormat invalidFile;
+  if (invalidFile.loadFile(QFile::encodeName(files.first()).constData()).bad()
+      || invalidFile.getDataset()->putAndInsertString(DCM_SOPInstanceUID, "../escaped").bad()
+      || invalidFile.saveFile(QFile::encodeName(invalidFilePath).constData(),
+                              EXS_LittleEndianExplicit).bad())
+    {
+    std::cerr << "Failed to write an object with an invalid UID" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (sendFiles(&firstSCU, QStringList() << invalidFilePath) != 1
+      || QFile::exists(escapedFilePath) || receiver.receivedCount() != 0)
+    {
+    std::cerr << "Object with an invalid SOP instance UID stored" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QTime timer;
+  timer.start();
+  QStringList firstHalf = files.mid(0, files.count() / 2);
+  QStringList secondHalf = files.mid(files.count() / 2);
+  QFuture<int> firstFailures = QtConcurrent::run(sendFiles, &firstSCU, firstHalf);
+  QFuture<int> secondFailures = QtConcurrent::run(sendFiles, &secondSCU, secondHalf);
+  if (firstFailures.result() + secondFailures.result() != 0)
+    {
+    std::cerr << firstFailures.result() + secondFailures.result()
+              << " objects not stored" << std::endl;
+    return EXIT_FAILURE;
+    }
+  int sendMsecs = timer.elapsed();
+  firstSCU.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+  secondSCU.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+
+  // the last objects are queued after being acknowledged
+  while (receiver.receivedCount() < files.count() && timer.elapsed() < sendMsecs + 5000)
+    {
+    QCoreApplication::processEvents();
+    }
+  receiver.waitForIndexing();
+  int indexMsecs = timer.elapsed();
+  std::cout << "received " << files.count() << " objects in " << sendMsecs << " ms ("
+            << (sendMsecs > 0 ? (1000. * files.count()) / sendMsecs : 0.)
+            << " objects/s), indexed after " << indexMsecs << " ms" << std::endl;
+
+  if (receiver.receivedCount() != files.count() || receiver.indexedCount() != files.count())
+    {
+    std::cerr << "Received " << receiver.receivedCount() << " and indexed "
+              << receiver.indexedCount() << " objects out of " << files.count() << std::endl;
+    return EXIT_FAILURE;
+    }
+  int count = ctkDICOMTester::imageCount(*database);
+  if (count != files.count())
+    {
+    std::cerr << "Expected " << files.count() << " images in the database, found "
+              << count << std::endl;
+    return EXIT_FAILURE;
+    }
+  // indexed in place
+  QString study = database->studiesForPatient(database->patients().first()).first();
+  QString storedFile = database->filesForSeries(database->seriesForStudy(study).first()).first();
+  if (QFileInfo(storedFile).absolutePath() != QFileInfo(receiver.storageDirectory()).absoluteFilePath())
+    {
+    std::cerr << "Received files not indexed in the storage directory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  receiver.stop();
+  if (receiver.isListening())
+    {
+    std::cerr << "Still listening after stop()" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -19,6 +19,9 @@
 
 =========================================================================*/
 
+// Qt includes
+#include <QTemporaryFile>
+
 // ctkDICOMCore includes
 #include "ctkDICOMAbstractThumbnailGenerator.h"
 #include "ctkLogger.h"
@@ -62,3 +65,21 @@ ctkDICOMAbstractThumbnailGenerator::ctkDICOMAbstractThumbnailGenerator(QObject*
 ctkDICOMAbstractThumbnailGenerator::~ctkDICOMAbstractThumbnailGenerator()
 {
 }
+
+//------------------------------------------------------------------------------
+bool ctkDICOMAbstractThumbnailGenerator::generateThumbnailData(DicomImage* dcmImage, QByteArray& data)
+{
+  QTemporaryFile thumbnail;
+  if (!thumbnail.open())
+    {
+    logger.error("Failed to create temporary thumbnail file: " + thumbnail.errorString());
+    return false;
+    }
+  thumbnail.close();
+  if (!this->generateThumbnail(dcmImage, thumbnail.fileName()) || !thumbnail.open())
+    {
+    return false;
+    }
+  data = thumbnail.readAll();
+  return !data.isEmpty();
+}
@@ -23,6 +23,7 @@
 #define __ctkDICOMAbstractThumbnailGenerator_h
 
 // Qt includes
+#include <QByteArray>
 #include <QObject>
 
 #include "ctkDICOMCoreExport.h"
@@ -43,7 +44,13 @@ public:
   explicit ctkDICOMAbstractThumbnailGenerator(QObject* parent = 0);
   virtual ~ctkDICOMAbstractThumbnailGenerator();
 
+  /// Called by the thumbnail threads of ctkDICOMDatabase, possibly by
+  /// several of them at once
   virtual bool generateThumbnail(DicomImage* dcmImage, const QString& path ) = 0;
+  /// Encode the thumbnail into \a data instead of a file, this is what
+  /// ctkDICOMDatabase stores. The default implementation goes through a
+  /// temporary file, subclasses should write the data directly.
+  virtual bool generateThumbnailData(DicomImage* dcmImage, QByteArray& data);
 
 protected:
   QScopedPointer<ctkDICOMAbstractThumbnailGeneratorPrivate> d_ptr;
@@ -21,24 +21,34 @@
 #include <stdexcept>
 
 // Qt includes
+#include <QCache>
 #include <QDate>
 #include <QDebug>
 #include <QDirIterator>
 #include <QFile>
 #include <QFileInfo>
 #include <QFileSystemWatcher>
+#include <QFuture>
+#include <QHash>
 #include <QMutexLocker>
+#include <QQueue>
+#include <QRunnable>
 #include <QSet>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include <QThreadStorage>
 #include <QVariant>
+#include <QtConcurrentRun>
 
 // ctkDICOM includes
 #include "ctkDICOMDatabase.h"
 #include "ctkDICOMAbstractThumbnailGenerator.h"
 #include "ctkDICOMDataset.h"
+#include "ctkDICOMThumbnailStore.h"
 
 #include "ctkLogger.h"
 
@@ -62,6 +72,46 @@
 static ctkLogger logger("org.commontk.dicom.DICOMDatabase" );
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// Read-only connection of a thread, removed when the thread exits
+struct ctkDICOMDatabaseReaderConnection
+{
+  ~ctkDICOMDatabaseReaderConnection()
+  {
+    QSqlDatabase::removeDatabase(this->ConnectionName);
+  }
+  QString ConnectionName;
+  QString DatabaseFileName;
+};
+
+//------------------------------------------------------------------------------
+/// Thumbnail waiting in the queue of ctkDICOMDatabase
+struct ctkDICOMThumbnailRequest
+{
+  ctkDICOMThumbnailRequest() : ThumbnailTime(0) {}
+  QString SOPInstanceUID;
+  QString SeriesInstanceUID;
+  QString FilePath;
+  /// modification time of the file the stored thumbnail was made from,
+  /// 0 if it is missing or known to be out of date (see
+  /// ctkDICOMDatabase::regenerateThumbnails())
+  uint    ThumbnailTime;
+};
+
+//------------------------------------------------------------------------------
+/// Thumbnail generated by a thumbnail thread, whose row is written in the
+/// thread of ctkDICOMDatabase
+struct ctkDICOMGeneratedThumbnail
+{
+  ctkDICOMGeneratedThumbnail() : DataOffset(-1), DataSize(0), ModifiedTime(0) {}
+  QString SOPInstanceUID;
+  QString SeriesInstanceUID;
+  /// in ThumbnailStore, -1 if the stored thumbnail was up to date
+  qint64  DataOffset;
+  int     DataSize;
+  uint    ModifiedTime;
+};
+
 //------------------------------------------------------------------------------
 class ctkDICOMDatabasePrivate
 {
@@ -75,6 +125,14 @@ public:
   void init(QString databaseFile);
   void registerCompressionLibraries();
   bool executeScript(const QString script);
+  /// set the PRAGMAs of the performance profile on a connection
+  void applyPerformanceProfile(QSqlDatabase& database, bool readOnly);
+  /// Upgrade an existing database to ctkDICOMDatabase::schemaVersion() by
+  /// running the dicom-schema-update-<version>.sql scripts in order
+  bool updateSchema();
+  /// build the full text search index if it or one of its triggers is
+  /// missing, as after a schema update or an initialization
+  void ensureSearchIndex();
   ///
   /// \brief runs a query and prints debug output of status
   ///
@@ -84,7 +142,9 @@ public:
 
   // dataset must be set always
   // filePath has to be set if this is an import of an actual file
-  void insert ( const ctkDICOMDataset& ctkDataset, const QString& filePath, bool storeFile = true, bool generateThumbnail = true);
+  /// Returns true if an image was added, false if it was already in the
+  /// database up to date, has no file or could not be inserted
+  bool insert ( const ctkDICOMDataset& ctkDataset, const QString& filePath, bool storeFile = true, bool generateThumbnail = true);
 
 
   /// Name of the database file (i.e. for SQLITE the sqlite file)
@@ -95,6 +155,68 @@ public:
 
   ctkDICOMAbstractThumbnailGenerator* thumbnailGenerator;
 
+  /// thumbnail queue, see ctkDICOMDatabase::requestThumbnail().
+  /// Every queued request starts a worker in ThumbnailThreadPool that
+  /// generates whichever thumbnail comes first at the time it runs.
+  QThreadPool ThumbnailThreadPool;
+  mutable QMutex ThumbnailMutex;
+  QQueue<ctkDICOMThumbnailRequest> RequestedThumbnails;
+  QHash<QString, QQueue<ctkDICOMThumbnailRequest> > QueuedThumbnails;
+  /// series of QueuedThumbnails in the order they were queued
+  QStringList QueuedThumbnailSeries;
+  QStringList VisibleThumbnailSeries;
+  /// instances whose thumbnail is queued, or being generated and stored,
+  /// to drop duplicates
+  QSet<QString> PendingThumbnails;
+  QSet<QString> ThumbnailsInProgress;
+  /// thumbnails appended to ThumbnailStore by the workers, waiting for
+  /// storeGeneratedThumbnails()
+  QList<ctkDICOMGeneratedThumbnail> GeneratedThumbnails;
+  /// a call of storeGeneratedThumbnails() is queued in the event loop
+  bool StoreThumbnailsQueued;
+
+  /// encoded thumbnails, indexed by the Thumbnails table
+  ctkDICOMThumbnailStore ThumbnailStore;
+  QString thumbnailStoreFileName();
+  /// open the thumbnail file of the database, and forget the thumbnails
+  /// of the Thumbnails table if it has been lost
+  void openThumbnailStore();
+  /// one PNG file per instance, before ctkDICOMThumbnailStore
+  QString legacyThumbnailPath(const QString& studyInstanceUID,
+                              const QString& seriesInstanceUID,
+                              const QString& sopInstanceUID);
+  /// modification time of the file the stored thumbnail was made from,
+  /// 0 if there is no thumbnail. Like storeThumbnail(), to be called in
+  /// the thread of the database with insertMutex locked.
+  uint storedThumbnailTime(const QString& sopInstanceUID);
+  /// write the row of a thumbnail appended to ThumbnailStore
+  bool storeThumbnail(const QString& sopInstanceUID, const QString& seriesInstanceUID,
+                      qint64 dataOffset, int dataSize, uint modifiedTime);
+  /// thumbnailGenerator, read with ThumbnailMutex locked
+  bool hasThumbnailGenerator() const;
+  /// @Returns false if the thumbnail is already pending
+  bool queueThumbnail(const ctkDICOMThumbnailRequest& request, bool requested);
+  bool takeThumbnailRequest(ctkDICOMThumbnailRequest& request);
+  /// run by the workers of ThumbnailThreadPool: the thumbnail is appended
+  /// to ThumbnailStore and handed to storeGeneratedThumbnails(), as the
+  /// connection can only be used by the thread of the database
+  void generateNextThumbnail();
+  /// write the rows of GeneratedThumbnails and emit thumbnailGenerated(),
+  /// in the thread of the database. The rows that can't be written stay in
+  /// GeneratedThumbnails, for the next call.
+  /// @Returns false if some rows could not be written
+  bool storeGeneratedThumbnails();
+
+  ctkDICOMDatabase::PerformanceProfile Profile;
+  /// the connections have been opened by ctkDICOMDatabase::openSharedDatabase()
+  /// and are removed by closeDatabase()
+  bool SharedConnection;
+  /// database whose thumbnail queue serves the inserts: the one shared by
+  /// openSharedDatabase(), this one otherwise
+  ctkDICOMDatabasePrivate* ThumbnailQueue;
+  /// one read-only connection per thread, see readOnlyDatabase()
+  QThreadStorage<ctkDICOMDatabaseReaderConnection*> ReaderConnections;
+
   /// these are for optimizing the import of image sequences
   /// since most information are identical for all slices
   QString LastPatientID;
@@ -107,6 +229,31 @@ public:
   /// parallel inserts are not allowed (yet)
   QMutex insertMutex;
 
+  /// bulk insert state, see ctkDICOMDatabase::beginBatchInsert()
+  bool BatchInsertActive;
+  int  InsertBatchSize;
+  int  PendingBatchInserts;
+  /// patients (PatientID and PatientsName), studies and series already
+  /// known to be in the database during the current batch
+  QHash<QString, int> BatchPatients;
+  QSet<QString>       BatchStudies;
+  QSet<QString>       BatchSeries;
+
+  /// statements used by insert(), prepared once per connection
+  bool      InsertStatementsPrepared;
+  QSqlQuery SelectImageBySOPInstanceUIDQuery;
+  QSqlQuery SelectImageByFilenameQuery;
+  QSqlQuery SelectPatientQuery;
+  QSqlQuery SelectStudyQuery;
+  QSqlQuery SelectSeriesQuery;
+  QSqlQuery InsertPatientQuery;
+  QSqlQuery InsertStudyQuery;
+  QSqlQuery InsertSeriesQuery;
+  QSqlQuery InsertImageQuery;
+  QSqlQuery InsertDirectoryFileQuery;
+  /// last directory added to the Directories table
+  QString   LastDirectoryName;
+
   /// tagCache table has been checked to exist
   bool TagCacheVerified;
   /// tag cache has independent database to avoid locking issue
@@ -114,10 +261,92 @@ public:
   /// reading while the tag cache is writing
   QSqlDatabase TagCacheDatabase;
   QString TagCacheDatabaseFilename;
+  /// most recently used tag values, in front of the TagCache table.
+  /// Keyed by tagCacheKey(), empty values are cached too.
+  QCache<QString, QString> TagMemoryCache;
+  QMutex TagMemoryCacheMutex;
+  /// counted by lookupCachedTag(), read by any thread
+  QAtomicInt TagCacheMemoryHits;
+  QAtomicInt TagCacheTableHits;
+  QAtomicInt TagCacheMisses;
+  /// prepared once per connection by lookupCachedTag()
+  QSqlQuery SelectTagCacheQuery;
+
+  /// tags extracted into the TagCache table at insert time
+  QStringList TagsToPrecache;
+  QList<DcmTagKey> TagKeysToPrecache;
+  QSqlQuery InsertTagCacheQuery;
+  /// a TagCache transaction is open, committed with the batch insert
+  bool TagCacheTransactionActive;
+  QFuture<void> TagCacheBackfillFuture;
+  volatile bool TagCacheBackfillCanceled;
+
+  /// write the TagsToPrecache of an inserted instance to the TagCache table
+  void precacheTags(const ctkDICOMDataset& ctkDataset, const QString& sopInstanceUID);
+  /// commit (or roll back) the TagCache writes made during a batch insert
+  void endTagCacheTransaction(bool commit);
+  void resetTagCacheStatements();
+  /// levels of the set based removal, see removeSets()
+  enum RemovalLevel
+  {
+    SeriesLevel,
+    StudyLevel,
+    PatientLevel
+  };
+  /// body of ctkDICOMDatabase::removeSeries(), removeStudies() and
+  /// removePatients(): the series to remove are gathered in temporary
+  /// tables and each table is purged with a single DELETE
+  bool removeSets(RemovalLevel level, const QStringList& uids,
+                  ctkDICOMRemovalReport* report, bool dryRun);
+  /// files of removed images, deleted by the reclamation job
+  QStringList FilesToReclaim;
+  mutable QMutex ReclaimMutex;
+  bool ReclaimRunning;
+  QFuture<void> ReclaimFuture;
+  /// queue files for deletion, and start the job if needed
+  void reclaimFiles(const QStringList& filePaths);
+  /// body of the reclamation job
+  void runFileReclamation();
+
+  /// value of an aggregate column of the Patients, Studies or Series
+  /// table, 0 if the row doesn't exist
+  qint64 aggregate(const QString& table, const QString& keyColumn,
+                   const QString& key, const QString& column);
+
+  /// body of the background job started by ctkDICOMDatabase::backfillTagCache()
+  void backfillTagCache(const QStringList& tags);
+
+  static QString tagCacheKey(const QString& sopInstanceUID, const QString& tag);
+  /// look for a value in memory, then in the TagCache table.
+  /// Unlike cachedTag(), a cached empty value is found.
+  bool lookupCachedTag(const QString& sopInstanceUID, const QString& tag, QString& value);
+  void memoryCacheTag(const QString& sopInstanceUID, const QString& tag, const QString& value);
+  void clearTagMemoryCache();
 
   int insertPatient(const ctkDICOMDataset& ctkDataset);
   void insertStudy(const ctkDICOMDataset& ctkDataset, int dbPatientID);
   void insertSeries( const ctkDICOMDataset& ctkDataset, QString studyInstanceUID);
+
+  void prepareInsertStatements();
+  void resetInsertStatements();
+  /// forget everything that has been remembered about the database content
+  /// to speed up inserts (last patient/study/series and batch caches)
+  void resetInsertCaches();
+  /// commit the pending batch inserts and start a new transaction
+  bool flushBatchInsert();
+};
+
+//------------------------------------------------------------------------------
+class ctkDICOMThumbnailWorker : public QRunnable
+{
+public:
+  ctkDICOMThumbnailWorker(ctkDICOMDatabasePrivate* database) : Database(database) {}
+  virtual void run()
+  {
+    this->Database->generateNextThumbnail();
+  }
+private:
+  ctkDICOMDatabasePrivate* Database;
 };
 
 //------------------------------------------------------------------------------
@@ -127,9 +356,25 @@ public:
 ctkDICOMDatabasePrivate::ctkDICOMDatabasePrivate(ctkDICOMDatabase& o): q_ptr(&o)
 {
   this->thumbnailGenerator = NULL;
+  this->StoreThumbnailsQueued = false;
   this->LoggedExecVerbose = false;
   this->LastPatientUID = -1;
   this->TagCacheVerified = false;
+  this->BatchInsertActive = false;
+  this->InsertBatchSize = 1000;
+  this->PendingBatchInserts = 0;
+  this->InsertStatementsPrepared = false;
+  this->Profile = ctkDICOMDatabase::BalancedProfile;
+  this->SharedConnection = false;
+  this->ThumbnailQueue = this;
+  this->TagMemoryCache.setMaxCost(100000);
+  this->TagCacheMemoryHits = 0;
+  this->TagCacheTableHits = 0;
+  this->TagCacheMisses = 0;
+  this->TagCacheTransactionActive = false;
+  this->TagCacheBackfillCanceled = false;
+  this->ReclaimRunning = false;
+  this->ThumbnailThreadPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
 }
 
 //------------------------------------------------------------------------------
@@ -159,6 +404,56 @@ void ctkDICOMDatabasePrivate::registerCompressionLibraries(){
 //------------------------------------------------------------------------------
 ctkDICOMDatabasePrivate::~ctkDICOMDatabasePrivate()
 {
+  // connections of the other threads are removed when they exit
+  this->ReaderConnections.setLocalData(0);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::applyPerformanceProfile(QSqlDatabase& database, bool readOnly)
+{
+  QStringList pragmas;
+  // the journal mode is stored in the file, read-only connections can't
+  // change it, and there is no WAL for in-memory databases
+  const bool setJournalMode = !readOnly && this->DatabaseFileName != ":memory:";
+  switch (this->Profile)
+    {
+    case ctkDICOMDatabase::CompatibilityProfile:
+      if (setJournalMode)
+        {
+        pragmas << "PRAGMA journal_mode = DELETE";
+        }
+      pragmas << "PRAGMA synchronous = FULL"
+              << "PRAGMA cache_size = -2000"
+              << "PRAGMA mmap_size = 0"
+              << "PRAGMA temp_store = DEFAULT";
+      break;
+    case ctkDICOMDatabase::BalancedProfile:
+      if (setJournalMode)
+        {
+        pragmas << "PRAGMA journal_mode = WAL";
+        }
+      pragmas << "PRAGMA synchronous = NORMAL"
+              << "PRAGMA cache_size = -65536"
+              << "PRAGMA mmap_size = 268435456"
+              << "PRAGMA temp_store = MEMORY";
+      break;
+    case ctkDICOMDatabase::FastProfile:
+      if (setJournalMode)
+        {
+        pragmas << "PRAGMA journal_mode = WAL";
+        }
+      pragmas << "PRAGMA synchronous = OFF"
+              << "PRAGMA cache_size = -262144"
+              << "PRAGMA mmap_size = 1073741824"
+              << "PRAGMA temp_store = MEMORY";
+      break;
+    }
+  // SQLite ignores the PRAGMAs it does not know (e.g. mmap_size before 3.7.17)
+  QSqlQuery pragma(database);
+  foreach (const QString& statement, pragmas)
+    {
+    this->loggedExec(pragma, statement);
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -195,10 +490,344 @@ bool ctkDICOMDatabasePrivate::loggedExec(QSqlQuery& query, const QString& queryS
   return (success);
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::prepareInsertStatements()
+{
+  if (this->InsertStatementsPrepared)
+    {
+    return;
+    }
+  this->SelectImageBySOPInstanceUIDQuery = QSqlQuery(this->Database);
+  this->SelectImageBySOPInstanceUIDQuery.prepare(
+    "SELECT InsertTimestamp,Filename FROM Images WHERE SOPInstanceUID == :sopInstanceUID" );
+  this->SelectImageByFilenameQuery = QSqlQuery(this->Database);
+  this->SelectImageByFilenameQuery.prepare( "SELECT SOPInstanceUID FROM Images WHERE Filename = ?" );
+  this->SelectPatientQuery = QSqlQuery(this->Database);
+  this->SelectPatientQuery.prepare( "SELECT UID FROM Patients WHERE PatientID = ? AND PatientsName = ?" );
+  this->SelectStudyQuery = QSqlQuery(this->Database);
+  this->SelectStudyQuery.prepare( "SELECT StudyInstanceUID FROM Studies WHERE StudyInstanceUID = ?" );
+  this->SelectSeriesQuery = QSqlQuery(this->Database);
+  this->SelectSeriesQuery.prepare( "SELECT SeriesInstanceUID FROM Series WHERE SeriesInstanceUID = ?" );
+  this->InsertPatientQuery = QSqlQuery(this->Database);
+  this->InsertPatientQuery.prepare( "INSERT INTO Patients ('UID', 'PatientsName', 'PatientID', 'PatientsBirthDate', 'PatientsBirthTime', 'PatientsSex', 'PatientsAge', 'PatientsComments' ) values ( NULL, ?, ?, ?, ?, ?, ?, ? )" );
+  this->InsertStudyQuery = QSqlQuery(this->Database);
+  this->InsertStudyQuery.prepare( "INSERT INTO Studies ( 'StudyInstanceUID', 'PatientsUID', 'StudyID', 'StudyDate', 'StudyTime', 'AccessionNumber', 'ModalitiesInStudy', 'InstitutionName', 'ReferringPhysician', 'PerformingPhysiciansName', 'StudyDescription' ) VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )" );
+  this->InsertSeriesQuery = QSqlQuery(this->Database);
+  this->InsertSeriesQuery.prepare( "INSERT INTO Series ( 'SeriesInstanceUID', 'StudyInstanceUID', 'SeriesNumber', 'SeriesDate', 'SeriesTime', 'SeriesDescription', 'BodyPartExamined', 'FrameOfReferenceUID', 'AcquisitionNumber', 'ContrastAgent', 'ScanningSequence', 'EchoNumber', 'TemporalPosition' ) VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )" );
+  this->InsertImageQuery = QSqlQuery(this->Database);
+  this->InsertImageQuery.prepare( "INSERT INTO Images ( 'SOPInstanceUID', 'Filename', 'SeriesInstanceUID', 'InsertTimestamp', 'FileSize' ) VALUES ( ?, ?, ?, ?, ? )" );
+  this->InsertDirectoryFileQuery = QSqlQuery(this->Database);
+  this->InsertDirectoryFileQuery.prepare( "INSERT OR REPLACE INTO DirectoryFiles ( 'Filename', 'Dirname', 'FileSize', 'ModifiedTime', 'StoredFilename' ) VALUES ( ?, ?, ?, ?, ? )" );
+  this->InsertStatementsPrepared = true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::resetInsertStatements()
+{
+  // statements must not outlive the connection or the tables they refer to
+  this->SelectImageBySOPInstanceUIDQuery = QSqlQuery();
+  this->SelectImageByFilenameQuery = QSqlQuery();
+  this->SelectPatientQuery = QSqlQuery();
+  this->SelectStudyQuery = QSqlQuery();
+  this->SelectSeriesQuery = QSqlQuery();
+  this->InsertPatientQuery = QSqlQuery();
+  this->InsertStudyQuery = QSqlQuery();
+  this->InsertSeriesQuery = QSqlQuery();
+  this->InsertImageQuery = QSqlQuery();
+  this->InsertDirectoryFileQuery = QSqlQuery();
+  this->InsertStatementsPrepared = false;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::resetInsertCaches()
+{
+  this->LastPatientID = "";
+  this->LastPatientsName = "";
+  this->LastPatientsBirthDate = "";
+  this->LastPatientUID = -1;
+  this->LastStudyInstanceUID = "";
+  this->LastSeriesInstanceUID = "";
+  this->LastDirectoryName = "";
+  this->BatchPatients.clear();
+  this->BatchStudies.clear();
+  this->BatchSeries.clear();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::flushBatchInsert()
+{
+  // the TagCache table is in another file, its writes can't be committed
+  // atomically with the batch. They are committed right after it, so that
+  // the backfill connection never waits for more than one batch, or
+  // dropped if the batch fails: the cache may then miss values, it never
+  // holds values of instances that are not in the database.
+  if (!this->Database.commit())
+    {
+    logger.error("SQLITE ERROR: could not commit batch insert: " + this->Database.lastError().text());
+    this->endTagCacheTransaction(false);
+    this->resetInsertCaches();
+    this->Database.transaction();
+    return false;
+    }
+  this->endTagCacheTransaction(true);
+  this->PendingBatchInserts = 0;
+  return this->Database.transaction();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::precacheTags(const ctkDICOMDataset& ctkDataset, const QString& sopInstanceUID)
+{
+  Q_Q(ctkDICOMDatabase);
+  if ( !q->tagCacheExists() && !q->initializeTagCache() )
+    {
+    return;
+    }
+  if (this->InsertTagCacheQuery.lastQuery().isEmpty())
+    {
+    this->InsertTagCacheQuery = QSqlQuery(this->TagCacheDatabase);
+    this->InsertTagCacheQuery.prepare( "INSERT OR REPLACE INTO TagCache VALUES(:sopInstanceUID, :tag, :value)" );
+    }
+  // the TagCache table is in its own database file, written through the
+  // tag cache connection of this database (the one of the writer thread
+  // for a database opened by openSharedDatabase()). The writes are grouped
+  // in a transaction committed together with the batch (or the instance).
+  if (!this->TagCacheTransactionActive)
+    {
+    this->TagCacheTransactionActive = this->TagCacheDatabase.transaction();
+    }
+  for (int i = 0; i < this->TagKeysToPrecache.count(); ++i)
+    {
+    // absent attributes are cached as empty values
+    this->InsertTagCacheQuery.bindValue(":sopInstanceUID", sopInstanceUID);
+    this->InsertTagCacheQuery.bindValue(":tag", this->TagsToPrecache[i]);
+    this->InsertTagCacheQuery.bindValue(":value", ctkDataset.GetAllElementValuesAsString(this->TagKeysToPrecache[i]));
+    this->loggedExec(this->InsertTagCacheQuery);
+    }
+  if (!this->BatchInsertActive)
+    {
+    this->endTagCacheTransaction(true);
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::endTagCacheTransaction(bool commit)
+{
+  if (!this->TagCacheTransactionActive)
+    {
+    return;
+    }
+  this->TagCacheTransactionActive = false;
+  if (commit ? !this->TagCacheDatabase.commit() : !this->TagCacheDatabase.rollback())
+    {
+    logger.error("SQLITE ERROR: could not end tag cache transaction: " + this->TagCacheDatabase.lastError().text());
+    }
+  if (!commit)
+    {
+    // lookups made through the tag cache connection may have read the
+    // discarded values
+    this->clearTagMemoryCache();
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::resetTagCacheStatements()
+{
+  this->endTagCacheTransaction(true);
+  this->InsertTagCacheQuery = QSqlQuery();
+  this->SelectTagCacheQuery = QSqlQuery();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::backfillTagCache(const QStringList& tags)
+{
+  Q_Q(ctkDICOMDatabase);
+
+  QList<DcmTagKey> tagKeys;
+  foreach (const QString& tag, tags)
+    {
+    unsigned short group = 0, element = 0;
+    q->tagToGroupElement(tag, group, element);
+    tagKeys << DcmTagKey(group, element);
+    }
+
+  // connections can't be shared with the other threads: the instances are
+  // read through the read-only connection of this thread and the values are
+  // written through a connection of its own
+  const QString tagCacheConnectionName =
+    QString("TagCache-backfill-%1").arg(reinterpret_cast<quintptr>(this), 0, 16);
+  {
+  QSqlDatabase tagCache = QSqlDatabase::addDatabase("QSQLITE", tagCacheConnectionName);
+  tagCache.setDatabaseName(this->TagCacheDatabaseFilename);
+  // an import precaching tags keeps the table locked until its batch is
+  // committed: wait for it rather than failing with SQLITE_BUSY
+  tagCache.setConnectOptions("QSQLITE_BUSY_TIMEOUT=60000");
+  if (!tagCache.open())
+    {
+    logger.error("Could not open tag cache for backfill: " + tagCache.lastError().text());
+    }
+  else
+    {
+    QSqlQuery createCacheTable(tagCache);
+    this->loggedExec(createCacheTable,
+      "CREATE TABLE IF NOT EXISTS TagCache (SOPInstanceUID, Tag, Value, PRIMARY KEY (SOPInstanceUID, Tag))");
+
+    QSqlDatabase images = q->readOnlyDatabase();
+    int instanceCount = 0;
+    QSqlQuery countImages(images);
+    if (this->loggedExec(countImages, "SELECT COUNT(*) FROM Images") && countImages.next())
+      {
+      instanceCount = countImages.value(0).toInt();
+      }
+    countImages.finish();
+
+    QSqlQuery selectImages(images);
+    selectImages.setForwardOnly(true);
+    QSqlQuery selectCachedTags(tagCache);
+    selectCachedTags.prepare("SELECT Tag FROM TagCache WHERE SOPInstanceUID = ?");
+    QSqlQuery insertTag(tagCache);
+    insertTag.prepare("INSERT OR REPLACE INTO TagCache VALUES(:sopInstanceUID, :tag, :value)");
+
+    int instancesDone = 0;
+    int lastProgress = -1;
+    tagCache.transaction();
+    this->loggedExec(selectImages, "SELECT SOPInstanceUID, Filename FROM Images");
+    while (!this->TagCacheBackfillCanceled && selectImages.next())
+      {
+      const QString sopInstanceUID = selectImages.value(0).toString();
+      selectCachedTags.bindValue(0, sopInstanceUID);
+      QSet<QString> cachedTags;
+      if (this->loggedExec(selectCachedTags))
+        {
+        while (selectCachedTags.next())
+          {
+          cachedTags.insert(selectCachedTags.value(0).toString());
+          }
+        }
+      selectCachedTags.finish();
+
+      // the file is only parsed if a tag is missing
+      QScopedPointer<ctkDICOMDataset> dataset;
+      for (int i = 0; i < tags.count(); ++i)
+        {
+        if (cachedTags.contains(tags[i]))
+          {
+          continue;
+          }
+        if (dataset.isNull())
+          {
+          dataset.reset(new ctkDICOMDataset);
+          dataset->InitializeFromFileHeader(selectImages.value(1).toString());
+          }
+        insertTag.bindValue(":sopInstanceUID", sopInstanceUID);
+        insertTag.bindValue(":tag", tags[i]);
+        insertTag.bindValue(":value", dataset->GetAllElementValuesAsString(tagKeys[i]));
+        this->loggedExec(insertTag);
+        }
+
+      // short transactions so that the other writers are not locked out
+      if (++instancesDone % 100 == 0)
+        {
+        tagCache.commit();
+        tagCache.transaction();
+        }
+      int progress = instanceCount > 0 ? (100 * instancesDone) / instanceCount : 100;
+      if (progress != lastProgress)
+        {
+        lastProgress = progress;
+        emit q->tagCacheBackfillProgress(progress);
+        }
+      }
+    selectImages.finish();
+    tagCache.commit();
+    tagCache.close();
+    }
+  }
+  QSqlDatabase::removeDatabase(tagCacheConnectionName);
+  emit q->tagCacheBackfillFinished();
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabasePrivate::tagCacheKey(const QString& sopInstanceUID, const QString& tag)
+{
+  return sopInstanceUID + '|' + tag;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::lookupCachedTag(const QString& sopInstanceUID, const QString& tag, QString& value)
+{
+  Q_Q(ctkDICOMDatabase);
+  const QString key = tagCacheKey(sopInstanceUID, tag);
+  {
+  QMutexLocker lock(&this->TagMemoryCacheMutex);
+  if (QString* cachedValue = this->TagMemoryCache.object(key))
+    {
+    this->TagCacheMemoryHits.ref();
+    value = *cachedValue;
+    return true;
+    }
+  }
+
+  bool found = false;
+  if ( q->tagCacheExists() || q->initializeTagCache() )
+    {
+    QSqlQuery& selectValue = this->SelectTagCacheQuery;
+    if (selectValue.lastQuery().isEmpty())
+      {
+      selectValue = QSqlQuery( this->TagCacheDatabase );
+      selectValue.prepare( "SELECT Value FROM TagCache WHERE SOPInstanceUID = :sopInstanceUID AND Tag = :tag" );
+      }
+    selectValue.bindValue(":sopInstanceUID",sopInstanceUID);
+    selectValue.bindValue(":tag",tag);
+    this->loggedExec(selectValue);
+    if (selectValue.next())
+      {
+      value = selectValue.value(0).toString();
+      found = true;
+      }
+    selectValue.finish();
+    }
+
+  if (found)
+    {
+    this->TagCacheTableHits.ref();
+    QMutexLocker lock(&this->TagMemoryCacheMutex);
+    this->TagMemoryCache.insert(key, new QString(value));
+    }
+  else
+    {
+    this->TagCacheMisses.ref();
+    }
+  return found;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::memoryCacheTag(const QString& sopInstanceUID, const QString& tag, const QString& value)
+{
+  QMutexLocker lock(&this->TagMemoryCacheMutex);
+  this->TagMemoryCache.insert(tagCacheKey(sopInstanceUID, tag), new QString(value));
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::clearTagMemoryCache()
+{
+  QMutexLocker lock(&this->TagMemoryCacheMutex);
+  this->TagMemoryCache.clear();
+}
+
 //------------------------------------------------------------------------------
 void ctkDICOMDatabase::openDatabase(const QString databaseFile, const QString& connectionName )
 {
   Q_D(ctkDICOMDatabase);
+  if (d->SharedConnection)
+    {
+    this->closeDatabase();
+    }
+  if (d->BatchInsertActive)
+    {
+    this->commitBatchInsert();
+    }
+  d->resetInsertStatements();
+  d->resetInsertCaches();
   d->DatabaseFileName = databaseFile;
   d->Database = QSqlDatabase::addDatabase("QSQLITE", connectionName);
   d->Database.setDatabaseName(databaseFile);
@@ -207,6 +836,7 @@ void ctkDICOMDatabase::openDatabase(const QString databaseFile, const QString& c
       d->LastError = d->Database.lastError().text();
       return;
     }
+  d->applyPerformanceProfile(d->Database, false);
   if ( d->Database.tables().empty() )
     {
       if (!initializeDatabase())
@@ -215,13 +845,27 @@ void ctkDICOMDatabase::openDatabase(const QString databaseFile, const QString& c
           return;
         }
     }
+  else if ( !d->updateSchema() )
+    {
+      d->LastError = QString("Unable to update the DICOM database schema!");
+      return;
+    }
+  d->ensureSearchIndex();
+  d->openThumbnailStore();
   if (!isInMemory())
     {
       QFileSystemWatcher* watcher = new QFileSystemWatcher(QStringList(databaseFile),this);
+      // in WAL mode, commits only touch the database file at checkpoints
+      if (QFile::exists(databaseFile + "-wal"))
+        {
+        watcher->addPath(databaseFile + "-wal");
+        }
       connect(watcher, SIGNAL(fileChanged(QString)),this, SIGNAL (databaseChanged()) );
     }
 
   // set up the tag cache for use later
+  d->resetTagCacheStatements();
+  d->clearTagMemoryCache();
   QFileInfo fileInfo(d->DatabaseFileName);
   d->TagCacheDatabaseFilename = QString( fileInfo.dir().path() + "/ctkDICOMTagCache.sql" );
   d->TagCacheVerified = false;
@@ -252,6 +896,17 @@ ctkDICOMDatabase::ctkDICOMDatabase(QObject* parent)
 //------------------------------------------------------------------------------
 ctkDICOMDatabase::~ctkDICOMDatabase()
 {
+  Q_D(ctkDICOMDatabase);
+  // the backfill job and the thumbnail workers emit signals of this object
+  this->cancelTagCacheBackfill();
+  this->cancelThumbnails();
+  this->waitForTagCacheBackfill();
+  this->waitForThumbnails();
+  this->waitForFileReclamation();
+  if (d->SharedConnection)
+    {
+    this->closeDatabase();
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -285,107 +940,1011 @@ const QSqlDatabase& ctkDICOMDatabase::database() const {
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabase::setThumbnailGenerator(ctkDICOMAbstractThumbnailGenerator *generator){
+QSqlDatabase ctkDICOMDatabase::readOnlyDatabase()
+{
   Q_D(ctkDICOMDatabase);
-  d->thumbnailGenerator = generator;
-}
+  // a second connection to ":memory:" would be another, empty, database
+  if (this->isInMemory() || !d->Database.isOpen())
+    {
+    return d->Database;
+    }
 
-//------------------------------------------------------------------------------
-ctkDICOMAbstractThumbnailGenerator* ctkDICOMDatabase::thumbnailGenerator(){
-  Q_D(const ctkDICOMDatabase);
-  return d->thumbnailGenerator;
+  ctkDICOMDatabaseReaderConnection* connection = d->ReaderConnections.localData();
+  if (connection && connection->DatabaseFileName == d->DatabaseFileName)
+    {
+    return QSqlDatabase::database(connection->ConnectionName);
+    }
+  // the database has been reopened on another file since
+  d->ReaderConnections.setLocalData(0);
+
+  const QString connectionName = QString("%1-reader-%2")
+    .arg(d->Database.connectionName())
+    .arg(reinterpret_cast<quintptr>(QThread::currentThread()), 0, 16);
+  bool opened = false;
+  {
+  QSqlDatabase reader = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+  reader.setDatabaseName(d->DatabaseFileName);
+  reader.setConnectOptions("QSQLITE_OPEN_READONLY");
+  opened = reader.open();
+  if (opened)
+    {
+    d->applyPerformanceProfile(reader, true);
+    }
+  else
+    {
+    logger.error("Could not open read-only connection: " + reader.lastError().text());
+    }
+  }
+  if (!opened)
+    {
+    QSqlDatabase::removeDatabase(connectionName);
+    return d->Database;
+    }
+  connection = new ctkDICOMDatabaseReaderConnection;
+  connection->ConnectionName = connectionName;
+  connection->DatabaseFileName = d->DatabaseFileName;
+  d->ReaderConnections.setLocalData(connection);
+  return QSqlDatabase::database(connectionName);
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabasePrivate::executeScript(const QString script) {
-  QFile scriptFile(script);
-  scriptFile.open(QIODevice::ReadOnly);
-  if  ( !scriptFile.isOpen() )
+bool ctkDICOMDatabase::openSharedDatabase(ctkDICOMDatabase& database)
+{
+  Q_D(ctkDICOMDatabase);
+  ctkDICOMDatabasePrivate* shared = database.d_func();
+  if (d->Database.isOpen())
     {
-      qDebug() << "Script file " << script << " could not be opened!\n";
-      return false;
+    this->closeDatabase();
     }
+  QString sharedConnectionName;
+  {
+  QMutexLocker lock(&shared->insertMutex);
+  if (!shared->Database.isOpen() || database.isInMemory())
+    {
+    d->LastError = QString("The database can't be shared with another thread");
+    return false;
+    }
+  sharedConnectionName = shared->Database.connectionName();
+  d->DatabaseFileName = shared->DatabaseFileName;
+  d->TagCacheDatabaseFilename = shared->TagCacheDatabaseFilename;
+  d->Profile = shared->Profile;
+  d->InsertBatchSize = shared->InsertBatchSize;
+  d->TagsToPrecache = shared->TagsToPrecache;
+  d->TagKeysToPrecache = shared->TagKeysToPrecache;
+  d->ThumbnailQueue = shared->ThumbnailQueue;
+  }
+  d->resetInsertStatements();
+  d->resetInsertCaches();
+  d->resetTagCacheStatements();
+  d->clearTagMemoryCache();
+  d->TagCacheVerified = false;
 
-  QString sqlCommands( QTextStream(&scriptFile).readAll() );
-  sqlCommands.replace( '\n', ' ' );
-  sqlCommands.remove( '\r' );
-  sqlCommands.replace("; ", ";\n");
-
-  QStringList sqlCommandsLines = sqlCommands.split('\n');
-
-  QSqlQuery query(Database);
-
-  for (QStringList::iterator it = sqlCommandsLines.begin(); it != sqlCommandsLines.end()-1; ++it)
+  // named after this object, several threads can share the same database
+  const QString connectionName = QString("%1-shared-%2")
+    .arg(sharedConnectionName)
+    .arg(reinterpret_cast<quintptr>(this), 0, 16);
+  d->Database = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+  d->Database.setDatabaseName(d->DatabaseFileName);
+  d->SharedConnection = true;
+  if (!d->Database.open())
     {
-      if (! (*it).startsWith("--") )
-        {
-          qDebug() << *it << "\n";
-          query.exec(*it);
-          if (query.lastError().type())
-            {
-              qDebug() << "There was an error during execution of the statement: " << (*it);
-              qDebug() << "Error message: " << query.lastError().text();
-              return false;
-            }
-        }
+    d->LastError = d->Database.lastError().text();
+    this->closeDatabase();
+    return false;
     }
+  d->LastError = QString();
+  d->applyPerformanceProfile(d->Database, false);
   return true;
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::initializeDatabase(const char* sqlFileName)
+void ctkDICOMDatabase::setPerformanceProfile(PerformanceProfile profile)
 {
   Q_D(ctkDICOMDatabase);
-  return d->executeScript(sqlFileName);
+  d->Profile = profile;
+  if (!d->Database.isOpen())
+    {
+    return;
+    }
+  if (d->BatchInsertActive)
+    {
+    // the journal mode can't be changed within a transaction
+    logger.warn("Performance profile will be applied when the database is reopened");
+    return;
+    }
+  d->applyPerformanceProfile(d->Database, false);
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabase::closeDatabase()
+ctkDICOMDatabase::PerformanceProfile ctkDICOMDatabase::performanceProfile() const
 {
+  Q_D(const ctkDICOMDatabase);
+  return d->Profile;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setThumbnailGenerator(ctkDICOMAbstractThumbnailGenerator *generator){
   Q_D(ctkDICOMDatabase);
-  d->Database.close();
-  d->TagCacheDatabase.close();
+  QMutexLocker locker(&d->ThumbnailMutex);
+  d->thumbnailGenerator = generator;
 }
 
-//
-// Patient/study/series convenience methods
-//
+//------------------------------------------------------------------------------
+ctkDICOMAbstractThumbnailGenerator* ctkDICOMDatabase::thumbnailGenerator(){
+  Q_D(const ctkDICOMDatabase);
+  QMutexLocker locker(&d->ThumbnailMutex);
+  return d->thumbnailGenerator;
+}
 
 //------------------------------------------------------------------------------
-QStringList ctkDICOMDatabase::patients()
+bool ctkDICOMDatabasePrivate::hasThumbnailGenerator() const
 {
-  Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
-  query.prepare ( "SELECT UID FROM Patients" );
-  query.exec();
-  QStringList result;
-  while (query.next())
+  QMutexLocker locker(&this->ThumbnailMutex);
+  return this->thumbnailGenerator != 0;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabasePrivate::thumbnailStoreFileName()
+{
+  Q_Q(ctkDICOMDatabase);
+  if (q->isInMemory())
     {
-      result << query.value(0).toString();
+    // several in-memory databases can be open at once
+    return QDir::temp().absoluteFilePath(
+      QString("ctkDICOMThumbnails-%1.dat").arg(reinterpret_cast<quintptr>(this), 0, 16));
     }
-  return( result );
+  // ctkDICOMThumbnails.dat for ctkDICOM.sql
+  return q->databaseDirectory() + "/"
+    + QFileInfo(this->DatabaseFileName).completeBaseName() + "Thumbnails.dat";
 }
 
 //------------------------------------------------------------------------------
-QStringList ctkDICOMDatabase::studiesForPatient(QString dbPatientID)
+void ctkDICOMDatabasePrivate::openThumbnailStore()
 {
-  Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
-  query.prepare ( "SELECT StudyInstanceUID FROM Studies WHERE PatientsUID = ?" );
-  query.bindValue ( 0, dbPatientID );
-  query.exec();
-  QStringList result;
-  while (query.next())
+  Q_Q(ctkDICOMDatabase);
+  const QString fileName = this->thumbnailStoreFileName();
+  if (q->isInMemory())
     {
-      result << query.value(0).toString();
+    QFile::remove(fileName);
+    }
+  this->ThumbnailStore.open(fileName);
+  if (this->ThumbnailStore.size() == 0)
+    {
+    // the thumbnails are generated again when needed
+    QSqlQuery query(this->Database);
+    this->loggedExec(query, "DELETE FROM Thumbnails");
     }
-  return( result );
 }
 
 //------------------------------------------------------------------------------
-QStringList ctkDICOMDatabase::seriesForStudy(QString studyUID)
+QString ctkDICOMDatabasePrivate::legacyThumbnailPath(const QString& studyInstanceUID,
+                                                     const QString& seriesInstanceUID,
+                                                     const QString& sopInstanceUID)
 {
-  Q_D(ctkDICOMDatabase);
+  Q_Q(ctkDICOMDatabase);
+  return q->databaseDirectory() + "/thumbs/" + studyInstanceUID + "/"
+    + seriesInstanceUID + "/" + sopInstanceUID + ".png";
+}
+
+//------------------------------------------------------------------------------
+uint ctkDICOMDatabasePrivate::storedThumbnailTime(const QString& sopInstanceUID)
+{
+  // the Thumbnails table is written through Database, in the pending batch
+  QSqlQuery query(this->Database);
+  query.prepare("SELECT ModifiedTime FROM Thumbnails WHERE SOPInstanceUID = ?");
+  query.bindValue(0, sopInstanceUID);
+  if (!query.exec() || !query.next())
+    {
+    return 0;
+    }
+  return query.value(0).toUInt();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::storeThumbnail(const QString& sopInstanceUID,
+                                             const QString& seriesInstanceUID,
+                                             qint64 dataOffset, int dataSize, uint modifiedTime)
+{
+  QSqlQuery query(this->Database);
+  query.prepare("INSERT OR REPLACE INTO Thumbnails ( 'SOPInstanceUID', 'SeriesInstanceUID', "
+                "'DataOffset', 'DataSize', 'ModifiedTime' ) VALUES ( ?, ?, ?, ?, ? )");
+  query.bindValue(0, sopInstanceUID);
+  query.bindValue(1, seriesInstanceUID);
+  query.bindValue(2, dataOffset);
+  query.bindValue(3, dataSize);
+  query.bindValue(4, modifiedTime);
+  return this->loggedExec(query);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::queueThumbnail(const ctkDICOMThumbnailRequest& request, bool requested)
+{
+  QMutexLocker locker(&this->ThumbnailMutex);
+  if (this->PendingThumbnails.contains(request.SOPInstanceUID)
+      || this->ThumbnailsInProgress.contains(request.SOPInstanceUID))
+    {
+    return false;
+    }
+  this->PendingThumbnails.insert(request.SOPInstanceUID);
+  if (requested)
+    {
+    this->RequestedThumbnails.enqueue(request);
+    }
+  else
+    {
+    if (!this->QueuedThumbnails.contains(request.SeriesInstanceUID))
+      {
+      this->QueuedThumbnailSeries << request.SeriesInstanceUID;
+      }
+    this->QueuedThumbnails[request.SeriesInstanceUID].enqueue(request);
+    }
+  this->ThumbnailThreadPool.start(new ctkDICOMThumbnailWorker(this));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::takeThumbnailRequest(ctkDICOMThumbnailRequest& request)
+{
+  if (!this->RequestedThumbnails.isEmpty())
+    {
+    request = this->RequestedThumbnails.dequeue();
+    return true;
+    }
+  if (this->QueuedThumbnailSeries.isEmpty())
+    {
+    return false;
+    }
+  QString seriesInstanceUID = this->QueuedThumbnailSeries.first();
+  foreach (const QString& visibleSeries, this->VisibleThumbnailSeries)
+    {
+    if (this->QueuedThumbnails.contains(visibleSeries))
+      {
+      seriesInstanceUID = visibleSeries;
+      break;
+      }
+    }
+  QQueue<ctkDICOMThumbnailRequest>& queue = this->QueuedThumbnails[seriesInstanceUID];
+  request = queue.dequeue();
+  if (queue.isEmpty())
+    {
+    this->QueuedThumbnails.remove(seriesInstanceUID);
+    this->QueuedThumbnailSeries.removeOne(seriesInstanceUID);
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::generateNextThumbnail()
+{
+  Q_Q(ctkDICOMDatabase);
+  ctkDICOMThumbnailRequest request;
+  ctkDICOMAbstractThumbnailGenerator* generator = 0;
+  {
+    QMutexLocker locker(&this->ThumbnailMutex);
+    // there are more workers than requests after cancelThumbnails()
+    if (!this->takeThumbnailRequest(request))
+      {
+      return;
+      }
+    this->PendingThumbnails.remove(request.SOPInstanceUID);
+    this->ThumbnailsInProgress.insert(request.SOPInstanceUID);
+    generator = this->thumbnailGenerator;
+  }
+
+  ctkDICOMGeneratedThumbnail thumbnail;
+  thumbnail.SOPInstanceUID = request.SOPInstanceUID;
+  thumbnail.SeriesInstanceUID = request.SeriesInstanceUID;
+  bool available = false;
+  QFileInfo fileInfo(request.FilePath);
+  if (generator && fileInfo.exists())
+    {
+    const uint modifiedTime = fileInfo.lastModified().toTime_t();
+    available = request.ThumbnailTime >= modifiedTime;
+    if (!available)
+      {
+      DicomImage dcmImage(QDir::toNativeSeparators(request.FilePath).toAscii());
+      QByteArray data;
+      if (generator->generateThumbnailData(&dcmImage, data))
+        {
+        thumbnail.DataOffset = this->ThumbnailStore.append(data);
+        thumbnail.DataSize = data.size();
+        thumbnail.ModifiedTime = modifiedTime;
+        available = thumbnail.DataOffset >= 0;
+        }
+      }
+    }
+
+  bool queueStore = false;
+  {
+    QMutexLocker locker(&this->ThumbnailMutex);
+    if (!available)
+      {
+      this->ThumbnailsInProgress.remove(request.SOPInstanceUID);
+      return;
+      }
+    // in progress until its row is written
+    this->GeneratedThumbnails << thumbnail;
+    queueStore = !this->StoreThumbnailsQueued;
+    this->StoreThumbnailsQueued = true;
+  }
+  if (queueStore)
+    {
+    QMetaObject::invokeMethod(q, "storeGeneratedThumbnails", Qt::QueuedConnection);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::storeGeneratedThumbnails()
+{
+  Q_Q(ctkDICOMDatabase);
+  QList<ctkDICOMGeneratedThumbnail> generated;
+  {
+    QMutexLocker locker(&this->ThumbnailMutex);
+    generated = this->GeneratedThumbnails;
+    this->GeneratedThumbnails.clear();
+    this->StoreThumbnailsQueued = false;
+  }
+  if (generated.isEmpty())
+    {
+    return true;
+    }
+
+  // the rows go in the pending batch if any, in a transaction of their own
+  // otherwise
+  int storedCount = 0;
+  int writtenRows = 0;
+  {
+  QMutexLocker lock(&this->insertMutex);
+  const bool ownTransaction = !this->BatchInsertActive && this->Database.transaction();
+  while (storedCount < generated.count())
+    {
+    const ctkDICOMGeneratedThumbnail& thumbnail = generated[storedCount];
+    if (thumbnail.DataOffset >= 0
+        && !this->storeThumbnail(thumbnail.SOPInstanceUID, thumbnail.SeriesInstanceUID,
+                                 thumbnail.DataOffset, thumbnail.DataSize,
+                                 thumbnail.ModifiedTime))
+      {
+      break;
+      }
+    if (thumbnail.DataOffset >= 0)
+      {
+      ++writtenRows;
+      }
+    ++storedCount;
+    }
+  if (ownTransaction && !this->Database.commit())
+    {
+    logger.error("SQLITE ERROR: could not store thumbnails: " + this->Database.lastError().text());
+    this->Database.rollback();
+    storedCount = 0;
+    }
+  // a batch opened for regenerateThumbnails() is committed every
+  // InsertBatchSize rows, here rather than in the workers
+  if (this->BatchInsertActive)
+    {
+    this->PendingBatchInserts += writtenRows;
+    if (this->PendingBatchInserts >= this->InsertBatchSize)
+      {
+      this->flushBatchInsert();
+      }
+    }
+  }
+
+  {
+    QMutexLocker locker(&this->ThumbnailMutex);
+    for (int i = 0; i < storedCount; ++i)
+      {
+      this->ThumbnailsInProgress.remove(generated[i].SOPInstanceUID);
+      }
+    if (storedCount < generated.count())
+      {
+      // e.g. the database is locked by an import: written with the next
+      // generated thumbnail or by waitForThumbnails()
+      logger.warn(QString("Could not store %1 thumbnails, kept for later")
+                  .arg(generated.count() - storedCount));
+      this->GeneratedThumbnails = generated.mid(storedCount) + this->GeneratedThumbnails;
+      }
+  }
+  for (int i = 0; i < storedCount; ++i)
+    {
+    emit q->thumbnailGenerated(generated[i].SOPInstanceUID);
+    }
+  return storedCount == generated.count();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setThumbnailThreadCount(int threadCount)
+{
+  Q_D(ctkDICOMDatabase);
+  d->ThumbnailThreadPool.setMaxThreadCount(qMax(1, threadCount));
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::thumbnailThreadCount() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->ThumbnailThreadPool.maxThreadCount();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::requestThumbnail(const QString& sopInstanceUID)
+{
+  Q_D(ctkDICOMDatabase);
+  if (!d->hasThumbnailGenerator())
+    {
+    return false;
+    }
+  // called from the GUI while an import may be using database()
+  QSqlQuery query(this->readOnlyDatabase());
+  query.prepare("SELECT Images.Filename, Images.SeriesInstanceUID, Thumbnails.ModifiedTime "
+                "FROM Images LEFT JOIN Thumbnails "
+                "ON Images.SOPInstanceUID = Thumbnails.SOPInstanceUID "
+                "WHERE Images.SOPInstanceUID = ?");
+  query.bindValue(0, sopInstanceUID);
+  if (!query.exec() || !query.next())
+    {
+    return false;
+    }
+  ctkDICOMThumbnailRequest request;
+  request.SOPInstanceUID = sopInstanceUID;
+  request.FilePath = query.value(0).toString();
+  request.SeriesInstanceUID = query.value(1).toString();
+  // NULL, hence 0, if there is no thumbnail yet
+  request.ThumbnailTime = query.value(2).toUInt();
+  d->queueThumbnail(request, true);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::regenerateThumbnails(bool allInstances, bool force)
+{
+  Q_D(ctkDICOMDatabase);
+  if (!d->hasThumbnailGenerator())
+    {
+    return -1;
+    }
+
+  // the images of a series are consecutive, sorted by file name
+  QList<ctkDICOMThumbnailRequest> candidates;
+  QList<QPair<uint, uint> > candidateTimes;
+  {
+  QMutexLocker lock(&d->insertMutex);
+  QSqlQuery query(d->Database);
+  query.setForwardOnly(true);
+  if (!d->loggedExec(query,
+        "SELECT Images.SOPInstanceUID, Images.SeriesInstanceUID, Images.Filename, "
+        "DirectoryFiles.ModifiedTime, Thumbnails.ModifiedTime FROM Images "
+        "LEFT JOIN DirectoryFiles ON Images.Filename = DirectoryFiles.Filename "
+        "LEFT JOIN Thumbnails ON Images.SOPInstanceUID = Thumbnails.SOPInstanceUID "
+        "ORDER BY Images.SeriesInstanceUID, Images.Filename"))
+    {
+    return 0;
+    }
+  QList<ctkDICOMThumbnailRequest> series;
+  QList<QPair<uint, uint> > seriesTimes;
+  bool more = true;
+  while (more)
+    {
+    more = query.next();
+    if (!series.isEmpty()
+        && (!more || query.value(1).toString() != series.first().SeriesInstanceUID))
+      {
+      // the middle image, as shown by ctkDICOMThumbnailListWidget
+      const int first = allInstances ? 0 : series.count() / 2;
+      const int count = allInstances ? series.count() : 1;
+      candidates += series.mid(first, count);
+      candidateTimes += seriesTimes.mid(first, count);
+      series.clear();
+      seriesTimes.clear();
+      }
+    if (more)
+      {
+      ctkDICOMThumbnailRequest request;
+      request.SOPInstanceUID = query.value(0).toString();
+      request.SeriesInstanceUID = query.value(1).toString();
+      request.FilePath = query.value(2).toString();
+      series << request;
+      // 0 if the file isn't in a directory manifest, or has no thumbnail
+      seriesTimes << qMakePair(query.value(3).toUInt(), query.value(4).toUInt());
+      }
+    }
+  }
+
+  // files indexed in place have their modification time in the manifest,
+  // the stored copies are looked at
+  QList<ctkDICOMThumbnailRequest> staleThumbnails;
+  for (int i = 0; i < candidates.count(); ++i)
+    {
+    uint fileTime = candidateTimes[i].first;
+    if (fileTime == 0)
+      {
+      QFileInfo fileInfo(candidates[i].FilePath);
+      if (!fileInfo.exists())
+        {
+        continue;
+        }
+      fileTime = fileInfo.lastModified().toTime_t();
+      }
+    const uint thumbnailTime = candidateTimes[i].second;
+    if (force || thumbnailTime == 0 || thumbnailTime < fileTime)
+      {
+      // queued with no ThumbnailTime, to be generated again
+      staleThumbnails << candidates[i];
+      }
+    }
+
+  if (force && !staleThumbnails.isEmpty())
+    {
+    // forgotten first, so that a canceled regeneration is resumed without
+    // forcing it again
+    QMutexLocker lock(&d->insertMutex);
+    const bool ownTransaction = !d->BatchInsertActive && d->Database.transaction();
+    QSqlQuery remove(d->Database);
+    remove.prepare("DELETE FROM Thumbnails WHERE SOPInstanceUID = ?");
+    foreach (const ctkDICOMThumbnailRequest& request, staleThumbnails)
+      {
+      remove.bindValue(0, request.SOPInstanceUID);
+      d->loggedExec(remove);
+      }
+    if (ownTransaction)
+      {
+      d->Database.commit();
+      }
+    }
+
+  int queued = 0;
+  foreach (const ctkDICOMThumbnailRequest& request, staleThumbnails)
+    {
+    if (d->queueThumbnail(request, false))
+      {
+      ++queued;
+      }
+    }
+  logger.info(QString("Regenerating %1 thumbnails, %2 up to date")
+              .arg(queued).arg(candidates.count() - staleThumbnails.count()));
+  return queued;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setVisibleThumbnailSeries(const QStringList& seriesInstanceUIDs)
+{
+  Q_D(ctkDICOMDatabase);
+  QMutexLocker locker(&d->ThumbnailMutex);
+  d->VisibleThumbnailSeries = seriesInstanceUIDs;
+}
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMDatabase::visibleThumbnailSeries() const
+{
+  Q_D(const ctkDICOMDatabase);
+  QMutexLocker locker(&d->ThumbnailMutex);
+  return d->VisibleThumbnailSeries;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::cancelThumbnails()
+{
+  Q_D(ctkDICOMDatabase);
+  QMutexLocker locker(&d->ThumbnailMutex);
+  d->RequestedThumbnails.clear();
+  d->QueuedThumbnails.clear();
+  d->QueuedThumbnailSeries.clear();
+  d->PendingThumbnails.clear();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::pendingThumbnailCount() const
+{
+  Q_D(const ctkDICOMDatabase);
+  QMutexLocker locker(&d->ThumbnailMutex);
+  return d->PendingThumbnails.count() + d->ThumbnailsInProgress.count();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::waitForThumbnails()
+{
+  Q_D(ctkDICOMDatabase);
+  d->ThumbnailThreadPool.waitForDone();
+  return d->storeGeneratedThumbnails();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::storeGeneratedThumbnails()
+{
+  Q_D(ctkDICOMDatabase);
+  d->storeGeneratedThumbnails();
+}
+
+//------------------------------------------------------------------------------
+QByteArray ctkDICOMDatabase::thumbnailData(const QString& sopInstanceUID)
+{
+  Q_D(ctkDICOMDatabase);
+  QString studyInstanceUID;
+  QString seriesInstanceUID;
+  {
+  QMutexLocker lock(&d->insertMutex);
+  QSqlQuery query(d->Database);
+  query.prepare("SELECT DataOffset, DataSize FROM Thumbnails WHERE SOPInstanceUID = ?");
+  query.bindValue(0, sopInstanceUID);
+  if (query.exec() && query.next())
+    {
+    return d->ThumbnailStore.read(query.value(0).toLongLong(), query.value(1).toInt());
+    }
+  query.prepare("SELECT Series.StudyInstanceUID, Series.SeriesInstanceUID FROM Images, Series "
+                "WHERE Images.SeriesInstanceUID = Series.SeriesInstanceUID AND Images.SOPInstanceUID = ?");
+  query.bindValue(0, sopInstanceUID);
+  if (!query.exec() || !query.next())
+    {
+    return QByteArray();
+    }
+  studyInstanceUID = query.value(0).toString();
+  seriesInstanceUID = query.value(1).toString();
+  }
+  // not migrated yet
+  QFile legacyThumbnail(d->legacyThumbnailPath(studyInstanceUID, seriesInstanceUID, sopInstanceUID));
+  if (!legacyThumbnail.open(QIODevice::ReadOnly))
+    {
+    return QByteArray();
+    }
+  return legacyThumbnail.readAll();
+}
+
+//------------------------------------------------------------------------------
+QMap<QString, QByteArray> ctkDICOMDatabase::seriesThumbnailData(const QString& seriesInstanceUID)
+{
+  Q_D(ctkDICOMDatabase);
+  QMap<QString, QByteArray> thumbnails;
+  QMutexLocker lock(&d->insertMutex);
+  QSqlQuery query(d->Database);
+  query.setForwardOnly(true);
+  query.prepare("SELECT SOPInstanceUID, DataOffset, DataSize FROM Thumbnails WHERE SeriesInstanceUID = ?");
+  query.bindValue(0, seriesInstanceUID);
+  if (!d->loggedExec(query))
+    {
+    return thumbnails;
+    }
+  while (query.next())
+    {
+    thumbnails[query.value(0).toString()] =
+      d->ThumbnailStore.read(query.value(1).toLongLong(), query.value(2).toInt());
+    }
+  return thumbnails;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::migrateThumbnailFiles()
+{
+  Q_D(ctkDICOMDatabase);
+  const QString thumbsDirectory = this->databaseDirectory() + "/thumbs";
+  if (!QFileInfo(thumbsDirectory).isDir())
+    {
+    return 0;
+    }
+
+  bool ownBatch = !this->isBatchInsertActive() && this->beginBatchInsert();
+  int migrated = 0;
+  QStringList directories;
+  QDirIterator it(thumbsDirectory, QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot,
+                  QDirIterator::Subdirectories);
+  while (it.hasNext())
+    {
+    const QString path = it.next();
+    const QFileInfo thumbnailInfo = it.fileInfo();
+    if (thumbnailInfo.isDir())
+      {
+      directories << path;
+      continue;
+      }
+    if (thumbnailInfo.suffix() != "png")
+      {
+      continue;
+      }
+    // thumbs/<study>/<series>/<sop>.png
+    const QString sopInstanceUID = thumbnailInfo.completeBaseName();
+    const QString seriesInstanceUID = thumbnailInfo.dir().dirName();
+    QMutexLocker lock(&d->insertMutex);
+    bool stored = d->storedThumbnailTime(sopInstanceUID) != 0;
+    if (!stored)
+      {
+      QByteArray data;
+      {
+      QFile thumbnail(path);
+      data = thumbnail.open(QIODevice::ReadOnly) ? thumbnail.readAll() : QByteArray();
+      }
+      const qint64 offset = data.isEmpty() ? -1 : d->ThumbnailStore.append(data);
+      stored = offset >= 0
+        && d->storeThumbnail(sopInstanceUID, seriesInstanceUID, offset, data.size(),
+                             thumbnailInfo.lastModified().toTime_t());
+      if (stored && d->BatchInsertActive && ++d->PendingBatchInserts >= d->InsertBatchSize)
+        {
+        d->flushBatchInsert();
+        }
+      }
+    if (stored)
+      {
+      QFile::remove(path);
+      ++migrated;
+      }
+    }
+
+  if (ownBatch)
+    {
+    this->commitBatchInsert();
+    }
+
+  // deepest directories first, the ones still containing files are kept
+  for (int i = directories.count() - 1; i >= 0; --i)
+    {
+    QDir().rmdir(directories[i]);
+    }
+  QDir().rmdir(thumbsDirectory);
+  logger.info(QString("Migrated %1 thumbnails to %2").arg(migrated).arg(d->thumbnailStoreFileName()));
+  return migrated;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::compactThumbnails()
+{
+  Q_D(ctkDICOMDatabase);
+  if (d->BatchInsertActive)
+    {
+    return false;
+    }
+  this->cancelThumbnails();
+  this->waitForThumbnails();
+
+  QMutexLocker lock(&d->insertMutex);
+  const QString fileName = d->thumbnailStoreFileName();
+  const QString compactedFileName = fileName + ".compact";
+  QFile::remove(compactedFileName);
+  ctkDICOMThumbnailStore compacted;
+  if (!compacted.open(compactedFileName) || !d->Database.transaction())
+    {
+    return false;
+    }
+  QSqlQuery select(d->Database);
+  select.setForwardOnly(true);
+  QSqlQuery update(d->Database);
+  update.prepare("UPDATE Thumbnails SET DataOffset = ? WHERE SOPInstanceUID = ?");
+  bool result = select.exec("SELECT SOPInstanceUID, DataOffset, DataSize FROM Thumbnails ORDER BY DataOffset");
+  while (result && select.next())
+    {
+    const qint64 offset = compacted.append(
+      d->ThumbnailStore.read(select.value(1).toLongLong(), select.value(2).toInt()));
+    update.bindValue(0, offset);
+    update.bindValue(1, select.value(0));
+    result = offset >= 0 && d->loggedExec(update);
+    }
+  select.finish();
+  compacted.close();
+  if (!result || !d->Database.commit())
+    {
+    d->Database.rollback();
+    QFile::remove(compactedFileName);
+    return false;
+    }
+
+  d->ThumbnailStore.close();
+  if (!QFile::remove(fileName) || !QFile::rename(compactedFileName, fileName))
+    {
+    logger.error("Failed to replace " + fileName + " by " + compactedFileName);
+    QSqlQuery clear(d->Database);
+    d->loggedExec(clear, "DELETE FROM Thumbnails");
+    result = false;
+    }
+  d->ThumbnailStore.open(fileName);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::executeScript(const QString script) {
+  QFile scriptFile(script);
+  scriptFile.open(QIODevice::ReadOnly);
+  if  ( !scriptFile.isOpen() )
+    {
+      qDebug() << "Script file " << script << " could not be opened!\n";
+      return false;
+    }
+
+  QString sqlCommands( QTextStream(&scriptFile).readAll() );
+  sqlCommands.replace( '\n', ' ' );
+  sqlCommands.remove( '\r' );
+  sqlCommands.replace("; ", ";\n");
+
+  QStringList sqlCommandsLines = sqlCommands.split('\n');
+
+  QSqlQuery query(Database);
+
+  QString statement;
+  for (QStringList::iterator it = sqlCommandsLines.begin(); it != sqlCommandsLines.end()-1; ++it)
+    {
+      statement += *it;
+      // the body of a trigger holds several statements, up to END
+      if ( statement.trimmed().startsWith("CREATE TRIGGER", Qt::CaseInsensitive)
+           && !statement.trimmed().endsWith("END;", Qt::CaseInsensitive) )
+        {
+          statement += " ";
+          continue;
+        }
+      if (! statement.trimmed().startsWith("--") )
+        {
+          logger.debug(statement);
+          query.exec(statement);
+          if (query.lastError().type())
+            {
+              qDebug() << "There was an error during execution of the statement: " << statement;
+              qDebug() << "Error message: " << query.lastError().text();
+              return false;
+            }
+        }
+      statement.clear();
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::updateSchema()
+{
+  Q_Q(ctkDICOMDatabase);
+  int version = q->schemaVersionLoaded();
+  if (version == ctkDICOMDatabase::schemaVersion())
+    {
+    return true;
+    }
+  if (version > ctkDICOMDatabase::schemaVersion())
+    {
+    logger.error(QString("DICOM database schema version %1 is newer than the supported version %2")
+                 .arg(version).arg(ctkDICOMDatabase::schemaVersion()));
+    return false;
+    }
+
+  // the tables are altered in place, the data is kept
+  this->resetInsertStatements();
+  if (!this->Database.transaction())
+    {
+    logger.error("SQLITE ERROR: could not start schema update: " + this->Database.lastError().text());
+    return false;
+    }
+  while (version < ctkDICOMDatabase::schemaVersion())
+    {
+    ++version;
+    logger.info(QString("Updating DICOM database schema to version %1").arg(version));
+    if (!this->executeScript(QString(":/dicom/dicom-schema-update-%1.sql").arg(version)))
+      {
+      this->Database.rollback();
+      return false;
+      }
+    }
+  return this->Database.commit();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::schemaVersion()
+{
+  // must match the version in the SchemaInfo table of dicom-schema.sql
+  return 4;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::schemaVersionLoaded()
+{
+  Q_D(ctkDICOMDatabase);
+  // databases created before the schema was versioned have no SchemaInfo
+  if (!d->Database.tables().contains("SchemaInfo"))
+    {
+    return 0;
+    }
+  QSqlQuery versionQuery(d->Database);
+  if (!d->loggedExec(versionQuery, "SELECT Version FROM SchemaInfo") || !versionQuery.next())
+    {
+    return 0;
+    }
+  return versionQuery.value(0).toInt();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::initializeDatabase(const char* sqlFileName)
+{
+  Q_D(ctkDICOMDatabase);
+  if (d->BatchInsertActive)
+    {
+    this->rollbackBatchInsert();
+    }
+  d->resetInsertStatements();
+  d->resetInsertCaches();
+  if (!d->executeScript(sqlFileName))
+    {
+    return false;
+    }
+  d->ensureSearchIndex();
+  // the thumbnails of the previous content are not indexed anymore
+  if (d->ThumbnailStore.isOpen())
+    {
+    this->cancelThumbnails();
+    this->waitForThumbnails();
+    d->ThumbnailStore.close();
+    QFile::remove(d->thumbnailStoreFileName());
+    d->ThumbnailStore.open(d->thumbnailStoreFileName());
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::closeDatabase()
+{
+  Q_D(ctkDICOMDatabase);
+  if (d->BatchInsertActive)
+    {
+    this->commitBatchInsert();
+    }
+  this->cancelThumbnails();
+  this->waitForThumbnails();
+  d->resetInsertStatements();
+  d->resetTagCacheStatements();
+  d->ReaderConnections.setLocalData(0);
+  d->ThumbnailStore.close();
+  if (this->isInMemory())
+    {
+    QFile::remove(d->thumbnailStoreFileName());
+    }
+  d->Database.close();
+  d->TagCacheDatabase.close();
+  if (d->SharedConnection)
+    {
+    // the connections can't outlive the handles referring to them
+    const QString connectionName = d->Database.connectionName();
+    const QString tagCacheConnectionName = d->TagCacheDatabase.connectionName();
+    d->Database = QSqlDatabase();
+    d->TagCacheDatabase = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+    if (!tagCacheConnectionName.isEmpty())
+      {
+      QSqlDatabase::removeDatabase(tagCacheConnectionName);
+      }
+    d->SharedConnection = false;
+    d->ThumbnailQueue = d;
+    }
+}
+
+//
+// Patient/study/series convenience methods
+//
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMDatabase::patients()
+{
+  Q_D(ctkDICOMDatabase);
+  QSqlQuery query(d->Database);
+  query.prepare ( "SELECT UID FROM Patients" );
+  query.exec();
+  QStringList result;
+  while (query.next())
+    {
+      result << query.value(0).toString();
+    }
+  return( result );
+}
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMDatabase::studiesForPatient(QString dbPatientID)
+{
+  Q_D(ctkDICOMDatabase);
+  QSqlQuery query(d->Database);
+  query.prepare ( "SELECT StudyInstanceUID FROM Studies WHERE PatientsUID = ?" );
+  query.bindValue ( 0, dbPatientID );
+  query.exec();
+  QStringList result;
+  while (query.next())
+    {
+      result << query.value(0).toString();
+    }
+  return( result );
+}
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMDatabase::seriesForStudy(QString studyUID)
+{
+  Q_D(ctkDICOMDatabase);
   QSqlQuery query(d->Database);
   query.prepare ( "SELECT SeriesInstanceUID FROM Series WHERE StudyInstanceUID=?");
   query.bindValue ( 0, studyUID );
@@ -446,6 +2005,83 @@ QString ctkDICOMDatabase::instanceForFile(QString fileName)
   return( result );
 }
 
+//------------------------------------------------------------------------------
+qint64 ctkDICOMDatabasePrivate::aggregate(const QString& table, const QString& keyColumn,
+                                          const QString& key, const QString& column)
+{
+  QSqlQuery query(this->Database);
+  query.prepare ( QString("SELECT %1 FROM %2 WHERE %3 = ?").arg(column).arg(table).arg(keyColumn) );
+  query.bindValue ( 0, key );
+  if (!query.exec() || !query.next())
+    {
+    return 0;
+    }
+  return query.value(0).toLongLong();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::studyCountForPatient(const QString patientUID)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->aggregate("Patients", "UID", patientUID, "StudyCount");
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::seriesCountForPatient(const QString patientUID)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->aggregate("Patients", "UID", patientUID, "SeriesCount");
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::imageCountForPatient(const QString patientUID)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->aggregate("Patients", "UID", patientUID, "ImageCount");
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMDatabase::fileSizeForPatient(const QString patientUID)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->aggregate("Patients", "UID", patientUID, "TotalFileSize");
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::seriesCountForStudy(const QString studyUID)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->aggregate("Studies", "StudyInstanceUID", studyUID, "SeriesCount");
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::imageCountForStudy(const QString studyUID)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->aggregate("Studies", "StudyInstanceUID", studyUID, "ImageCount");
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMDatabase::fileSizeForStudy(const QString studyUID)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->aggregate("Studies", "StudyInstanceUID", studyUID, "TotalFileSize");
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::imageCountForSeries(const QString seriesUID)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->aggregate("Series", "SeriesInstanceUID", seriesUID, "ImageCount");
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMDatabase::fileSizeForSeries(const QString seriesUID)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->aggregate("Series", "SeriesInstanceUID", seriesUID, "TotalFileSize");
+}
+
 //
 // instance header methods
 //
@@ -515,49 +2151,117 @@ QString ctkDICOMDatabase::headerValue (QString key)
 //------------------------------------------------------------------------------
 QString ctkDICOMDatabase::instanceValue(QString sopInstanceUID, QString tag)
 {
-  QString value = this->cachedTag(sopInstanceUID, tag);
-  if (value != "")
-    {
-    return value;
-    }
   unsigned short group, element;
   this->tagToGroupElement(tag, group, element);
   return( this->instanceValue(sopInstanceUID, group, element) );
 }
 
-//------------------------------------------------------------------------------
-QString ctkDICOMDatabase::instanceValue(const QString sopInstanceUID, const unsigned short group, const unsigned short element)
-{
-  QString tag = this->groupElementToTag(group,element);
-  QString value = this->cachedTag(sopInstanceUID, tag);
-  if (value != "")
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabase::instanceValue(const QString sopInstanceUID, const unsigned short group, const unsigned short element)
+{
+  Q_D(ctkDICOMDatabase);
+  QString tag = this->groupElementToTag(group,element);
+  QString value;
+  if (d->lookupCachedTag(sopInstanceUID, tag, value))
+    {
+    return value;
+    }
+  QString filePath = this->fileForInstance(sopInstanceUID);
+  if (filePath != "" )
+    {
+    ctkDICOMDataset dataset;
+    dataset.InitializeFromFileTags(filePath, QList<DcmTagKey>() << DcmTagKey(group, element));
+    value = dataset.GetAllElementValuesAsString(DcmTagKey(group, element));
+    this->cacheTag(sopInstanceUID, tag, value);
+    return( value );
+    }
+  else
+    {
+    return ("");
+    }
+}
+
+//------------------------------------------------------------------------------
+QMap<QString, QStringList> ctkDICOMDatabase::instanceValues(const QStringList& sopInstanceUIDs, const QStringList& tags)
+{
+  Q_D(ctkDICOMDatabase);
+  QMap<QString, QStringList> values;
+
+  // same spelling as instanceValue() so that both share the cache entries
+  QList<DcmTagKey> tagKeys;
+  QStringList cacheTags;
+  foreach (const QString& tag, tags)
+    {
+    unsigned short group = 0, element = 0;
+    this->tagToGroupElement(tag, group, element);
+    tagKeys << DcmTagKey(group, element);
+    cacheTags << this->groupElementToTag(group, element);
+    }
+
+  // first pass: memory and TagCache table
+  QMap<QString, QList<int> > missingTagIndices;
+  foreach (const QString& sopInstanceUID, sopInstanceUIDs)
     {
-    return value;
+    QStringList& instanceValues = values[sopInstanceUID];
+    for (int i = 0; i < cacheTags.count(); ++i)
+      {
+      QString value;
+      if (!d->lookupCachedTag(sopInstanceUID, cacheTags[i], value))
+        {
+        missingTagIndices[sopInstanceUID] << i;
+        }
+      instanceValues << value;
+      }
     }
-  QString filePath = this->fileForInstance(sopInstanceUID);
-  if (filePath != "" )
+  if (missingTagIndices.isEmpty())
     {
-    value = this->fileValue(filePath, group, element);
-    return( value );
+    return values;
     }
-  else
+
+  // second pass: each file is parsed once for all its missing tags, and the
+  // values are written to the TagCache table in a single transaction
+  bool transaction = this->tagCacheExists() && d->TagCacheDatabase.transaction();
+  QSqlQuery insertTag( d->TagCacheDatabase );
+  insertTag.prepare( "INSERT OR REPLACE INTO TagCache VALUES(:sopInstanceUID, :tag, :value)" );
+  QMap<QString, QList<int> >::const_iterator it;
+  for (it = missingTagIndices.constBegin(); it != missingTagIndices.constEnd(); ++it)
     {
-    return ("");
+    const QString& sopInstanceUID = it.key();
+    QString filePath = this->fileForInstance(sopInstanceUID);
+    if (filePath.isEmpty())
+      {
+      continue;
+      }
+    QList<DcmTagKey> missingTagKeys;
+    foreach (int i, it.value())
+      {
+      missingTagKeys << tagKeys[i];
+      }
+    ctkDICOMDataset dataset;
+    dataset.InitializeFromFileTags(filePath, missingTagKeys);
+    QStringList& instanceValues = values[sopInstanceUID];
+    foreach (int i, it.value())
+      {
+      instanceValues[i] = dataset.GetAllElementValuesAsString(tagKeys[i]);
+      d->memoryCacheTag(sopInstanceUID, cacheTags[i], instanceValues[i]);
+      insertTag.bindValue(":sopInstanceUID", sopInstanceUID);
+      insertTag.bindValue(":tag", cacheTags[i]);
+      insertTag.bindValue(":value", instanceValues[i]);
+      d->loggedExec(insertTag);
+      }
+    }
+  if (transaction && !d->TagCacheDatabase.commit())
+    {
+    logger.error("SQLITE ERROR: could not commit tag cache: " + d->TagCacheDatabase.lastError().text());
     }
+  return values;
 }
 
-
 //------------------------------------------------------------------------------
 QString ctkDICOMDatabase::fileValue(const QString fileName, QString tag)
 {
   unsigned short group, element;
   this->tagToGroupElement(tag, group, element);
-  QString sopInstanceUID = this->instanceForFile(fileName);
-  QString value = this->cachedTag(sopInstanceUID, tag);
-  if (value != "")
-    {
-    return value;
-    }
   return( this->fileValue(fileName, group, element) );
 }
 
@@ -565,7 +2269,8 @@ QString ctkDICOMDatabase::fileValue(const QString fileName, QString tag)
 QString ctkDICOMDatabase::fileValue(const QString fileName, const unsigned short group, const unsigned short element)
 {
   // here is where the real lookup happens
-  // - first we check the tagCache to see if the value exists for this instance tag
+  // - first we check the tag cache (memory, then TagCache table) to see if
+  //   the value exists for this instance tag
   // If not,
   // - for now we create a ctkDICOMDataset and extract the value from there
   // - then we convert to the appropriate type of string
@@ -577,19 +2282,20 @@ QString ctkDICOMDatabase::fileValue(const QString fileName, const unsigned short
   //   -- if so, keep looking for the requested group/element
   //   -- if not, start again from the begining
 
+  Q_D(ctkDICOMDatabase);
   QString tag = this->groupElementToTag(group, element);
   QString sopInstanceUID = this->instanceForFile(fileName);
-  QString value = this->cachedTag(sopInstanceUID, tag);
-  if (value != "")
+  QString value;
+  if (d->lookupCachedTag(sopInstanceUID, tag, value))
     {
     return value;
     }
 
-  ctkDICOMDataset dataset;
-  dataset.InitializeFromFile(fileName);
-
   DcmTagKey tagKey(group, element);
 
+  ctkDICOMDataset dataset;
+  dataset.InitializeFromFileTags(fileName, QList<DcmTagKey>() << tagKey);
+
   value = dataset.GetAllElementValuesAsString(tagKey);
   this->cacheTag(sopInstanceUID, tag, value);
   return( value );
@@ -633,6 +2339,36 @@ void ctkDICOMDatabase::insert( const ctkDICOMDataset& ctkDataset, bool storeFile
   d->insert(ctkDataset, QString(), storeFile, generateThumbnail);
 }
 
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::insert( const ctkDICOMDataset& ctkDataset, const QString& filePath, bool storeFile, bool generateThumbnail)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->insert(ctkDataset, filePath, storeFile, generateThumbnail);
+}
+
+//------------------------------------------------------------------------------
+QList<DcmTagKey> ctkDICOMDatabase::indexedTags()
+{
+  QList<DcmTagKey> tags;
+  tags << DCM_SpecificCharacterSet
+       // Patients
+       << DCM_PatientID << DCM_PatientName << DCM_PatientBirthDate
+       << DCM_PatientBirthTime << DCM_PatientSex << DCM_PatientAge
+       << DCM_PatientComments
+       // Studies
+       << DCM_StudyInstanceUID << DCM_StudyID << DCM_StudyDate << DCM_StudyTime
+       << DCM_AccessionNumber << DCM_ModalitiesInStudy << DCM_InstitutionName
+       << DCM_PerformingPhysicianName << DCM_ReferringPhysicianName
+       << DCM_StudyDescription
+       // Series
+       << DCM_SeriesInstanceUID << DCM_SeriesDate << DCM_SeriesTime
+       << DCM_SeriesDescription << DCM_BodyPartExamined << DCM_FrameOfReferenceUID
+       << DCM_ContrastBolusAgent << DCM_ScanningSequence << DCM_SeriesNumber
+       << DCM_AcquisitionNumber << DCM_EchoNumbers << DCM_TemporalPositionIdentifier
+       // Images
+       << DCM_SOPInstanceUID;
+  return tags;
+}
 
 //------------------------------------------------------------------------------
 void ctkDICOMDatabase::insert ( const QString& filePath, bool storeFile, bool generateThumbnail, bool createHierarchy, const QString& destinationDirectoryName)
@@ -644,18 +2380,16 @@ void ctkDICOMDatabase::insert ( const QString& filePath, bool storeFile, bool ge
   /// first we check if the file is already in the database
   if (fileExistsAndUpToDate(filePath))
     {
-      logger.debug( "File " + filePath + " already added.");
       return;
     }
 
-  logger.debug( "Processing " + filePath );
-
   std::string filename = filePath.toStdString();
 
   DcmFileFormat fileformat;
   ctkDICOMDataset ctkDataset;
 
-  ctkDataset.InitializeFromFile(filePath);
+  // the file is copied as is when stored, only the attributes are needed
+  ctkDataset.InitializeFromFileHeader(filePath);
   if ( ctkDataset.IsInitialized() )
     {
       d->insert( ctkDataset, filePath, storeFile, generateThumbnail );
@@ -666,6 +2400,118 @@ void ctkDICOMDatabase::insert ( const QString& filePath, bool storeFile, bool ge
     }
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::insertFiles ( const QStringList& filePaths, bool storeFile, bool generateThumbnail )
+{
+  bool ownBatch = !this->isBatchInsertActive() && this->beginBatchInsert();
+  foreach (const QString& filePath, filePaths)
+    {
+    this->insert(filePath, storeFile, generateThumbnail);
+    }
+  if (ownBatch)
+    {
+    this->commitBatchInsert();
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::beginBatchInsert()
+{
+  Q_D(ctkDICOMDatabase);
+  QMutexLocker lock(&d->insertMutex);
+  if (d->BatchInsertActive)
+    {
+    logger.warn("Batch insert already in progress");
+    return false;
+    }
+  if (!d->Database.transaction())
+    {
+    d->LastError = d->Database.lastError().text();
+    logger.error("SQLITE ERROR: could not start batch insert: " + d->LastError);
+    return false;
+    }
+  d->BatchInsertActive = true;
+  d->PendingBatchInserts = 0;
+  d->BatchPatients.clear();
+  d->BatchStudies.clear();
+  d->BatchSeries.clear();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::commitBatchInsert()
+{
+  Q_D(ctkDICOMDatabase);
+  {
+  QMutexLocker lock(&d->insertMutex);
+  if (!d->BatchInsertActive)
+    {
+    return false;
+    }
+  d->BatchInsertActive = false;
+  d->PendingBatchInserts = 0;
+  d->BatchPatients.clear();
+  d->BatchStudies.clear();
+  d->BatchSeries.clear();
+  // see flushBatchInsert()
+  if (!d->Database.commit())
+    {
+    d->LastError = d->Database.lastError().text();
+    logger.error("SQLITE ERROR: could not commit batch insert: " + d->LastError);
+    d->endTagCacheTransaction(false);
+    d->resetInsertCaches();
+    return false;
+    }
+  d->endTagCacheTransaction(true);
+  }
+  if (this->isInMemory())
+    {
+    emit databaseChanged();
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::rollbackBatchInsert()
+{
+  Q_D(ctkDICOMDatabase);
+  QMutexLocker lock(&d->insertMutex);
+  if (!d->BatchInsertActive)
+    {
+    return;
+    }
+  d->BatchInsertActive = false;
+  d->PendingBatchInserts = 0;
+  d->endTagCacheTransaction(false);
+  if (!d->Database.rollback())
+    {
+    logger.error("SQLITE ERROR: could not rollback batch insert: " + d->Database.lastError().text());
+    }
+  // rows remembered since the last commit don't exist anymore
+  d->resetInsertCaches();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::isBatchInsertActive() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->BatchInsertActive;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setInsertBatchSize(int batchSize)
+{
+  Q_D(ctkDICOMDatabase);
+  d->InsertBatchSize = qMax(1, batchSize);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::insertBatchSize() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->InsertBatchSize;
+}
+
 //------------------------------------------------------------------------------
 int ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMDataset& ctkDataset)
 {
@@ -677,8 +2523,13 @@ int ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMDataset& ctkDataset)
   QString patientsName(ctkDataset.GetElementAsString(DCM_PatientName) );
   QString patientsBirthDate(ctkDataset.GetElementAsString(DCM_PatientBirthDate) );
 
-  QSqlQuery checkPatientExistsQuery(Database);
-  checkPatientExistsQuery.prepare ( "SELECT * FROM Patients WHERE PatientID = ? AND PatientsName = ?" );
+  QString patientKey = patientID + QLatin1Char('\\') + patientsName;
+  if (this->BatchInsertActive && this->BatchPatients.contains(patientKey))
+    {
+    return this->BatchPatients.value(patientKey);
+    }
+
+  QSqlQuery& checkPatientExistsQuery = this->SelectPatientQuery;
   checkPatientExistsQuery.bindValue ( 0, patientID );
   checkPatientExistsQuery.bindValue ( 1, patientsName );
   loggedExec(checkPatientExistsQuery);
@@ -686,11 +2537,12 @@ int ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMDataset& ctkDataset)
   if (checkPatientExistsQuery.next())
     {
       // we found him
-      dbPatientID = checkPatientExistsQuery.value(checkPatientExistsQuery.record().indexOf("UID")).toInt();
-      qDebug() << "Found patient in the database as UId: " << dbPatientID;
+      dbPatientID = checkPatientExistsQuery.value(0).toInt();
+      checkPatientExistsQuery.finish();
     }
   else
     {
+      checkPatientExistsQuery.finish();
       // Insert it
 
       QString patientsBirthTime(ctkDataset.GetElementAsString(DCM_PatientBirthTime) );
@@ -698,8 +2550,7 @@ int ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMDataset& ctkDataset)
       QString patientsAge(ctkDataset.GetElementAsString(DCM_PatientAge) );
       QString patientComments(ctkDataset.GetElementAsString(DCM_PatientComments) );
 
-      QSqlQuery insertPatientStatement ( Database );
-      insertPatientStatement.prepare ( "INSERT INTO Patients ('UID', 'PatientsName', 'PatientID', 'PatientsBirthDate', 'PatientsBirthTime', 'PatientsSex', 'PatientsAge', 'PatientsComments' ) values ( NULL, ?, ?, ?, ?, ?, ?, ? )" );
+      QSqlQuery& insertPatientStatement = this->InsertPatientQuery;
       insertPatientStatement.bindValue ( 0, patientsName );
       insertPatientStatement.bindValue ( 1, patientID );
       insertPatientStatement.bindValue ( 2, patientsBirthDate );
@@ -708,27 +2559,34 @@ int ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMDataset& ctkDataset)
       // TODO: shift patient's age to study,
       // since this is not a patient level attribute in images
       // insertPatientStatement.bindValue ( 5, patientsAge );
+      insertPatientStatement.bindValue ( 5, QVariant(QVariant::String) );
       insertPatientStatement.bindValue ( 6, patientComments );
       loggedExec(insertPatientStatement);
       dbPatientID = insertPatientStatement.lastInsertId().toInt();
-      logger.debug ( "New patient inserted: " + QString().setNum ( dbPatientID ) );
-      qDebug() << "New patient inserted as : " << dbPatientID;
     }
-    return dbPatientID;
+  if (this->BatchInsertActive)
+    {
+    this->BatchPatients.insert(patientKey, dbPatientID);
+    }
+  return dbPatientID;
 }
 
 //------------------------------------------------------------------------------
 void ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMDataset& ctkDataset, int dbPatientID)
 {
   QString studyInstanceUID(ctkDataset.GetElementAsString(DCM_StudyInstanceUID) );
-  QSqlQuery checkStudyExistsQuery (Database);
-  checkStudyExistsQuery.prepare ( "SELECT * FROM Studies WHERE StudyInstanceUID = ?" );
+  if (this->BatchInsertActive && this->BatchStudies.contains(studyInstanceUID))
+    {
+    LastStudyInstanceUID = studyInstanceUID;
+    return;
+    }
+  QSqlQuery& checkStudyExistsQuery = this->SelectStudyQuery;
   checkStudyExistsQuery.bindValue ( 0, studyInstanceUID );
   checkStudyExistsQuery.exec();
-  if(!checkStudyExistsQuery.next())
+  bool studyExists = checkStudyExistsQuery.next();
+  checkStudyExistsQuery.finish();
+  if(!studyExists)
     {
-      qDebug() << "Need to insert new study: " << studyInstanceUID;
-
       QString studyID(ctkDataset.GetElementAsString(DCM_StudyID) );
       QString studyDate(ctkDataset.GetElementAsString(DCM_StudyDate) );
       QString studyTime(ctkDataset.GetElementAsString(DCM_StudyTime) );
@@ -739,8 +2597,7 @@ void ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMDataset& ctkDataset, int
       QString referringPhysician(ctkDataset.GetElementAsString(DCM_ReferringPhysicianName) );
       QString studyDescription(ctkDataset.GetElementAsString(DCM_StudyDescription) );
 
-      QSqlQuery insertStudyStatement ( Database );
-      insertStudyStatement.prepare ( "INSERT INTO Studies ( 'StudyInstanceUID', 'PatientsUID', 'StudyID', 'StudyDate', 'StudyTime', 'AccessionNumber', 'ModalitiesInStudy', 'InstitutionName', 'ReferringPhysician', 'PerformingPhysiciansName', 'StudyDescription' ) VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )" );
+      QSqlQuery& insertStudyStatement = this->InsertStudyQuery;
       insertStudyStatement.bindValue ( 0, studyInstanceUID );
       insertStudyStatement.bindValue ( 1, dbPatientID );
       insertStudyStatement.bindValue ( 2, studyID );
@@ -755,15 +2612,13 @@ void ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMDataset& ctkDataset, int
       if ( !insertStudyStatement.exec() )
         {
           logger.error ( "Error executing statament: " + insertStudyStatement.lastQuery() + " Error: " + insertStudyStatement.lastError().text() );
-        }
-      else
-        {
-          LastStudyInstanceUID = studyInstanceUID;
+          return;
         }
     }
-  else
+  LastStudyInstanceUID = studyInstanceUID;
+  if (this->BatchInsertActive)
     {
-    qDebug() << "Used existing study: " << studyInstanceUID;
+    this->BatchStudies.insert(studyInstanceUID);
     }
 }
 
@@ -771,15 +2626,18 @@ void ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMDataset& ctkDataset, int
 void ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMDataset& ctkDataset, QString studyInstanceUID)
 {
   QString seriesInstanceUID(ctkDataset.GetElementAsString(DCM_SeriesInstanceUID) );
-  QSqlQuery checkSeriesExistsQuery (Database);
-  checkSeriesExistsQuery.prepare ( "SELECT * FROM Series WHERE SeriesInstanceUID = ?" );
+  if (this->BatchInsertActive && this->BatchSeries.contains(seriesInstanceUID))
+    {
+    LastSeriesInstanceUID = seriesInstanceUID;
+    return;
+    }
+  QSqlQuery& checkSeriesExistsQuery = this->SelectSeriesQuery;
   checkSeriesExistsQuery.bindValue ( 0, seriesInstanceUID );
-  logger.warn ( "Statement: " + checkSeriesExistsQuery.lastQuery() );
   loggedExec(checkSeriesExistsQuery);
-  if(!checkSeriesExistsQuery.next())
+  bool seriesExists = checkSeriesExistsQuery.next();
+  checkSeriesExistsQuery.finish();
+  if(!seriesExists)
     {
-      qDebug() << "Need to insert new series: " << seriesInstanceUID;
-
       QString seriesDate(ctkDataset.GetElementAsString(DCM_SeriesDate) );
       QString seriesTime(ctkDataset.GetElementAsString(DCM_SeriesTime) );
       QString seriesDescription(ctkDataset.GetElementAsString(DCM_SeriesDescription) );
@@ -792,8 +2650,7 @@ void ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMDataset& ctkDataset, QS
       long echoNumber(ctkDataset.GetElementAsInteger(DCM_EchoNumbers) );
       long temporalPosition(ctkDataset.GetElementAsInteger(DCM_TemporalPositionIdentifier) );
 
-      QSqlQuery insertSeriesStatement ( Database );
-      insertSeriesStatement.prepare ( "INSERT INTO Series ( 'SeriesInstanceUID', 'StudyInstanceUID', 'SeriesNumber', 'SeriesDate', 'SeriesTime', 'SeriesDescription', 'BodyPartExamined', 'FrameOfReferenceUID', 'AcquisitionNumber', 'ContrastAgent', 'ScanningSequence', 'EchoNumber', 'TemporalPosition' ) VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )" );
+      QSqlQuery& insertSeriesStatement = this->InsertSeriesQuery;
       insertSeriesStatement.bindValue ( 0, seriesInstanceUID );
       insertSeriesStatement.bindValue ( 1, studyInstanceUID );
       insertSeriesStatement.bindValue ( 2, static_cast<int>(seriesNumber) );
@@ -813,25 +2670,25 @@ void ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMDataset& ctkDataset, QS
                          + insertSeriesStatement.lastQuery()
                          + " Error: " + insertSeriesStatement.lastError().text() );
           LastSeriesInstanceUID = "";
-        }
-      else
-        {
-          LastSeriesInstanceUID = seriesInstanceUID;
+          return;
         }
     }
-  else
+  LastSeriesInstanceUID = seriesInstanceUID;
+  if (this->BatchInsertActive)
     {
-    qDebug() << "Used existing series: " << seriesInstanceUID;
+    this->BatchSeries.insert(seriesInstanceUID);
     }
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const QString& filePath, bool storeFile, bool generateThumbnail)
+bool ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const QString& filePath, bool storeFile, bool generateThumbnail)
 {
   Q_Q(ctkDICOMDatabase);
 
   QMutexLocker lock(&insertMutex);
 
+  this->prepareInsertStatements();
+
   // Check to see if the file has already been loaded
   // TODO:
   // It could make sense to actually remove the dataset and re-add it. This needs the remove
@@ -840,34 +2697,29 @@ void ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const Q
 
   QString sopInstanceUID ( ctkDataset.GetElementAsString(DCM_SOPInstanceUID) );
 
-  QSqlQuery fileExists ( Database );
-  fileExists.prepare("SELECT InsertTimestamp,Filename FROM Images WHERE SOPInstanceUID == :sopInstanceUID");
+  QSqlQuery& fileExists = this->SelectImageBySOPInstanceUIDQuery;
   fileExists.bindValue(":sopInstanceUID",sopInstanceUID);
   bool success = fileExists.exec();
   if (!success)
     {
       logger.error("SQLITE ERROR: " + fileExists.lastError().driverText());
-      return;
+      return false;
     }
 
-  QString databaseFilename(fileExists.value(1).toString());
-  QDateTime fileLastModified(QFileInfo(databaseFilename).lastModified());
-  QDateTime databaseInsertTimestamp(QDateTime::fromString(fileExists.value(0).toString(),Qt::ISODate));
+  bool instanceExists = fileExists.next();
+  QString databaseFilename(instanceExists ? fileExists.value(1).toString() : QString());
+  QDateTime databaseInsertTimestamp(instanceExists ?
+    QDateTime::fromString(fileExists.value(0).toString(),Qt::ISODate) : QDateTime());
+  fileExists.finish();
 
-  qDebug() << "inserting filePath: " << filePath;
-  if (databaseFilename == "")
-    {
-      qDebug() << "database filename for " << sopInstanceUID << " is empty - we should insert on top of it";
-    }
-  else
+  // if the instance has no file yet, it is inserted on top of it
+  if (!databaseFilename.isEmpty())
     {
-      qDebug() << "database filename for " << sopInstanceUID << " is: " << databaseFilename;
-      qDebug() << "modified date is: " << fileLastModified;
-      qDebug() << "db insert date is: " << databaseInsertTimestamp;
-      if ( fileExists.next() && fileLastModified < databaseInsertTimestamp )
+      QDateTime fileLastModified(QFileInfo(databaseFilename).lastModified());
+      if ( fileLastModified < databaseInsertTimestamp )
         {
-          logger.debug ( "File " + databaseFilename + " already added" );
-          return;
+          // already added
+          return false;
         }
     }
 
@@ -884,7 +2736,7 @@ void ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const Q
   if ( patientsName.isEmpty() || studyInstanceUID.isEmpty() || patientID.isEmpty() )
     {
       logger.error("Dataset is missing necessary information!");
-      return;
+      return false;
     }
 
   // store the file if the database is not in memomry
@@ -907,12 +2759,10 @@ void ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const Q
 
       if(filePath.isEmpty())
         {
-          logger.debug ( "Saving file: " + filename );
-
           if ( !ctkDataset.SaveToFile( filename) )
             {
               logger.error ( "Error saving file: " + filename );
-              return;
+              return false;
             }
         }
       else
@@ -921,8 +2771,6 @@ void ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const Q
 
           QFile currentFile( filePath );
           currentFile.copy(filename);
-          logger.debug( "Copy file from: " + filePath );
-          logger.debug( "Copy file to  : " + filename );
         }
     }
 
@@ -930,6 +2778,7 @@ void ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const Q
   //generated by the sqlite autoincrement
   //The patientID  is the (non-unique) DICOM patient id
   int dbPatientID = LastPatientUID;
+  bool imageInserted = false;
 
   if ( patientID != "" && patientsName != "" )
     {
@@ -939,9 +2788,7 @@ void ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const Q
       if ( LastPatientID != patientID
            || LastPatientsBirthDate != patientsBirthDate
            || LastPatientsName != patientsName )
-        {  QString seriesInstanceUID(ctkDataset.GetElementAsString(DCM_SeriesInstanceUID) );
-
-          qDebug() << "This looks like a different patient from last insert: " << patientID;
+        {
           // Ok, something is different from last insert, let's insert him if he's not
           // already in the db.
 
@@ -954,8 +2801,6 @@ void ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const Q
           LastPatientsName = patientsName;
         }
 
-      qDebug() << "Going to insert this instance with dbPatientID: " << dbPatientID;
-
       // Patient is in now. Let's continue with the study
 
       if ( studyInstanceUID != "" && LastStudyInstanceUID != studyInstanceUID )
@@ -971,229 +2816,708 @@ void ctkDICOMDatabasePrivate::insert( const ctkDICOMDataset& ctkDataset, const Q
       //
       if ( !filename.isEmpty() && !seriesInstanceUID.isEmpty() )
         {
-          QSqlQuery checkImageExistsQuery (Database);
-          checkImageExistsQuery.prepare ( "SELECT * FROM Images WHERE Filename = ?" );
+          QSqlQuery& checkImageExistsQuery = this->SelectImageByFilenameQuery;
           checkImageExistsQuery.bindValue ( 0, filename );
           checkImageExistsQuery.exec();
-          if(!checkImageExistsQuery.next())
+          bool imageExists = checkImageExistsQuery.next();
+          checkImageExistsQuery.finish();
+          if(!imageExists)
             {
-              QSqlQuery insertImageStatement ( Database );
-              insertImageStatement.prepare ( "INSERT INTO Images ( 'SOPInstanceUID', 'Filename', 'SeriesInstanceUID', 'InsertTimestamp' ) VALUES ( ?, ?, ?, ? )" );
+              QSqlQuery& insertImageStatement = this->InsertImageQuery;
               insertImageStatement.bindValue ( 0, sopInstanceUID );
               insertImageStatement.bindValue ( 1, filename );
               insertImageStatement.bindValue ( 2, seriesInstanceUID );
               insertImageStatement.bindValue ( 3, QDateTime::currentDateTime() );
-              insertImageStatement.exec();
+              // summed up into the series, study and patient by the
+              // triggers of the schema
+              insertImageStatement.bindValue ( 4, QFileInfo(filename).size() );
+              bool inserted = loggedExec(insertImageStatement);
+              imageInserted = inserted;
+              if ( inserted && !this->TagKeysToPrecache.isEmpty() )
+                {
+                  this->precacheTags(ctkDataset, sopInstanceUID);
+                }
+              if ( inserted
+                   && this->BatchInsertActive
+                   && ++this->PendingBatchInserts >= this->InsertBatchSize )
+                {
+                  this->flushBatchInsert();
+                }
             }
         }
 
-      if( generateThumbnail && thumbnailGenerator && !seriesInstanceUID.isEmpty() )
+      if( generateThumbnail && !seriesInstanceUID.isEmpty() && this->ThumbnailQueue->hasThumbnailGenerator() )
+        {
+          ctkDICOMThumbnailRequest request;
+          request.SOPInstanceUID = sopInstanceUID;
+          request.SeriesInstanceUID = seriesInstanceUID;
+          request.FilePath = filename;
+          request.ThumbnailTime = this->storedThumbnailTime(sopInstanceUID);
+          this->ThumbnailQueue->queueThumbnail(request, false);
+        }
+
+      // in batch mode, the notification is sent when the batch is committed
+      if (q->isInMemory() && !this->BatchInsertActive)
+        {
+          emit q->databaseChanged();
+        }
+    }
+  else
+    {
+    logger.warn("No patient name or no patient id - not inserting!");
+    }
+  return imageInserted;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::fileExistsAndUpToDate(const QString& filePath)
+{
+  Q_D(ctkDICOMDatabase);
+  bool result(false);
+
+  QSqlQuery check_filename_query(database());
+  check_filename_query.prepare("SELECT InsertTimestamp FROM Images WHERE Filename == ?");
+  check_filename_query.bindValue(0,filePath);
+  d->loggedExec(check_filename_query);
+  if (
+      check_filename_query.next() &&
+      QFileInfo(filePath).lastModified() < QDateTime::fromString(check_filename_query.value(0).toString(),Qt::ISODate)
+      )
+    {
+      result = true;
+    }
+  check_filename_query.finish();
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+QHash<QString, QPair<qint64, uint> > ctkDICOMDatabase::directoryManifest(const QString& directoryName)
+{
+  Q_D(ctkDICOMDatabase);
+  QHash<QString, QPair<qint64, uint> > manifest;
+
+  QSqlQuery directoryFiles(d->Database);
+  directoryFiles.setForwardOnly(true);
+  directoryFiles.prepare("SELECT Filename, FileSize, ModifiedTime FROM DirectoryFiles WHERE Dirname = ?");
+  directoryFiles.bindValue(0, directoryName);
+  if (!d->loggedExec(directoryFiles))
+    {
+    return manifest;
+    }
+  while (directoryFiles.next())
+    {
+    manifest.insert(directoryFiles.value(0).toString(),
+                    qMakePair(directoryFiles.value(1).toLongLong(), directoryFiles.value(2).toUInt()));
+    }
+  return manifest;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::updateDirectoryManifest(const QString& directoryName, const QString& filePath,
+                                               qint64 fileSize, uint modifiedTime,
+                                               const QString& storedFilePath)
+{
+  Q_D(ctkDICOMDatabase);
+  QMutexLocker lock(&d->insertMutex);
+  d->prepareInsertStatements();
+
+  if (directoryName != d->LastDirectoryName)
+    {
+    QSqlQuery insertDirectory(d->Database);
+    insertDirectory.prepare("INSERT OR IGNORE INTO Directories ( 'Dirname' ) VALUES ( ? )");
+    insertDirectory.bindValue(0, directoryName);
+    if (!d->loggedExec(insertDirectory))
+      {
+      return;
+      }
+    d->LastDirectoryName = directoryName;
+    }
+
+  QSqlQuery& insertFile = d->InsertDirectoryFileQuery;
+  insertFile.bindValue(0, filePath);
+  insertFile.bindValue(1, directoryName);
+  insertFile.bindValue(2, fileSize);
+  insertFile.bindValue(3, modifiedTime);
+  insertFile.bindValue(4, storedFilePath.isEmpty() || storedFilePath == filePath ?
+                          QVariant(QVariant::String) : QVariant(storedFilePath));
+  d->loggedExec(insertFile);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::removeFromDirectoryManifest(const QStringList& filePaths)
+{
+  Q_D(ctkDICOMDatabase);
+  if (filePaths.isEmpty())
+    {
+    return true;
+    }
+
+  bool ownBatch = !this->isBatchInsertActive() && this->beginBatchInsert();
+  bool result = true;
+  QStringList storedFilesToRemove;
+  {
+  QMutexLocker lock(&d->insertMutex);
+  // the images of a file copied into the database directory are indexed
+  // under the path of the copy
+  QSqlQuery storedFileForFile(d->Database);
+  storedFileForFile.prepare("SELECT StoredFilename FROM DirectoryFiles WHERE Filename = ?");
+  // the space in the thumbnail file is reclaimed by compactThumbnails()
+  QSqlQuery thumbnailRemove(d->Database);
+  thumbnailRemove.prepare("DELETE FROM Thumbnails WHERE SOPInstanceUID IN "
+                          "( SELECT SOPInstanceUID FROM Images WHERE Filename = ? )");
+  QSqlQuery imageRemove(d->Database);
+  imageRemove.prepare("DELETE FROM Images WHERE Filename = ?");
+  QSqlQuery directoryFileRemove(d->Database);
+  directoryFileRemove.prepare("DELETE FROM DirectoryFiles WHERE Filename = ?");
+
+  foreach (const QString& filePath, filePaths)
+    {
+    QString indexedFilePath = filePath;
+    storedFileForFile.bindValue(0, filePath);
+    if (d->loggedExec(storedFileForFile) && storedFileForFile.next()
+        && !storedFileForFile.value(0).toString().isEmpty())
+      {
+      indexedFilePath = storedFileForFile.value(0).toString();
+      storedFilesToRemove << indexedFilePath;
+      }
+    storedFileForFile.finish();
+
+    thumbnailRemove.bindValue(0, indexedFilePath);
+    imageRemove.bindValue(0, indexedFilePath);
+    directoryFileRemove.bindValue(0, filePath);
+    if (!d->loggedExec(thumbnailRemove) || !d->loggedExec(imageRemove)
+        || !d->loggedExec(directoryFileRemove))
+      {
+      logger.error("SQLITE ERROR: could not remove file " + filePath);
+      result = false;
+      }
+    }
+  }
+
+  this->cleanup();
+  // cleanup() may have removed series, studies and patients
+  d->resetInsertCaches();
+
+  if (ownBatch)
+    {
+    result = this->commitBatchInsert() && result;
+    }
+
+  // removed right away rather than by the file reclamation, the modified
+  // files are copied again by the indexing that follows
+  if (result)
+    {
+    foreach (const QString& storedFilePath, storedFilesToRemove)
+      {
+      QFile::remove(storedFilePath);
+      }
+    }
+  return result;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::isOpen() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->Database.isOpen();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::isInMemory() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->DatabaseFileName == ":memory:";
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::removeSets(RemovalLevel level, const QStringList& uids,
+                                         ctkDICOMRemovalReport* report, bool dryRun)
+{
+  Q_Q(ctkDICOMDatabase);
+  if (report)
+    {
+    *report = ctkDICOMRemovalReport();
+    }
+  if (uids.isEmpty())
+    {
+    return true;
+    }
+
+  const QString storageDirectory = q->databaseDirectory() + "/dicom/";
+  const QString thumbsDirectory = q->databaseDirectory() + "/thumbs/";
+  QStringList filesToReclaim;
+  bool result = true;
+  {
+  QMutexLocker lock(&this->insertMutex);
+  // a batch insert already holds a transaction, the removal is then undone
+  // on its own if it fails, without losing the pending inserts
+  bool ownTransaction = !this->BatchInsertActive && this->Database.transaction();
+  QSqlQuery query(this->Database);
+  bool savepoint = this->BatchInsertActive
+    && this->loggedExec(query, "SAVEPOINT RemoveSets");
+
+  // temporary tables belong to the connection, only their content is
+  // replaced by each removal
+  result = (!this->BatchInsertActive || savepoint)
+    && this->loggedExec(query, "CREATE TEMP TABLE IF NOT EXISTS RemovalUIDs ( 'UID' PRIMARY KEY )")
+    && this->loggedExec(query, "CREATE TEMP TABLE IF NOT EXISTS RemovedSeries ( 'SeriesInstanceUID' PRIMARY KEY )")
+    && this->loggedExec(query, "CREATE TEMP TABLE IF NOT EXISTS RemovedStudies ( 'StudyInstanceUID' PRIMARY KEY )")
+    && this->loggedExec(query, "CREATE TEMP TABLE IF NOT EXISTS RemovedPatients ( 'UID' PRIMARY KEY )")
+    && this->loggedExec(query, "DELETE FROM RemovalUIDs")
+    && this->loggedExec(query, "DELETE FROM RemovedSeries")
+    && this->loggedExec(query, "DELETE FROM RemovedStudies")
+    && this->loggedExec(query, "DELETE FROM RemovedPatients");
+
+  QSqlQuery insertUID(this->Database);
+  insertUID.prepare("INSERT OR IGNORE INTO RemovalUIDs VALUES ( ? )");
+  foreach (const QString& uid, uids)
+    {
+    // Patients.UID is an integer
+    insertUID.bindValue(0, level == PatientLevel ? QVariant(uid.toLongLong()) : QVariant(uid));
+    result = result && this->loggedExec(insertUID);
+    }
+
+  switch (level)
+    {
+    case PatientLevel:
+      result = result
+        && this->loggedExec(query, "INSERT INTO RemovedPatients SELECT UID FROM RemovalUIDs")
+        && this->loggedExec(query, "INSERT OR IGNORE INTO RemovedStudies SELECT StudyInstanceUID FROM Studies "
+                                   "WHERE PatientsUID IN ( SELECT UID FROM RemovedPatients )")
+        && this->loggedExec(query, "INSERT OR IGNORE INTO RemovedSeries SELECT SeriesInstanceUID FROM Series "
+                                   "WHERE StudyInstanceUID IN ( SELECT StudyInstanceUID FROM RemovedStudies )");
+      break;
+    case StudyLevel:
+      result = result
+        && this->loggedExec(query, "INSERT INTO RemovedStudies SELECT UID FROM RemovalUIDs")
+        && this->loggedExec(query, "INSERT OR IGNORE INTO RemovedSeries SELECT SeriesInstanceUID FROM Series "
+                                   "WHERE StudyInstanceUID IN ( SELECT StudyInstanceUID FROM RemovedStudies )");
+      break;
+    case SeriesLevel:
+      result = result
+        && this->loggedExec(query, "INSERT INTO RemovedSeries SELECT UID FROM RemovalUIDs");
+      break;
+    }
+  // studies and patients left empty
+  result = result
+    && this->loggedExec(query, "INSERT OR IGNORE INTO RemovedStudies SELECT DISTINCT s.StudyInstanceUID FROM Series s "
+                               "WHERE s.SeriesInstanceUID IN ( SELECT SeriesInstanceUID FROM RemovedSeries ) "
+                               "AND NOT EXISTS ( SELECT 1 FROM Series o WHERE o.StudyInstanceUID = s.StudyInstanceUID "
+                               "AND o.SeriesInstanceUID NOT IN ( SELECT SeriesInstanceUID FROM RemovedSeries ) )")
+    && this->loggedExec(query, "INSERT OR IGNORE INTO RemovedPatients SELECT DISTINCT s.PatientsUID FROM Studies s "
+                               "WHERE s.StudyInstanceUID IN ( SELECT StudyInstanceUID FROM RemovedStudies ) "
+                               "AND NOT EXISTS ( SELECT 1 FROM Studies o WHERE o.PatientsUID = s.PatientsUID "
+                               "AND o.StudyInstanceUID NOT IN ( SELECT StudyInstanceUID FROM RemovedStudies ) )");
+
+  if (result && report)
+    {
+    if (this->loggedExec(query,
+          "SELECT ( SELECT COUNT(*) FROM Patients WHERE UID IN ( SELECT UID FROM RemovedPatients ) ), "
+          "( SELECT COUNT(*) FROM Studies WHERE StudyInstanceUID IN ( SELECT StudyInstanceUID FROM RemovedStudies ) ), "
+          "( SELECT COUNT(*) FROM Series WHERE SeriesInstanceUID IN ( SELECT SeriesInstanceUID FROM RemovedSeries ) ), "
+          "( SELECT COUNT(*) FROM Images WHERE SeriesInstanceUID IN ( SELECT SeriesInstanceUID FROM RemovedSeries ) ), "
+          "( SELECT COUNT(*) FROM Thumbnails WHERE SeriesInstanceUID IN ( SELECT SeriesInstanceUID FROM RemovedSeries ) ), "
+          "( SELECT TOTAL(DataSize) FROM Thumbnails WHERE SeriesInstanceUID IN ( SELECT SeriesInstanceUID FROM RemovedSeries ) )")
+        && query.next())
+      {
+      report->Patients = query.value(0).toInt();
+      report->Studies = query.value(1).toInt();
+      report->Series = query.value(2).toInt();
+      report->Images = query.value(3).toInt();
+      report->Thumbnails = query.value(4).toInt();
+      report->ThumbnailBytes = static_cast<qint64>(query.value(5).toDouble());
+      }
+    query.finish();
+    }
+
+  // stored copies and thumbnails not migrated to the thumbnail file
+  if (result && (report || !dryRun))
+    {
+    result = this->loggedExec(query,
+      "SELECT Images.Filename, Images.SOPInstanceUID, Images.SeriesInstanceUID, Series.StudyInstanceUID, "
+      "Thumbnails.SOPInstanceUID IS NOT NULL "
+      "FROM Images LEFT JOIN Series ON Series.SeriesInstanceUID = Images.SeriesInstanceUID "
+      "LEFT JOIN Thumbnails ON Thumbnails.SOPInstanceUID = Images.SOPInstanceUID "
+      "WHERE Images.SeriesInstanceUID IN ( SELECT SeriesInstanceUID FROM RemovedSeries )");
+    while (query.next())
+      {
+      const QString filePath = query.value(0).toString();
+      const QString internalFilePath = query.value(3).toString() + "/"
+        + query.value(2).toString() + "/" + query.value(1).toString();
+      const QString thumbnail = thumbsDirectory + internalFilePath + ".png";
+      if (filePath.startsWith(storageDirectory))
         {
-          QString studySeriesDirectory = studyInstanceUID + "/" + seriesInstanceUID;
-          //Create thumbnail here
-          QString thumbnailPath = q->databaseDirectory() +
-              "/thumbs/" + studyInstanceUID + "/" + seriesInstanceUID
-              + "/" + sopInstanceUID + ".png";
-          QFileInfo thumbnailInfo(thumbnailPath);
-          if( !(thumbnailInfo.exists()
-                && (thumbnailInfo.lastModified() > QFileInfo(filename).lastModified())))
+        if (!filePath.endsWith(internalFilePath))
+          {
+          logger.error("Database inconsistency detected during delete!");
+          }
+        else
+          {
+          filesToReclaim << filePath;
+          if (report)
             {
-              QDir(q->databaseDirectory() + "/thumbs/").mkpath(studySeriesDirectory);
-              DicomImage dcmImage(QDir::toNativeSeparators(filename).toAscii());
-              thumbnailGenerator->generateThumbnail(&dcmImage, thumbnailPath);
+            report->Files << filePath;
+            report->FileBytes += QFileInfo(filePath).size();
             }
+          }
+        }
+      // a thumbnail in the thumbnail file is already counted, a leftover
+      // file of an older version is only deleted
+      if (report && !query.value(4).toBool())
+        {
+        QFileInfo thumbnailInfo(thumbnail);
+        if (thumbnailInfo.exists())
+          {
+          ++report->Thumbnails;
+          report->ThumbnailBytes += thumbnailInfo.size();
+          }
         }
+      // deleting a missing file is cheaper than checking first
+      filesToReclaim << thumbnail;
+      }
+    query.finish();
+    }
+
+  if (result && !dryRun)
+    {
+    // the space in the thumbnail file is reclaimed by compactThumbnails()
+    result = this->loggedExec(query, "DELETE FROM Thumbnails WHERE SeriesInstanceUID IN ( SELECT SeriesInstanceUID FROM RemovedSeries )")
+      && this->loggedExec(query, "DELETE FROM Images WHERE SeriesInstanceUID IN ( SELECT SeriesInstanceUID FROM RemovedSeries )")
+      && this->loggedExec(query, "DELETE FROM Series WHERE SeriesInstanceUID IN ( SELECT SeriesInstanceUID FROM RemovedSeries )")
+      && this->loggedExec(query, "DELETE FROM Studies WHERE StudyInstanceUID IN ( SELECT StudyInstanceUID FROM RemovedStudies )")
+      && this->loggedExec(query, "DELETE FROM Patients WHERE UID IN ( SELECT UID FROM RemovedPatients )");
+    }
 
-      if (q->isInMemory())
+  if (ownTransaction)
+    {
+    if (result && !dryRun)
+      {
+      if (!this->Database.commit())
         {
-          emit q->databaseChanged();
+        logger.error("SQLITE ERROR: could not commit removal: " + this->Database.lastError().text());
+        result = false;
         }
+      }
+    else
+      {
+      this->Database.rollback();
+      }
     }
-  else
+  else if (savepoint)
+    {
+    if (!result)
+      {
+      logger.error("SQLITE ERROR: removal failed within a batch insert, the removal is undone");
+      this->loggedExec(query, "ROLLBACK TO RemoveSets");
+      }
+    this->loggedExec(query, "RELEASE RemoveSets");
+    }
+  if (!dryRun)
+    {
+    this->resetInsertCaches();
+    }
+  }
+
+  if (result && !dryRun)
     {
-    qDebug() << "No patient name or no patient id - not inserting!";
+    this->reclaimFiles(filesToReclaim);
     }
+  return result;
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::fileExistsAndUpToDate(const QString& filePath)
+void ctkDICOMDatabasePrivate::reclaimFiles(const QStringList& filePaths)
 {
-  Q_D(ctkDICOMDatabase);
-  bool result(false);
-
-  QSqlQuery check_filename_query(database());
-  check_filename_query.prepare("SELECT InsertTimestamp FROM Images WHERE Filename == ?");
-  check_filename_query.bindValue(0,filePath);
-  d->loggedExec(check_filename_query);
-  if (
-      check_filename_query.next() &&
-      QFileInfo(filePath).lastModified() < QDateTime::fromString(check_filename_query.value(0).toString(),Qt::ISODate)
-      )
+  if (filePaths.isEmpty())
     {
-      result = true;
+    return;
+    }
+  QMutexLocker lock(&this->ReclaimMutex);
+  this->FilesToReclaim << filePaths;
+  if (!this->ReclaimRunning)
+    {
+    this->ReclaimRunning = true;
+    this->ReclaimFuture = QtConcurrent::run(this, &ctkDICOMDatabasePrivate::runFileReclamation);
     }
-  check_filename_query.finish();
-  return result;
 }
 
-
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::isOpen() const
+void ctkDICOMDatabasePrivate::runFileReclamation()
 {
-  Q_D(const ctkDICOMDatabase);
-  return d->Database.isOpen();
+  Q_Q(ctkDICOMDatabase);
+  int removed = 0;
+  forever
+    {
+    QStringList filePaths;
+    {
+    QMutexLocker lock(&this->ReclaimMutex);
+    if (this->FilesToReclaim.isEmpty())
+      {
+      this->ReclaimRunning = false;
+      break;
+      }
+    filePaths = this->FilesToReclaim;
+    this->FilesToReclaim.clear();
+    }
+
+    QSet<QString> directories;
+    foreach (const QString& filePath, filePaths)
+      {
+      if (QFile::remove(filePath))
+        {
+        ++removed;
+        directories.insert(QFileInfo(filePath).absolutePath());
+        }
+      }
+    // series directories left empty, then their study directories
+    foreach (const QString& directory, directories)
+      {
+      if (QDir().rmdir(directory))
+        {
+        QDir().rmdir(QFileInfo(directory).absolutePath());
+        }
+      }
+    }
+  logger.debug(QString("Reclaimed %1 files").arg(removed));
+  emit q->filesReclaimed(removed);
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::isInMemory() const
+bool ctkDICOMDatabase::removeSeries(const QString& seriesInstanceUID)
 {
-  Q_D(const ctkDICOMDatabase);
-  return d->DatabaseFileName == ":memory:";
+  return this->removeSeries(QStringList() << seriesInstanceUID);
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::removeSeries(const QString& seriesInstanceUID)
+bool ctkDICOMDatabase::removeSeries(const QStringList& seriesInstanceUIDs,
+                                    ctkDICOMRemovalReport* report, bool dryRun)
 {
   Q_D(ctkDICOMDatabase);
+  return d->removeSets(ctkDICOMDatabasePrivate::SeriesLevel, seriesInstanceUIDs, report, dryRun);
+}
 
-  // get all images from series
-  QSqlQuery fileExists ( d->Database );
-  fileExists.prepare("SELECT Filename, SOPInstanceUID, StudyInstanceUID FROM Images,Series WHERE Series.SeriesInstanceUID = Images.SeriesInstanceUID AND Images.SeriesInstanceUID = :seriesID");
-  fileExists.bindValue(":seriesID",seriesInstanceUID);
-  bool success = fileExists.exec();
-  if (!success)
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::ensureSearchIndex()
+{
+  Q_Q(ctkDICOMDatabase);
+  if (!q->searchIndexExists() && !q->rebuildSearchIndex())
     {
-      logger.error("SQLITE ERROR: " + fileExists.lastError().driverText());
-      return false;
+    logger.warn("No full text search index, SQLite may lack the FTS4 module");
     }
+}
 
-  QList< QPair<QString,QString> > removeList;
-  while ( fileExists.next() )
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::searchIndexExists()
+{
+  Q_D(ctkDICOMDatabase);
+  // the triggers are dropped with their table, check them too. The
+  // triggers of older indexes, keyed on the rowid of studies and series,
+  // don't count.
+  QSqlQuery query(d->Database);
+  if (!query.exec("SELECT COUNT(*) FROM sqlite_master WHERE name IN ( "
+                  "'PatientsSearch', 'StudiesSearch', 'SeriesSearch', "
+                  "'PatientsSearchInsert', 'PatientsSearchDelete', 'PatientsSearchUpdate', "
+                  "'StudiesSearchInsert', 'StudiesSearchDelete', 'StudiesSearchUpdate', "
+                  "'SeriesSearchInsert', 'SeriesSearchDelete', 'SeriesSearchUpdate' ) "
+                  "AND sql NOT LIKE '%rowid%'")
+      || !query.next())
     {
-      QString dbFilePath = fileExists.value(fileExists.record().indexOf("Filename")).toString();
-      QString sopInstanceUID = fileExists.value(fileExists.record().indexOf("SOPInstanceUID")).toString();
-      QString studyInstanceUID = fileExists.value(fileExists.record().indexOf("StudyInstanceUID")).toString();
-      QString internalFilePath = studyInstanceUID + "/" + seriesInstanceUID + "/" + sopInstanceUID;
-      removeList << qMakePair(dbFilePath,internalFilePath);
+    return false;
     }
+  return query.value(0).toInt() == 12;
+}
 
-  QSqlQuery fileRemove ( d->Database );
-  fileRemove.prepare("DELETE FROM Images WHERE SeriesInstanceUID == :seriesID");
-  fileRemove.bindValue(":seriesID",seriesInstanceUID);
-  logger.debug("SQLITE: removing seriesInstanceUID " + seriesInstanceUID);
-  success = fileRemove.exec();
-  if (!success)
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::rebuildSearchIndex()
+{
+  Q_D(ctkDICOMDatabase);
+  QMutexLocker lock(&d->insertMutex);
+  if (!d->Database.tables().contains("Patients"))
     {
-      logger.error("SQLITE ERROR: could not remove seriesInstanceUID " + seriesInstanceUID);
-      logger.error("SQLITE ERROR: " + fileRemove.lastError().driverText());
+    return false;
     }
-
-  QPair<QString,QString> fileToRemove;
-  foreach (fileToRemove, removeList)
+  bool ownTransaction = !d->BatchInsertActive && d->Database.transaction();
+  bool success = d->executeScript(":/dicom/dicom-search-index.sql");
+  if (ownTransaction)
     {
-      QString dbFilePath = fileToRemove.first;
-      QString thumbnailToRemove = databaseDirectory() + "/thumbs/" + fileToRemove.second + ".png";
-
-      // check that the file is below our internal storage
-      if (dbFilePath.startsWith( databaseDirectory() + "/dicom/"))
-        {
-          if (!dbFilePath.endsWith(fileToRemove.second))
-            {
-              logger.error("Database inconsistency detected during delete!");
-              continue;
-            }
-          if (QFile( dbFilePath ).remove())
-            {
-              logger.debug("Removed file " + dbFilePath );
-            }
-          else
-            {
-              logger.warn("Failed to remove file " + dbFilePath );
-            }
-        }
-      if (QFile( thumbnailToRemove ).remove())
-        {
-          logger.debug("Removed thumbnail " + thumbnailToRemove);
-        }
-      else
-        {
-          logger.warn("Failed to remove thumbnail " + thumbnailToRemove);
-        }
+    if (success)
+      {
+      success = d->Database.commit();
+      }
+    else
+      {
+      d->Database.rollback();
+      }
     }
+  return success;
+}
 
-  this->cleanup();
-
-  d->LastSeriesInstanceUID = "";
-
-  return true;
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabase::fullTextQuery(const QString& text)
+{
+  // the FTS4 simple tokenizer splits words on anything but letters and
+  // digits. The words are lower case so that none is taken for an operator.
+  QStringList terms;
+  QString word;
+  foreach(const QChar& character, text + QChar(' '))
+    {
+    if (character.isLetterOrNumber())
+      {
+      word += character.toLower();
+      }
+    else if (!word.isEmpty())
+      {
+      terms << word + "*";
+      word.clear();
+      }
+    }
+  return terms.join(" ");
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::cleanup()
+namespace
 {
-  Q_D(ctkDICOMDatabase);
-  QSqlQuery seriesCleanup ( d->Database );
-  seriesCleanup.exec("DELETE FROM Series WHERE ( SELECT COUNT(*) FROM Images WHERE Images.SeriesInstanceUID = Series.SeriesInstanceUID ) = 0;");
-  seriesCleanup.exec("DELETE FROM Studies WHERE ( SELECT COUNT(*) FROM Series WHERE Series.StudyInstanceUID = Studies.StudyInstanceUID ) = 0;");
-  seriesCleanup.exec("DELETE FROM Patients WHERE ( SELECT COUNT(*) FROM Studies WHERE Studies.PatientsUID = Patients.UID ) = 0;");
-  return true;
+bool searchMatchLessThan(const ctkDICOMSearchMatch& match1, const ctkDICOMSearchMatch& match2)
+{
+  if (match1.Score != match2.Score)
+    {
+    return match1.Score > match2.Score;
+    }
+  return match1.MatchLevel < match2.MatchLevel;
+}
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::removeStudy(const QString& studyInstanceUID)
+QList<ctkDICOMSearchMatch> ctkDICOMDatabase::search(const QString& text, int limit)
 {
   Q_D(ctkDICOMDatabase);
-
-  QSqlQuery seriesForStudy( d->Database );
-  seriesForStudy.prepare("SELECT SeriesInstanceUID FROM Series WHERE StudyInstanceUID = :studyID");
-  seriesForStudy.bindValue(":studyID", studyInstanceUID);
-  bool success = seriesForStudy.exec();
-  if (!success)
+  QList<ctkDICOMSearchMatch> matches;
+  const QString matchExpression = fullTextQuery(text);
+  if (matchExpression.isEmpty() || !this->searchIndexExists())
     {
-      logger.error("SQLITE ERROR: " + seriesForStudy.lastError().driverText());
-      return false;
+    return matches;
     }
-  bool result = true;
-  while ( seriesForStudy.next() )
+  const char* tables[] = {"PatientsSearch", "StudiesSearch", "SeriesSearch"};
+  QMap<int, QList<ctkDICOMSearchMatch> > matchesByLength;
+  for (int level = ctkDICOMSearchMatch::Patient; level <= ctkDICOMSearchMatch::Series; ++level)
     {
-      QString seriesInstanceUID = seriesForStudy.value(seriesForStudy.record().indexOf("SeriesInstanceUID")).toString();
-      if ( ! this->removeSeries(seriesInstanceUID) )
-        {
-          result = false;
-        }
+    // offsets() lists 4 integers per occurrence of a term
+    QSqlQuery query(d->Database);
+    query.prepare(QString("SELECT UID, offsets(%1), length(Content) FROM %1 WHERE Content MATCH ?")
+                  .arg(tables[level]));
+    query.bindValue(0, matchExpression);
+    if (!d->loggedExec(query))
+      {
+      continue;
+      }
+    while (query.next())
+      {
+      ctkDICOMSearchMatch match;
+      match.MatchLevel = static_cast<ctkDICOMSearchMatch::Level>(level);
+      match.UID = query.value(0).toString();
+      match.Score = query.value(1).toString().split(' ', QString::SkipEmptyParts).count() / 4;
+      matchesByLength[query.value(2).toInt()] << match;
+      }
+    }
+  // shortest descriptors first for a given score: they match more exactly
+  foreach(const QList<ctkDICOMSearchMatch>& sameLength, matchesByLength)
+    {
+    matches << sameLength;
+    }
+  qStableSort(matches.begin(), matches.end(), searchMatchLessThan);
+  if (limit >= 0 && matches.count() > limit)
+    {
+    matches.erase(matches.begin() + limit, matches.end());
+    }
+  return matches;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::cleanup()
+{
+  Q_D(ctkDICOMDatabase);
+  QMutexLocker lock(&d->insertMutex);
+  bool ownTransaction = !d->BatchInsertActive && d->Database.transaction();
+  // each table is compared once with the keys referenced by its children,
+  // rather than counting the children of every row
+  QSqlQuery cleanup ( d->Database );
+  bool result = d->loggedExec(cleanup, "DELETE FROM Series WHERE SeriesInstanceUID NOT IN "
+                                       "( SELECT SeriesInstanceUID FROM Images WHERE SeriesInstanceUID IS NOT NULL )")
+    && d->loggedExec(cleanup, "DELETE FROM Studies WHERE StudyInstanceUID NOT IN "
+                              "( SELECT StudyInstanceUID FROM Series WHERE StudyInstanceUID IS NOT NULL )")
+    && d->loggedExec(cleanup, "DELETE FROM Patients WHERE UID NOT IN "
+                              "( SELECT PatientsUID FROM Studies WHERE PatientsUID IS NOT NULL )")
+    // the space is reclaimed by compactThumbnails()
+    && d->loggedExec(cleanup, "DELETE FROM Thumbnails WHERE SOPInstanceUID NOT IN "
+                              "( SELECT SOPInstanceUID FROM Images WHERE SOPInstanceUID IS NOT NULL )");
+  if (ownTransaction)
+    {
+    if (result)
+      {
+      result = d->Database.commit();
+      }
+    else
+      {
+      d->Database.rollback();
+      }
     }
-  d->LastStudyInstanceUID = "";
   return result;
 }
 
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::removeStudy(const QString& studyInstanceUID)
+{
+  return this->removeStudies(QStringList() << studyInstanceUID);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::removeStudies(const QStringList& studyInstanceUIDs,
+                                     ctkDICOMRemovalReport* report, bool dryRun)
+{
+  Q_D(ctkDICOMDatabase);
+  return d->removeSets(ctkDICOMDatabasePrivate::StudyLevel, studyInstanceUIDs, report, dryRun);
+}
+
 //------------------------------------------------------------------------------
 bool ctkDICOMDatabase::removePatient(const QString& patientID)
+{
+  return this->removePatients(QStringList() << patientID);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::removePatients(const QStringList& patientUIDs,
+                                      ctkDICOMRemovalReport* report, bool dryRun)
 {
   Q_D(ctkDICOMDatabase);
+  return d->removeSets(ctkDICOMDatabasePrivate::PatientLevel, patientUIDs, report, dryRun);
+}
 
-  QSqlQuery studiesForPatient( d->Database );
-  studiesForPatient.prepare("SELECT StudyInstanceUID FROM Studies WHERE PatientsUID = :patientsID");
-  studiesForPatient.bindValue(":patientsID", patientID);
-  bool success = studiesForPatient.exec();
-  if (!success)
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::isReclaimingFiles() const
+{
+  Q_D(const ctkDICOMDatabase);
+  QMutexLocker lock(&d->ReclaimMutex);
+  return d->ReclaimRunning;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::waitForFileReclamation()
+{
+  Q_D(ctkDICOMDatabase);
+  forever
     {
-      logger.error("SQLITE ERROR: " + studiesForPatient.lastError().driverText());
-      return false;
-    }
-  bool result = true;
-  while ( studiesForPatient.next() )
+    QFuture<void> future;
     {
-      QString studyInstanceUID = studiesForPatient.value(studiesForPatient.record().indexOf("StudyInstanceUID")).toString();
-      if ( ! this->removeStudy(studyInstanceUID) )
-        {
-          result = false;
-        }
+    QMutexLocker lock(&d->ReclaimMutex);
+    if (!d->ReclaimRunning)
+      {
+      return;
+      }
+    future = d->ReclaimFuture;
+    }
+    future.waitForFinished();
     }
-  d->LastPatientID = "";
-  d->LastPatientsName = "";
-  d->LastPatientsBirthDate = "";
-  d->LastPatientUID = -1;
-  return result;
 }
 
 ///
@@ -1213,14 +3537,21 @@ bool ctkDICOMDatabase::tagCacheExists()
   if ( !(d->TagCacheDatabase.isOpen()) )
     {
     qDebug() << "TagCacheDatabase not open\n";
-    d->TagCacheDatabase = QSqlDatabase::addDatabase("QSQLITE", "TagCache");
+    // one connection per database, see openSharedDatabase()
+    d->TagCacheDatabase = QSqlDatabase::addDatabase("QSQLITE", d->Database.connectionName() + "-TagCache");
     d->TagCacheDatabase.setDatabaseName(d->TagCacheDatabaseFilename);
+    if (d->SharedConnection)
+      {
+      // background writers wait for the backfill to commit
+      d->TagCacheDatabase.setConnectOptions("QSQLITE_BUSY_TIMEOUT=60000");
+      }
     if ( !(d->TagCacheDatabase.open()) )
       {
       qDebug() << "TagCacheDatabase would not open!\n";
       qDebug() << "TagCacheDatabaseFilename is: " << d->TagCacheDatabaseFilename << "\n";
       return false;
       }
+    d->applyPerformanceProfile(d->TagCacheDatabase, false);
     }
 
   // check that the table exists
@@ -1242,6 +3573,8 @@ bool ctkDICOMDatabase::initializeTagCache()
 {
   Q_D(ctkDICOMDatabase);
 
+  d->resetTagCacheStatements();
+
   // First, drop any existing table
   if ( this->tagCacheExists() )
     {
@@ -1257,6 +3590,7 @@ bool ctkDICOMDatabase::initializeTagCache()
   createCacheTable.prepare(
     "CREATE TABLE TagCache (SOPInstanceUID, Tag, Value, PRIMARY KEY (SOPInstanceUID, Tag))" );
   bool success = d->loggedExec(createCacheTable);
+  d->clearTagMemoryCache();
   if (success)
     {
     d->TagCacheVerified = true;
@@ -1269,23 +3603,8 @@ bool ctkDICOMDatabase::initializeTagCache()
 QString ctkDICOMDatabase::cachedTag(const QString sopInstanceUID, const QString tag)
 {
   Q_D(ctkDICOMDatabase);
-  if ( !this->tagCacheExists() )
-    {
-    if ( !this->initializeTagCache() )
-      {
-      return( "" );
-      }
-    }
-  QSqlQuery selectValue( d->TagCacheDatabase );
-  selectValue.prepare( "SELECT Value FROM TagCache WHERE SOPInstanceUID = :sopInstanceUID AND Tag = :tag" );
-  selectValue.bindValue(":sopInstanceUID",sopInstanceUID);
-  selectValue.bindValue(":tag",tag);
-  d->loggedExec(selectValue);
   QString result("");
-  if (selectValue.next())
-    {
-    result = selectValue.value(0).toString();
-    }
+  d->lookupCachedTag(sopInstanceUID, tag, result);
   return( result );
 }
 
@@ -1305,5 +3624,112 @@ bool ctkDICOMDatabase::cacheTag(const QString sopInstanceUID, const QString tag,
   insertTag.bindValue(":sopInstanceUID",sopInstanceUID);
   insertTag.bindValue(":tag",tag);
   insertTag.bindValue(":value",value);
+  d->memoryCacheTag(sopInstanceUID, tag, value);
   return d->loggedExec(insertTag);
 }
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setTagCacheMemorySize(int entries)
+{
+  Q_D(ctkDICOMDatabase);
+  QMutexLocker lock(&d->TagMemoryCacheMutex);
+  d->TagMemoryCache.setMaxCost(qMax(0, entries));
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::tagCacheMemorySize() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->TagMemoryCache.maxCost();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::tagCacheMemoryHits() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->TagCacheMemoryHits;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::tagCacheTableHits() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->TagCacheTableHits;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::tagCacheMisses() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->TagCacheMisses;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::resetTagCacheStatistics()
+{
+  Q_D(ctkDICOMDatabase);
+  d->TagCacheMemoryHits = 0;
+  d->TagCacheTableHits = 0;
+  d->TagCacheMisses = 0;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setTagsToPrecache(const QStringList& tags)
+{
+  Q_D(ctkDICOMDatabase);
+  QMutexLocker lock(&d->insertMutex);
+  d->TagsToPrecache.clear();
+  d->TagKeysToPrecache.clear();
+  foreach (const QString& tag, tags)
+    {
+    unsigned short group, element;
+    if (!this->tagToGroupElement(tag, group, element))
+      {
+      logger.warn("Invalid tag to precache: " + tag);
+      continue;
+      }
+    // same spelling as instanceValue() uses for the cache entries
+    d->TagsToPrecache << this->groupElementToTag(group, element);
+    d->TagKeysToPrecache << DcmTagKey(group, element);
+    }
+}
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMDatabase::tagsToPrecache() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->TagsToPrecache;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::backfillTagCache()
+{
+  Q_D(ctkDICOMDatabase);
+  if (this->isTagCacheBackfillRunning() || d->TagsToPrecache.isEmpty())
+    {
+    return;
+    }
+  d->TagCacheBackfillCanceled = false;
+  d->TagCacheBackfillFuture = QtConcurrent::run(d, &ctkDICOMDatabasePrivate::backfillTagCache, d->TagsToPrecache);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::cancelTagCacheBackfill()
+{
+  Q_D(ctkDICOMDatabase);
+  d->TagCacheBackfillCanceled = true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::isTagCacheBackfillRunning() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->TagCacheBackfillFuture.isRunning();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::waitForTagCacheBackfill()
+{
+  Q_D(ctkDICOMDatabase);
+  d->TagCacheBackfillFuture.waitForFinished();
+}
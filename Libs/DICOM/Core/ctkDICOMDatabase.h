@@ -22,7 +22,11 @@
 #define __ctkDICOMDatabase_h
 
 // Qt includes
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
 #include <QObject>
+#include <QPair>
 #include <QStringList>
 #include <QSqlDatabase>
 
@@ -33,6 +37,46 @@ class ctkDICOMDatabasePrivate;
 class DcmDataset;
 class ctkDICOMAbstractThumbnailGenerator;
 
+/// \ingroup DICOM_Core
+///
+/// What ctkDICOMDatabase::removeSeries(), removeStudies() or
+/// removePatients() remove, or would remove in a dry run
+struct ctkDICOMRemovalReport
+{
+  ctkDICOMRemovalReport()
+    : Patients(0), Studies(0), Series(0), Images(0), FileBytes(0),
+      Thumbnails(0), ThumbnailBytes(0) {}
+  int Patients;
+  int Studies;
+  int Series;
+  int Images;
+  /// copies stored in the database directory
+  QStringList Files;
+  qint64 FileBytes;
+  /// thumbnails of the removed images. The space they take in the
+  /// thumbnail file is freed by ctkDICOMDatabase::compactThumbnails().
+  int Thumbnails;
+  qint64 ThumbnailBytes;
+};
+
+/// \ingroup DICOM_Core
+///
+/// Patient, study or series found by ctkDICOMDatabase::search()
+struct ctkDICOMSearchMatch
+{
+  enum Level
+  {
+    Patient,
+    Study,
+    Series
+  };
+  Level MatchLevel;
+  /// key of the Patients table, StudyInstanceUID or SeriesInstanceUID
+  QString UID;
+  /// number of term occurrences in the descriptors
+  int Score;
+};
+
 /// \ingroup DICOM_Core
 ///
 /// Class handling a database of DICOM objects. So far, an underlying
@@ -55,13 +99,52 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMDatabase : public QObject
   Q_PROPERTY(bool isOpen READ isOpen)
   Q_PROPERTY(QString lastError READ lastError)
   Q_PROPERTY(QString databaseFilename READ databaseFilename)
+  Q_PROPERTY(int insertBatchSize READ insertBatchSize WRITE setInsertBatchSize)
+  Q_PROPERTY(PerformanceProfile performanceProfile READ performanceProfile WRITE setPerformanceProfile)
+  Q_PROPERTY(int thumbnailThreadCount READ thumbnailThreadCount WRITE setThumbnailThreadCount)
+  Q_ENUMS(PerformanceProfile)
 
 public:
+  /// SQLite settings applied to the connections when the database is opened.
+  /// WAL requires the database file to be on a local file system.
+  enum PerformanceProfile
+  {
+    /// SQLite defaults: rollback journal, synchronous FULL.
+    /// A commit is on disk when it returns, even after a power failure,
+    /// but readers wait for the writer and the writer waits for readers.
+    CompatibilityProfile,
+    /// WAL journal, synchronous NORMAL, 64 MB page cache, 256 MB memory
+    /// mapping, temporary tables in memory. Readers never wait for the
+    /// writer. An application crash loses nothing; a power failure or OS
+    /// crash may lose the last commits but does not corrupt the database.
+    BalancedProfile,
+    /// As BalancedProfile with synchronous OFF, 256 MB page cache and 1 GB
+    /// memory mapping, for bulk imports that can be redone. An application
+    /// crash loses nothing; a power failure or OS crash may corrupt the
+    /// database.
+    FastProfile
+  };
+
   explicit ctkDICOMDatabase(QObject *parent = 0);
   explicit ctkDICOMDatabase(QString databaseFile);
   virtual ~ctkDICOMDatabase();
 
   const QSqlDatabase& database() const;
+  /// Read-only connection to the database for the calling thread, opened on
+  /// first use and closed when the thread exits or the database is closed.
+  /// With a WAL profile, queries on it never wait for an import in progress
+  /// (e.g. ctkDICOMModel). For an in-memory database, database() is returned.
+  QSqlDatabase readOnlyDatabase();
+  /// Open the database file of \a database on a connection of the calling
+  /// thread, with the performance profile, insert batch size and tags to
+  /// precache of \a database. A connection can only be used by the thread
+  /// that opened it: a background thread writing into \a database does it
+  /// through a ctkDICOMDatabase of its own opened this way, destroyed by the
+  /// same thread. The thumbnails queued by its inserts are generated by
+  /// \a database, which must outlive it.
+  /// @Returns false if \a database is not open or is in memory (a second
+  ///          connection to ":memory:" would be another, empty, database)
+  bool openSharedDatabase(ctkDICOMDatabase& database);
   const QString lastError() const;
   const QString databaseFilename() const;
 
@@ -83,6 +166,15 @@ public:
   /// @return True if in memory mode, false otherwise.
   bool isInMemory() const;
 
+  ///
+  /// Performance profile, BalancedProfile by default. If the database is
+  /// open, the profile is applied to database() right away (except while a
+  /// batch insert is running) and to the read-only connections opened
+  /// afterwards. Leaving WAL only works while no other connection is open,
+  /// otherwise it happens at the next openDatabase().
+  void setPerformanceProfile(PerformanceProfile profile);
+  PerformanceProfile performanceProfile() const;
+
   ///
   /// set thumbnail generator object
   void setThumbnailGenerator(ctkDICOMAbstractThumbnailGenerator* generator);
@@ -90,6 +182,73 @@ public:
   /// get thumbnail genrator object
   ctkDICOMAbstractThumbnailGenerator* thumbnailGenerator();
 
+  ///
+  /// \brief Thumbnail queue
+  /// Thumbnails are not generated by insert() but queued and generated by
+  /// a pool of background threads. Their rows are written in the thread of
+  /// the database, by the event loop or waitForThumbnails(), then
+  /// thumbnailGenerated() is emitted. A thumbnail already queued or being
+  /// generated is not queued again. Requests made with requestThumbnail() are served first,
+  /// then the ones of the visibleThumbnailSeries(), then the others in
+  /// the order they were queued.
+  /// The generator must be thread safe and outlive the queued requests,
+  /// see cancelThumbnails() and waitForThumbnails().
+  ///
+  /// Number of threads generating thumbnails, half the cores by default
+  void setThumbnailThreadCount(int threadCount);
+  int thumbnailThreadCount() const;
+  /// Queue the thumbnail of an instance of the database ahead of the
+  /// thumbnails queued by insert()
+  /// @Returns false if there is no generator or the instance is unknown
+  Q_INVOKABLE bool requestThumbnail(const QString& sopInstanceUID);
+  /// Queue the thumbnails of the database that are missing or older than
+  /// their file, for all the instances or only for the middle instance of
+  /// each series by file name (the one shown by ctkDICOMThumbnailListWidget).
+  /// The stored thumbnails and the file times recorded by the directory
+  /// manifests are looked up in a single query; only the stored copies,
+  /// which have no manifest, are stat()ed. With \a force the thumbnails
+  /// of the selected instances are discarded and queued again: after
+  /// cancelThumbnails(), calling it again without \a force resumes where
+  /// it stopped. The thumbnails are committed in batches, in the thread of
+  /// the database, if a batch insert is active.
+  /// @Returns the number of thumbnails queued, -1 if there is no generator
+  Q_INVOKABLE int regenerateThumbnails(bool allInstances = false, bool force = false);
+  /// Series whose queued thumbnails are generated before the other ones
+  /// (e.g. series displayed by the application), in order of importance
+  Q_INVOKABLE void setVisibleThumbnailSeries(const QStringList& seriesInstanceUIDs);
+  Q_INVOKABLE QStringList visibleThumbnailSeries() const;
+  /// Drop the queued thumbnails, the ones being generated are completed
+  Q_INVOKABLE void cancelThumbnails();
+  /// Number of thumbnails queued, being generated or waiting to be stored
+  Q_INVOKABLE int pendingThumbnailCount() const;
+  /// Block until the thumbnail threads are done, then store the generated
+  /// thumbnails. To be called from the thread of the database.
+  /// @Returns false if some thumbnails could not be stored, e.g. because
+  /// the database is locked. They are kept and stored by the next call.
+  bool waitForThumbnails();
+
+  ///
+  /// \brief Thumbnail storage
+  /// The encoded thumbnails are packed in a single file next to the
+  /// database file (ctkDICOMThumbnails.dat for ctkDICOM.sql), indexed by
+  /// the Thumbnails table (see ctkDICOMThumbnailStore).
+  /// @Returns the encoded thumbnail of an instance (PNG with
+  ///          ctkDICOMThumbnailGenerator), empty if there is none yet. The
+  ///          thumbnails of databases created before the thumbnail file,
+  ///          thumbs/<study>/<series>/<instance>.png, are found as well.
+  Q_INVOKABLE QByteArray thumbnailData(const QString& sopInstanceUID);
+  /// Encoded thumbnails of a series keyed by SOPInstanceUID, read at once.
+  /// The thumbnails not migrated to the thumbnail file are not included.
+  QMap<QString, QByteArray> seriesThumbnailData(const QString& seriesInstanceUID);
+  /// Move the PNG files of the thumbs directory into the thumbnail file and
+  /// remove them
+  /// @Returns the number of thumbnails migrated
+  Q_INVOKABLE int migrateThumbnailFiles();
+  /// Rewrite the thumbnail file without the thumbnails that have been
+  /// removed or regenerated. The queued thumbnails are canceled.
+  /// @Returns false if a batch insert is active or the file can't be written
+  Q_INVOKABLE bool compactThumbnails();
+
   ///
   /// open the SQLite database in @param databaseFile . If the file does not
   /// exist, a new database is created and initialized with the
@@ -110,6 +269,13 @@ public:
   /// delete all data and reinitialize the database.
   Q_INVOKABLE bool initializeDatabase(const char* schemaFile = ":/dicom/dicom-schema.sql");
 
+  ///
+  /// \brief Version of the schema created by initializeDatabase()
+  /// openDatabase() upgrades older databases in place to this version.
+  static int schemaVersion();
+  /// Version of the schema of the open database, 0 if it predates versioning
+  Q_INVOKABLE int schemaVersionLoaded();
+
   ///
   /// \brief database accessors
   Q_INVOKABLE QStringList patients ();
@@ -119,6 +285,22 @@ public:
   Q_INVOKABLE QString fileForInstance (const QString sopInstanceUID);
   Q_INVOKABLE QString instanceForFile (const QString fileName);
 
+  ///
+  /// \brief cached aggregates
+  /// Counts and total size in bytes of the stored files below a patient,
+  /// study or series. They are kept up to date by the database itself on
+  /// every insertion and removal, so reading them costs a single lookup.
+  /// Files inserted before schema version 3 count as 0 bytes.
+  Q_INVOKABLE int studyCountForPatient (const QString patientUID);
+  Q_INVOKABLE int seriesCountForPatient (const QString patientUID);
+  Q_INVOKABLE int imageCountForPatient (const QString patientUID);
+  Q_INVOKABLE qint64 fileSizeForPatient (const QString patientUID);
+  Q_INVOKABLE int seriesCountForStudy (const QString studyUID);
+  Q_INVOKABLE int imageCountForStudy (const QString studyUID);
+  Q_INVOKABLE qint64 fileSizeForStudy (const QString studyUID);
+  Q_INVOKABLE int imageCountForSeries (const QString seriesUID);
+  Q_INVOKABLE qint64 fileSizeForSeries (const QString seriesUID);
+
   ///
   /// \brief load the header from a file and allow access to elements
   /// @param sopInstanceUID A string with the uid for a given instance
@@ -143,21 +325,116 @@ public:
   ///                  be stored to disk. Note that in case of a memory-only
   ///                  database, this flag is ignored. Usually, this flag
   ///                  does only make sense if a full object is received.
-  /// @param @generateThumbnail If true, a thumbnail is generated.
+  /// @param @generateThumbnail If true, a thumbnail is queued, see requestThumbnail().
   ///
   Q_INVOKABLE void insert( const ctkDICOMDataset& ctkDataset, bool storeFile, bool generateThumbnail);
   void insert ( DcmDataset *dataset, bool storeFile = true, bool generateThumbnail = true);
   Q_INVOKABLE void insert ( const QString& filePath, bool storeFile = true, bool generateThumbnail = true, bool createHierarchy = true, const QString& destinationDirectoryName = QString() );
-  
+  /// Insert a dataset that has already been read from \a filePath. The
+  /// dataset only needs to contain the indexedTags(), the file itself is
+  /// copied into the database directory if \a storeFile is set.
+  /// Returns true if an image was added, false if it was already in the
+  /// database up to date or could not be inserted.
+  bool insert ( const ctkDICOMDataset& ctkDataset, const QString& filePath, bool storeFile, bool generateThumbnail );
+
+  /// Attributes stored in the Patients, Studies, Series and Images tables.
+  /// Readers that only feed the database can restrict parsing to them.
+  static QList<DcmTagKey> indexedTags();
+
+  ///
+  /// \brief Bulk insert support
+  /// All inserts made between beginBatchInsert() and commitBatchInsert() are
+  /// grouped into transactions of insertBatchSize() instances instead of
+  /// being committed one by one. Patients, studies and series seen during the
+  /// batch are remembered in memory so they are looked up only once.
+  /// Removing data from the database while a batch is open is allowed, the
+  /// removal becomes part of the pending transaction.
+  /// @Returns false if a batch is already open or the transaction can't start
+  Q_INVOKABLE bool beginBatchInsert();
+  /// Commit the pending inserts and leave batch mode
+  Q_INVOKABLE bool commitBatchInsert();
+  /// Discard the inserts made since the last intermediate commit and leave
+  /// batch mode. Files already copied into the database directory are kept.
+  Q_INVOKABLE void rollbackBatchInsert();
+  Q_INVOKABLE bool isBatchInsertActive() const;
+  /// Number of instances committed at once in batch mode (default 1000)
+  void setInsertBatchSize(int batchSize);
+  int insertBatchSize() const;
+  /// Convenience method inserting all the files in a single batch
+  Q_INVOKABLE void insertFiles ( const QStringList& filePaths, bool storeFile = true, bool generateThumbnail = true );
+
   /// Check if file is already in database and up-to-date
   bool fileExistsAndUpToDate(const QString& filePath);
 
+  ///
+  /// \brief Directory manifest
+  /// For every directory indexed in place, the database remembers the size
+  /// and modification time of the files found in it (DirectoryFiles table),
+  /// so a rescan only needs to parse the new and modified files.
+  /// @Returns the file sizes and modification times (seconds since epoch)
+  ///          recorded for \a directoryName, keyed by file path
+  QHash<QString, QPair<qint64, uint> > directoryManifest(const QString& directoryName);
+  /// Record a file of \a directoryName as indexed. The directory is added
+  /// to the Directories table if needed. Part of the batch if one is open.
+  /// \a storedFilePath is the copy of the file in the database directory
+  /// the images are indexed from, if the file was stored.
+  void updateDirectoryManifest(const QString& directoryName, const QString& filePath,
+                               qint64 fileSize, uint modifiedTime,
+                               const QString& storedFilePath = QString());
+  /// Forget files that disappeared from an indexed directory: their manifest
+  /// entries, the images indexed from them and their thumbnails are removed.
+  /// Copies stored in the database directory are deleted as well.
+  bool removeFromDirectoryManifest(const QStringList& filePaths);
+
   /// remove the series from the database, including images and
   /// thumbnails
   Q_INVOKABLE bool removeSeries(const QString& seriesInstanceUID);
   Q_INVOKABLE bool removeStudy(const QString& studyInstanceUID);
   Q_INVOKABLE bool removePatient(const QString& patientID);
+
+  ///
+  /// \brief Set based removal
+  /// The series and everything below them are removed with a single
+  /// statement per table, in one transaction, together with the studies and
+  /// patients left empty. Within a batch insert, a removal that fails is
+  /// undone and false is returned, the batch itself stays open.
+  /// Stored copies and thumbnail files are deleted afterwards by a
+  /// background job, see isReclaimingFiles().
+  /// @param report filled with what is removed, if not null. Sizing the
+  ///        stored files needs one stat per file.
+  /// @param dryRun only fill \a report, nothing is removed
+  bool removeSeries(const QStringList& seriesInstanceUIDs,
+                    ctkDICOMRemovalReport* report = 0, bool dryRun = false);
+  bool removeStudies(const QStringList& studyInstanceUIDs,
+                     ctkDICOMRemovalReport* report = 0, bool dryRun = false);
+  /// \a patientUIDs are keys of the Patients table, as for removePatient()
+  bool removePatients(const QStringList& patientUIDs,
+                      ctkDICOMRemovalReport* report = 0, bool dryRun = false);
+  /// Remove the series, studies and patients left without images
   bool cleanup();
+  /// Files of removed images are still being deleted
+  Q_INVOKABLE bool isReclaimingFiles() const;
+  void waitForFileReclamation();
+
+  ///
+  /// \brief Full text search
+  /// Patient names and IDs, study descriptions and accession numbers, series
+  /// descriptions and body parts are indexed in the PatientsSearch,
+  /// StudiesSearch and SeriesSearch FTS4 tables, kept up to date by the
+  /// database on insertion and removal. The index is built when a database
+  /// without it is opened. Without the FTS4 module of SQLite, there is no
+  /// index and search() finds nothing.
+  Q_INVOKABLE bool searchIndexExists();
+  /// Drop and build the index again from the Patients, Studies and Series
+  /// tables
+  Q_INVOKABLE bool rebuildSearchIndex();
+  /// Patients, studies and series having words starting with each word of
+  /// \a text, the ones with the most occurrences first, then the ones with
+  /// the shortest descriptors. Case is ignored.
+  QList<ctkDICOMSearchMatch> search(const QString& text, int limit = 100);
+  /// MATCH expression searching the words of \a text as word prefixes,
+  /// empty if \a text has no word
+  static QString fullTextQuery(const QString& text);
 
   ///
   /// \brief access element values for given instance
@@ -170,6 +447,11 @@ public:
   /// @Returns empty string if element is missing
   Q_INVOKABLE QString instanceValue (const QString sopInstanceUID, const QString tag);
   Q_INVOKABLE QString instanceValue (const QString sopInstanceUID, const unsigned short group, const unsigned short element);
+  /// Values of \a tags (group,element strings) for each instance, in the
+  /// order of \a tags. Each file is parsed at most once for all its tags
+  /// missing from the cache, and the new values are written to the cache
+  /// in a single transaction.
+  QMap<QString, QStringList> instanceValues (const QStringList& sopInstanceUIDs, const QStringList& tags);
   Q_INVOKABLE QString fileValue (const QString fileName, const QString tag);
   Q_INVOKABLE QString fileValue (const QString fileName, const unsigned short group, const unsigned short element);
   Q_INVOKABLE bool tagToGroupElement (const QString tag, unsigned short& group, unsigned short& element);
@@ -194,9 +476,59 @@ public:
   /// Insert an instance tag's value into to the cache
   Q_INVOKABLE bool cacheTag (const QString sopInstanceUID, const QString tag, const QString value);
 
+  ///
+  /// \brief In-memory tier of the tag cache
+  /// The most recently used values are kept in memory in front of the
+  /// TagCache table, least recently used ones are dropped first.
+  /// @param entries Maximum number of values kept (default 100000), 0
+  ///                disables the memory tier
+  void setTagCacheMemorySize(int entries);
+  int tagCacheMemorySize() const;
+  /// Lookups answered from memory and from the TagCache table, and lookups
+  /// that needed the file, since the last resetTagCacheStatistics()
+  int tagCacheMemoryHits() const;
+  int tagCacheTableHits() const;
+  int tagCacheMisses() const;
+  void resetTagCacheStatistics();
+
+  ///
+  /// \brief Tags extracted at insert time
+  /// The values of these tags (group,element strings) are written to the
+  /// TagCache table when an instance is inserted, from the dataset already
+  /// in memory, so that instanceValue() never needs to read its file.
+  /// During a batch insert, they are committed right after the batch. The
+  /// TagCache table is in a separate file, the two commits are not atomic:
+  /// if the batch fails or is rolled back, the tag cache writes are rolled
+  /// back and the in-memory tier is cleared, so the cache can miss values
+  /// but never holds values of instances that are not in the database.
+  /// Changing the list does not affect the instances already in the
+  /// database, see backfillTagCache().
+  void setTagsToPrecache(const QStringList& tags);
+  QStringList tagsToPrecache() const;
+  /// Start a background job caching the tagsToPrecache() of all the
+  /// instances of the database that miss some of them. Files are only
+  /// parsed if needed. Does nothing if the job is already running.
+  Q_INVOKABLE void backfillTagCache();
+  Q_INVOKABLE void cancelTagCacheBackfill();
+  Q_INVOKABLE bool isTagCacheBackfillRunning() const;
+  void waitForTagCacheBackfill();
+
 
 Q_SIGNALS:
   void databaseChanged();
+  /// Emitted from the background thread running backfillTagCache()
+  void tagCacheBackfillProgress(int percent);
+  void tagCacheBackfillFinished();
+  /// Emitted in the thread of the database when the thumbnail of an
+  /// instance has been stored or found up to date
+  void thumbnailGenerated(const QString& sopInstanceUID);
+  /// Emitted from a background thread when the files of removed images
+  /// have been deleted
+  void filesReclaimed(int count);
+
+protected Q_SLOTS:
+  /// Write the rows of the thumbnails generated by the thumbnail threads
+  void storeGeneratedThumbnails();
 
 protected:
   QScopedPointer<ctkDICOMDatabasePrivate> d_ptr;
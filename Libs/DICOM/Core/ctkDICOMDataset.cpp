@@ -112,11 +112,10 @@ void ctkDICOMDataset::InitializeFromFile(const QString& filename,
                                          const Uint32 maxReadLength,
                                          const E_FileReadMode readMode)
 {
-  Q_UNUSED(maxReadLength);
   DcmDataset *dataset;
 
   DcmFileFormat fileformat;
-  OFCondition status = fileformat.loadFile(filename.toAscii().data(), readXfer, groupLength, readMode);
+  OFCondition status = fileformat.loadFile(filename.toAscii().data(), readXfer, groupLength, maxReadLength, readMode);
   dataset = fileformat.getAndRemoveDataset();
 
   if (!status.good())
@@ -129,42 +128,272 @@ void ctkDICOMDataset::InitializeFromFile(const QString& filename,
   InitializeFromDataset(dataset, true);
 }
 
+namespace
+{
+
+/// Loads the dataset of \a filename without its top level elements at or
+/// after \a stopTag, returns 0 if the file can't be read
+DcmDataset* LoadDatasetUntilTag(const QString& filename, const DcmTagKey& stopTag, const Uint32 maxReadLength)
+{
+  const QByteArray name = QDir::toNativeSeparators(filename).toLocal8Bit();
+  DcmFileFormat fileformat;
+#if OFFIS_DCMTK_VERSION_NUMBER >= 362
+  OFCondition status = fileformat.loadFileUntilTag(name.data(), EXS_Unknown, EGL_noChange,
+                                                   maxReadLength, ERM_autoDetect, stopTag);
+#else
+  // Without loadFileUntilTag() the whole file is parsed, but values longer
+  // than maxReadLength are seeked over and the ones pruned below are never
+  // read.
+  OFCondition status = fileformat.loadFile(name.data(), EXS_Unknown, EGL_noChange,
+                                           maxReadLength, ERM_autoDetect);
+#endif
+  if (!status.good())
+  {
+    // not logged, the indexer can meet many files that aren't DICOM and
+    // counts them instead
+    return 0;
+  }
+  DcmDataset* dataset = fileformat.getAndRemoveDataset();
+
+  // elements are sorted by tag
+  while (dataset->card() > 0)
+  {
+    DcmElement* last = dataset->getElement(dataset->card() - 1);
+    if (last->getTag() < stopTag)
+    {
+      break;
+    }
+    delete dataset->remove(last);
+  }
+  return dataset;
+}
+
+}
+
+bool ctkDICOMDataset::InitializeFromFileHeader(const QString& filename,
+                                               const DcmTagKey& stopTag,
+                                               const Uint32 maxReadLength)
+{
+  DcmDataset* dataset = LoadDatasetUntilTag(filename, stopTag, maxReadLength);
+  if (!dataset)
+  {
+    return false;
+  }
+  InitializeFromDataset(dataset, true);
+  return true;
+}
+
+bool ctkDICOMDataset::InitializeFromFileTags(const QString& filename,
+                                             const QList<DcmTagKey>& tags)
+{
+  QList<DcmTagKey> keptTags = tags;
+  if (!keptTags.contains(DCM_SpecificCharacterSet))
+  {
+    keptTags << DCM_SpecificCharacterSet;
+  }
+  // parse up to (and including) the last requested element
+  DcmTagKey stopTag(0, 0);
+  foreach(const DcmTagKey& tag, keptTags)
+  {
+    if (stopTag < tag)
+    {
+      stopTag = tag;
+    }
+  }
+  if (stopTag.getElement() < 0xffff)
+  {
+    stopTag.setElement(stopTag.getElement() + 1);
+  }
+  else
+  {
+    stopTag.set(stopTag.getGroup() + 1, 0);
+  }
+
+  DcmDataset* dataset = LoadDatasetUntilTag(filename, stopTag, DCM_MaxReadLength);
+  if (!dataset)
+  {
+    return false;
+  }
+  // move the requested elements, the rest is discarded unread
+  DcmDataset* subset = new DcmDataset;
+  foreach(const DcmTagKey& tag, keptTags)
+  {
+    DcmElement* element = dataset->remove(tag);
+    if (element)
+    {
+      element->loadAllDataIntoMemory();
+      subset->insert(element);
+    }
+  }
+  delete dataset;
+  InitializeFromDataset(subset, true);
+  return true;
+}
+
 void ctkDICOMDataset::Serialize()
 {
-  Q_D(ctkDICOMDataset);
-  EnsureDcmDataSetIsInitialized();
+  QByteArray data = this->SerializeToByteArray();
+  this->SetStoredSerialization( QString::fromAscii(data.toBase64()) );
+}
 
-  // store content of current DcmDataset (our parent) as QByteArray into m_ctkDICOMDataset
-  Uint32 buffersize = 1024*1024; // reserve 1MB
-  char* writebuffer = new char[buffersize];
+namespace
+{
+/// Size of the blocks read or written by the streaming serialization
+const int SerializationBlockSize = 64 * 1024;
+}
+
+QByteArray ctkDICOMDataset::SerializeToByteArray() const
+{
+  EnsureDcmDataSetIsInitialized();
+  DcmDataset& dataset = GetDcmDataset();
+
+  // the dataset is written straight into the returned array, which is
+  // sized to the dataset and only grows if DCMTK's estimate is short
+  QByteArray data;
+  data.resize(dataset.calcElementLength(EXS_LittleEndianImplicit, EET_UndefinedLength));
+  int written = 0;
+  OFCondition condition = EC_StreamNotifyClient;
+  dataset.transferInit();
+  while (condition == EC_StreamNotifyClient)
+  {
+    DcmOutputBufferStream dcmbuffer(data.data() + written, data.size() - written);
+    condition = dataset.write(dcmbuffer, EXS_LittleEndianImplicit, EET_UndefinedLength, NULL);
+    void* block = NULL;
+    offile_off_t length = 0;
+    dcmbuffer.flushBuffer(block, length);
+    written += static_cast<int>(length);
+    if (condition == EC_StreamNotifyClient)
+    {
+      data.resize(2 * data.size() + SerializationBlockSize);
+    }
+  }
+  dataset.transferEnd();
 
-  // write into buffer
-  DcmOutputBufferStream dcmbuffer(writebuffer, buffersize);
-  d->m_DcmDataset->transferInit();
-  OFCondition condition = d->m_DcmDataset->write(dcmbuffer, EXS_LittleEndianImplicit, EET_UndefinedLength, NULL );
-  d->m_DcmDataset->transferEnd();
   if ( condition.bad() )
   {
     std::cerr << "Could not DcmDataset::write(..): " << condition.text() << std::endl;
+    return QByteArray();
   }
+  data.resize(written);
+  return data;
+}
 
-  // get written contents of buffer
-  offile_off_t datasetsize = 0;
-  void* readbuffer = NULL;
-  dcmbuffer.flushBuffer(readbuffer, datasetsize);
+bool ctkDICOMDataset::DeserializeFromByteArray(const QByteArray& data)
+{
+  // DCMTK reads from the array itself, no intermediate copy
+  DcmInputBufferStream dcmbuffer;
+  dcmbuffer.setBuffer( data.constData(), data.size() );
+  dcmbuffer.setEos();
 
-  //std::cerr << "** " << (void*)this << " ctkDICOMDataset: Serializing Dataset into " << datasetsize << " bytes" << std::endl;
+  DcmDataset* dataset = new DcmDataset;
+  dataset->transferInit();
+  OFCondition condition = dataset->read( dcmbuffer, EXS_LittleEndianImplicit );
+  dataset->transferEnd();
+  dcmbuffer.releaseBuffer();
 
-  // construct Qt type from that contents
-  QByteArray qtArray = QByteArray::fromRawData( static_cast<const char*>(readbuffer), datasetsize );
-  //std::cerr << "** Buffer size: " << qtArray.size() << std::endl;
-  QString stringbuffer = QString::fromAscii(qtArray.toBase64());
+  // do this in all cases, even when reading reported an error
+  this->InitializeFromDataset(dataset, true);
+
+  // DCMTK asks for more data if the array ends within the dataset
+  if ( condition.bad() || condition == EC_StreamNotifyClient )
+  {
+    std::cerr << "Could not DcmDataset::read(..): " << condition.text() << std::endl;
+    return false;
+  }
+  return true;
+}
 
-  //std::cerr << "** String of size " << stringbuffer.size() << " looks like this:\n" << stringbuffer.toStdString() << std::endl << std::endl;
+bool ctkDICOMDataset::SerializeToDevice(QIODevice* device) const
+{
+  EnsureDcmDataSetIsInitialized();
+  if (!device)
+  {
+    return false;
+  }
+  DcmDataset& dataset = GetDcmDataset();
 
-  this->SetStoredSerialization( stringbuffer );
+  QByteArray block;
+  block.resize(SerializationBlockSize);
+  DcmOutputBufferStream dcmbuffer(block.data(), block.size());
+  OFCondition condition = EC_StreamNotifyClient;
+  bool deviceOk = true;
+  dataset.transferInit();
+  while (condition == EC_StreamNotifyClient && deviceOk)
+  {
+    condition = dataset.write(dcmbuffer, EXS_LittleEndianImplicit, EET_UndefinedLength, NULL);
+    void* written = NULL;
+    offile_off_t length = 0;
+    dcmbuffer.flushBuffer(written, length);
+    deviceOk = device->write(static_cast<const char*>(written), length) == length;
+  }
+  dataset.transferEnd();
 
-  delete[] writebuffer;
+  if ( condition.bad() )
+  {
+    std::cerr << "Could not DcmDataset::write(..): " << condition.text() << std::endl;
+  }
+  return deviceOk && condition.good();
+}
+
+bool ctkDICOMDataset::DeserializeFromDevice(QIODevice* device, qint64 size, int msecs)
+{
+  if (!device)
+  {
+    return false;
+  }
+  DcmInputBufferStream dcmbuffer;
+  DcmDataset* dataset = new DcmDataset;
+  OFCondition condition = EC_StreamNotifyClient;
+  qint64 remaining = size;
+  bool end = false;
+  bool timedOut = false;
+  dataset->transferInit();
+  while (condition == EC_StreamNotifyClient && !end)
+  {
+    qint64 blockSize = remaining < 0 ? SerializationBlockSize : qMin<qint64>(SerializationBlockSize, remaining);
+    QByteArray block = device->read(blockSize);
+    if (block.isEmpty() && blockSize > 0)
+    {
+      if (device->waitForReadyRead(msecs))
+      {
+        continue;
+      }
+      // a device that can't wait, like a file, is at its end
+      timedOut = remaining > 0;
+    }
+    if (remaining >= 0)
+    {
+      remaining -= block.size();
+    }
+    end = block.isEmpty() || remaining == 0;
+    if (!block.isEmpty())
+    {
+      dcmbuffer.setBuffer( block.constData(), block.size() );
+    }
+    if (end)
+    {
+      dcmbuffer.setEos();
+    }
+    condition = dataset->read( dcmbuffer, EXS_LittleEndianImplicit );
+    // keeps what DCMTK did not consume yet, block is released afterwards
+    dcmbuffer.releaseBuffer();
+  }
+  dataset->transferEnd();
+
+  this->InitializeFromDataset(dataset, true);
+
+  if ( timedOut )
+  {
+    std::cerr << "Could not DcmDataset::read(..): " << remaining
+              << " bytes not received after " << msecs << " ms" << std::endl;
+    return false;
+  }
+  if ( condition.bad() || condition == EC_StreamNotifyClient )
+  {
+    std::cerr << "Could not DcmDataset::read(..): " << condition.text() << std::endl;
+    return false;
+  }
+  return true;
 }
 
 void ctkDICOMDataset::MarkForInitialization()
@@ -205,40 +434,7 @@ void ctkDICOMDataset::Deserialize()
     return; // TODO nicer: hold three states: newly created / loaded but not initialized / restored from DB
   }
 
-
-  //std::cerr << "** " << (void*)this << " ctkDICOMDataset: Deserialize Dataset from string of size " << stringbuffer.size() << "\n" << stringbuffer.toStdString() << std::endl;
-
-  QByteArray qtArray = QByteArray::fromBase64( stringbuffer.toAscii() );
-  //std::cerr << "** " << (void*)this << " ctkDICOMDataset: Deserialize Dataset from byte array of size " << qtArray.size() << std::endl;
-
-  DcmInputBufferStream dcmbuffer;
-  dcmbuffer.setBuffer( qtArray.data(), qtArray.size() );
-  //std::cerr << "** Buffer state: " << dcmbuffer.status().code() << " " <<  dcmbuffer.good() << " " << dcmbuffer.eos() << " tell " << dcmbuffer.tell() << " avail " << dcmbuffer.avail() << std::endl;
-
-  DcmDataset dataset;
-  dataset.transferInit();
-  //std::cerr << "** Dataset state: " << dataset.transferState() << std::endl << std::endl;
-  OFCondition condition = dataset.read( dcmbuffer, EXS_LittleEndianImplicit );
-  dataset.transferEnd();
-
-  // do this in all cases, even when reading reported an error
-  this->InitializeFromDataset(&dataset);
-
-  if ( condition.bad() )
-  {
-    std::cerr << "** Condition code of Dataset::read() is "
-              << condition.code() << std::endl;
-    std::cerr << "** Buffer state: " << dcmbuffer.status().code()
-              << " " <<  dcmbuffer.good()
-              << " " << dcmbuffer.eos()
-              << " tell " << dcmbuffer.tell()
-              << " avail " << dcmbuffer.avail() << std::endl;
-    std::cerr << "** Dataset state: "
-              << static_cast<int>(dataset.transferState()) << std::endl;
-    std::cerr << "Could not DcmDataset::read(..): "
-              << condition.text() << std::endl;
-    //throw std::invalid_argument( std::string("Could not DcmDataset::read(..): ") + condition.text() );
-  }
+  this->DeserializeFromByteArray( QByteArray::fromBase64( stringbuffer.toAscii() ) );
 }
 
 DcmDataset& ctkDICOMDataset::GetDcmDataset() const
@@ -985,3 +1181,19 @@ bool ctkDICOMDataset::SaveToFile(const QString& filePath) const
   return status.good();
 }
 
+QDataStream& operator<<(QDataStream& stream, const ctkDICOMDataset& dataset)
+{
+  stream << dataset.SerializeToByteArray();
+  return stream;
+}
+
+QDataStream& operator>>(QDataStream& stream, ctkDICOMDataset& dataset)
+{
+  QByteArray data;
+  stream >> data;
+  if (stream.status() == QDataStream::Ok && !dataset.DeserializeFromByteArray(data))
+  {
+    stream.setStatus(QDataStream::ReadCorruptData);
+  }
+  return stream;
+}
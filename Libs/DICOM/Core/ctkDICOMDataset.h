@@ -26,6 +26,7 @@
 #include "ctkDICOMPersonName.h"
 
 #include <dcdatset.h> // DCMTK DcmDataset
+#include <dcdeftag.h> // DCMTK DCM_PixelData
 
 #include <QtCore>
 
@@ -89,6 +90,30 @@ public:
                     const Uint32 maxReadLength = DCM_MaxReadLength,
                     const E_FileReadMode readMode = ERM_autoDetect);
 
+    ///
+    /// \brief Initialization from the header of a file.
+    ///
+    /// Only the top level attributes before \a stopTag are kept, by default
+    /// the pixel data and whatever follows it are never read. Values longer
+    /// than \a maxReadLength are read from the file when they are accessed.
+    /// Use this instead of InitializeFromFile() when only attributes are
+    /// needed, e.g. for indexing.
+    /// \returns true on success
+    virtual bool InitializeFromFileHeader(const QString& filename,
+                    const DcmTagKey& stopTag = DCM_PixelData,
+                    const Uint32 maxReadLength = DCM_MaxReadLength);
+
+    ///
+    /// \brief Initialization from a subset of the top level attributes of
+    /// a file.
+    ///
+    /// Only the elements listed in \a tags (and the specific character set
+    /// needed to decode them) are kept and loaded into memory, parsing stops
+    /// after the last of them.
+    /// \returns true on success
+    virtual bool InitializeFromFileTags(const QString& filename,
+                    const QList<DcmTagKey>& tags);
+
 
 
     /// \brief Save dataset to file
@@ -99,17 +124,46 @@ public:
 
     /// \brief Store a string representation of the object to a database field.
     ///
-    /// The internal DcmDataset is serialized into a memory buffer using DcmDataset::write(..).
+    /// The internal DcmDataset is serialized with SerializeToByteArray().
     /// To store the memory buffer in a simple string database field, we convert it to a base64 encoded string.
     /// Doing so prevents errors from encoding conversions that could be made by QString or the database etc.
+    /// \note Kept for compatibility, new code should use the binary methods below.
     void Serialize();
 
     /// \brief Restore the object from a string representation in a database field.
     ///
-    /// The database stored string is base64 decoded into a memory buffer. Then
-    /// the internal DcmDataset is created using DcmDataset::read(..).
+    /// The database stored string is base64 decoded and read with
+    /// DeserializeFromByteArray().
     void Deserialize();
 
+    /// \brief Binary representation of the internal DcmDataset.
+    ///
+    /// The dataset is written with DcmDataset::write(..) in little endian
+    /// implicit transfer syntax, into a buffer sized to the dataset.
+    QByteArray SerializeToByteArray() const;
+
+    /// \brief Restore the object from the output of SerializeToByteArray()
+    /// or SerializeToDevice().
+    ///
+    /// \returns false if \a data is not a complete dataset. The object is
+    /// initialized with what could be read in any case.
+    bool DeserializeFromByteArray(const QByteArray& data);
+
+    /// \brief Streaming variant of SerializeToByteArray().
+    ///
+    /// The dataset is written to \a device block by block, large objects are
+    /// never held in memory twice.
+    /// \returns true on success.
+    bool SerializeToDevice(QIODevice* device) const;
+
+    /// \brief Streaming variant of DeserializeFromByteArray().
+    ///
+    /// Reads \a size bytes from \a device, or up to its end if \a size is
+    /// negative. Waits at most \a msecs for more data to arrive.
+    /// \returns false if the data read is not a complete dataset, or if the
+    /// \a size bytes were not received in time.
+    bool DeserializeFromDevice(QIODevice* device, qint64 size = -1, int msecs = 30000);
+
 
     /// \brief To be called from InitializeData, flags status as dirty.
     ///
@@ -256,5 +310,10 @@ private:
   Q_DECLARE_PRIVATE(ctkDICOMDataset);
 };
 
+/// Writes the binary representation of \a dataset, see ctkDICOMDataset::SerializeToByteArray()
+CTK_DICOM_CORE_EXPORT QDataStream& operator<<(QDataStream& stream, const ctkDICOMDataset& dataset);
+/// Reads a dataset written with operator<<()
+CTK_DICOM_CORE_EXPORT QDataStream& operator>>(QDataStream& stream, ctkDICOMDataset& dataset);
+
 #endif
 
@@ -31,7 +31,7 @@
 #include <QFileInfo>
 #include <QDebug>
 #include <QPixmap>
-#include <QtConcurrentRun>
+#include <QtConcurrentMap>
 
 // ctkDICOM includes
 #include "ctkLogger.h"
@@ -51,65 +51,400 @@
 #include <dcmtk/dcmimgle/dcmimage.h>  /* for class DicomImage */
 #include <dcmtk/dcmimage/diregist.h>  /* include support for color images */
 
-class AddFileFunctor
+//------------------------------------------------------------------------------
+static ctkLogger logger("org.commontk.dicom.DICOMIndexer" );
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// Parses the header of a file and queues the attributes the database needs
+class ParseFileFunctor
 {
 public:
-     AddFileFunctor(ctkDICOMIndexer* indexer, ctkDICOMDatabase& database,
-                    const QString& destinationDirectoryName = "")
-       : Indexer(indexer), Database(database), DestinationDirectoryName(destinationDirectoryName) { }
+  typedef void result_type;
 
-     bool operator()(const QString &filePath)
-     {
-         Indexer->addFile(Database,filePath,DestinationDirectoryName);
-         return false; // make sure it is removed;
-     }
+  ParseFileFunctor(ctkDICOMIndexerPrivate* indexerPrivate, const QList<DcmTagKey>& tags)
+    : IndexerPrivate(indexerPrivate), Tags(tags) { }
 
-     ctkDICOMIndexer* Indexer;
-     ctkDICOMDatabase& Database;
-     QString DestinationDirectoryName;
+  void operator()(const QString &filePath)
+  {
+    if (this->IndexerPrivate->Canceled)
+      {
+      return;
+      }
+    const bool timed =
+      this->IndexerPrivate->InstrumentationLevel == ctkDICOMIndexer::TimersInstrumentation;
+    QTime parseTimer;
+    if (timed)
+      {
+      parseTimer.start();
+      }
+    // stat before parsing: if the file changes meanwhile, the next
+    // refreshDatabase() sees it as modified
+    QFileInfo fileInfo(filePath);
+    // only the indexed attributes are kept, the pixel data is never read
+    ctkDICOMDataset* dataset = new ctkDICOMDataset;
+    if (!dataset->InitializeFromFileTags(filePath, this->Tags))
+      {
+      delete dataset;
+      dataset = 0;
+      }
+    ctkDICOMIndexerRecord* record = new ctkDICOMIndexerRecord(
+      filePath, fileInfo.size(), fileInfo.lastModified().toTime_t(), dataset);
+    if (timed)
+      {
+      record->ParseTime = parseTimer.elapsed();
+      }
+    this->IndexerPrivate->pushRecord(record);
+  }
 
- };
+  ctkDICOMIndexerPrivate* IndexerPrivate;
+  QList<DcmTagKey> Tags;
+};
 
 
 //------------------------------------------------------------------------------
-static ctkLogger logger("org.commontk.dicom.DICOMIndexer" );
+// ctkDICOMIndexerWriter methods
+
 //------------------------------------------------------------------------------
+ctkDICOMIndexerWriter::ctkDICOMIndexerWriter(ctkDICOMIndexerPrivate* indexerPrivate)
+  : IndexerPrivate(indexerPrivate)
+{
+}
 
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerWriter::run()
+{
+  this->IndexerPrivate->writeRecords();
+}
 
 //------------------------------------------------------------------------------
 // ctkDICOMIndexerPrivate methods
 
 //------------------------------------------------------------------------------
-ctkDICOMIndexerPrivate::ctkDICOMIndexerPrivate(ctkDICOMIndexer& o) : q_ptr(&o), Canceled(false), CurrentPercentageProgress(-1)
+ctkDICOMIndexerPrivate::ctkDICOMIndexerPrivate(ctkDICOMIndexer& o)
+  : q_ptr(&o)
+  , Canceled(false)
+  , CurrentPercentageProgress(-1)
+  , InstrumentationLevel(ctkDICOMIndexer::NoInstrumentation)
+  , Mode(ImportStatistics)
+  , Database(0)
+  , StoreFiles(false)
+  , FilesWritten(0)
+  , Writer(this)
+  , MaxQueuedRecords(512)
+  , FilesToParse(0)
+  , ThumbnailDatabase(0)
+  , OwnThumbnailBatch(false)
 {
-  Q_Q(ctkDICOMIndexer);
-  connect(&DirectoryImportWatcher,SIGNAL(progressValueChanged(int)),this,SLOT(OnProgress(int)));
-  connect(&DirectoryImportWatcher,SIGNAL(finished()),q,SIGNAL(indexingComplete()));
-  connect(&DirectoryImportWatcher,SIGNAL(canceled()),q,SIGNAL(indexingComplete()));
 }
 
 //------------------------------------------------------------------------------
 ctkDICOMIndexerPrivate::~ctkDICOMIndexerPrivate()
 {
+  {
+  QMutexLocker lock(&this->RecordsMutex);
+  this->Canceled = true;
+  this->RecordsNotFull.wakeAll();
+  this->RecordsNotEmpty.wakeAll();
+  }
   DirectoryImportWatcher.cancel();
-  DirectoryImportWatcher.waitForFinished();
+  this->waitForImportFinished();
+  if (this->ThumbnailDatabase)
+    {
+    // the thumbnails generated so far are kept
+    this->ThumbnailDatabase->cancelThumbnails();
+    this->ThumbnailDatabase->waitForThumbnails();
+    QObject::disconnect(this->ThumbnailDatabase, SIGNAL(thumbnailGenerated(QString)),
+                        this, SLOT(onThumbnailGenerated()));
+    if (this->OwnThumbnailBatch)
+      {
+      this->ThumbnailDatabase->commitBatchInsert();
+      }
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivate::waitForImportFinished()
+{
+  this->DirectoryImportWatcher.waitForFinished();
+  this->Writer.wait();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivate::pushRecord(ctkDICOMIndexerRecord* record)
+{
+  QMutexLocker lock(&this->RecordsMutex);
+  while (this->Records.count() >= this->MaxQueuedRecords && !this->Canceled)
+    {
+    this->RecordsNotFull.wait(&this->RecordsMutex);
+    }
+  --this->FilesToParse;
+  if (this->Canceled)
+    {
+    delete record;
+    }
+  else
+    {
+    this->Records.enqueue(record);
+    }
+  // the last file also wakes up the writer to let it know the parsing ended
+  this->RecordsNotEmpty.wakeAll();
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMIndexerRecord* ctkDICOMIndexerPrivate::takeRecord()
+{
+  QMutexLocker lock(&this->RecordsMutex);
+  while (this->Records.isEmpty())
+    {
+    // once canceled, the files still being parsed are never queued
+    if (this->FilesToParse <= 0 || this->Canceled)
+      {
+      return 0;
+      }
+    this->RecordsNotEmpty.wait(&this->RecordsMutex);
+    }
+  ctkDICOMIndexerRecord* record = this->Records.dequeue();
+  this->RecordsNotFull.wakeOne();
+  return record;
+}
 
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivate::writeRecords()
+{
+  // connections can't be shared with the other threads: the records are
+  // inserted through a connection of the writer thread
+  ctkDICOMDatabase writerDatabase;
+  if (!writerDatabase.openSharedDatabase(*this->Database))
+    {
+    logger.error("Could not open the database for indexing: " + writerDatabase.lastError());
+    // the parsed records are dropped
+    QMutexLocker lock(&this->RecordsMutex);
+    this->Canceled = true;
+    this->RecordsNotFull.wakeAll();
+    }
+  this->insertRecords(writerDatabase);
 }
 
-void ctkDICOMIndexerPrivate::OnProgress(int progress)
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivate::insertRecords(ctkDICOMDatabase& database)
 {
   Q_Q(ctkDICOMIndexer);
 
-  int newPercentageProgress = ( 100 * DirectoryImportFuture.progressValue() ) / DirectoryImportFuture.progressMaximum();
-  if (newPercentageProgress != CurrentPercentageProgress)
+  const int totalNumberOfFiles = this->FilesToIndex.count();
+  const bool counted = this->InstrumentationLevel != ctkDICOMIndexer::NoInstrumentation;
+  const bool timed = this->InstrumentationLevel == ctkDICOMIndexer::TimersInstrumentation;
+  QTime insertTimer;
+  int unreadableFiles = 0;
+  bool ownBatch = database.beginBatchInsert();
+  while (ctkDICOMIndexerRecord* record = this->takeRecord())
     {
-      CurrentPercentageProgress = newPercentageProgress;
+    if (this->Canceled)
+      {
+      delete record;
+      continue;
+      }
+    emit q->indexingFilePath(record->FilePath);
+    if (timed)
+      {
+      insertTimer.start();
+      }
+    bool inserted = false;
+    QString storedFilePath;
+    if (record->Dataset)
+      {
+      inserted = database.insert(*record->Dataset, record->FilePath, this->StoreFiles, true);
+      if (this->StoreFiles)
+        {
+        // the images are indexed under the path of the copy
+        storedFilePath = database.fileForInstance(
+          record->Dataset->GetElementAsString(DCM_SOPInstanceUID));
+        }
+      }
+    else
+      {
+      // reported at the end, there can be many files that aren't DICOM
+      ++unreadableFiles;
+      }
+    // unreadable files are recorded as well so that they are not parsed
+    // again by the next refreshDatabase()
+    database.updateDirectoryManifest(this->DirectoryName, record->FilePath,
+                                     record->FileSize, record->ModifiedTime, storedFilePath);
+    if (counted)
+      {
+      if (record->Dataset)
+        {
+        ++this->Statistics.FilesParsed;
+        this->Statistics.BytesParsed += record->FileSize;
+        }
+      if (inserted)
+        {
+        ++this->Statistics.FilesInserted;
+        }
+      else
+        {
+        ++this->Statistics.FilesSkipped;
+        }
+      }
+    if (timed)
+      {
+      this->Statistics.ParseTime += record->ParseTime;
+      this->Statistics.InsertTime += insertTimer.elapsed();
+      }
+    delete record;
+
+    emit q->indexingFileNumber(++this->FilesWritten);
+    int newPercentageProgress = ( 100 * this->FilesWritten ) / totalNumberOfFiles;
+    if (newPercentageProgress != this->CurrentPercentageProgress)
+      {
+      this->CurrentPercentageProgress = newPercentageProgress;
       emit q->progress(newPercentageProgress);
+      }
+    }
+  if (timed)
+    {
+    insertTimer.start();
     }
+  if (ownBatch)
+    {
+    database.commitBatchInsert();
+    }
+  if (timed)
+    {
+    this->Statistics.InsertTime += insertTimer.elapsed();
+    }
+  if (unreadableFiles > 0)
+    {
+    logger.warn(QString("%1 files of %2 could not be read as DICOM")
+                .arg(unreadableFiles).arg(this->DirectoryName));
+    }
+  this->finishStatistics();
+  emit q->indexingComplete();
+}
 
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivate::startStatistics(StatisticsMode mode, const QString& directoryName)
+{
+  this->Mode = mode;
+  this->DirectoryName = directoryName;
+  this->Statistics = ctkDICOMIndexerStatistics();
+  if (this->InstrumentationLevel == ctkDICOMIndexer::TimersInstrumentation)
+    {
+    this->ImportTimer.start();
+    }
 }
 
 //------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivate::finishStatistics()
+{
+  Q_Q(ctkDICOMIndexer);
+  if (this->InstrumentationLevel == ctkDICOMIndexer::NoInstrumentation)
+    {
+    return;
+    }
+  if (this->InstrumentationLevel == ctkDICOMIndexer::TimersInstrumentation)
+    {
+    this->Statistics.TotalTime = this->ImportTimer.elapsed();
+    }
+  logger.info(q->statisticsSummary());
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMIndexerPrivate::waitForThumbnails()
+{
+  if (!this->ThumbnailDatabase)
+    {
+    return true;
+    }
+  // the rows that could not be written, e.g. because another process holds
+  // the database, are tried again a few times rather than lost
+  bool stored = this->ThumbnailDatabase->waitForThumbnails();
+  for (int attempt = 1; !stored && attempt < 3; ++attempt)
+    {
+    stored = this->ThumbnailDatabase->waitForThumbnails();
+    }
+  if (!stored)
+    {
+    logger.error(QString("Could not store %1 thumbnails")
+                 .arg(this->ThumbnailDatabase->pendingThumbnailCount()));
+    }
+  QObject::disconnect(this->ThumbnailDatabase, SIGNAL(thumbnailGenerated(QString)),
+                      this, SLOT(onThumbnailGenerated()));
+  if (this->OwnThumbnailBatch)
+    {
+    stored = this->ThumbnailDatabase->commitBatchInsert() && stored;
+    }
+  this->ThumbnailDatabase = 0;
+  this->OwnThumbnailBatch = false;
+  this->Statistics.ThumbnailsGenerated = this->ThumbnailsGenerated;
+  this->finishStatistics();
+  return stored;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivate::onThumbnailGenerated()
+{
+  this->ThumbnailsGenerated.ref();
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMIndexerPrivate::manifestDirectoryName(const QString& directoryName)
+{
+  return QDir(directoryName).absolutePath();
+}
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMIndexerPrivate::filesInDirectory(const QString& directoryName)
+{
+  OFList<OFString> originalDcmtkFileNames;
+  OFStandard::searchDirectoryRecursively( QDir::toNativeSeparators(directoryName).toAscii().data(), originalDcmtkFileNames, "", "");
+
+  // hack to reverse list of filenames (not neccessary when image loading works correctly)
+  QStringList fileNames;
+  for ( OFListIterator(OFString) iter = originalDcmtkFileNames.begin(); iter != originalDcmtkFileNames.end(); ++iter )
+  {
+    fileNames.prepend( QString((*iter).c_str()) );
+  }
+  return fileNames;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivate::startImport(ctkDICOMDatabase& database,
+                                         const QString& directoryName, bool storeFiles)
+{
+  this->Canceled = false;
+  this->Database = &database;
+  this->DirectoryName = directoryName;
+  this->StoreFiles = storeFiles;
+  this->FilesWritten = 0;
+  this->FilesToParse = this->FilesToIndex.count();
+  this->CurrentPercentageProgress = -1;
+
+  // the tags to precache are written to the tag cache by the insert
+  QList<DcmTagKey> tags = ctkDICOMDatabase::indexedTags();
+  foreach (const QString& tag, database.tagsToPrecache())
+    {
+    unsigned short group, element;
+    if (database.tagToGroupElement(tag, group, element))
+      {
+      tags << DcmTagKey(group, element);
+      }
+    }
+
+  // The headers are parsed in the global thread pool (one thread per core),
+  // a single thread writes into the database in batches.
+  this->DirectoryImportFuture = QtConcurrent::map(this->FilesToIndex,
+    ParseFileFunctor(this, tags));
+  this->DirectoryImportWatcher.setFuture(this->DirectoryImportFuture);
+  if (database.isInMemory())
+    {
+    // a second connection to ":memory:" would be another database: the
+    // records are inserted by the calling thread, which owns the connection
+    this->insertRecords(database);
+    return;
+    }
+  this->Writer.start();
+}
 
 //------------------------------------------------------------------------------
 // ctkDICOMIndexer methods
@@ -130,7 +465,6 @@ void ctkDICOMIndexer::addFile(ctkDICOMDatabase& database,
                                    const QString filePath,
                                    const QString& destinationDirectoryName)
 {
-  std::cout << filePath.toStdString();
   if (!destinationDirectoryName.isEmpty())
   {
     logger.warn("Ignoring destinationDirectoryName parameter, just taking it as indication we should copy!");
@@ -151,99 +485,203 @@ void ctkDICOMIndexer::addDirectory(ctkDICOMDatabase& ctkDICOMDatabase,
   // currently it is not supported to have multiple
   // parallel directory imports so the second call blocks
   //
-  d->DirectoryImportWatcher.waitForFinished();
-
-  const std::string src_directory(directoryName.toStdString());
+  d->waitForImportFinished();
 
-  OFList<OFString> originalDcmtkFileNames;
-  OFList<OFString> dcmtkFileNames;
-  OFStandard::searchDirectoryRecursively( QDir::toNativeSeparators(src_directory.c_str()).toAscii().data(), originalDcmtkFileNames, "", "");
+  if (directoryName.isEmpty())
+    {
+    return;
+    }
+  const QString directory = ctkDICOMIndexerPrivate::manifestDirectoryName(directoryName);
 
-  int totalNumberOfFiles = originalDcmtkFileNames.size();
+  d->startStatistics(ctkDICOMIndexerPrivate::ImportStatistics, directory);
+  d->FilesToIndex = ctkDICOMIndexerPrivate::filesInDirectory(directory);
+  d->Statistics.FilesScanned = d->FilesToIndex.count();
+  if (d->InstrumentationLevel == TimersInstrumentation)
+    {
+    d->Statistics.ScanTime = d->ImportTimer.elapsed();
+    }
+  if (d->FilesToIndex.isEmpty())
+    {
+    return;
+    }
 
-  // hack to reverse list of filenames (not neccessary when image loading works correctly)
-  for ( OFListIterator(OFString) iter = originalDcmtkFileNames.begin(); iter != originalDcmtkFileNames.end(); ++iter )
-  {
-    dcmtkFileNames.push_front( *iter );
-  }
+  emit foundFilesToIndex(d->FilesToIndex.count());
 
-  OFListIterator(OFString) iter = dcmtkFileNames.begin();
+  d->startImport(ctkDICOMDatabase, directory, !destinationDirectoryName.isEmpty());
+}
 
-  OFListIterator(OFString) last = dcmtkFileNames.end();
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::setInstrumentationLevel(InstrumentationLevel level)
+{
+  Q_D(ctkDICOMIndexer);
+  // the level is read by the parser and writer threads
+  d->waitForImportFinished();
+  d->InstrumentationLevel = level;
+}
 
-  if(iter == last) return;
+//------------------------------------------------------------------------------
+ctkDICOMIndexer::InstrumentationLevel ctkDICOMIndexer::instrumentationLevel()const
+{
+  Q_D(const ctkDICOMIndexer);
+  return d->InstrumentationLevel;
+}
 
-  emit foundFilesToIndex(totalNumberOfFiles);
+//------------------------------------------------------------------------------
+ctkDICOMIndexerStatistics ctkDICOMIndexer::statistics()const
+{
+  Q_D(const ctkDICOMIndexer);
+  return d->Statistics;
+}
 
-  /* iterate over all input filenames */
-  int fileNumber = 0;
-  int currentProgress = -1;
-  d->Canceled = false;
-  while (iter != last)
-  {
-    if (d->Canceled)
+//------------------------------------------------------------------------------
+QString ctkDICOMIndexer::statisticsSummary()const
+{
+  Q_D(const ctkDICOMIndexer);
+  const ctkDICOMIndexerStatistics& statistics = d->Statistics;
+  if (d->Mode == ctkDICOMIndexerPrivate::ThumbnailStatistics)
+    {
+    QString summary = QString("Regenerated %1 thumbnails out of %2 queued")
+      .arg(statistics.ThumbnailsGenerated)
+      .arg(statistics.ThumbnailsQueued);
+    if (d->InstrumentationLevel == TimersInstrumentation)
       {
-      break;
+      summary += QString(" in %1 ms (%2 thumbnails/s)")
+        .arg(statistics.TotalTime)
+        .arg(statistics.TotalTime > 0 ?
+             1000. * statistics.ThumbnailsGenerated / statistics.TotalTime : 0., 0, 'f', 1);
       }
-    emit indexingFileNumber(++fileNumber);
-    int newProgress = ( fileNumber * 100 ) / totalNumberOfFiles;
-    if (newProgress != currentProgress)
+    return summary;
+    }
+  QString summary = QString("Indexed %1: %2 files scanned, %3 parsed (%4 MB), "
+                            "%5 inserted, %6 skipped")
+    .arg(d->DirectoryName)
+    .arg(statistics.FilesScanned)
+    .arg(statistics.FilesParsed)
+    .arg(statistics.BytesParsed / (1024. * 1024.), 0, 'f', 1)
+    .arg(statistics.FilesInserted)
+    .arg(statistics.FilesSkipped);
+  if (d->InstrumentationLevel == TimersInstrumentation)
     {
-      currentProgress = newProgress;
-      emit progress( currentProgress );
+    summary += QString(". Scan %1 ms, parse %2 ms (all threads), insert %3 ms, total %4 ms")
+      .arg(statistics.ScanTime)
+      .arg(statistics.ParseTime)
+      .arg(statistics.InsertTime)
+      .arg(statistics.TotalTime);
     }
-    QString filePath((*iter).c_str());
-    d->FilesToIndex << filePath;
-    ++iter;
-  }
-  d->DirectoryImportFuture = QtConcurrent::filter(d->FilesToIndex,AddFileFunctor(this,ctkDICOMDatabase,destinationDirectoryName));
-  d->DirectoryImportWatcher.setFuture(d->DirectoryImportFuture);
+  return summary;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::waitForImportFinished()
+{
+  Q_D(ctkDICOMIndexer);
+  d->waitForImportFinished();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMIndexer::regenerateThumbnails(ctkDICOMDatabase& dicomDatabase, bool allInstances,
+                                          bool force)
+{
+  Q_D(ctkDICOMIndexer);
+  d->waitForImportFinished();
+  d->waitForThumbnails();
+  if (!dicomDatabase.thumbnailGenerator())
+    {
+    return -1;
+    }
+
+  d->startStatistics(ctkDICOMIndexerPrivate::ThumbnailStatistics);
+  d->ThumbnailDatabase = &dicomDatabase;
+  d->ThumbnailsGenerated = 0;
+  QObject::connect(&dicomDatabase, SIGNAL(thumbnailGenerated(QString)),
+                   d, SLOT(onThumbnailGenerated()), Qt::DirectConnection);
+  // one commit per insertBatchSize() thumbnails instead of one each
+  d->OwnThumbnailBatch = !dicomDatabase.isBatchInsertActive()
+    && dicomDatabase.beginBatchInsert();
+  const int queued = dicomDatabase.regenerateThumbnails(allInstances, force);
+  d->Statistics.ThumbnailsQueued = qMax(queued, 0);
+  return queued;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMIndexer::waitForThumbnails()
+{
+  Q_D(ctkDICOMIndexer);
+  return d->waitForThumbnails();
 }
 
 //------------------------------------------------------------------------------
 void ctkDICOMIndexer::refreshDatabase(ctkDICOMDatabase& dicomDatabase, const QString& directoryName)
 {
-  Q_UNUSED(dicomDatabase);
-  Q_UNUSED(directoryName);
-  /*
-   * Probably this should go to the database class as well
-   * Or we have to extend the interface to make possible what we do here
-   * without using SQL directly
-   
+  Q_D(ctkDICOMIndexer);
+
+  d->waitForImportFinished();
+
+  if (directoryName.isEmpty())
+    {
+    return;
+    }
+  const QString directory = ctkDICOMIndexerPrivate::manifestDirectoryName(directoryName);
+  d->startStatistics(ctkDICOMIndexerPrivate::ImportStatistics, directory);
 
-  /// get all filenames from the database
-  QSqlQuery allFilesQuery(dicomDatabase.database());
-  QStringList databaseFileNames;
-  QStringList filesToRemove;
-  this->loggedExec(allFilesQuery, "SELECT Filename from Images;");
+  // what was found in the directory last time, loaded at once
+  QHash<QString, QPair<qint64, uint> > manifest = dicomDatabase.directoryManifest(directory);
 
-  while (allFilesQuery.next())
+  // only stat() the files, the unchanged ones are not parsed again
+  d->FilesToIndex.clear();
+  QStringList staleFiles;
+  foreach (const QString& filePath, ctkDICOMIndexerPrivate::filesInDirectory(directory))
     {
-    QString fileName = allFilesQuery.value(0).toString();
-    databaseFileNames.append(fileName);
-    if (! QFile::exists(fileName) )
+    QHash<QString, QPair<qint64, uint> >::iterator entry = manifest.find(filePath);
+    QFileInfo fileInfo(filePath);
+    if (entry == manifest.end())
+      {
+      d->FilesToIndex << filePath;
+      continue;
+      }
+    if (entry.value().first != fileInfo.size()
+        || entry.value().second != fileInfo.lastModified().toTime_t())
       {
-      filesToRemove.append(fileName);
+      // re-indexed from scratch, so that modified attributes are picked up
+      staleFiles << filePath;
+      d->FilesToIndex << filePath;
       }
+    manifest.erase(entry);
+    }
+  // what is left in the manifest has been deleted
+  logger.debug(QString("Refreshing %1: %2 new or modified files, %3 deleted files")
+               .arg(directory).arg(d->FilesToIndex.count()).arg(manifest.count()));
+  staleFiles << manifest.keys();
+  dicomDatabase.removeFromDirectoryManifest(staleFiles);
+  d->Statistics.FilesScanned = d->FilesToIndex.count();
+  if (d->InstrumentationLevel == TimersInstrumentation)
+    {
+    d->Statistics.ScanTime = d->ImportTimer.elapsed();
     }
 
-  QSet<QString> filesytemFiles;
-  QDirIterator dirIt(directoryName);
-  while (dirIt.hasNext())
+  emit foundFilesToIndex(d->FilesToIndex.count());
+  if (d->FilesToIndex.isEmpty())
     {
-    filesytemFiles.insert(dirIt.next());
+    d->finishStatistics();
+    emit indexingComplete();
+    return;
     }
-  
-  // TODO: it looks like this function was never finished...
-  // 
-  // I guess the next step is to remove all filesToRemove from the database
-  // and also to add filesystemFiles into the database tables
-  */ 
-  }
+  d->startImport(dicomDatabase, directory, false);
+}
 
 //----------------------------------------------------------------------------
 void ctkDICOMIndexer::cancel()
 {
   Q_D(ctkDICOMIndexer);
+  {
+  QMutexLocker lock(&d->RecordsMutex);
+  d->Canceled = true;
+  d->RecordsNotFull.wakeAll();
+  d->RecordsNotEmpty.wakeAll();
+  }
   d->DirectoryImportWatcher.cancel();
+  if (d->ThumbnailDatabase)
+    {
+    d->ThumbnailDatabase->cancelThumbnails();
+    }
 }
@@ -30,6 +30,44 @@
 
 class ctkDICOMIndexerPrivate;
 
+/// \ingroup DICOM_Core
+///
+/// \brief Counters of a directory import or a thumbnail regeneration
+///
+/// See ctkDICOMIndexer::setInstrumentationLevel(). Times are in
+/// milliseconds and only measured at the TimersInstrumentation level.
+struct ctkDICOMIndexerStatistics
+{
+  ctkDICOMIndexerStatistics()
+    : FilesScanned(0), FilesParsed(0), FilesSkipped(0), FilesInserted(0)
+    , BytesParsed(0), ThumbnailsQueued(0), ThumbnailsGenerated(0)
+    , ScanTime(0), ParseTime(0), InsertTime(0), TotalTime(0) {}
+
+  /// Files found in the directory, only the new and modified ones for
+  /// refreshDatabase()
+  int    FilesScanned;
+  /// Files whose header was read
+  int    FilesParsed;
+  /// Files that aren't DICOM, or whose image was in the database already
+  int    FilesSkipped;
+  /// Images added to the database
+  int    FilesInserted;
+  /// Size of the parsed files, of which only the header is read
+  qint64 BytesParsed;
+  /// Thumbnails found missing or out of date by regenerateThumbnails()
+  int    ThumbnailsQueued;
+  /// Thumbnails stored by the database until waitForThumbnails() returned
+  int    ThumbnailsGenerated;
+  /// Listing the directory (and comparing it with the manifest)
+  int    ScanTime;
+  /// Parsing the headers, summed over the parser threads
+  int    ParseTime;
+  /// Inserting into the database
+  int    InsertTime;
+  /// From the scan to the end of the import
+  int    TotalTime;
+};
+
 /// \ingroup DICOM_Core
 ///
 /// \brief Indexes DICOM images located in local directory into an Sql database
@@ -37,16 +75,46 @@ class ctkDICOMIndexerPrivate;
 class CTK_DICOM_CORE_EXPORT ctkDICOMIndexer : public QObject
 {
   Q_OBJECT
+  Q_ENUMS(InstrumentationLevel)
+  Q_PROPERTY(InstrumentationLevel instrumentationLevel READ instrumentationLevel WRITE setInstrumentationLevel)
 public:
   explicit ctkDICOMIndexer(QObject *parent = 0);
   virtual ~ctkDICOMIndexer();
 
+  enum InstrumentationLevel
+  {
+    /// Nothing is measured
+    NoInstrumentation = 0,
+    /// Files and bytes are counted
+    CountersInstrumentation,
+    /// Files and bytes are counted and the phases of the import timed
+    TimersInstrumentation
+  };
+
+  /// What is measured by the imports, see statistics(). At any other level
+  /// than NoInstrumentation (the default), a summary is logged at the end
+  /// of each import.
+  void setInstrumentationLevel(InstrumentationLevel level);
+  InstrumentationLevel instrumentationLevel()const;
+  /// Counters of the last import, complete once indexingComplete() is
+  /// emitted
+  ctkDICOMIndexerStatistics statistics()const;
+  /// statistics() in a human readable form
+  QString statisticsSummary()const;
+
   ///
   /// \brief Adds directory to database and optionally copies files to
   /// destinationDirectory.
   ///
   /// Scan the directory using Dcmtk and populate the database with all the
   /// DICOM images accordingly.
+  /// The import runs in the background: the file headers are parsed in
+  /// parallel (one thread per core) and a single thread inserts them into
+  /// the database in batches, through a connection of its own (see
+  /// ctkDICOMDatabase::openSharedDatabase()). indexingComplete() is emitted
+  /// when done. The connection of an in-memory database can't be shared:
+  /// the calling thread inserts the files and addDirectory() returns once
+  /// they are all in the database.
   ///
   Q_INVOKABLE void addDirectory(ctkDICOMDatabase& database, const QString& directoryName,
                     const QString& destinationDirectoryName = "");
@@ -61,8 +129,48 @@ public:
   Q_INVOKABLE void addFile(ctkDICOMDatabase& database, const QString filePath,
                     const QString& destinationDirectoryName = "");
 
+  ///
+  /// \brief Incremental rescan of a directory previously added with
+  /// addDirectory().
+  ///
+  /// The sizes and modification times recorded in the database directory
+  /// manifest are loaded at once and compared with the files on disk: only
+  /// new and modified files are parsed again (in the background, like
+  /// addDirectory()) and the images of deleted files are removed. Files are
+  /// indexed in place, they are not copied into the database directory.
+  /// indexingComplete() is emitted even if nothing changed.
+  ///
   Q_INVOKABLE void refreshDatabase(ctkDICOMDatabase& database, const QString& directoryName);
 
+  ///
+  /// \brief Block until the running directory import (if any) is finished.
+  ///
+  Q_INVOKABLE void waitForImportFinished();
+
+  ///
+  /// \brief Regenerate the thumbnails of \a database
+  ///
+  /// The missing and out of date thumbnails, of all the instances or of one
+  /// per series, are queued with ctkDICOMDatabase::regenerateThumbnails()
+  /// and rendered in the background by the thumbnail threads of the
+  /// database, with its thumbnail generator. They are stored and committed
+  /// in batches by the thread of the database (its event loop) until
+  /// waitForThumbnails() is called. cancel() drops the queued ones;
+  /// regenerating again resumes from there.
+  /// @Returns the number of thumbnails queued, -1 if the database has no
+  ///          thumbnail generator
+  ///
+  Q_INVOKABLE int regenerateThumbnails(ctkDICOMDatabase& database, bool allInstances = false,
+                                       bool force = false);
+
+  ///
+  /// \brief Block until the thumbnails are regenerated, then commit them
+  /// and complete the statistics.
+  /// @Returns false if some thumbnails could not be stored, they are kept
+  ///          by the database until its next waitForThumbnails()
+  ///
+  Q_INVOKABLE bool waitForThumbnails();
+
 Q_SIGNALS:
   void foundFilesToIndex(int);
   void indexingFileNumber(int);
@@ -21,10 +21,53 @@
 #ifndef CTKDICOMINDEXERPRIVATE_H
 #define CTKDICOMINDEXERPRIVATE_H
 
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QMutex>
 #include <QObject>
+#include <QQueue>
+#include <QThread>
+#include <QTime>
+#include <QWaitCondition>
 
 #include "ctkDICOMIndexer.h"
 
+class ctkDICOMIndexerPrivate;
+
+//------------------------------------------------------------------------------
+/// Result of parsing one file: only the attributes needed by the database
+/// are kept. Dataset is null if the file could not be read.
+struct ctkDICOMIndexerRecord
+{
+  ctkDICOMIndexerRecord(const QString& filePath, qint64 fileSize, uint modifiedTime,
+                        ctkDICOMDataset* dataset)
+    : FilePath(filePath), FileSize(fileSize), ModifiedTime(modifiedTime), Dataset(dataset)
+    , ParseTime(0) {}
+  ~ctkDICOMIndexerRecord() { delete this->Dataset; }
+
+  QString          FilePath;
+  /// stat() of the file before parsing, for the directory manifest
+  qint64           FileSize;
+  uint             ModifiedTime;
+  ctkDICOMDataset* Dataset;
+  /// milliseconds, only measured at the TimersInstrumentation level
+  int              ParseTime;
+};
+
+//------------------------------------------------------------------------------
+/// Single thread inserting the parsed records into the database
+class ctkDICOMIndexerWriter : public QThread
+{
+  Q_OBJECT
+public:
+  ctkDICOMIndexerWriter(ctkDICOMIndexerPrivate* indexerPrivate);
+
+protected:
+  void run();
+
+  ctkDICOMIndexerPrivate* IndexerPrivate;
+};
+
 //------------------------------------------------------------------------------
 class ctkDICOMIndexerPrivate : public QObject
 {
@@ -39,17 +82,79 @@ public:
   ctkDICOMIndexerPrivate(ctkDICOMIndexer&);
   ~ctkDICOMIndexerPrivate();
 
-public Q_SLOTS:
-
-  void OnProgress(int progress);
-public:
+  /// Called once per file from the parser threads, blocks while the queue
+  /// is full
+  void pushRecord(ctkDICOMIndexerRecord* record);
+  /// Called from the writer thread, blocks until a record is queued.
+  /// Returns 0 once all files are parsed and the queue is empty, or once
+  /// the import is canceled
+  ctkDICOMIndexerRecord* takeRecord();
+  /// Body of the writer thread, inserts the records through a connection
+  /// of its own
+  void writeRecords();
+  /// Insert the parsed records into \a database until all the files are
+  /// parsed
+  void insertRecords(ctkDICOMDatabase& database);
+  void waitForImportFinished();
+  /// Absolute path of \a directoryName, as stored in the directory manifest
+  static QString manifestDirectoryName(const QString& directoryName);
+  /// All the files below \a directoryName
+  static QStringList filesInDirectory(const QString& directoryName);
+  /// Parse FilesToIndex in the background and insert them into \a database
+  void startImport(ctkDICOMDatabase& database, const QString& directoryName, bool storeFiles);
+  /// What the statistics are counting
+  enum StatisticsMode
+  {
+    ImportStatistics,
+    ThumbnailStatistics
+  };
+  /// Reset the statistics before scanning \a directoryName, or before
+  /// regenerating thumbnails
+  void startStatistics(StatisticsMode mode, const QString& directoryName = QString());
+  /// Complete and log the statistics at the end of an import
+  void finishStatistics();
+  /// @Returns false if some thumbnails could not be stored
+  bool waitForThumbnails();
 
   ctkDICOMAbstractThumbnailGenerator* thumbnailGenerator;
-  bool                    Canceled;
+  /// set by the calling thread, read by the parser and writer threads
+  QAtomicInt              Canceled;
   QStringList FilesToIndex;
   QFutureWatcher<void> DirectoryImportWatcher;
   QFuture<void> DirectoryImportFuture;
   int CurrentPercentageProgress;
+
+  ctkDICOMIndexer::InstrumentationLevel InstrumentationLevel;
+  /// written by the writer thread during an import
+  ctkDICOMIndexerStatistics Statistics;
+  StatisticsMode          Mode;
+  QTime                   ImportTimer;
+
+  /// state of the current import, shared with the writer thread. Only the
+  /// settings of Database are read by the writer thread.
+  ctkDICOMDatabase*       Database;
+  QString                 DirectoryName;
+  bool                    StoreFiles;
+  int                     FilesWritten;
+  ctkDICOMIndexerWriter   Writer;
+
+  /// bounded queue between the parser threads and the writer thread
+  QQueue<ctkDICOMIndexerRecord*> Records;
+  int                     MaxQueuedRecords;
+  QMutex                  RecordsMutex;
+  QWaitCondition          RecordsNotEmpty;
+  QWaitCondition          RecordsNotFull;
+  /// number of files not pushed yet, the writer stops when it reaches 0
+  int                     FilesToParse;
+
+  /// state of the thumbnail regeneration
+  ctkDICOMDatabase*       ThumbnailDatabase;
+  bool                    OwnThumbnailBatch;
+  QAtomicInt              ThumbnailsGenerated;
+
+public Q_SLOTS:
+  /// Connected directly to ThumbnailDatabase, called from its threads
+  void onThumbnailGenerated();
 };
 
 
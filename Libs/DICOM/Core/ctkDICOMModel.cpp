@@ -27,88 +27,164 @@
 #include <QSqlResult>
 
 #include <QTime>
+#include <QTimer>
 #include <QDebug>
 
 // ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
 #include "ctkDICOMModel.h"
+#include "ctkDICOMModel_p.h"
 #include "ctkLogger.h"
 
 static ctkLogger logger ( "org.commontk.dicom.DICOMModel" );
-struct Node;
 
 Q_DECLARE_METATYPE(Qt::CheckState);
 Q_DECLARE_METATYPE(QStringList);
 
 //------------------------------------------------------------------------------
-class ctkDICOMModelPrivate
+// ctkDICOMModelFetcher methods
+
+//------------------------------------------------------------------------------
+ctkDICOMModelFetcher::ctkDICOMModelFetcher(const QAtomicInt& generation)
+  : Generation(generation)
 {
-  Q_DECLARE_PUBLIC(ctkDICOMModel);
-protected:
-  ctkDICOMModel* const q_ptr;
-  
-public:
-  ctkDICOMModelPrivate(ctkDICOMModel&);
-  virtual ~ctkDICOMModelPrivate();
-  void init();
-
-  void fetch(const QModelIndex& indexValue, int limit);
-  Node* createNode(int row, const QModelIndex& parentValue)const;
-  Node* nodeFromIndex(const QModelIndex& indexValue)const;
-  //QModelIndexList indexListFromNode(const Node* node)const;
-  //QModelIndexList modelIndexList(Node* node = 0)const;
-  //int childrenCount(Node* node = 0)const;
-  // move it in the Node struct
-  QVariant value(Node* parentValue, int row, int field)const;
-  QVariant value(const QModelIndex& indexValue, int row, int field)const;
-  QString  generateQuery(const QString& fields, const QString& table, const QString& conditions = QString())const;
-  void updateQueries(Node* node)const;
-
-  Node*        RootNode;
-  QSqlDatabase DataBase;
-  QList<QMap<int, QVariant> > Headers;
-  QString      Sort;
-  QMap<QString, QVariant> SearchParameters;
-
-  ctkDICOMModel::IndexType StartLevel;
-  ctkDICOMModel::IndexType EndLevel;
-};
-
-//------------------------------------------------------------------------------
-// 1 node per row
-// TBD: should probably use the QStandardItems instead.
-struct Node
-{
-  ~Node()
-    {
-    foreach(Node* node, this->Children)
+  static QAtomicInt fetcherCount;
+  this->ConnectionName = QString("ctkDICOMModelFetcher%1").arg(fetcherCount.fetchAndAddOrdered(1));
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMModelFetcher::~ctkDICOMModelFetcher()
+{
+  bool ownConnection = this->Database.connectionName() == this->ConnectionName;
+  this->Database = QSqlDatabase();
+  if (ownConnection)
+    {
+    QSqlDatabase::removeDatabase(this->ConnectionName);
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelFetcher::setDatabase(const QSqlDatabase& database)
+{
+  this->Database = database;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelFetcher::openDatabase(const QString& databaseName)
+{
+  if (this->Database.isOpen() && this->Database.databaseName() == databaseName)
+    {
+    return;
+    }
+  this->Database = QSqlDatabase();
+  QSqlDatabase::removeDatabase(this->ConnectionName);
+  this->Database = QSqlDatabase::addDatabase("QSQLITE", this->ConnectionName);
+  this->Database.setDatabaseName(databaseName);
+  this->Database.setConnectOptions("QSQLITE_OPEN_READONLY");
+  if (!this->Database.open())
+    {
+    logger.error("ctkDICOMModelFetcher: can't open " + databaseName + ": "
+                 + this->Database.lastError().text());
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelFetcher::fetch(int nodeId, int fetchId, int generation,
+                                 const QString& statement, const QVariantList& values,
+                                 int offset, bool count)
+{
+  if (this->Generation != generation)
+    {
+    return;
+    }
+  QSqlQuery query(this->Database);
+  if (count)
+    {
+    query.prepare("SELECT COUNT(*) FROM (" + statement + ")");
+    foreach(const QVariant& value, values)
+      {
+      query.addBindValue(value);
+      }
+    if (query.exec() && query.next())
+      {
+      emit countFetched(nodeId, fetchId, query.value(0).toInt());
+      }
+    }
+
+  query.setForwardOnly(true);
+  query.prepare(offset > 0 ? QString("%1 LIMIT -1 OFFSET %2").arg(statement).arg(offset) : statement);
+  foreach(const QVariant& value, values)
+    {
+    query.addBindValue(value);
+    }
+  if (!query.exec())
+    {
+    logger.error("ctkDICOMModelFetcher::fetch: " + query.lastError().text());
+    emit rowsFetched(nodeId, fetchId, QStringList(), ctkDICOMModelRows(), true);
+    return;
+    }
+  QSqlRecord record = query.record();
+  QStringList columns;
+  for (int i = 0; i < record.count(); ++i)
+    {
+    columns << record.fieldName(i);
+    }
+  ctkDICOMModelRows rows;
+  while (query.next())
+    {
+    if (this->Generation != generation)
+      {
+      return;
+      }
+    QVariantList row;
+    for (int i = 0; i < columns.count(); ++i)
+      {
+      row << query.value(i);
+      }
+    rows << row;
+    if (rows.count() == ChunkSize)
       {
-      delete node;
+      emit rowsFetched(nodeId, fetchId, columns, rows, false);
+      rows.clear();
       }
-    this->Children.clear();
     }
-  ctkDICOMModel::IndexType Type;
-  Node*                           Parent;
-  QVector<Node*>                  Children;
-  int                             Row;
-  QSqlQuery                       Query;
-  QString                         UID;
-  int                             RowCount;
-  bool                            AtEnd;
-  bool                            Fetching;
-  QMap<int, QVariant>             Data;
-};
+  emit rowsFetched(nodeId, fetchId, columns, rows, true);
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMModelPrivate methods
 
 //------------------------------------------------------------------------------
-ctkDICOMModelPrivate::ctkDICOMModelPrivate(ctkDICOMModel& o):q_ptr(&o)
+ctkDICOMModelPrivate::ctkDICOMModelPrivate(ctkDICOMModel& o)
+  : q_ptr(&o)
+  , Fetcher(Generation)
 {
   this->RootNode     = 0;
+  this->NextNodeId = 0;
+  this->NextFetchId = 0;
+  this->PendingFetches = 0;
+  this->BackgroundFetcher = 0;
+  this->FetchInBackground = false;
+  this->BackgroundFetch = true;
+  this->HasAggregates = false;
+  this->HasSearchIndex = false;
   this->StartLevel = ctkDICOMModel::RootType;
   this->EndLevel = ctkDICOMModel::ImageType;
+  this->SearchTimer.setSingleShot(true);
+  this->SearchTimer.setInterval(300);
 }
 
 //------------------------------------------------------------------------------
 ctkDICOMModelPrivate::~ctkDICOMModelPrivate()
 {
+  // cancel the running fetch
+  this->Generation.ref();
+  if (this->BackgroundFetcher)
+    {
+    this->FetchThread.quit();
+    this->FetchThread.wait();
+    delete this->BackgroundFetcher;
+    }
   delete this->RootNode;
   this->RootNode = 0;
 }
@@ -116,6 +192,15 @@ ctkDICOMModelPrivate::~ctkDICOMModelPrivate()
 //------------------------------------------------------------------------------
 void ctkDICOMModelPrivate::init()
 {
+  Q_Q(ctkDICOMModel);
+  QObject::connect(&this->SearchTimer, SIGNAL(timeout()),
+                   q, SLOT(applySearchParameters()));
+  qRegisterMetaType<ctkDICOMModelRows>("ctkDICOMModelRows");
+  QObject::connect(&this->Fetcher, SIGNAL(countFetched(int,int,int)),
+                   this, SLOT(onCountFetched(int,int,int)));
+  QObject::connect(&this->Fetcher, SIGNAL(rowsFetched(int,int,QStringList,ctkDICOMModelRows,bool)),
+                   this, SLOT(onRowsFetched(int,int,QStringList,ctkDICOMModelRows,bool)));
+
   QMap<int, QVariant> data;
   data[Qt::DisplayRole] = QString("Name");
   this->Headers << data;
@@ -143,6 +228,17 @@ Node* ctkDICOMModelPrivate::nodeFromIndex(const QModelIndex& indexValue)const
   return indexValue.isValid() ? reinterpret_cast<Node*>(indexValue.internalPointer()) : this->RootNode;
 }
 
+//------------------------------------------------------------------------------
+QModelIndex ctkDICOMModelPrivate::indexFromNode(Node* node)const
+{
+  Q_Q(const ctkDICOMModel);
+  if (!node || node == this->RootNode)
+    {
+    return QModelIndex();
+    }
+  return q->createIndex(node->Row, 0, node);
+}
+
 /*
 //------------------------------------------------------------------------------
 QModelIndexList ctkDICOMModelPrivate::indexListFromNode(const Node* node)const
@@ -214,7 +310,7 @@ int ctkDICOMModelPrivate::childrenCount(Node* node)const
 */
 
 //------------------------------------------------------------------------------
-Node* ctkDICOMModelPrivate::createNode(int row, const QModelIndex& parentValue)const
+Node* ctkDICOMModelPrivate::createNode(int row, const QModelIndex& parentValue)
 {
   Node* node = new Node;
   Node* nodeParent = 0;
@@ -238,50 +334,65 @@ Node* ctkDICOMModelPrivate::createNode(int row, const QModelIndex& parentValue)c
   node->Row = row;
   if (node->Type != ctkDICOMModel::RootType)
     {
-    int field = 0;//nodeParent->Query.record().indexOf("UID");
-    node->UID = this->value(parentValue, row, field).toString();
+    int field = 0;//nodeParent->Columns.indexOf("UID");
+    node->UID = this->value(nodeParent, row, field).toString();
 #if CHECKABLE_COLUMNS
     node->Data[Qt::CheckStateRole] = node->Parent->Data[Qt::CheckStateRole];
 #endif
     }
   
+  node->Id = this->NextNodeId++;
+  this->Nodes[node->Id] = node;
   node->RowCount = 0;
-  node->AtEnd = false;
-  node->Fetching = false;
+  node->TotalCount = -1;
+  node->FetchId = -1;
+  node->Loading = false;
+  node->AtEnd = node->Type >= ctkDICOMModel::ImageType;
+  node->LoadingNode = 0;
+  node->IsLoadingNode = false;
 
-  this->updateQueries(node);
-  
   return node;
 }
 
 //------------------------------------------------------------------------------
-QVariant ctkDICOMModelPrivate::value(const QModelIndex& parentValue, int row, int column) const
+QVariant ctkDICOMModelPrivate::value(Node* parentNode, int row, int column) const
 {
-  Node* node = this->nodeFromIndex(parentValue);
-  if (row >= node->RowCount)
-    {      
-    const_cast<ctkDICOMModelPrivate *>(this)->fetch(parentValue, row + 256);
+  if (row < 0 || column < 0 || !parentNode || row >= parentNode->Values.count()
+      || column >= parentNode->Columns.count())
+    {
+    return QVariant();
     }
-  return this->value(node, row, column);
+  return parentNode->Values[row][column];
 }
 
 //------------------------------------------------------------------------------
-QVariant ctkDICOMModelPrivate::value(Node* parentNode, int row, int column) const
+bool ctkDICOMModelPrivate::isFiltered()const
 {
-  if (row < 0 || column < 0 || !parentNode || row >= parentNode->RowCount)
+  foreach(const QVariant& parameter, this->SearchParameters)
+    {
+    if (parameter.type() == QVariant::StringList ?
+        !parameter.toStringList().isEmpty() : !parameter.toString().isEmpty())
+      {
+      return true;
+      }
+    }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+QVariant ctkDICOMModelPrivate::aggregate(const QModelIndex& indexValue, const QString& field)const
+{
+  Node* node = this->nodeFromIndex(indexValue);
+  if (!this->HasAggregates || !node || !node->Parent)
     {
     return QVariant();
     }
-  
-  if (!parentNode->Query.seek(row))
+  int column = node->Parent->Columns.indexOf(field);
+  if (column < 0)
     {
-    qDebug() << parentNode->Query.lastError();
-    Q_ASSERT(parentNode->Query.seek(row));
     return QVariant();
     }
-  QVariant res = parentNode->Query.value(column);
-  Q_ASSERT(res.isValid());
-  return res;
+  return this->value(node->Parent, indexValue.row(), column);
 }
 
 //------------------------------------------------------------------------------
@@ -301,122 +412,273 @@ QString ctkDICOMModelPrivate::generateQuery(const QString& fields, const QString
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMModelPrivate::updateQueries(Node* node)const
+QString ctkDICOMModelPrivate::searchCondition(const QString& key, const QString& searchTable,
+                                              const QString& searchKey,
+                                              const QString& column, const QString& text,
+                                              QVariantList& values)const
+{
+  QString matchExpression = ctkDICOMDatabase::fullTextQuery(text);
+  if (this->HasSearchIndex && !matchExpression.isEmpty())
+    {
+    values << matchExpression;
+    return key + " IN (SELECT " + searchKey + " FROM " + searchTable + " WHERE Content MATCH ?)";
+    }
+  values << "%" + text + "%";
+  return column + " LIKE ?";
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::updateStatements()
 {
-  // are you kidding me, it should be virtualized here :-)
-  QString query;
+  // counts cached by the database, ChildCount saves hasChildren() a query
+  QString patientAggregates;
+  QString studyAggregates;
+  QString seriesAggregates;
+  QString imageAggregates;
+  if (this->HasAggregates)
+    {
+    patientAggregates = ", StudyCount as ChildCount, StudyCount, SeriesCount, ImageCount, TotalFileSize";
+    studyAggregates = ", SeriesCount as ChildCount, SeriesCount, ImageCount, TotalFileSize";
+    seriesAggregates = ", ImageCount as ChildCount, ImageCount, TotalFileSize";
+    imageAggregates = ", FileSize as TotalFileSize";
+    }
+  for (int level = ctkDICOMModel::RootType; level < ctkDICOMModel::ImageType; ++level)
+    {
+    this->FilterValues[level].clear();
+    }
   QString condition;
-  switch(node->Type)
+
+  // patients
+  if (!this->SearchParameters["Name"].toString().isEmpty())
     {
-    default:
-      Q_ASSERT(node->Type == ctkDICOMModel::RootType);
-      break;
-    case ctkDICOMModel::RootType:
-      //query = QString("SELECT  FROM ");
-      if(this->SearchParameters["Name"].toString() != ""){
-        condition.append("PatientsName LIKE \"%" + this->SearchParameters["Name"].toString() + "%\"");
+    condition = this->searchCondition("UID", "PatientsSearch", "docid", "PatientsName",
+      this->SearchParameters["Name"].toString(), this->FilterValues[ctkDICOMModel::RootType]);
+    }
+  this->Statements[ctkDICOMModel::RootType] = this->generateQuery(
+    "UID as UID, PatientsName as Name, PatientsAge as Age, PatientsBirthDate as Date, PatientID as \"Subject ID\"" + patientAggregates,
+    "Patients", condition);
+
+  // studies of a patient
+  condition.clear();
+  QVariantList& studyValues = this->FilterValues[ctkDICOMModel::PatientType];
+  if (!this->SearchParameters["Study"].toString().isEmpty())
+    {
+    condition.append(this->searchCondition("StudyInstanceUID", "StudiesSearch", "UID", "StudyDescription",
+      this->SearchParameters["Study"].toString(), studyValues) + " AND ");
+    }
+  QStringList modalities = this->SearchParameters["Modalities"].value<QStringList>();
+  if (modalities.count() > 0)
+    {
+    QStringList placeholders;
+    foreach(const QString& modality, modalities)
+      {
+      placeholders << "?";
+      studyValues << modality;
       }
-      query = this->generateQuery("UID as UID, PatientsName as Name, PatientsAge as Age, PatientsBirthDate as Date, PatientID as \"Subject ID\"","Patients", condition);
-      logger.debug ( "ctkDICOMModelPrivate::updateQueries for Root: query is: " + query );
-      break;
-    case ctkDICOMModel::PatientType:
-      //query = QString("SELECT  FROM Studies WHERE PatientsUID='%1'").arg(node->UID);
-      if(this->SearchParameters["Study"].toString() != "")
-        {
-        condition.append("StudyDescription LIKE \"%" + this->SearchParameters["Study"].toString() + "%\"" + " AND ");
-        }
-      if(this->SearchParameters["Modalities"].value<QStringList>().count() > 0)
-        {
-        condition.append("ModalitiesInStudy IN (\"" + this->SearchParameters["Modalities"].value<QStringList>().join("\",\"") + "\") AND ");
-        }
-      if(this->SearchParameters["StartDate"].toString() != "" &&
-         this->SearchParameters["EndDate"].toString() != "")
-        {
-          condition.append(" ( StudyDate BETWEEN \'" + QDate::fromString(this->SearchParameters["StartDate"].toString(), "yyyyMMdd").toString("yyyy-MM-dd")
-                           + "\' AND \'" + QDate::fromString(this->SearchParameters["EndDate"].toString(), "yyyyMMdd").toString("yyyy-MM-dd") + "\' ) AND ");
-        }
-      query = this->generateQuery("StudyInstanceUID as UID, StudyDescription as Name, ModalitiesInStudy as Scan, StudyDate as Date, AccessionNumber as Number, ReferringPhysician as Institution, ReferringPhysician as Referrer, PerformingPhysiciansName as Performer", "Studies", condition + QString("PatientsUID='%1'").arg(node->UID));
-      logger.debug ( "ctkDICOMModelPrivate::updateQueries for Patient: query is: " + query );
-      break;
-    case ctkDICOMModel::StudyType:
-      //query = QString("SELECT SeriesInstanceUID as UID, SeriesDescription as Name, BodyPartExamined as Scan, SeriesDate as Date, AcquisitionNumber as Number FROM Series WHERE StudyInstanceUID='%1'").arg(node->UID);
-      if(this->SearchParameters["Series"].toString() != "")
-        {
-        condition.append("SeriesDescription LIKE \"%" + this->SearchParameters["Series"].toString() + "%\"" + " AND ");
-        }
-      query = this->generateQuery("SeriesInstanceUID as UID, SeriesDescription as Name, BodyPartExamined as Scan, SeriesDate as Date, AcquisitionNumber as Number","Series",condition + QString("StudyInstanceUID='%1'").arg(node->UID));
-      logger.debug ( "ctkDICOMModelPrivate::updateQueries for Study: query is: " + query );
-      break;
-    case ctkDICOMModel::SeriesType:
-      if(this->SearchParameters["ID"].toString() != "")
-        {
-        condition.append("SOPInstanceUID LIKE \"%" + this->SearchParameters["ID"].toString() + "%\"" + " AND ");
-        }
-      //query = QString("SELECT Filename as UID, Filename as Name, SeriesInstanceUID as Date FROM Images WHERE SeriesInstanceUID='%1'").arg(node->UID);
-      query = this->generateQuery("SOPInstanceUID as UID, Filename as Name, SeriesInstanceUID as Date", "Images", condition + QString("SeriesInstanceUID='%1'").arg(node->UID));
-      logger.debug ( "ctkDICOMModelPrivate::updateQueries for Series: query is: " + query );
-      break;
-    case ctkDICOMModel::ImageType:
-      break;
+    condition.append("ModalitiesInStudy IN (" + placeholders.join(",") + ") AND ");
     }
-  node->Query = QSqlQuery(query, this->DataBase);
-  foreach(Node* child, node->Children)
+  if (!this->SearchParameters["StartDate"].toString().isEmpty() &&
+      !this->SearchParameters["EndDate"].toString().isEmpty())
+    {
+    condition.append(" ( StudyDate BETWEEN ? AND ? ) AND ");
+    studyValues << QDate::fromString(this->SearchParameters["StartDate"].toString(), "yyyyMMdd").toString("yyyy-MM-dd")
+                << QDate::fromString(this->SearchParameters["EndDate"].toString(), "yyyyMMdd").toString("yyyy-MM-dd");
+    }
+  this->Statements[ctkDICOMModel::PatientType] = this->generateQuery(
+    "StudyInstanceUID as UID, StudyDescription as Name, ModalitiesInStudy as Scan, StudyDate as Date, AccessionNumber as Number, ReferringPhysician as Institution, ReferringPhysician as Referrer, PerformingPhysiciansName as Performer" + studyAggregates,
+    "Studies", condition + "PatientsUID = ?");
+
+  // series of a study
+  condition.clear();
+  if (!this->SearchParameters["Series"].toString().isEmpty())
+    {
+    condition.append(this->searchCondition("SeriesInstanceUID", "SeriesSearch", "UID", "SeriesDescription",
+      this->SearchParameters["Series"].toString(), this->FilterValues[ctkDICOMModel::StudyType]) + " AND ");
+    }
+  this->Statements[ctkDICOMModel::StudyType] = this->generateQuery(
+    "SeriesInstanceUID as UID, SeriesDescription as Name, BodyPartExamined as Scan, SeriesDate as Date, AcquisitionNumber as Number" + seriesAggregates,
+    "Series", condition + "StudyInstanceUID = ?");
+
+  // images of a series
+  condition.clear();
+  if (!this->SearchParameters["ID"].toString().isEmpty())
+    {
+    condition.append("SOPInstanceUID LIKE ? AND ");
+    this->FilterValues[ctkDICOMModel::SeriesType] << "%" + this->SearchParameters["ID"].toString() + "%";
+    }
+  this->Statements[ctkDICOMModel::SeriesType] = this->generateQuery(
+    "SOPInstanceUID as UID, Filename as Name, SeriesInstanceUID as Date" + imageAggregates,
+    "Images", condition + "SeriesInstanceUID = ?");
+}
+
+//------------------------------------------------------------------------------
+QVariantList ctkDICOMModelPrivate::boundValues(Node* node)const
+{
+  QVariantList values = this->FilterValues[node->Type];
+  if (node->Type != ctkDICOMModel::RootType)
     {
-    this->updateQueries(child);
+    values << node->UID;
     }
+  return values;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMModelPrivate::fetch(const QModelIndex& indexValue, int limit)
+void ctkDICOMModelPrivate::repopulate()
 {
   Q_Q(ctkDICOMModel);
-  Node* node = this->nodeFromIndex(indexValue);
-  if (node->AtEnd || limit <= node->RowCount || node->Fetching/*|| bottom.column() == -1*/)
+  q->beginResetModel();
+  // the rows of the running fetches are for the deleted nodes
+  this->Generation.ref();
+  this->PendingFetches = 0;
+  delete this->RootNode;
+  this->RootNode = 0;
+  this->Nodes.clear();
+
+  if (this->DataBase.tables().empty())
     {
+    //Q_ASSERT(this->DataBase.isOpen());
+    q->endResetModel();
     return;
     }
-  node->Fetching = true;
 
-  int newRowCount;
-  const int oldRowCount = node->RowCount;
+  this->updateStatements();
+  this->RootNode = this->createNode(-1, QModelIndex());
+
+  q->endResetModel();
+
+  this->startFetch(this->RootNode, QModelIndex());
+}
 
-  // try to seek directly
-  if (node->Query.seek(limit - 1)) 
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::startFetch(Node* node, const QModelIndex& indexValue)
+{
+  Q_Q(ctkDICOMModel);
+  if (node->AtEnd || node->Loading || node->IsLoadingNode)
+    {
+    return;
+    }
+  node->Loading = true;
+  node->FetchId = this->NextFetchId++;
+  ++this->PendingFetches;
+
+  // the database counts the children, unless the search hides some
+  QVariant childCount = this->aggregate(indexValue, "ChildCount");
+  if (node->TotalCount < 0 && childCount.isValid() && !childCount.isNull()
+      && !this->isFiltered())
     {
-    newRowCount = limit;
-    } 
-  else 
+    node->TotalCount = childCount.toInt();
+    }
+
+  if (!this->FetchInBackground)
     {
-    newRowCount = qMax(oldRowCount, 1);
-    if (node->Query.seek(newRowCount - 1)) 
-      {
-      while (node->Query.next())
-        {
-        ++newRowCount;
-        }
-      } 
-    else 
-      {
-      // empty or invalid query
-      newRowCount = 0;
-      }
-    node->AtEnd = true; // this is the end.
+    // the rows arrive right away, no need to count them first
+    this->Fetcher.fetch(node->Id, node->FetchId, this->Generation, this->Statements[node->Type],
+                        this->boundValues(node), node->Values.count(), false);
+    return;
     }
-  if (newRowCount > 0 && newRowCount > node->RowCount) 
+
+  if (node->RowCount == 0)
     {
-    q->beginInsertRows(indexValue, node->RowCount, newRowCount - 1);
-    node->RowCount = newRowCount;
-    node->Fetching = false;
+    q->beginInsertRows(indexValue, 0, 0);
+    node->LoadingNode = new Node;
+    node->LoadingNode->Type = ctkDICOMModel::IndexType(node->Type + 1);
+    node->LoadingNode->Parent = node;
+    node->LoadingNode->Row = 0;
+    node->LoadingNode->Id = -1;
+    node->LoadingNode->RowCount = 0;
+    node->LoadingNode->TotalCount = 0;
+    node->LoadingNode->FetchId = -1;
+    node->LoadingNode->Loading = false;
+    node->LoadingNode->AtEnd = true;
+    node->LoadingNode->LoadingNode = 0;
+    node->LoadingNode->IsLoadingNode = true;
+    node->RowCount = 1;
     q->endInsertRows();
-    } 
-  else 
+    }
+  QMetaObject::invokeMethod(this->BackgroundFetcher, "fetch", Qt::QueuedConnection,
+                            Q_ARG(int, node->Id), Q_ARG(int, node->FetchId),
+                            Q_ARG(int, this->Generation),
+                            Q_ARG(QString, this->Statements[node->Type]),
+                            Q_ARG(QVariantList, this->boundValues(node)),
+                            Q_ARG(int, node->Values.count()),
+                            Q_ARG(bool, node->TotalCount < 0));
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::fetchAll(Node* node, const QModelIndex& indexValue)
+{
+  if (node->AtEnd || node->IsLoadingNode)
+    {
+    return;
+    }
+  if (node->Loading)
     {
-    node->RowCount = newRowCount;
-    node->Fetching = false;
+    // the rows of the background fetch are not waited for, they are
+    // fetched again here after the ones already received
+    node->Loading = false;
+    --this->PendingFetches;
     }
+  bool background = this->FetchInBackground;
+  this->FetchInBackground = false;
+  this->startFetch(node, indexValue);
+  this->FetchInBackground = background;
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::onCountFetched(int nodeId, int fetchId, int count)
+{
+  Q_Q(ctkDICOMModel);
+  Node* node = this->Nodes.value(nodeId);
+  if (!node || node->FetchId != fetchId)
+    {
+    return;
+    }
+  node->TotalCount = count;
+  if (node->LoadingNode)
+    {
+    QModelIndex loadingIndex = q->index(0, 0, this->indexFromNode(node));
+    emit q->dataChanged(loadingIndex, loadingIndex);
+    }
+}
 
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::onRowsFetched(int nodeId, int fetchId, const QStringList& columns,
+                                         const ctkDICOMModelRows& rows, bool atEnd)
+{
+  Q_Q(ctkDICOMModel);
+  Node* node = this->Nodes.value(nodeId);
+  if (!node || node->FetchId != fetchId || !node->Loading)
+    {
+    return;
+    }
+  QModelIndex indexValue = this->indexFromNode(node);
+  if (node->LoadingNode && (atEnd || !rows.isEmpty()))
+    {
+    q->beginRemoveRows(indexValue, 0, 0);
+    delete node->LoadingNode;
+    node->LoadingNode = 0;
+    node->RowCount = 0;
+    q->endRemoveRows();
+    }
+  if (!columns.isEmpty())
+    {
+    node->Columns = columns;
+    }
+  if (!rows.isEmpty())
+    {
+    q->beginInsertRows(indexValue, node->RowCount, node->RowCount + rows.count() - 1);
+    node->Values << rows;
+    node->RowCount = node->Values.count();
+    q->endInsertRows();
+    }
+  if (atEnd)
+    {
+    node->Loading = false;
+    node->AtEnd = true;
+    node->TotalCount = node->Values.count();
+    --this->PendingFetches;
+    }
+}
 
 //------------------------------------------------------------------------------
 ctkDICOMModel::ctkDICOMModel(QObject* parentObject)
@@ -437,7 +699,7 @@ bool ctkDICOMModel::canFetchMore ( const QModelIndex & parentValue ) const
 {
   Q_D(const ctkDICOMModel);
   Node* node = d->nodeFromIndex(parentValue);
-  return node ? !node->AtEnd : false;
+  return node ? !node->AtEnd && !node->Loading : false;
 }
 
 //------------------------------------------------------------------------------
@@ -452,6 +714,20 @@ int ctkDICOMModel::columnCount ( const QModelIndex & _parent ) const
 QVariant ctkDICOMModel::data ( const QModelIndex & dataIndex, int role ) const
 {
   Q_D(const ctkDICOMModel);
+  Node* dataNode = d->nodeFromIndex(dataIndex);
+  if (dataNode && dataNode->IsLoadingNode)
+    {
+    if (role == TypeRole)
+      {
+      return dataNode->Type;
+      }
+    if (role != Qt::DisplayRole || dataIndex.column() != 0)
+      {
+      return QVariant();
+      }
+    int totalCount = dataNode->Parent->TotalCount;
+    return totalCount >= 0 ? tr("Loading %1 items...").arg(totalCount) : tr("Loading...");
+    }
   if ( role == UIDRole )
     {
     Node* node = d->nodeFromIndex(dataIndex);
@@ -462,6 +738,22 @@ QVariant ctkDICOMModel::data ( const QModelIndex & dataIndex, int role ) const
     Node* node = d->nodeFromIndex(dataIndex);
     return node ? node->Type : 0;
     }
+  else if ( role == StudyCountRole )
+    {
+    return d->aggregate(dataIndex, "StudyCount");
+    }
+  else if ( role == SeriesCountRole )
+    {
+    return d->aggregate(dataIndex, "SeriesCount");
+    }
+  else if ( role == ImageCountRole )
+    {
+    return d->aggregate(dataIndex, "ImageCount");
+    }
+  else if ( role == FileSizeRole )
+    {
+    return d->aggregate(dataIndex, "TotalFileSize");
+    }
   else if ( dataIndex.column() == 0 && role == Qt::CheckStateRole)
     {
     Node* node = d->nodeFromIndex(dataIndex);
@@ -484,12 +776,8 @@ QVariant ctkDICOMModel::data ( const QModelIndex & dataIndex, int role ) const
     }
   QModelIndex parentIndex = this->parent(dataIndex);
   Node* parentNode = d->nodeFromIndex(parentIndex);
-  if (dataIndex.row() >= parentNode->RowCount)
-    {      
-    const_cast<ctkDICOMModelPrivate *>(d)->fetch(dataIndex, dataIndex.row());
-    }
   QString columnName = d->Headers[dataIndex.column()][Qt::DisplayRole].toString();
-  int field = parentNode->Query.record().indexOf(columnName);
+  int field = parentNode->Columns.indexOf(columnName);
   if (field < 0)
     {
     // Not all the columns are in the record, it's ok to have no field here.
@@ -497,7 +785,7 @@ QVariant ctkDICOMModel::data ( const QModelIndex & dataIndex, int role ) const
     // invalid).
     return QString();
     }
-  return d->value(parentIndex, dataIndex.row(), field);
+  return d->value(parentNode, dataIndex.row(), field);
 }
 
 //------------------------------------------------------------------------------
@@ -505,7 +793,28 @@ void ctkDICOMModel::fetchMore ( const QModelIndex & parentValue )
 {
   Q_D(ctkDICOMModel);
   Node* node = d->nodeFromIndex(parentValue);
-  d->fetch(parentValue, qMax(node->RowCount, 0) + 256);
+  if (node)
+    {
+    d->startFetch(node, parentValue);
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModel::fetchAll ( const QModelIndex & parentValue )
+{
+  Q_D(ctkDICOMModel);
+  Node* node = d->nodeFromIndex(parentValue);
+  if (node)
+    {
+    d->fetchAll(node, parentValue);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModel::isFetching()const
+{
+  Q_D(const ctkDICOMModel);
+  return d->PendingFetches > 0;
 }
 
 //------------------------------------------------------------------------------
@@ -522,6 +831,10 @@ Qt::ItemFlags ctkDICOMModel::flags ( const QModelIndex & modelIndex ) const
     {
     return indexFlags;
     }
+  if (node->IsLoadingNode)
+    {
+    return Qt::NoItemFlags;
+    }
   bool checkable = true;
   node->Data[Qt::CheckStateRole].toInt(&checkable);
   indexFlags = indexFlags | (checkable ? Qt::ItemIsUserCheckable : Qt::NoItemFlags);
@@ -539,7 +852,7 @@ bool ctkDICOMModel::hasChildren ( const QModelIndex & parentIndex ) const
     return false;
     }
   Node* node = d->nodeFromIndex(parentIndex);
-  if (!node)
+  if (!node || node->IsLoadingNode)
     {
     return false;
     }
@@ -551,16 +864,30 @@ bool ctkDICOMModel::hasChildren ( const QModelIndex & parentIndex ) const
   // just means that the children haven't been fetched yet
   if (node->RowCount == 0 && !node->AtEnd)
     {
-    // We don't want to fetch the data because we don't want to add children
-    // to the index yet (it would be a mess to add rows inside a hasChildren)
-    //const_cast<qCTKDCMTKModelPrivate*>(d)->fetch(parentIndex, 1);
-    bool res = node->Query.seek(0);
-    if (!res)
+    // The database counts the children of the node: no query is needed
+    // unless the search parameters hide some of them
+    QVariant childCount = d->aggregate(parentIndex, "ChildCount");
+    if (childCount.isValid() && !childCount.isNull())
+      {
+      if (childCount.toInt() == 0)
+        {
+        node->AtEnd = true;
+        return false;
+        }
+      if (!d->isFiltered())
+        {
+        return true;
+        }
+      }
+    if (node->TotalCount >= 0)
       {
-      // now we know there is no children to the node, don't try next time.
-      node->AtEnd = true;
+      return node->TotalCount > 0;
       }
-    return res;
+    // We don't want to fetch the data because we don't want to add children
+    // to the index yet (it would be a mess to add rows inside a hasChildren),
+    // nor query the database on the GUI thread. Expanding the node fetches
+    // its children, and shows none if there are none.
+    return true;
     }
   return node->RowCount > 0;
 }
@@ -594,8 +921,18 @@ QModelIndex ctkDICOMModel::index ( int row, int column, const QModelIndex & pare
     return QModelIndex();
     }
   Node* parentNode = d->nodeFromIndex(parentIndex);
-  int field = 0;// always 0//parentNode->Query.record().indexOf("UID");
-  QString uid = d->value(parentIndex, row, field).toString();
+  if (parentNode->LoadingNode)
+    {
+    return row == 0 ? this->createIndex(row, column, parentNode->LoadingNode) : QModelIndex();
+    }
+  // rows not fetched yet have no index, code browsing the model calls
+  // fetchAll() first
+  if (row < 0 || row >= parentNode->Values.count())
+    {
+    return QModelIndex();
+    }
+  int field = 0;// always 0//parentNode->Columns.indexOf("UID");
+  QString uid = d->value(parentNode, row, field).toString();
   Node* node = 0;
   foreach(Node* tmpNode, parentNode->Children)
     {
@@ -609,7 +946,7 @@ QModelIndex ctkDICOMModel::index ( int row, int column, const QModelIndex & pare
   // arguments, we should probably be a bit more careful.
   if (node == 0)
     {
-    node = d->createNode(row, parentIndex);
+    node = const_cast<ctkDICOMModelPrivate *>(d)->createNode(row, parentIndex);
     }
   return this->createIndex(row, column, node);
 }
@@ -784,71 +1121,100 @@ bool ctkDICOMModel::setParentData(const QModelIndex &index, const QVariant &valu
 void ctkDICOMModel::setDatabase(const QSqlDatabase &db)
 {
   Q_D(ctkDICOMModel);
-
-  this->beginResetModel();
   d->DataBase = db;
-  
-  delete d->RootNode;
-  d->RootNode = 0;
-
-  if (d->DataBase.tables().empty())
+  d->HasAggregates = d->DataBase.record("Patients").contains("StudyCount");
+  d->HasSearchIndex = d->DataBase.tables().contains("PatientsSearch");
+
+  // a second connection to an in-memory database would see another one
+  const QString databaseName = d->DataBase.databaseName();
+  d->Fetcher.setDatabase(d->DataBase);
+  d->FetchInBackground = d->BackgroundFetch
+    && d->DataBase.driverName() == "QSQLITE"
+    && !databaseName.isEmpty() && databaseName != ":memory:";
+  if (d->FetchInBackground)
     {
-    //Q_ASSERT(d->DataBase.isOpen());
-    this->endResetModel();
-    return;
-    }
-    
-  d->RootNode = d->createNode(-1, QModelIndex());
-  
-  this->endResetModel();
-
-  // TODO, use hasQuerySize everywhere, not only in setDataBase()
-  bool hasQuerySize = d->RootNode->Query.driver()->hasFeature(QSqlDriver::QuerySize);
-  if (hasQuerySize && d->RootNode->Query.size() > 0) 
-    {
-    int newRowCount= d->RootNode->Query.size();
-    beginInsertRows(QModelIndex(), 0, qMax(0, newRowCount - 1));
-    d->RootNode->RowCount = newRowCount;
-    d->RootNode->AtEnd = true;
-    endInsertRows();
+    if (!d->BackgroundFetcher)
+      {
+      d->BackgroundFetcher = new ctkDICOMModelFetcher(d->Generation);
+      d->BackgroundFetcher->moveToThread(&d->FetchThread);
+      QObject::connect(d->BackgroundFetcher, SIGNAL(countFetched(int,int,int)),
+                       d, SLOT(onCountFetched(int,int,int)));
+      QObject::connect(d->BackgroundFetcher, SIGNAL(rowsFetched(int,int,QStringList,ctkDICOMModelRows,bool)),
+                       d, SLOT(onRowsFetched(int,int,QStringList,ctkDICOMModelRows,bool)));
+      d->FetchThread.start();
+      }
+    QMetaObject::invokeMethod(d->BackgroundFetcher, "openDatabase", Qt::QueuedConnection,
+                              Q_ARG(QString, databaseName));
     }
-  d->fetch(QModelIndex(), 256);
+  d->repopulate();
 }
 
 //------------------------------------------------------------------------------
 void ctkDICOMModel::setDatabase(const QSqlDatabase &db,const QMap<QString, QVariant>& parameters)
 {
   Q_D(ctkDICOMModel);
-
-  this->beginResetModel();
-  d->DataBase = db;
+  d->SearchTimer.stop();
   d->SearchParameters = parameters;
+  d->PendingSearchParameters = parameters;
+  this->setDatabase(db);
+}
 
-  delete d->RootNode;
-  d->RootNode = 0;
+//------------------------------------------------------------------------------
+QMap<QString, QVariant> ctkDICOMModel::searchParameters()const
+{
+  Q_D(const ctkDICOMModel);
+  return d->SearchParameters;
+}
 
-  if (d->DataBase.tables().empty())
+//------------------------------------------------------------------------------
+void ctkDICOMModel::setSearchParameters(const QMap<QString, QVariant>& parameters)
+{
+  Q_D(ctkDICOMModel);
+  d->PendingSearchParameters = parameters;
+  // restart the countdown on each edit
+  d->SearchTimer.start();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModel::applySearchParameters()
+{
+  Q_D(ctkDICOMModel);
+  d->SearchTimer.stop();
+  if (d->PendingSearchParameters == d->SearchParameters)
     {
-    //Q_ASSERT(d->DataBase.isOpen());
-    this->endResetModel();
     return;
     }
+  d->SearchParameters = d->PendingSearchParameters;
+  d->repopulate();
+  emit searchParametersChanged();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModel::backgroundFetch()const
+{
+  Q_D(const ctkDICOMModel);
+  return d->BackgroundFetch;
+}
 
-  d->RootNode = d->createNode(-1, QModelIndex());
+//------------------------------------------------------------------------------
+void ctkDICOMModel::setBackgroundFetch(bool enable)
+{
+  Q_D(ctkDICOMModel);
+  d->BackgroundFetch = enable;
+}
 
-  this->endResetModel();
+//------------------------------------------------------------------------------
+int ctkDICOMModel::searchDelay()const
+{
+  Q_D(const ctkDICOMModel);
+  return d->SearchTimer.interval();
+}
 
-  // TODO, use hasQuerySize everywhere, not only in setDataBase()
-  bool hasQuerySize = d->RootNode->Query.driver()->hasFeature(QSqlDriver::QuerySize);
-  if (hasQuerySize && d->RootNode->Query.size() > 0)
-    {
-    int newRowCount= d->RootNode->Query.size();
-    beginInsertRows(QModelIndex(), 0, qMax(0, newRowCount - 1));
-    d->RootNode->RowCount = newRowCount;
-    d->RootNode->AtEnd = true;
-    endInsertRows();
-    }
-  d->fetch(QModelIndex(), 256);
+//------------------------------------------------------------------------------
+void ctkDICOMModel::setSearchDelay(int msecs)
+{
+  Q_D(ctkDICOMModel);
+  d->SearchTimer.setInterval(qMax(0, msecs));
 }
 
 //------------------------------------------------------------------------------
@@ -886,21 +1252,16 @@ void ctkDICOMModel::sort(int column, Qt::SortOrder order)
   d->Sort = QString("\"%1\" %2")
     .arg(d->Headers[column])
     .arg(order == Qt::AscendingOrder ? "ASC" : "DESC");
-  d->updateQueries(d->RootNode);
+  d->updateStatements();
   QModelIndexList newIndexList = d->modelIndexList();
   Q_ASSERT(oldIndexList.count() == newIndexList.count());
   this->changePersistentIndexList(oldIndexList, newIndexList);
   emit layoutChanged();
   */
-  this->beginResetModel();
-  delete d->RootNode;
-  d->RootNode = 0;
   d->Sort = QString("\"%1\" %2")
     .arg(d->Headers[column][Qt::DisplayRole].toString())
     .arg(order == Qt::AscendingOrder ? "ASC" : "DESC");
-  d->RootNode = d->createNode(-1, QModelIndex());
-  
-  this->endResetModel();
+  d->repopulate();
 }
 
 //------------------------------------------------------------------------------
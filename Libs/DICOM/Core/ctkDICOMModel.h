@@ -41,11 +41,26 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMModel
   Q_ENUMS(IndexType)
   /// startLevel contains the hierarchy depth the model contains
   Q_PROPERTY(IndexType endLevel READ endLevel WRITE setEndLevel);
+  /// time in ms setSearchParameters() waits for another call before
+  /// querying the database, 300 by default
+  Q_PROPERTY(int searchDelay READ searchDelay WRITE setSearchDelay);
+  /// The children of a node are fetched by a worker thread with its own
+  /// connection to the database, and delivered in chunks. A "Loading..."
+  /// row is shown meanwhile. True by default, applies from the next
+  /// setDatabase(). In-memory databases are always fetched synchronously.
+  Q_PROPERTY(bool backgroundFetch READ backgroundFetch WRITE setBackgroundFetch);
 public:
 
   enum {
     UIDRole = Qt::UserRole,
-    TypeRole
+    TypeRole,
+    /// Counts and total file size in bytes below the item, as cached by
+    /// ctkDICOMDatabase. Invalid for levels without such a count, or for
+    /// databases older than schema version 3.
+    StudyCountRole,
+    SeriesCountRole,
+    ImageCountRole,
+    FileSizeRole
   };
 
   enum IndexType{
@@ -60,8 +75,16 @@ public:
   virtual ~ctkDICOMModel();
 
   void setDatabase(const QSqlDatabase& dataBase);
+  /// Set the database and apply the search parameters right away
   void setDatabase(const QSqlDatabase& dataBase, const QMap<QString,QVariant>& parameters);
 
+  /// Search parameters currently applied
+  QMap<QString,QVariant> searchParameters()const;
+  int searchDelay()const;
+  void setSearchDelay(int msecs);
+  bool backgroundFetch()const;
+  void setBackgroundFetch(bool enable);
+
   /// Set it before populating the model
   ctkDICOMModel::IndexType endLevel()const;
   void setEndLevel(ctkDICOMModel::IndexType level);
@@ -69,7 +92,13 @@ public:
   virtual bool canFetchMore ( const QModelIndex & parent ) const;
   virtual int columnCount ( const QModelIndex & parent = QModelIndex() ) const;
   virtual QVariant data ( const QModelIndex & index, int role = Qt::DisplayRole ) const;
+  /// Start fetching the children of \a parent, see backgroundFetch
   virtual void fetchMore ( const QModelIndex & parent );
+  /// Fetch the children of \a parent before returning, for code browsing
+  /// the model rather than a view
+  void fetchAll ( const QModelIndex & parent );
+  /// Some children are still being fetched in the background
+  bool isFetching()const;
   virtual Qt::ItemFlags flags ( const QModelIndex & index ) const;
   // can return true even if rowCount returns 0, you should use canFetchMore/fetchMore to populate
   // the children.
@@ -84,6 +113,19 @@ public:
   virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
 public Q_SLOTS:
   virtual void reset();
+  /// Filter the model once searchDelay() elapsed without another call, so
+  /// that typing in a search field doesn't query the database on each key.
+  /// The values are bound to prepared statements, they need no escaping.
+  /// Names, study and series descriptions are searched as word prefixes in
+  /// the full text index of ctkDICOMDatabase if the database has one.
+  void setSearchParameters(const QMap<QString,QVariant>& parameters);
+  /// Apply the parameters of the last setSearchParameters() call now
+  void applySearchParameters();
+
+Q_SIGNALS:
+  /// Emitted once new search parameters are applied and the model reset
+  void searchParametersChanged();
+
 protected:
   QScopedPointer<ctkDICOMModelPrivate> d_ptr;
 
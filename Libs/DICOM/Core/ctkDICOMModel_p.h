@@ -0,0 +1,206 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef CTKDICOMMODELPRIVATE_H
+#define CTKDICOMMODELPRIVATE_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+
+#include "ctkDICOMModel.h"
+
+/// rows fetched in one go, as lists of field values
+typedef QList<QVariantList> ctkDICOMModelRows;
+Q_DECLARE_METATYPE(ctkDICOMModelRows)
+
+//------------------------------------------------------------------------------
+// 1 node per row
+// TBD: should probably use the QStandardItems instead.
+struct Node
+{
+  ~Node()
+    {
+    foreach(Node* node, this->Children)
+      {
+      delete node;
+      }
+    this->Children.clear();
+    delete this->LoadingNode;
+    }
+  ctkDICOMModel::IndexType Type;
+  Node*                           Parent;
+  QVector<Node*>                  Children;
+  int                             Row;
+  QString                         UID;
+  /// key of the node in ctkDICOMModelPrivate::Nodes
+  int                             Id;
+  /// rows of the children, with the field names of the level query
+  QStringList                     Columns;
+  ctkDICOMModelRows               Values;
+  /// rows shown, including the loading row
+  int                             RowCount;
+  /// number of children once known, -1 before
+  int                             TotalCount;
+  /// fetch whose rows are expected, older ones are ignored
+  int                             FetchId;
+  bool                            Loading;
+  bool                            AtEnd;
+  /// "Loading..." row shown until the first rows arrive
+  Node*                           LoadingNode;
+  bool                            IsLoadingNode;
+  QMap<int, QVariant>             Data;
+};
+
+//------------------------------------------------------------------------------
+/// Runs the level queries of ctkDICOMModel with its own connection and
+/// sends the rows back in chunks. It lives in a worker thread when the
+/// database is a file, a second connection to an in-memory database would
+/// see another database.
+class ctkDICOMModelFetcher : public QObject
+{
+  Q_OBJECT
+public:
+  ctkDICOMModelFetcher(const QAtomicInt& generation);
+  virtual ~ctkDICOMModelFetcher();
+
+  /// Use the connection of the model, for the fetcher of the GUI thread
+  void setDatabase(const QSqlDatabase& database);
+
+  /// rows sent per rowsFetched() signal
+  static const int ChunkSize = 256;
+
+public Q_SLOTS:
+  /// Open a read-only connection of its own to the SQLite \a databaseName
+  void openDatabase(const QString& databaseName);
+  /// Run \a statement, skipping the first \a offset rows. The fetch is
+  /// dropped as soon as the generation of the model is not \a generation
+  /// anymore.
+  void fetch(int nodeId, int fetchId, int generation, const QString& statement,
+             const QVariantList& values, int offset, bool count);
+
+Q_SIGNALS:
+  void countFetched(int nodeId, int fetchId, int count);
+  void rowsFetched(int nodeId, int fetchId, const QStringList& columns,
+                   const ctkDICOMModelRows& rows, bool atEnd);
+
+protected:
+  const QAtomicInt& Generation;
+  QSqlDatabase Database;
+  QString ConnectionName;
+};
+
+//------------------------------------------------------------------------------
+class ctkDICOMModelPrivate : public QObject
+{
+  Q_OBJECT
+  Q_DECLARE_PUBLIC(ctkDICOMModel);
+protected:
+  ctkDICOMModel* const q_ptr;
+
+public:
+  ctkDICOMModelPrivate(ctkDICOMModel&);
+  virtual ~ctkDICOMModelPrivate();
+  void init();
+
+  /// Start fetching the children of the node, in the background if
+  /// possible. A loading row is shown meanwhile.
+  void startFetch(Node* node, const QModelIndex& indexValue);
+  /// Fetch the children of the node that are not yet, before returning
+  void fetchAll(Node* node, const QModelIndex& indexValue);
+  Node* createNode(int row, const QModelIndex& parentValue);
+  Node* nodeFromIndex(const QModelIndex& indexValue)const;
+  QModelIndex indexFromNode(Node* node)const;
+  //QModelIndexList indexListFromNode(const Node* node)const;
+  //QModelIndexList modelIndexList(Node* node = 0)const;
+  //int childrenCount(Node* node = 0)const;
+  // move it in the Node struct
+  QVariant value(Node* parentValue, int row, int field)const;
+  QString  generateQuery(const QString& fields, const QString& table, const QString& conditions = QString())const;
+  /// build the statement of each level from the sort order and the search
+  /// parameters, the values of the filters are bound when executed
+  void updateStatements();
+  /// condition on the \a key column matching \a text. The full text index
+  /// is used when it exists, \a text is then searched as word prefixes and
+  /// \a key is compared to the \a searchKey column of \a searchTable.
+  QString searchCondition(const QString& key, const QString& searchTable,
+                          const QString& searchKey,
+                          const QString& column, const QString& text,
+                          QVariantList& values)const;
+  /// values to bind to the statement of the children of the node
+  QVariantList boundValues(Node* node)const;
+  /// replace all the nodes, the views will only query what they show
+  void repopulate();
+  /// true if the search parameters can hide some children
+  bool isFiltered()const;
+  /// cached count or size of \a node, invalid if not in the database
+  QVariant aggregate(const QModelIndex& indexValue, const QString& field)const;
+
+  Node*        RootNode;
+  QSqlDatabase DataBase;
+  QList<QMap<int, QVariant> > Headers;
+  QString      Sort;
+  QMap<QString, QVariant> SearchParameters;
+  /// parameters of the last setSearchParameters() call, applied once the
+  /// search delay elapses without another call
+  QMap<QString, QVariant> PendingSearchParameters;
+  QTimer       SearchTimer;
+  /// prepared statement and bound filter values per level, indexed by the
+  /// type of the parent node
+  QString      Statements[ctkDICOMModel::ImageType];
+  QVariantList FilterValues[ctkDICOMModel::ImageType];
+  /// the tables have the ChildCount, ImageCount... columns maintained by
+  /// ctkDICOMDatabase since schema version 3
+  bool         HasAggregates;
+  /// the full text search index of ctkDICOMDatabase exists, the name, study
+  /// and series search parameters are matched with it
+  bool         HasSearchIndex;
+
+  /// nodes by id, for the fetched rows to find their node. Cleared with
+  /// the nodes, the rows of older nodes are then dropped.
+  QHash<int, Node*> Nodes;
+  int          NextNodeId;
+  int          NextFetchId;
+  int          PendingFetches;
+  /// increased when the nodes are replaced, to cancel the running fetches
+  QAtomicInt   Generation;
+  /// fetcher of the worker thread, and of the GUI thread
+  ctkDICOMModelFetcher* BackgroundFetcher;
+  ctkDICOMModelFetcher  Fetcher;
+  QThread      FetchThread;
+  /// backgroundFetch property, and whether it applies to the database
+  bool         BackgroundFetch;
+  bool         FetchInBackground;
+
+  ctkDICOMModel::IndexType StartLevel;
+  ctkDICOMModel::IndexType EndLevel;
+
+public Q_SLOTS:
+  void onCountFetched(int nodeId, int fetchId, int count);
+  void onRowsFetched(int nodeId, int fetchId, const QStringList& columns,
+                     const ctkDICOMModelRows& rows, bool atEnd);
+};
+
+#endif // CTKDICOMMODELPRIVATE_H
@@ -28,7 +28,11 @@
 #include <QFile>
 #include <QDirIterator>
 #include <QFileInfo>
+#include <QDateTime>
 #include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
 
 // ctkDICOMCore includes
 #include "ctkDICOMQuery.h"
@@ -65,73 +69,399 @@ public:
   ~ctkDICOMQuerySCUPrivate() {};
   virtual OFCondition handleFINDResponse(const T_ASC_PresentationContextID  presID,
                                          QRResponse *response,
-                                         OFBool &waitForNextResponse)
-    {
-      if (this->query)
-        {
-        logger.debug ( "FIND RESPONSE" );
-        emit this->query->debug("Got a find response!");
-        return this->DcmSCU::handleFINDResponse(presID, response, waitForNextResponse);
-        }
-      return DIMSE_NULLKEY;
-    };
+                                         OFBool &waitForNextResponse);
 };
 
+//------------------------------------------------------------------------------
+/// Results of a C-FIND shared by all the queries
+struct ctkDICOMQueryCacheEntry
+{
+  QDateTime Time;
+  QList<QSharedPointer<DcmDataset> > Results;
+  bool Truncated;
+};
+
+static QMutex ctkDICOMQueryCacheMutex;
+static QHash<QString, ctkDICOMQueryCacheEntry> ctkDICOMQueryCache;
+
 //------------------------------------------------------------------------------
 class ctkDICOMQueryPrivate
 {
+  Q_DECLARE_PUBLIC(ctkDICOMQuery);
+protected:
+  ctkDICOMQuery* const q_ptr;
+
 public:
-  ctkDICOMQueryPrivate();
+  ctkDICOMQueryPrivate(ctkDICOMQuery& obj);
   ~ctkDICOMQueryPrivate();
 
   /// Add a StudyInstanceUID to be queried
-  void addStudyInstanceUIDAndDataset(const QString& StudyInstanceUID, DcmDataset* dataset );
+  void addStudyInstanceUIDAndDataset(const QString& StudyInstanceUID, QSharedPointer<DcmDataset> dataset );
+
+  /// Open the association if it isn't or if the connection parameters
+  /// changed, \a reused is set to true if it was already open
+  bool connect(bool& reused);
+  /// Send Query at \a level, the results are passed to processResult() as
+  /// they arrive, or all at once if they are cached
+  bool find(const QString& level);
+  /// Called by the SCU for each response of the running find
+  void handleResult(T_ASC_PresentationContextID presID, DcmDataset* dataset);
+  /// Insert a result into Database and report it
+  void processResult(DcmDataset* dataset);
+  /// Identifies the peer, the level and the keys of Query
+  QString cacheKey()const;
+  /// Only ask for series attributes. This requires kicking out the rest of
+  /// a former query.
+  void prepareSeriesQuery(const QString& studyInstanceUID, const QString& seriesDescription);
 
   QString                 CallingAETitle;
   QString                 CalledAETitle;
   QString                 Host;
   int                     Port;
   bool                    PreferCGET;
+  int                     MaximumResults;
+  int                     CacheTimeToLive;
+  bool                    ConnectionParametersChanged;
   QMap<QString,QVariant>  Filters;
   ctkDICOMQuerySCUPrivate SCU;
   DcmDataset*             Query;
   QStringList             StudyInstanceUIDList;
-  QList<DcmDataset*>      StudyDatasetList;
+  QList<QSharedPointer<DcmDataset> > StudyDatasetList;
+  QStringList             SOPInstanceUIDList;
   bool                    Canceled;
+
+  /// state of the running find
+  ctkDICOMDatabase*       Database;
+  QString                 Level;
+  QList<QSharedPointer<DcmDataset> > Results;
+  bool                    Truncated;
+  bool                    CancelSent;
+  /// true if a find of the last query was truncated
+  bool                    ResultsTruncated;
 };
 
+//------------------------------------------------------------------------------
+// ctkDICOMQuerySCUPrivate methods
+
+//------------------------------------------------------------------------------
+OFCondition ctkDICOMQuerySCUPrivate::handleFINDResponse(const T_ASC_PresentationContextID  presID,
+                                                        QRResponse *response,
+                                                        OFBool &waitForNextResponse)
+{
+  if (this->query)
+    {
+    OFCondition result = this->DcmSCU::handleFINDResponse(presID, response, waitForNextResponse);
+    // the last response is always empty
+    if (result.good() && response->m_dataset != NULL)
+      {
+      this->query->d_func()->handleResult(presID, response->m_dataset);
+      }
+    return result;
+    }
+  return DIMSE_NULLKEY;
+}
+
 //------------------------------------------------------------------------------
 // ctkDICOMQueryPrivate methods
 
 //------------------------------------------------------------------------------
-ctkDICOMQueryPrivate::ctkDICOMQueryPrivate()
+ctkDICOMQueryPrivate::ctkDICOMQueryPrivate(ctkDICOMQuery& obj)
+  : q_ptr(&obj)
 {
   this->Query = new DcmDataset();
   this->Port = 0;
   this->Canceled = false;
   this->PreferCGET = true;
+  this->MaximumResults = 0;
+  this->CacheTimeToLive = 0;
+  this->ConnectionParametersChanged = false;
+  this->Database = 0;
+  this->Truncated = false;
+  this->CancelSent = false;
+  this->ResultsTruncated = false;
+
+  OFList<OFString> transferSyntaxes;
+  transferSyntaxes.push_back ( UID_LittleEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_BigEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_LittleEndianImplicitTransferSyntax );
+  this->SCU.addPresentationContext ( UID_FINDStudyRootQueryRetrieveInformationModel, transferSyntaxes );
 }
 
 //------------------------------------------------------------------------------
 ctkDICOMQueryPrivate::~ctkDICOMQueryPrivate()
 {
+  if (this->SCU.isConnected())
+    {
+    this->SCU.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+    }
   delete this->Query;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMQueryPrivate::addStudyInstanceUIDAndDataset( const QString& s, DcmDataset* dataset )
+void ctkDICOMQueryPrivate::addStudyInstanceUIDAndDataset( const QString& s, QSharedPointer<DcmDataset> dataset )
 {
   this->StudyInstanceUIDList.append ( s );
   this->StudyDatasetList.append ( dataset );
 }
 
+//------------------------------------------------------------------------------
+bool ctkDICOMQueryPrivate::connect(bool& reused)
+{
+  reused = false;
+  if (this->SCU.isConnected() && !this->ConnectionParametersChanged)
+    {
+    reused = true;
+    return true;
+    }
+  if (this->SCU.isConnected())
+    {
+    this->SCU.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+    }
+  this->ConnectionParametersChanged = false;
+  this->SCU.setAETitle ( OFString(this->CallingAETitle.toStdString().c_str()) );
+  this->SCU.setPeerAETitle ( OFString(this->CalledAETitle.toStdString().c_str()) );
+  this->SCU.setPeerHostName ( OFString(this->Host.toStdString().c_str()) );
+  this->SCU.setPeerPort ( this->Port );
+
+  if ( !this->SCU.initNetwork().good() )
+    {
+    logger.error( "Error initializing the network" );
+    return false;
+    }
+  logger.debug ( "Negotiating Association" );
+  OFCondition result = this->SCU.negotiateAssociation();
+  if (result.bad())
+    {
+    logger.error( "Error negotiating the association: " + QString(result.text()) );
+    return false;
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMQueryPrivate::cacheKey()const
+{
+  QStringList key;
+  key << this->CallingAETitle << this->CalledAETitle << this->Host
+      << QString::number(this->Port) << QString::number(this->MaximumResults);
+  for (unsigned long i = 0; i < this->Query->card(); ++i)
+    {
+    DcmElement* element = this->Query->getElement(i);
+    OFString value;
+    element->getOFStringArray(value);
+    key << QString(element->getTag().toString().c_str()) + "=" + value.c_str();
+    }
+  return key.join("|");
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::prepareSeriesQuery(const QString& studyInstanceUID,
+                                              const QString& seriesDescription)
+{
+  this->Query->clear();
+  this->Query->insertEmptyElement ( DCM_SeriesNumber );
+  this->Query->insertEmptyElement ( DCM_SeriesDescription );
+  this->Query->insertEmptyElement ( DCM_SeriesInstanceUID );
+  this->Query->insertEmptyElement ( DCM_SeriesDate );
+  this->Query->insertEmptyElement ( DCM_SeriesTime );
+  this->Query->insertEmptyElement ( DCM_Modality );
+  this->Query->insertEmptyElement ( DCM_NumberOfSeriesRelatedInstances ); // Number of images in the series
+
+  /* Add user-defined filters */
+  this->Query->putAndInsertOFStringArray(DCM_SeriesDescription, seriesDescription.toLatin1().data());
+  this->Query->putAndInsertString ( DCM_StudyInstanceUID, studyInstanceUID.toStdString().c_str() );
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMQueryPrivate::find(const QString& level)
+{
+  this->Query->putAndInsertString ( DCM_QueryRetrieveLevel, level.toLatin1().data() );
+  this->Level = level;
+
+  QString key = this->cacheKey();
+  if (this->CacheTimeToLive > 0)
+    {
+    ctkDICOMQueryCacheEntry entry;
+    bool cached = false;
+      {
+      QMutexLocker locker(&ctkDICOMQueryCacheMutex);
+      QHash<QString, ctkDICOMQueryCacheEntry>::iterator it = ctkDICOMQueryCache.find(key);
+      if (it != ctkDICOMQueryCache.end())
+        {
+        if (it->Time.secsTo(QDateTime::currentDateTime()) < this->CacheTimeToLive)
+          {
+          entry = *it;
+          cached = true;
+          }
+        else
+          {
+          ctkDICOMQueryCache.erase(it);
+          }
+        }
+      }
+    if (cached)
+      {
+      logger.debug ( "Using the cached results of the " + level + " level find" );
+      this->ResultsTruncated = this->ResultsTruncated || entry.Truncated;
+      foreach(QSharedPointer<DcmDataset> result, entry.Results)
+        {
+        if (this->Canceled)
+          {
+          return false;
+          }
+        this->processResult(result.data());
+        }
+      return true;
+      }
+    }
+
+  bool reused = false;
+  if (!this->connect(reused))
+    {
+    return false;
+    }
+  // Check for any accepted presentation context for FIND in study root (dont care about transfer syntax)
+  T_ASC_PresentationContextID presentationContext =
+    this->SCU.findPresentationContextID ( UID_FINDStudyRootQueryRetrieveInformationModel, "");
+  if ( presentationContext == 0 )
+    {
+    logger.error ( "Failed to find acceptable presentation context" );
+    return false;
+    }
+
+  this->Results.clear();
+  this->Truncated = false;
+  this->CancelSent = false;
+  // the responses are handled and freed one at a time by the SCU
+  OFCondition status = this->SCU.sendFINDRequest ( presentationContext, this->Query, NULL );
+  if ( status.bad() && reused && this->Results.isEmpty() && !this->Canceled )
+    {
+    // the peer may have closed the association since the last find
+    logger.debug ( "Find failed on the open association, reconnecting" );
+    this->SCU.closeAssociation ( DCMSCU_ABORT_ASSOCIATION );
+    if (!this->connect(reused))
+      {
+      return false;
+      }
+    presentationContext =
+      this->SCU.findPresentationContextID ( UID_FINDStudyRootQueryRetrieveInformationModel, "");
+    status = this->SCU.sendFINDRequest ( presentationContext, this->Query, NULL );
+    }
+  if ( status.bad() )
+    {
+    logger.error ( "Find failed: " + QString(status.text()) );
+    this->SCU.closeAssociation ( DCMSCU_RELEASE_ASSOCIATION );
+    return false;
+    }
+  this->ResultsTruncated = this->ResultsTruncated || this->Truncated;
+  if (this->Canceled)
+    {
+    return false;
+    }
+  if (this->CacheTimeToLive > 0)
+    {
+    ctkDICOMQueryCacheEntry entry;
+    entry.Time = QDateTime::currentDateTime();
+    entry.Results = this->Results;
+    entry.Truncated = this->Truncated;
+    QMutexLocker locker(&ctkDICOMQueryCacheMutex);
+    // drop the expired entries of all the peers while at it
+    QHash<QString, ctkDICOMQueryCacheEntry>::iterator it = ctkDICOMQueryCache.begin();
+    while (it != ctkDICOMQueryCache.end())
+      {
+      if (it->Time.secsTo(entry.Time) >= this->CacheTimeToLive)
+        {
+        it = ctkDICOMQueryCache.erase(it);
+        }
+      else
+        {
+        ++it;
+        }
+      }
+    ctkDICOMQueryCache.insert(key, entry);
+    }
+  this->Results.clear();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::handleResult(T_ASC_PresentationContextID presID, DcmDataset* dataset)
+{
+  if (this->CancelSent)
+    {
+    return;
+    }
+  if (this->Canceled
+      || (this->MaximumResults > 0 && this->Results.count() >= this->MaximumResults))
+    {
+    if (!this->Canceled)
+      {
+      logger.warn ( QString("More than %1 results, the find is truncated").arg(this->MaximumResults) );
+      this->Truncated = true;
+      }
+    // ask the peer to stop, the responses still on their way are dropped
+    this->CancelSent = true;
+    if (this->SCU.sendCANCELRequest(presID).bad())
+      {
+      logger.debug ( "Failed to cancel the find" );
+      }
+    return;
+    }
+  // the response is freed by the SCU, keep a copy for the cache
+  QSharedPointer<DcmDataset> result(new DcmDataset(*dataset));
+  this->Results.append(result);
+  this->processResult(result.data());
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::processResult(DcmDataset* dataset)
+{
+  Q_Q(ctkDICOMQuery);
+  OFString studyInstanceUID;
+  dataset->findAndGetOFString ( DCM_StudyInstanceUID, studyInstanceUID );
+  if (this->Level == "STUDY")
+    {
+    this->Database->insert ( dataset, false /* do not store to disk*/, false /* no thumbnail*/);
+    this->addStudyInstanceUIDAndDataset ( studyInstanceUID.c_str(),
+      QSharedPointer<DcmDataset>(new DcmDataset(*dataset)) );
+    emit q->studyFound(studyInstanceUID.c_str());
+    }
+  else if (this->Level == "SERIES")
+    {
+    OFString seriesInstanceUID;
+    dataset->findAndGetOFString ( DCM_SeriesInstanceUID, seriesInstanceUID );
+    int studyIndex = this->StudyInstanceUIDList.indexOf(studyInstanceUID.c_str());
+    if (studyIndex >= 0)
+      {
+      // add the patient elements not provided for the series level query,
+      // on a copy as the cached results are shared
+      DcmDataset seriesDataset(*dataset);
+      OFString patientName, patientID;
+      this->StudyDatasetList[studyIndex]->findAndGetOFString(DCM_PatientName, patientName);
+      this->StudyDatasetList[studyIndex]->findAndGetOFString(DCM_PatientID, patientID);
+      seriesDataset.putAndInsertOFStringArray(DCM_PatientName, patientName);
+      seriesDataset.putAndInsertOFStringArray(DCM_PatientID, patientID);
+      this->Database->insert ( &seriesDataset, false /* do not store */, false /* no thumbnail */ );
+      }
+    emit q->seriesFound(studyInstanceUID.c_str(), seriesInstanceUID.c_str());
+    }
+  else
+    {
+    OFString seriesInstanceUID, sopInstanceUID;
+    dataset->findAndGetOFString ( DCM_SeriesInstanceUID, seriesInstanceUID );
+    dataset->findAndGetOFString ( DCM_SOPInstanceUID, sopInstanceUID );
+    this->SOPInstanceUIDList.append(sopInstanceUID.c_str());
+    emit q->instanceFound(seriesInstanceUID.c_str(), sopInstanceUID.c_str());
+    }
+}
+
 //------------------------------------------------------------------------------
 // ctkDICOMQuery methods
 
 //------------------------------------------------------------------------------
 ctkDICOMQuery::ctkDICOMQuery(QObject* parentObject)
   : QObject(parentObject)
-  , d_ptr(new ctkDICOMQueryPrivate)
+  , d_ptr(new ctkDICOMQueryPrivate(*this))
 {
   Q_D(ctkDICOMQuery);
   d->SCU.query = this; // give the dcmtk level access to this for emitting signals
@@ -148,6 +478,7 @@ void ctkDICOMQuery::setCallingAETitle( const QString& callingAETitle )
 {
   Q_D(ctkDICOMQuery);
   d->CallingAETitle = callingAETitle;
+  d->ConnectionParametersChanged = true;
 }
 
 //------------------------------------------------------------------------------
@@ -162,6 +493,7 @@ void ctkDICOMQuery::setCalledAETitle( const QString& calledAETitle )
 {
   Q_D(ctkDICOMQuery);
   d->CalledAETitle = calledAETitle;
+  d->ConnectionParametersChanged = true;
 }
 
 //------------------------------------------------------------------------------
@@ -176,6 +508,7 @@ void ctkDICOMQuery::setHost( const QString& host )
 {
   Q_D(ctkDICOMQuery);
   d->Host = host;
+  d->ConnectionParametersChanged = true;
 }
 
 //------------------------------------------------------------------------------
@@ -190,6 +523,7 @@ void ctkDICOMQuery::setPort ( int port )
 {
   Q_D(ctkDICOMQuery);
   d->Port = port;
+  d->ConnectionParametersChanged = true;
 }
 
 //------------------------------------------------------------------------------
@@ -213,6 +547,41 @@ bool ctkDICOMQuery::preferCGET()const
   return d->PreferCGET;
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMQuery::setMaximumResults ( int maximumResults )
+{
+  Q_D(ctkDICOMQuery);
+  d->MaximumResults = qMax(0, maximumResults);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMQuery::maximumResults()const
+{
+  Q_D(const ctkDICOMQuery);
+  return d->MaximumResults;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQuery::setCacheTimeToLive ( int seconds )
+{
+  Q_D(ctkDICOMQuery);
+  d->CacheTimeToLive = qMax(0, seconds);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMQuery::cacheTimeToLive()const
+{
+  Q_D(const ctkDICOMQuery);
+  return d->CacheTimeToLive;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQuery::clearCache()
+{
+  QMutexLocker locker(&ctkDICOMQueryCacheMutex);
+  ctkDICOMQueryCache.clear();
+}
+
 //------------------------------------------------------------------------------
 void ctkDICOMQuery::setFilters( const QMap<QString,QVariant>& filters )
 {
@@ -234,6 +603,20 @@ QStringList ctkDICOMQuery::studyInstanceUIDQueried()const
   return d->StudyInstanceUIDList;
 }
 
+//------------------------------------------------------------------------------
+QStringList ctkDICOMQuery::sopInstanceUIDQueried()const
+{
+  Q_D(const ctkDICOMQuery);
+  return d->SOPInstanceUIDList;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMQuery::resultsTruncated()const
+{
+  Q_D(const ctkDICOMQuery);
+  return d->ResultsTruncated;
+}
+
 //------------------------------------------------------------------------------
 bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
 {
@@ -260,43 +643,9 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
   if (d->Canceled) {return false;}
 
   d->StudyInstanceUIDList.clear();
-  d->SCU.setAETitle ( OFString(this->callingAETitle().toStdString().c_str()) );
-  d->SCU.setPeerAETitle ( OFString(this->calledAETitle().toStdString().c_str()) );
-  d->SCU.setPeerHostName ( OFString(this->host().toStdString().c_str()) );
-  d->SCU.setPeerPort ( this->port() );
-
-  logger.error ( "Setting Transfer Syntaxes" );
-  emit progress("Setting Transfer Syntaxes");
-  emit progress(10);
-  if (d->Canceled) {return false;}
-
-  OFList<OFString> transferSyntaxes;
-  transferSyntaxes.push_back ( UID_LittleEndianExplicitTransferSyntax );
-  transferSyntaxes.push_back ( UID_BigEndianExplicitTransferSyntax );
-  transferSyntaxes.push_back ( UID_LittleEndianImplicitTransferSyntax );
-
-  d->SCU.addPresentationContext ( UID_FINDStudyRootQueryRetrieveInformationModel, transferSyntaxes );
-  // d->SCU.addPresentationContext ( UID_VerificationSOPClass, transferSyntaxes );
-  if ( !d->SCU.initNetwork().good() )
-    {
-    logger.error( "Error initializing the network" );
-    emit progress("Error initializing the network");
-    emit progress(100);
-    return false;
-    }
-  logger.debug ( "Negotiating Association" );
-  emit progress("Negotiating Association");
-  emit progress(20);
-  if (d->Canceled) {return false;}
-
-  OFCondition result = d->SCU.negotiateAssociation();
-  if (result.bad())
-    {
-    logger.error( "Error negotiating the association: " + QString(result.text()) );
-    emit progress("Error negotiating the association");
-    emit progress(100);
-    return false;
-    }
+  d->StudyDatasetList.clear();
+  d->ResultsTruncated = false;
+  d->Database = &database;
 
   // Clear the query
   d->Query->clear();
@@ -380,30 +729,14 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
   emit progress(30);
   if (d->Canceled) {return false;}
 
-  OFList<QRResponse *> responses;
-
-  Uint16 presentationContext = 0;
-  // Check for any accepted presentation context for FIND in study root (dont care about transfer syntax)
-  presentationContext = d->SCU.findPresentationContextID ( UID_FINDStudyRootQueryRetrieveInformationModel, "");
-  if ( presentationContext == 0 )
-    {
-    logger.error ( "Failed to find acceptable presentation context" );
-    emit progress("Failed to find acceptable presentation context");
-    }
-  else
-    {
-    logger.info ( "Found useful presentation context" );
-    emit progress("Found useful presentation context");
-    }
+  logger.debug ( "Finding studies" );
+  emit progress("Finding studies");
   emit progress(40);
-  if (d->Canceled) {return false;}
-
-  OFCondition status = d->SCU.sendFINDRequest ( presentationContext, d->Query, &responses );
-  if ( !status.good() )
+  // the studies are inserted as they arrive
+  if ( !d->find("STUDY") )
     {
-    logger.error ( "Find failed" );
+    if (d->Canceled) {return false;}
     emit progress("Find failed");
-    d->SCU.closeAssociation ( DCMSCU_RELEASE_ASSOCIATION );
     emit progress(100);
     return false;
     }
@@ -412,87 +745,69 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
   emit progress(50);
   if (d->Canceled) {return false;}
 
-  for ( OFIterator<QRResponse*> it = responses.begin(); it != responses.end(); it++ )
-    {
-    DcmDataset *dataset = (*it)->m_dataset;
-    if ( dataset != NULL ) // the last response is always empty
-      {
-      database.insert ( dataset, false /* do not store to disk*/, false /* no thumbnail*/);
-      OFString StudyInstanceUID;
-      dataset->findAndGetOFString ( DCM_StudyInstanceUID, StudyInstanceUID );
-      d->addStudyInstanceUIDAndDataset ( StudyInstanceUID.c_str(), dataset );
-      emit progress(QString("Processing: ") + QString(StudyInstanceUID.c_str()));
-      emit progress(50);
-      if (d->Canceled) {return false;}
-      }
-    }
-
-  /* Only ask for series attributes now. This requires kicking out the rest of former query. */
-  d->Query->clear();
-  d->Query->insertEmptyElement ( DCM_SeriesNumber );
-  d->Query->insertEmptyElement ( DCM_SeriesDescription );
-  d->Query->insertEmptyElement ( DCM_SeriesInstanceUID );
-  d->Query->insertEmptyElement ( DCM_SeriesDate );
-  d->Query->insertEmptyElement ( DCM_SeriesTime );
-  d->Query->insertEmptyElement ( DCM_Modality );
-  d->Query->insertEmptyElement ( DCM_NumberOfSeriesRelatedInstances ); // Number of images in the series
-
-  /* Add user-defined filters */
-  d->Query->putAndInsertOFStringArray(DCM_SeriesDescription, seriesDescription.toLatin1().data());
-
-  // Now search each within each Study that was identified
-  d->Query->putAndInsertString ( DCM_QueryRetrieveLevel, "SERIES" );
-  float progressRatio = 25. / d->StudyInstanceUIDList.count();
-  int i = 0; 
-
-  QListIterator<DcmDataset*> datasetIterator(d->StudyDatasetList);
+  // Now search each within each Study that was identified, over the same
+  // association
+  float progressRatio = 50. / qMax(1, d->StudyInstanceUIDList.count());
+  int i = 0;
   foreach ( QString StudyInstanceUID, d->StudyInstanceUIDList )
     {
-    DcmDataset *studyDataset = datasetIterator.next();
-    DcmElement *patientName, *patientID;
-    studyDataset->findAndGetElement(DCM_PatientName, patientName);
-    studyDataset->findAndGetElement(DCM_PatientID, patientID);
-
     logger.debug ( "Starting Series C-FIND for Study: " + StudyInstanceUID );
     emit progress(QString("Starting Series C-FIND for Study: ") + StudyInstanceUID);
-    emit progress(50 + (progressRatio * i++));
+    emit progress(50 + (progressRatio * i));
     if (d->Canceled) {return false;}
 
-    d->Query->putAndInsertString ( DCM_StudyInstanceUID, StudyInstanceUID.toStdString().c_str() );
-    OFList<QRResponse *> responses;
-    status = d->SCU.sendFINDRequest ( presentationContext, d->Query, &responses );
-    if ( status.good() )
+    d->prepareSeriesQuery ( StudyInstanceUID, seriesDescription );
+    if ( d->find("SERIES") )
       {
-      for ( OFIterator<QRResponse*> it = responses.begin(); it != responses.end(); it++ )
-        {
-        DcmDataset *dataset = (*it)->m_dataset;
-        if ( dataset != NULL )
-          {
-          // add the patient elements not provided for the series level query
-          dataset->insert( patientName, true );
-          dataset->insert( patientID, true );
-          // insert series dataset 
-          database.insert ( dataset, false /* do not store */, false /* no thumbnail */ );
-          }
-        }
       logger.debug ( "Find succeded on Series level for Study: " + StudyInstanceUID );
       emit progress(QString("Find succeded on Series level for Study: ") + StudyInstanceUID);
-      emit progress(50 + (progressRatio * i++));
-      if (d->Canceled) {return false;}
       }
     else
       {
+      if (d->Canceled) {return false;}
       logger.error ( "Find on Series level failed for Study: " + StudyInstanceUID );
       emit progress(QString("Find on Series level failed for Study: ") + StudyInstanceUID);
       }
-    emit progress(50 + (progressRatio * i++));
-    if (d->Canceled) {return false;}
+    emit progress(50 + (progressRatio * ++i));
     }
-  d->SCU.closeAssociation ( DCMSCU_RELEASE_ASSOCIATION );
   emit progress(100);
   return true;
 }
 
+//----------------------------------------------------------------------------
+bool ctkDICOMQuery::querySeries(ctkDICOMDatabase& database, const QString& studyInstanceUID)
+{
+  Q_D(ctkDICOMQuery);
+  if (d->Canceled) {return false;}
+  d->ResultsTruncated = false;
+  d->Database = &database;
+  QString seriesDescription;
+  if ( !d->Filters.value("Series").toString().isEmpty() )
+    {
+    seriesDescription = "*" + d->Filters.value("Series").toString() + "*";
+    }
+  d->prepareSeriesQuery ( studyInstanceUID, seriesDescription );
+  return d->find("SERIES");
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMQuery::queryInstances(const QString& studyInstanceUID, const QString& seriesInstanceUID)
+{
+  Q_D(ctkDICOMQuery);
+  if (d->Canceled) {return false;}
+  d->SOPInstanceUIDList.clear();
+  d->ResultsTruncated = false;
+  d->Database = 0;
+
+  d->Query->clear();
+  d->Query->insertEmptyElement ( DCM_SOPInstanceUID );
+  d->Query->insertEmptyElement ( DCM_SOPClassUID );
+  d->Query->insertEmptyElement ( DCM_InstanceNumber );
+  d->Query->putAndInsertString ( DCM_StudyInstanceUID, studyInstanceUID.toStdString().c_str() );
+  d->Query->putAndInsertString ( DCM_SeriesInstanceUID, seriesInstanceUID.toStdString().c_str() );
+  return d->find("IMAGE");
+}
+
 //----------------------------------------------------------------------------
 void ctkDICOMQuery::cancel()
 {
@@ -36,6 +36,14 @@
 class ctkDICOMQueryPrivate;
 
 /// \ingroup DICOM_Core
+///
+/// The results of a C-FIND are inserted into the database and reported by
+/// studyFound(), seriesFound() and instanceFound() as the responses arrive.
+/// All the finds of a query share one association, kept open across calls
+/// until the query is destroyed or its connection parameters change.
+/// Results can be cached for cacheTimeToLive() seconds so that browsing the
+/// same peer again doesn't query it again, the cache is disabled by default
+/// as the peer may have changed in the meantime.
 class CTK_DICOM_CORE_EXPORT ctkDICOMQuery : public QObject
 {
   Q_OBJECT
@@ -44,6 +52,8 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMQuery : public QObject
   Q_PROPERTY(QString host READ host WRITE setHost);
   Q_PROPERTY(int port READ port WRITE setPort);
   Q_PROPERTY(bool preferCGET READ preferCGET WRITE setPreferCGET);
+  Q_PROPERTY(int maximumResults READ maximumResults WRITE setMaximumResults);
+  Q_PROPERTY(int cacheTimeToLive READ cacheTimeToLive WRITE setCacheTimeToLive);
 
 public:
   explicit ctkDICOMQuery(QObject* parent = 0);
@@ -68,13 +78,39 @@ public:
   /// false by default
   void setPreferCGET ( bool preferCGET );
   bool preferCGET()const;
+  /// Maximum number of results of a single C-FIND, the peer is asked to
+  /// cancel the find once reached and the remaining responses are dropped.
+  /// 0 (unlimited) by default.
+  void setMaximumResults ( int maximumResults );
+  int maximumResults()const;
+  /// Number of seconds the results of a C-FIND are reused by the queries
+  /// of the same peer with the same keys, 0 disables the cache.
+  /// 0 by default.
+  void setCacheTimeToLive ( int seconds );
+  int cacheTimeToLive()const;
+  /// Forget the cached results of all the queries
+  static void clearCache();
 
   /// Query a remote DICOM Image Store SCP
   /// You must at least set the host and port before calling query()
+  /// The studies matching the filters are found first, then the series of
+  /// each study.
   bool query(ctkDICOMDatabase& database);
+  /// Find the series of \a studyInstanceUID only. They are inserted into
+  /// the database if the study was found by query() before, the patient of
+  /// the other studies being unknown.
+  bool querySeries(ctkDICOMDatabase& database, const QString& studyInstanceUID);
+  /// Find the instances of a series. They have no file and are not
+  /// inserted into the database, see instanceFound() and
+  /// sopInstanceUIDQueried().
+  bool queryInstances(const QString& studyInstanceUID, const QString& seriesInstanceUID);
 
   /// Access the list of study instance UIDs from the last query
   QStringList studyInstanceUIDQueried()const;
+  /// Access the list of SOP instance UIDs from the last queryInstances()
+  QStringList sopInstanceUIDQueried()const;
+  /// True if a C-FIND of the last query had more than maximumResults()
+  bool resultsTruncated()const;
 
   ///
   /// Filters are keyword/value pairs as generated by
@@ -111,6 +147,12 @@ Q_SIGNALS:
   /// Signal is emitted inside the query() function when finished with value 
   /// true for success or false for error
   void done(const bool& error);
+  /// Emitted as soon as a study is found and inserted into the database
+  void studyFound(const QString& studyInstanceUID);
+  /// Emitted as soon as a series is found
+  void seriesFound(const QString& studyInstanceUID, const QString& seriesInstanceUID);
+  /// Emitted as soon as an instance is found
+  void instanceFound(const QString& seriesInstanceUID, const QString& sopInstanceUID);
 
 public Q_SLOTS:
   void cancel();
@@ -122,7 +164,7 @@ private:
   Q_DECLARE_PRIVATE(ctkDICOMQuery);
   Q_DISABLE_COPY(ctkDICOMQuery);
 
-  friend class ctkDICOMQuerySCUPrivate;  // for access to queryResponseHandled
+  friend class ctkDICOMQuerySCUPrivate;  // for access to handleResult
 };
 
 #endif
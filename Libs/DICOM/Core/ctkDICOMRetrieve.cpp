@@ -56,9 +56,12 @@ class ctkDICOMRetrieveSCUPrivate : public DcmSCU
 {
 public:
   ctkDICOMRetrieve *retrieve;
+  /// sub-operations reported complete by the last move response
+  Uint16 CompletedSubops;
   ctkDICOMRetrieveSCUPrivate()
     {
     this->retrieve = 0;
+    this->CompletedSubops = 0;
     };
   ~ctkDICOMRetrieveSCUPrivate() {};
 
@@ -72,6 +75,12 @@ public:
         {
         emit this->retrieve->progress("Got move request");
         emit this->retrieve->progress(0);
+        if (response->m_numberOfCompletedSubops > this->CompletedSubops)
+          {
+          emit this->retrieve->instancesRetrieved(
+            response->m_numberOfCompletedSubops - this->CompletedSubops, 0);
+          this->CompletedSubops = response->m_numberOfCompletedSubops;
+          }
         return this->DcmSCU::handleMOVEResponse(
                         presID, response, waitForNextResponse);
         }
@@ -94,6 +103,8 @@ public:
         emit this->retrieve->progress("Got STORE request for " + qInstanceUID);
         emit this->retrieve->progress(0);
         continueCGETSession = !this->retrieve->wasCanceled();
+        emit this->retrieve->instancesRetrieved(1,
+          incomingObject->getLength(incomingObject->getOriginalXfer()));
         if (this->retrieve && this->retrieve->database())
           {
           this->retrieve->database()->insert(incomingObject);
@@ -286,6 +297,7 @@ bool ctkDICOMRetrievePrivate::move ( const QString& studyInstanceUID,
 
   // Issue request
   logger.debug ( "Sending Move Request" );
+  this->SCU.CompletedSubops = 0;
   OFList<RetrieveResponse*> responses;
   T_ASC_PresentationContextID presID = this->SCU.findPresentationContextID(
                                           UID_MOVEStudyRootQueryRetrieveInformationModel, 
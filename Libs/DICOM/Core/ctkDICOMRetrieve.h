@@ -109,6 +109,12 @@ Q_SIGNALS:
   void debug(const QString& message);
   /// Signal is emitted inside the retrieve() function. It send any error messages
   void error(const QString& message);
+  /// Signal is emitted for each object received by a C-GET, with its size
+  /// in bytes, and for each C-MOVE response with the number of objects the
+  /// peer host sent to the move destination since the previous response
+  /// (the size is then unknown and 0). It can be emitted from the thread
+  /// doing the retrieve.
+  void instancesRetrieved(int count, qint64 bytes);
   /// Signal is emitted inside the retrieve() function when finished with value 
   /// true for success or false for error
   void done(const bool& error);
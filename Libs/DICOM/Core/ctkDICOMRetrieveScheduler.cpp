@@ -0,0 +1,680 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QtConcurrentRun>
+
+// ctkDICOMCore includes
+#include "ctkDICOMRetrieve.h"
+#include "ctkDICOMRetrieveScheduler.h"
+#include "ctkDICOMRetrieveScheduler_p.h"
+#include "ctkLogger.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcdatset.h>
+
+static ctkLogger logger("org.commontk.dicom.DICOMRetrieveScheduler");
+
+//------------------------------------------------------------------------------
+/// Retrieves queued sub-operations over the association of its retrieve
+class ctkDICOMRetrieveSchedulerWorker : public QRunnable
+{
+public:
+  ctkDICOMRetrieveSchedulerWorker(ctkDICOMRetrieveSchedulerPrivate* schedulerPrivate,
+                                  ctkDICOMRetrieve* retrieve)
+    : SchedulerPrivate(schedulerPrivate), Retrieve(retrieve) {}
+
+  virtual void run()
+    {
+    this->SchedulerPrivate->work(this->Retrieve);
+    }
+
+  ctkDICOMRetrieveSchedulerPrivate* SchedulerPrivate;
+  ctkDICOMRetrieve* Retrieve;
+};
+
+//------------------------------------------------------------------------------
+// ctkDICOMRetrieveSchedulerPrivate methods
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveSchedulerPrivate::ctkDICOMRetrieveSchedulerPrivate(ctkDICOMRetrieveScheduler& obj)
+  : q_ptr(&obj)
+{
+  this->Port = 0;
+  this->UseCGET = false;
+  this->MaximumAssociations = 4;
+  this->ConnectionParametersChanged = false;
+  this->Canceled = false;
+  this->Synchronous = false;
+  this->SeriesCount = 0;
+  this->InstanceCount = 0;
+  this->RetrievedBytes = 0;
+  this->Elapsed = 0;
+
+  OFList<OFString> transferSyntaxes;
+  transferSyntaxes.push_back ( UID_LittleEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_BigEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_LittleEndianImplicitTransferSyntax );
+  this->FindSCU.addPresentationContext (
+      UID_FINDStudyRootQueryRetrieveInformationModel, transferSyntaxes );
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveSchedulerPrivate::~ctkDICOMRetrieveSchedulerPrivate()
+{
+  qDeleteAll(this->Retrieves);
+  if (this->FindSCU.isConnected())
+    {
+    this->FindSCU.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveSchedulerPrivate::connectFindSCU()
+{
+  if (this->FindSCU.isConnected())
+    {
+    return true;
+    }
+  this->FindSCU.setAETitle(this->CallingAETitle.toStdString().c_str());
+  this->FindSCU.setPeerAETitle(this->CalledAETitle.toStdString().c_str());
+  this->FindSCU.setPeerHostName(this->Host.toStdString().c_str());
+  this->FindSCU.setPeerPort(this->Port);
+  if (!this->FindSCU.initNetwork().good())
+    {
+    logger.error("Error initializing the network");
+    return false;
+    }
+  if (!this->FindSCU.negotiateAssociation().good())
+    {
+    logger.error("Error negotiating the association to find the series");
+    return false;
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+QList<ctkDICOMRetrieveSubOperation> ctkDICOMRetrieveSchedulerPrivate::findSeries(
+  const QString& studyInstanceUID, bool& found)
+{
+  QList<ctkDICOMRetrieveSubOperation> series;
+  found = false;
+  if (!this->connectFindSCU())
+    {
+    return series;
+    }
+  T_ASC_PresentationContextID presID = this->FindSCU.findPresentationContextID(
+    UID_FINDStudyRootQueryRetrieveInformationModel, "" /* don't care about transfer syntax */ );
+  if (presID == 0)
+    {
+    logger.error("No valid Study Root FIND Presentation Context available");
+    return series;
+    }
+
+  DcmDataset queryKeys;
+  queryKeys.putAndInsertString(DCM_QueryRetrieveLevel, "SERIES");
+  queryKeys.putAndInsertString(DCM_StudyInstanceUID, studyInstanceUID.toStdString().c_str());
+  queryKeys.putAndInsertString(DCM_SeriesInstanceUID, "");
+  queryKeys.putAndInsertString(DCM_NumberOfSeriesRelatedInstances, "");
+
+  OFList<QRResponse*> responses;
+  OFCondition status = this->FindSCU.sendFINDRequest(presID, &queryKeys, &responses);
+  for (OFIterator<QRResponse*> it = responses.begin(); it != responses.end(); ++it)
+    {
+    DcmDataset* dataset = (*it)->m_dataset;
+    OFString seriesInstanceUID;
+    if (dataset && dataset->findAndGetOFString(DCM_SeriesInstanceUID, seriesInstanceUID).good()
+        && !seriesInstanceUID.empty())
+      {
+      OFString instances;
+      dataset->findAndGetOFString(DCM_NumberOfSeriesRelatedInstances, instances);
+      ctkDICOMRetrieveSubOperation subOperation;
+      subOperation.StudyInstanceUID = studyInstanceUID;
+      subOperation.SeriesInstanceUID = seriesInstanceUID.c_str();
+      subOperation.Instances = QString(instances.c_str()).trimmed().toInt();
+      series << subOperation;
+      }
+    delete *it;
+    }
+  if (status.bad())
+    {
+    logger.warn("Finding the series of " + studyInstanceUID + " failed: " + status.text());
+    this->FindSCU.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+    return QList<ctkDICOMRetrieveSubOperation>();
+    }
+  found = !series.isEmpty();
+  return series;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::configureRetrieve(ctkDICOMRetrieve* retrieve)
+{
+  retrieve->setCallingAETitle(this->CallingAETitle);
+  retrieve->setCalledAETitle(this->CalledAETitle);
+  retrieve->setHost(this->Host);
+  retrieve->setPort(this->Port);
+  retrieve->setMoveDestinationAETitle(this->MoveDestinationAETitle);
+  retrieve->setKeepAssociationOpen(true);
+  retrieve->setDatabase(this->Database);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::run()
+{
+  Q_Q(ctkDICOMRetrieveScheduler);
+
+  emit q->progress(QString("Finding the series to retrieve"));
+  // the series already retrieved are looked up through a connection of
+  // this thread, not in memory unless the request runs in the thread of
+  // the database
+  ctkDICOMDatabase sharedDatabase;
+  ctkDICOMDatabase* requestDatabase = this->Database.data();
+  if (!this->Synchronous)
+    {
+    requestDatabase = sharedDatabase.openSharedDatabase(*this->Database) ? &sharedDatabase : 0;
+    }
+  const bool canResume = requestDatabase != 0;
+  QList<ctkDICOMRetrieveSubOperation> subOperations;
+  bool instancesKnown = true;
+  int skippedSeries = 0;
+  foreach(const QString& studyInstanceUID, this->Studies)
+    {
+    if (this->Canceled)
+      {
+      break;
+      }
+    bool found = false;
+    QList<ctkDICOMRetrieveSubOperation> series = this->findSeries(studyInstanceUID, found);
+    if (!found)
+      {
+      ctkDICOMRetrieveSubOperation study;
+      study.StudyInstanceUID = studyInstanceUID;
+      study.Instances = 0;
+      subOperations << study;
+      instancesKnown = false;
+      continue;
+      }
+    foreach(const ctkDICOMRetrieveSubOperation& subOperation, series)
+      {
+      // resume: series already complete in the database are not retrieved
+      if (canResume && subOperation.Instances > 0
+          && requestDatabase->imageCountForSeries(subOperation.SeriesInstanceUID) >= subOperation.Instances)
+        {
+        ++skippedSeries;
+        continue;
+        }
+      instancesKnown = instancesKnown && subOperation.Instances > 0;
+      subOperations << subOperation;
+      }
+    }
+
+  int instanceCount = 0;
+  foreach(const ctkDICOMRetrieveSubOperation& subOperation, subOperations)
+    {
+    instanceCount += instancesKnown ? subOperation.Instances : 0;
+    }
+  this->InstanceCount = instanceCount;
+  this->SeriesCount = subOperations.count();
+  emit q->progress(QString("Retrieving %1 series, %2 already retrieved")
+                   .arg(subOperations.count()).arg(skippedSeries));
+
+  {
+  QMutexLocker lock(&this->Mutex);
+  if (!this->Canceled)
+    {
+    this->SubOperations = QQueue<ctkDICOMRetrieveSubOperation>();
+    this->SubOperations << subOperations;
+    }
+  }
+  if (this->Synchronous)
+    {
+    this->work(this->Retrieves.first());
+    }
+  else
+    {
+    const int workers = qMin(this->Retrieves.count(), subOperations.count());
+    this->Workers.setMaxThreadCount(qMax(1, workers));
+    for (int i = 0; i < workers; ++i)
+      {
+      this->Workers.start(new ctkDICOMRetrieveSchedulerWorker(this, this->Retrieves[i]));
+      }
+    this->Workers.waitForDone();
+    }
+
+  const int elapsed = this->Timer.elapsed();
+  this->Elapsed = elapsed;
+  bool success = !this->Canceled && this->FailedSeries == 0;
+  logger.info(QString("Retrieved %1 series out of %2 in %3 ms")
+              .arg(int(this->CompletedSeries)).arg(subOperations.count()).arg(elapsed));
+  emit q->progress(100);
+  emit q->finished(success);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveSchedulerPrivate::takeSubOperation(ctkDICOMRetrieveSubOperation& subOperation)
+{
+  QMutexLocker lock(&this->Mutex);
+  if (this->Canceled || this->SubOperations.isEmpty())
+    {
+    return false;
+    }
+  subOperation = this->SubOperations.dequeue();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::work(ctkDICOMRetrieve* retrieve)
+{
+  Q_Q(ctkDICOMRetrieveScheduler);
+  // C-GET inserts the retrieved objects through a connection of this
+  // worker thread, destroyed with it at the end
+  QSharedPointer<ctkDICOMDatabase> workerDatabase;
+  bool databaseOpened = true;
+  if (this->UseCGET && !this->Synchronous)
+    {
+    workerDatabase = QSharedPointer<ctkDICOMDatabase>(new ctkDICOMDatabase);
+    databaseOpened = workerDatabase->openSharedDatabase(*this->Database);
+    if (databaseOpened)
+      {
+      retrieve->setDatabase(workerDatabase);
+      }
+    else
+      {
+      logger.error("Can't open the database to retrieve into: " + workerDatabase->lastError());
+      }
+    }
+
+  ctkDICOMRetrieveSubOperation subOperation;
+  while (this->takeSubOperation(subOperation))
+    {
+    if (!databaseOpened)
+      {
+      this->FailedSeries.ref();
+      emit q->seriesRetrieved(subOperation.StudyInstanceUID, subOperation.SeriesInstanceUID, false);
+      this->emitProgress();
+      continue;
+      }
+    // a cancel() from now on is seen by onRetrieveProgress()
+    retrieve->setWasCanceled(false);
+    bool success = false;
+    if (subOperation.SeriesInstanceUID.isEmpty())
+      {
+      success = this->UseCGET ? retrieve->getStudy(subOperation.StudyInstanceUID)
+        : retrieve->moveStudy(subOperation.StudyInstanceUID);
+      }
+    else
+      {
+      success = this->UseCGET ?
+        retrieve->getSeries(subOperation.StudyInstanceUID, subOperation.SeriesInstanceUID)
+        : retrieve->moveSeries(subOperation.StudyInstanceUID, subOperation.SeriesInstanceUID);
+      }
+    // a canceled series is incomplete, resume() retrieves it again
+    success = success && !retrieve->wasCanceled();
+    if (success)
+      {
+      this->CompletedSeries.ref();
+      }
+    else
+      {
+      this->FailedSeries.ref();
+      }
+    emit q->seriesRetrieved(subOperation.StudyInstanceUID, subOperation.SeriesInstanceUID, success);
+    this->emitProgress();
+    }
+  retrieve->setDatabase(this->Database);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::emitProgress()
+{
+  Q_Q(ctkDICOMRetrieveScheduler);
+  const int retrievedInstances = this->RetrievedInstances;
+  const int instanceCount = this->InstanceCount;
+  const int seriesCount = this->SeriesCount;
+  int percentage = 0;
+  if (instanceCount > 0)
+    {
+    percentage = qMin(100, (100 * retrievedInstances) / instanceCount);
+    }
+  else if (seriesCount > 0)
+    {
+    percentage = (100 * (this->CompletedSeries + this->FailedSeries)) / seriesCount;
+    }
+  emit q->progress(percentage);
+  emit q->transferProgress(retrievedInstances, instanceCount,
+                           q->retrievedBytes(), q->bytesPerSecond());
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::onInstancesRetrieved(int count, qint64 bytes)
+{
+  this->RetrievedInstances.fetchAndAddOrdered(count);
+  {
+  QMutexLocker lock(&this->Mutex);
+  this->RetrievedBytes += bytes;
+  }
+  this->emitProgress();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::onRetrieveProgress()
+{
+  // the retrieve is only used by the thread of its worker, it is canceled
+  // from there rather than from the thread calling cancel()
+  if (this->Canceled)
+    {
+    ctkDICOMRetrieve* retrieve = qobject_cast<ctkDICOMRetrieve*>(this->sender());
+    if (retrieve)
+      {
+      retrieve->cancel();
+      }
+    }
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMRetrieveScheduler methods
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveScheduler::ctkDICOMRetrieveScheduler(QObject* parentObject)
+  : QObject(parentObject)
+  , d_ptr(new ctkDICOMRetrieveSchedulerPrivate(*this))
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveScheduler::~ctkDICOMRetrieveScheduler()
+{
+  this->cancel();
+  this->waitForFinished();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setCallingAETitle(const QString& callingAETitle)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  d->ConnectionParametersChanged |= (callingAETitle != d->CallingAETitle);
+  d->CallingAETitle = callingAETitle;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMRetrieveScheduler::callingAETitle()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->CallingAETitle;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setCalledAETitle(const QString& calledAETitle)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  d->ConnectionParametersChanged |= (calledAETitle != d->CalledAETitle);
+  d->CalledAETitle = calledAETitle;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMRetrieveScheduler::calledAETitle()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->CalledAETitle;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setHost(const QString& host)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  d->ConnectionParametersChanged |= (host != d->Host);
+  d->Host = host;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMRetrieveScheduler::host()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->Host;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setPort(int port)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  d->ConnectionParametersChanged |= (port != d->Port);
+  d->Port = port;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::port()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->Port;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setMoveDestinationAETitle(const QString& moveDestinationAETitle)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  d->MoveDestinationAETitle = moveDestinationAETitle;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMRetrieveScheduler::moveDestinationAETitle()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->MoveDestinationAETitle;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setUseCGET(bool useCGET)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  d->UseCGET = useCGET;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveScheduler::useCGET()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->UseCGET;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setMaximumAssociations(int maximumAssociations)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  d->MaximumAssociations = qMax(1, maximumAssociations);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::maximumAssociations()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->MaximumAssociations;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setDatabase(QSharedPointer<ctkDICOMDatabase> dicomDatabase)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  d->Database = dicomDatabase;
+}
+
+//------------------------------------------------------------------------------
+QSharedPointer<ctkDICOMDatabase> ctkDICOMRetrieveScheduler::database()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->Database;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveScheduler::isRunning()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->Request.isRunning();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::waitForFinished()
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  d->Request.waitForFinished();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::seriesCount()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->SeriesCount;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::completedSeriesCount()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->CompletedSeries;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::failedSeriesCount()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->FailedSeries;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::instanceCount()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->InstanceCount;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::retrievedInstanceCount()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  return d->RetrievedInstances;
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMRetrieveScheduler::retrievedBytes()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker lock(&const_cast<ctkDICOMRetrieveSchedulerPrivate*>(d)->Mutex);
+  return d->RetrievedBytes;
+}
+
+//------------------------------------------------------------------------------
+double ctkDICOMRetrieveScheduler::bytesPerSecond()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  int elapsed = d->Elapsed;
+  if (elapsed < 0)
+    {
+    elapsed = d->Timer.elapsed();
+    }
+  return elapsed > 0 ? (1000. * this->retrievedBytes()) / elapsed : 0.;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveScheduler::retrieveStudies(const QStringList& studyInstanceUIDs)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  if (this->isRunning())
+    {
+    logger.error("A retrieve request is already running");
+    return false;
+    }
+  if (!d->Database)
+    {
+    logger.error("No Database for retrieve transaction");
+    return false;
+    }
+  // the workers insert through connections of their own, which a database
+  // in memory can't share
+  d->Synchronous = d->UseCGET && d->Database->isInMemory();
+  const int associations = d->Synchronous ? 1 : d->MaximumAssociations;
+
+  if (d->ConnectionParametersChanged)
+    {
+    // the associations are to another peer host
+    qDeleteAll(d->Retrieves);
+    d->Retrieves.clear();
+    if (d->FindSCU.isConnected())
+      {
+      d->FindSCU.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+      }
+    d->ConnectionParametersChanged = false;
+    }
+  while (d->Retrieves.count() > associations)
+    {
+    delete d->Retrieves.takeLast();
+    }
+  while (d->Retrieves.count() < associations)
+    {
+    ctkDICOMRetrieve* retrieve = new ctkDICOMRetrieve;
+    QObject::connect(retrieve, SIGNAL(instancesRetrieved(int,qint64)),
+                     d, SLOT(onInstancesRetrieved(int,qint64)), Qt::DirectConnection);
+    QObject::connect(retrieve, SIGNAL(progress(QString)),
+                     d, SLOT(onRetrieveProgress()), Qt::DirectConnection);
+    d->Retrieves << retrieve;
+    }
+  foreach(ctkDICOMRetrieve* retrieve, d->Retrieves)
+    {
+    d->configureRetrieve(retrieve);
+    }
+
+  d->Studies = studyInstanceUIDs;
+  d->Canceled = false;
+  d->SeriesCount = 0;
+  d->InstanceCount = 0;
+  d->CompletedSeries = 0;
+  d->FailedSeries = 0;
+  d->RetrievedInstances = 0;
+  d->RetrievedBytes = 0;
+  d->Elapsed = -1;
+  d->Timer.start();
+  if (d->Synchronous)
+    {
+    d->Request = QFuture<void>();
+    d->run();
+    return true;
+    }
+  d->Request = QtConcurrent::run(d, &ctkDICOMRetrieveSchedulerPrivate::run);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveScheduler::resume()
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  return this->retrieveStudies(d->Studies);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::cancel()
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  {
+  QMutexLocker lock(&d->Mutex);
+  d->Canceled = true;
+  d->SubOperations.clear();
+  }
+}
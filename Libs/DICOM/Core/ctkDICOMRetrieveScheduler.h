@@ -0,0 +1,141 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMRetrieveScheduler_h
+#define __ctkDICOMRetrieveScheduler_h
+
+// Qt includes
+#include <QObject>
+#include <QSharedPointer>
+#include <QStringList>
+
+#include "ctkDICOMCoreExport.h"
+
+// CTK Core includes
+#include "ctkDICOMDatabase.h"
+
+class ctkDICOMRetrieveSchedulerPrivate;
+
+/// \ingroup DICOM_Core
+///
+/// \brief Retrieves studies series by series over several associations
+///
+/// The series of the requested studies are first found with a series level
+/// C-FIND, then retrieved in parallel by maximumAssociations() instances of
+/// ctkDICOMRetrieve. Their associations are kept open across requests to
+/// the same peer host. Series whose instances are all in the database
+/// already are skipped, so resume() only retrieves what a canceled or
+/// failed request left out. Studies whose series can't be found are
+/// retrieved as a whole.
+class CTK_DICOM_CORE_EXPORT ctkDICOMRetrieveScheduler : public QObject
+{
+  Q_OBJECT
+  Q_PROPERTY(QString callingAETitle READ callingAETitle WRITE setCallingAETitle);
+  Q_PROPERTY(QString calledAETitle READ calledAETitle WRITE setCalledAETitle);
+  Q_PROPERTY(QString host READ host WRITE setHost);
+  Q_PROPERTY(int port READ port WRITE setPort);
+  Q_PROPERTY(QString moveDestinationAETitle READ moveDestinationAETitle WRITE setMoveDestinationAETitle);
+  Q_PROPERTY(bool useCGET READ useCGET WRITE setUseCGET);
+  Q_PROPERTY(int maximumAssociations READ maximumAssociations WRITE setMaximumAssociations);
+
+public:
+  explicit ctkDICOMRetrieveScheduler(QObject* parent = 0);
+  virtual ~ctkDICOMRetrieveScheduler();
+
+  /// Connection parameters, see ctkDICOMRetrieve. Changing them closes the
+  /// open associations.
+  void setCallingAETitle(const QString& callingAETitle);
+  QString callingAETitle()const;
+  void setCalledAETitle(const QString& calledAETitle);
+  QString calledAETitle()const;
+  void setHost(const QString& host);
+  QString host()const;
+  void setPort(int port);
+  int port()const;
+  void setMoveDestinationAETitle(const QString& moveDestinationAETitle);
+  QString moveDestinationAETitle()const;
+  /// Retrieve with C-GET into the database instead of C-MOVE to the move
+  /// destination (default false)
+  void setUseCGET(bool useCGET);
+  bool useCGET()const;
+  /// Number of series retrieved at the same time, each over an association
+  /// of its own (default 4)
+  void setMaximumAssociations(int maximumAssociations);
+  int maximumAssociations()const;
+
+  /// Where the retrieved objects are inserted with C-GET, and looked for to
+  /// skip the series already retrieved. The background threads use
+  /// connections of their own. A database in memory can't be shared: C-GET
+  /// into it runs in the calling thread over a single association, and
+  /// C-MOVE doesn't skip the series already retrieved.
+  Q_INVOKABLE void setDatabase(QSharedPointer<ctkDICOMDatabase> dicomDatabase);
+  Q_INVOKABLE QSharedPointer<ctkDICOMDatabase> database()const;
+
+  Q_INVOKABLE bool isRunning()const;
+  /// Block until the current request is finished
+  Q_INVOKABLE void waitForFinished();
+
+  /// Statistics of the current or last request
+  Q_INVOKABLE int seriesCount()const;
+  Q_INVOKABLE int completedSeriesCount()const;
+  /// Series that failed or were canceled, for resume() to retry
+  Q_INVOKABLE int failedSeriesCount()const;
+  /// Instances of the series to retrieve, 0 if the peer host doesn't tell
+  Q_INVOKABLE int instanceCount()const;
+  Q_INVOKABLE int retrievedInstanceCount()const;
+  /// Bytes received, C-GET only
+  Q_INVOKABLE qint64 retrievedBytes()const;
+  Q_INVOKABLE double bytesPerSecond()const;
+
+public Q_SLOTS:
+  /// Start retrieving \a studyInstanceUIDs in the background, finished()
+  /// is emitted when done. With C-GET into a database in memory, the
+  /// studies are retrieved before returning.
+  /// Returns false if a request is already running.
+  bool retrieveStudies(const QStringList& studyInstanceUIDs);
+  /// Retrieve the series of the last request not in the database yet
+  bool resume();
+  /// Cancel the running sub-operations and drop the queued ones. The
+  /// workers stop their retrieve at its next response.
+  void cancel();
+
+Q_SIGNALS:
+  /// Percentage of the instances retrieved, or of the series when the
+  /// number of instances is unknown
+  void progress(int progress);
+  void progress(const QString& message);
+  /// Emitted as the instances arrive
+  void transferProgress(int retrievedInstances, int instances, qint64 bytes,
+                        double bytesPerSecond);
+  /// Emitted after a series is retrieved, or failed to be
+  void seriesRetrieved(const QString& studyInstanceUID, const QString& seriesInstanceUID,
+                       bool success);
+  /// \a success is false if a series failed or the request was canceled
+  void finished(bool success);
+
+protected:
+  QScopedPointer<ctkDICOMRetrieveSchedulerPrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(ctkDICOMRetrieveScheduler);
+  Q_DISABLE_COPY(ctkDICOMRetrieveScheduler);
+};
+
+#endif
@@ -0,0 +1,126 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef CTKDICOMRETRIEVESCHEDULERPRIVATE_H
+#define CTKDICOMRETRIEVESCHEDULERPRIVATE_H
+
+#include <QAtomicInt>
+#include <QFuture>
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QThreadPool>
+#include <QTime>
+
+#include "ctkDICOMRetrieveScheduler.h"
+
+// DCMTK includes
+#include <dcmtk/dcmnet/scu.h>
+
+class ctkDICOMRetrieve;
+
+//------------------------------------------------------------------------------
+/// A series to retrieve, or a whole study if SeriesInstanceUID is empty
+struct ctkDICOMRetrieveSubOperation
+{
+  QString StudyInstanceUID;
+  QString SeriesInstanceUID;
+  /// number of instances, 0 if unknown
+  int     Instances;
+};
+
+//------------------------------------------------------------------------------
+class ctkDICOMRetrieveSchedulerPrivate : public QObject
+{
+  Q_OBJECT
+  Q_DECLARE_PUBLIC(ctkDICOMRetrieveScheduler);
+
+protected:
+  ctkDICOMRetrieveScheduler* const q_ptr;
+
+public:
+  ctkDICOMRetrieveSchedulerPrivate(ctkDICOMRetrieveScheduler& obj);
+  ~ctkDICOMRetrieveSchedulerPrivate();
+
+  /// Body of a request, run in the background
+  void run();
+  /// Series of \a studyInstanceUID on the peer host, \a found is false if
+  /// the series level C-FIND failed
+  QList<ctkDICOMRetrieveSubOperation> findSeries(const QString& studyInstanceUID, bool& found);
+  /// Open the association of FindSCU if it isn't
+  bool connectFindSCU();
+  void configureRetrieve(ctkDICOMRetrieve* retrieve);
+  /// Called from the workers, false once the queue is empty or canceled
+  bool takeSubOperation(ctkDICOMRetrieveSubOperation& subOperation);
+  /// Body of a worker, retrieves queued sub-operations with \a retrieve.
+  /// With C-GET, the objects are inserted through a connection of the
+  /// worker thread (see ctkDICOMDatabase::openSharedDatabase()), or
+  /// through Database itself when the request is synchronous.
+  void work(ctkDICOMRetrieve* retrieve);
+  void emitProgress();
+
+  QString CallingAETitle;
+  QString CalledAETitle;
+  QString Host;
+  int     Port;
+  QString MoveDestinationAETitle;
+  bool    UseCGET;
+  int     MaximumAssociations;
+  QSharedPointer<ctkDICOMDatabase> Database;
+  /// the connection parameters changed, the open associations are closed
+  /// by the next request
+  bool    ConnectionParametersChanged;
+
+  /// one per association, kept across requests
+  QList<ctkDICOMRetrieve*> Retrieves;
+  DcmSCU  FindSCU;
+  QThreadPool Workers;
+  QFuture<void> Request;
+  QStringList Studies;
+  /// set by cancel(), each worker cancels its own retrieve when it sees it
+  QAtomicInt Canceled;
+  /// C-GET into a database in memory, whose connection can't be shared:
+  /// the request runs in the calling thread over a single association
+  bool    Synchronous;
+
+  QQueue<ctkDICOMRetrieveSubOperation> SubOperations;
+  QMutex  Mutex;
+
+  /// statistics of the request, read from any thread
+  QAtomicInt SeriesCount;
+  QAtomicInt InstanceCount;
+  QAtomicInt CompletedSeries;
+  QAtomicInt FailedSeries;
+  QAtomicInt RetrievedInstances;
+  /// protected by Mutex
+  qint64     RetrievedBytes;
+  QTime      Timer;
+  /// duration of the finished request, -1 while running
+  QAtomicInt Elapsed;
+
+public Q_SLOTS:
+  /// Connected directly to the retrieves, called from the worker threads
+  void onInstancesRetrieved(int count, qint64 bytes);
+  /// Connected directly to the retrieves, called from the worker threads
+  /// before the retrieve decides to go on with the current operation
+  void onRetrieveProgress();
+};
+
+#endif // CTKDICOMRETRIEVESCHEDULERPRIVATE_H
@@ -0,0 +1,585 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QDir>
+#include <QFile>
+#include <QRegExp>
+#include <QRunnable>
+
+// ctkDICOMCore includes
+#include "ctkDICOMStorageReceiver.h"
+#include "ctkDICOMStorageReceiver_p.h"
+#include "ctkLogger.h"
+
+// DCMTK includes
+#include <dcmtk/dcmnet/dimse.h>
+#include <dcmtk/dcmnet/diutil.h>
+#include <dcmtk/dcmdata/dcuid.h>
+
+static ctkLogger logger("org.commontk.dicom.DICOMStorageReceiver");
+
+//------------------------------------------------------------------------------
+/// Serves one association in the thread pool
+class ctkDICOMStorageReceiverAssociation : public QRunnable
+{
+public:
+  ctkDICOMStorageReceiverAssociation(ctkDICOMStorageReceiverPrivate* receiverPrivate,
+                                     T_ASC_Association* association)
+    : ReceiverPrivate(receiverPrivate), Association(association) {}
+
+  virtual void run()
+    {
+    this->ReceiverPrivate->serveAssociation(this->Association);
+    }
+
+  ctkDICOMStorageReceiverPrivate* ReceiverPrivate;
+  T_ASC_Association* Association;
+};
+
+//------------------------------------------------------------------------------
+// ctkDICOMStorageReceiverListener methods
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageReceiverListener::ctkDICOMStorageReceiverListener(
+  ctkDICOMStorageReceiverPrivate* receiverPrivate)
+  : ReceiverPrivate(receiverPrivate)
+{
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiverListener::run()
+{
+  this->ReceiverPrivate->listen();
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMStorageReceiverWriter methods
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageReceiverWriter::ctkDICOMStorageReceiverWriter(
+  ctkDICOMStorageReceiverPrivate* receiverPrivate)
+  : ReceiverPrivate(receiverPrivate)
+{
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiverWriter::run()
+{
+  this->ReceiverPrivate->writeFiles();
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMStorageReceiverPrivate methods
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageReceiverPrivate::ctkDICOMStorageReceiverPrivate(ctkDICOMStorageReceiver& obj)
+  : q_ptr(&obj)
+  , AETitle("CTKSTORE")
+  , Port(11112)
+  , MaximumAssociations(4)
+  , Timeout(30)
+  , Network(0)
+  , Stopping(false)
+  , AssociationsDone(false)
+  , Listener(this)
+  , Writer(this)
+  , FilesInProgress(0)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageReceiverPrivate::~ctkDICOMStorageReceiverPrivate()
+{
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiverPrivate::listen()
+{
+  // uncompressed syntaxes first, the compressed ones are stored as received
+  const char* transferSyntaxes[] = {
+    UID_LittleEndianExplicitTransferSyntax,
+    UID_BigEndianExplicitTransferSyntax,
+    UID_LittleEndianImplicitTransferSyntax,
+    UID_DeflatedExplicitVRLittleEndianTransferSyntax,
+    UID_JPEGProcess14SV1TransferSyntax,
+    UID_JPEGProcess1TransferSyntax,
+    UID_JPEGProcess2_4TransferSyntax,
+    UID_JPEGLSLosslessTransferSyntax,
+    UID_JPEGLSLossyTransferSyntax,
+    UID_JPEG2000LosslessOnlyTransferSyntax,
+    UID_JPEG2000TransferSyntax,
+    UID_RLELosslessTransferSyntax
+    };
+  const int transferSyntaxCount = sizeof(transferSyntaxes) / sizeof(transferSyntaxes[0]);
+  const char* verificationSyntax[] = { UID_VerificationSOPClass };
+  const QByteArray aeTitle = this->AETitle.toAscii();
+
+  while (!this->Stopping)
+    {
+    T_ASC_Association* association = 0;
+    // the timeout lets stop() be noticed
+    OFCondition status = ASC_receiveAssociation(this->Network, &association,
+      ASC_DEFAULTMAXPDU, NULL, NULL, OFFalse, DUL_NOBLOCK, 1);
+    bool rejected = false;
+    if (status.good() && this->ActiveAssociations >= this->MaximumAssociations)
+      {
+      logger.warn("Association rejected: already serving "
+                  + QString::number(this->MaximumAssociations) + " associations");
+      T_ASC_RejectParameters rejection =
+        {
+        ASC_RESULT_REJECTEDTRANSIENT,
+        ASC_SOURCE_SERVICEPROVIDER_PRESENTATION_RELATED,
+        ASC_REASON_SP_PRES_LOCALLIMITEXCEEDED
+        };
+      ASC_rejectAssociation(association, &rejection);
+      rejected = true;
+      }
+    if (status.good() && !rejected)
+      {
+      ASC_acceptContextsWithPreferredTransferSyntaxes(association->params,
+        verificationSyntax, 1, transferSyntaxes, transferSyntaxCount);
+      ASC_acceptContextsWithPreferredTransferSyntaxes(association->params,
+        dcmAllStorageSOPClassUIDs, numberOfAllDcmStorageSOPClassUIDs,
+        transferSyntaxes, transferSyntaxCount);
+      ASC_setAPTitles(association->params, NULL, NULL, aeTitle.constData());
+      status = ASC_acknowledgeAssociation(association);
+      }
+    if (status.good() && !rejected)
+      {
+      this->ActiveAssociations.ref();
+      this->AssociationPool.start(new ctkDICOMStorageReceiverAssociation(this, association));
+      continue;
+      }
+    if (status.bad() && status != DUL_NOASSOCIATIONREQUEST)
+      {
+      logger.warn(QString("Association request failed: ") + status.text());
+      }
+    if (association)
+      {
+      ASC_dropSCPAssociation(association);
+      ASC_destroyAssociation(&association);
+      }
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiverPrivate::serveAssociation(T_ASC_Association* association)
+{
+  OFCondition status = EC_Normal;
+  int idleSeconds = 0;
+  while (status.good())
+    {
+    T_DIMSE_Message message;
+    T_ASC_PresentationContextID presentationContextID;
+    status = DIMSE_receiveCommand(association, DIMSE_NONBLOCKING, 1,
+                                  &presentationContextID, &message, NULL);
+    if (status == DIMSE_NODATAAVAILABLE)
+      {
+      if (this->Stopping || ++idleSeconds >= this->Timeout)
+        {
+        break;
+        }
+      status = EC_Normal;
+      continue;
+      }
+    if (status.bad())
+      {
+      break;
+      }
+    idleSeconds = 0;
+    switch (message.CommandField)
+      {
+      case DIMSE_C_ECHO_RQ:
+        status = DIMSE_sendEchoResponse(association, presentationContextID,
+                                        &message.msg.CEchoRQ, STATUS_Success, NULL);
+        break;
+      case DIMSE_C_STORE_RQ:
+        status = this->store(association, message, presentationContextID);
+        break;
+      default:
+        logger.warn("Unsupported DIMSE command received, aborting association");
+        status = DIMSE_BADCOMMANDTYPE;
+        break;
+      }
+    }
+
+  if (status == DUL_PEERREQUESTEDRELEASE)
+    {
+    ASC_acknowledgeRelease(association);
+    }
+  else if (status != DUL_PEERABORTEDASSOCIATION)
+    {
+    ASC_abortAssociation(association);
+    }
+  ASC_dropSCPAssociation(association);
+  ASC_destroyAssociation(&association);
+  this->ActiveAssociations.deref();
+}
+
+//------------------------------------------------------------------------------
+OFCondition ctkDICOMStorageReceiverPrivate::store(T_ASC_Association* association,
+                                                  T_DIMSE_Message& message,
+                                                  T_ASC_PresentationContextID presentationContextID)
+{
+  Q_Q(ctkDICOMStorageReceiver);
+  T_DIMSE_C_StoreRQ& request = message.msg.CStoreRQ;
+  QString sopInstanceUID(request.AffectedSOPInstanceUID);
+  // the UID names the file: anything else than a UID could write outside
+  // of the storage directory
+  if (sopInstanceUID.length() > 64
+      || !QRegExp("[0-9]+(\\.[0-9]+)*").exactMatch(sopInstanceUID))
+    {
+    logger.error("Rejected an object with an invalid SOP instance UID: " + sopInstanceUID);
+    OFCondition status = DIMSE_ignoreDataSet(association, DIMSE_NONBLOCKING, this->Timeout,
+                                             NULL, NULL);
+    if (status.bad())
+      {
+      return status;
+      }
+    T_DIMSE_C_StoreRSP response;
+    memset(&response, 0, sizeof(response));
+    response.DimseStatus = STATUS_STORE_Error_CannotUnderstand;
+    return DIMSE_sendStoreResponse(association, presentationContextID, &request,
+                                   &response, NULL);
+    }
+  QString filePath = QDir(this->CurrentStorageDirectory).filePath(sopInstanceUID + ".dcm");
+
+  // the data set is written to the file as it is received, with a meta
+  // header, without being parsed
+  OFCondition status = DIMSE_storeProvider(association, presentationContextID, &request,
+    QFile::encodeName(filePath).constData(), OFTrue, NULL, NULL, NULL,
+    DIMSE_NONBLOCKING, this->Timeout);
+  if (status.bad())
+    {
+    logger.error("Receiving " + sopInstanceUID + " failed: " + status.text());
+    QFile::remove(filePath);
+    return status;
+    }
+  this->ReceivedCount.ref();
+  this->pushFile(filePath);
+  emit q->objectReceived(sopInstanceUID, filePath);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiverPrivate::pushFile(const QString& filePath)
+{
+  QMutexLocker lock(&this->FilesMutex);
+  this->Files.enqueue(filePath);
+  this->FilesNotEmpty.wakeOne();
+}
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMStorageReceiverPrivate::takeFiles(int batchSize)
+{
+  QMutexLocker lock(&this->FilesMutex);
+  while (this->Files.isEmpty())
+    {
+    if (this->AssociationsDone)
+      {
+      return QStringList();
+      }
+    this->FilesNotEmpty.wait(&this->FilesMutex);
+    }
+  // everything received meanwhile goes into the same transaction
+  batchSize = qMax(1, batchSize);
+  QStringList files;
+  while (!this->Files.isEmpty() && files.count() < batchSize)
+    {
+    files << this->Files.dequeue();
+    }
+  this->FilesInProgress += files.count();
+  return files;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiverPrivate::writeFiles()
+{
+  Q_Q(ctkDICOMStorageReceiver);
+
+  // the connection of Database belongs to the thread that opened it
+  ctkDICOMDatabase writerDatabase;
+  if (!writerDatabase.openSharedDatabase(*this->Database))
+    {
+    QString message = "Can't open the database for indexing: " + writerDatabase.lastError();
+    logger.error(message);
+    emit q->error(message);
+    return;
+    }
+
+  // the tags to precache are written to the tag cache by the insert
+  QList<DcmTagKey> tags = ctkDICOMDatabase::indexedTags();
+  foreach (const QString& tag, writerDatabase.tagsToPrecache())
+    {
+    unsigned short group, element;
+    if (writerDatabase.tagToGroupElement(tag, group, element))
+      {
+      tags << DcmTagKey(group, element);
+      }
+    }
+
+  const int batchSize = writerDatabase.insertBatchSize();
+  QStringList files = this->takeFiles(batchSize);
+  while (!files.isEmpty())
+    {
+    bool ownBatch = writerDatabase.beginBatchInsert();
+    foreach (const QString& filePath, files)
+      {
+      ctkDICOMDataset dataset;
+      if (dataset.InitializeFromFileTags(filePath, tags))
+        {
+        writerDatabase.insert(dataset, filePath, false, true);
+        }
+      else
+        {
+        logger.warn("Could not read received file:" + filePath);
+        }
+      }
+    if (ownBatch)
+      {
+      writerDatabase.commitBatchInsert();
+      }
+    this->IndexedCount.fetchAndAddOrdered(files.count());
+
+    {
+    QMutexLocker lock(&this->FilesMutex);
+    this->FilesInProgress -= files.count();
+    this->FilesIndexed.wakeAll();
+    }
+    emit q->objectsIndexed(files.count());
+
+    files = this->takeFiles(batchSize);
+    }
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMStorageReceiver methods
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageReceiver::ctkDICOMStorageReceiver(QObject* parentObject)
+  : QObject(parentObject)
+  , d_ptr(new ctkDICOMStorageReceiverPrivate(*this))
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageReceiver::~ctkDICOMStorageReceiver()
+{
+  this->stop();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiver::setAETitle(const QString& AETitle)
+{
+  Q_D(ctkDICOMStorageReceiver);
+  d->AETitle = AETitle;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMStorageReceiver::AETitle()const
+{
+  Q_D(const ctkDICOMStorageReceiver);
+  return d->AETitle;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiver::setPort(int port)
+{
+  Q_D(ctkDICOMStorageReceiver);
+  d->Port = port;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageReceiver::port()const
+{
+  Q_D(const ctkDICOMStorageReceiver);
+  return d->Port;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiver::setStorageDirectory(const QString& directory)
+{
+  Q_D(ctkDICOMStorageReceiver);
+  d->StorageDirectory = directory;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMStorageReceiver::storageDirectory()const
+{
+  Q_D(const ctkDICOMStorageReceiver);
+  if (d->StorageDirectory.isEmpty() && d->Database)
+    {
+    return d->Database->databaseDirectory() + "/incoming";
+    }
+  return d->StorageDirectory;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiver::setMaximumAssociations(int maximumAssociations)
+{
+  Q_D(ctkDICOMStorageReceiver);
+  d->MaximumAssociations = qMax(1, maximumAssociations);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageReceiver::maximumAssociations()const
+{
+  Q_D(const ctkDICOMStorageReceiver);
+  return d->MaximumAssociations;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiver::setTimeout(int seconds)
+{
+  Q_D(ctkDICOMStorageReceiver);
+  d->Timeout = qMax(1, seconds);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageReceiver::timeout()const
+{
+  Q_D(const ctkDICOMStorageReceiver);
+  return d->Timeout;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiver::setDatabase(QSharedPointer<ctkDICOMDatabase> dicomDatabase)
+{
+  Q_D(ctkDICOMStorageReceiver);
+  if (this->isListening())
+    {
+    logger.error("Can't change the database of a running storage receiver");
+    return;
+    }
+  d->Database = dicomDatabase;
+}
+
+//------------------------------------------------------------------------------
+QSharedPointer<ctkDICOMDatabase> ctkDICOMStorageReceiver::database()const
+{
+  Q_D(const ctkDICOMStorageReceiver);
+  return d->Database;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMStorageReceiver::isListening()const
+{
+  Q_D(const ctkDICOMStorageReceiver);
+  return d->Listener.isRunning();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageReceiver::receivedCount()const
+{
+  Q_D(const ctkDICOMStorageReceiver);
+  return d->ReceivedCount;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageReceiver::indexedCount()const
+{
+  Q_D(const ctkDICOMStorageReceiver);
+  return d->IndexedCount;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiver::waitForIndexing()
+{
+  Q_D(ctkDICOMStorageReceiver);
+  QMutexLocker lock(&d->FilesMutex);
+  while (d->Writer.isRunning() && (!d->Files.isEmpty() || d->FilesInProgress > 0))
+    {
+    d->FilesIndexed.wait(&d->FilesMutex, 100);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMStorageReceiver::start()
+{
+  Q_D(ctkDICOMStorageReceiver);
+  if (this->isListening())
+    {
+    return true;
+    }
+  // the previous session may still be indexing
+  this->stop();
+  if (!d->Database)
+    {
+    logger.error("No database for the storage receiver");
+    emit error("No database for the storage receiver");
+    return false;
+    }
+  if (d->Database->isInMemory())
+    {
+    // the writer thread opens its own connection to the database file
+    logger.error("The storage receiver needs a database file");
+    emit error("The storage receiver needs a database file");
+    return false;
+    }
+  d->CurrentStorageDirectory = this->storageDirectory();
+  if (!QDir().mkpath(d->CurrentStorageDirectory))
+    {
+    logger.error("Can't create the storage directory " + d->CurrentStorageDirectory);
+    emit error("Can't create the storage directory " + d->CurrentStorageDirectory);
+    return false;
+    }
+  OFCondition status = ASC_initializeNetwork(NET_ACCEPTOR, d->Port, d->Timeout, &d->Network);
+  if (status.bad())
+    {
+    QString message = QString("Can't listen to port %1: %2").arg(d->Port).arg(status.text());
+    logger.error(message);
+    emit error(message);
+    d->Network = 0;
+    return false;
+    }
+  logger.debug(QString("Listening to port %1 as %2").arg(d->Port).arg(d->AETitle));
+
+  d->Stopping = false;
+  d->AssociationsDone = false;
+  d->ReceivedCount = 0;
+  d->IndexedCount = 0;
+  d->AssociationPool.setMaxThreadCount(d->MaximumAssociations);
+  d->Writer.start();
+  d->Listener.start();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageReceiver::stop()
+{
+  Q_D(ctkDICOMStorageReceiver);
+  if (!d->Network)
+    {
+    return;
+    }
+  d->Stopping = true;
+  d->Listener.wait();
+  d->AssociationPool.waitForDone();
+  ASC_dropNetwork(&d->Network);
+  d->Network = 0;
+
+  {
+  QMutexLocker lock(&d->FilesMutex);
+  d->AssociationsDone = true;
+  d->FilesNotEmpty.wakeAll();
+  }
+  d->Writer.wait();
+}
@@ -0,0 +1,115 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMStorageReceiver_h
+#define __ctkDICOMStorageReceiver_h
+
+// Qt includes
+#include <QObject>
+#include <QSharedPointer>
+
+#include "ctkDICOMCoreExport.h"
+
+// CTK Core includes
+#include "ctkDICOMDatabase.h"
+
+class ctkDICOMStorageReceiverPrivate;
+
+/// \ingroup DICOM_Core
+///
+/// \brief Storage service (C-STORE SCP) receiving objects into a database
+///
+/// Each association is served by a thread of its own, up to
+/// maximumAssociations() at once, further association requests are
+/// rejected. An incoming object is written as received into the
+/// storageDirectory() and acknowledged right away: it is indexed later by
+/// a single thread inserting the received files into the database in
+/// batches, so the network is never slowed down by the database.
+/// The files are indexed in place, they are not copied again. Objects
+/// whose SOP instance UID isn't a valid UID are refused.
+/// Verification (C-ECHO) requests are answered as well.
+class CTK_DICOM_CORE_EXPORT ctkDICOMStorageReceiver : public QObject
+{
+  Q_OBJECT
+  Q_PROPERTY(QString AETitle READ AETitle WRITE setAETitle);
+  Q_PROPERTY(int port READ port WRITE setPort);
+  Q_PROPERTY(QString storageDirectory READ storageDirectory WRITE setStorageDirectory);
+  Q_PROPERTY(int maximumAssociations READ maximumAssociations WRITE setMaximumAssociations);
+  Q_PROPERTY(int timeout READ timeout WRITE setTimeout);
+
+public:
+  explicit ctkDICOMStorageReceiver(QObject* parent = 0);
+  virtual ~ctkDICOMStorageReceiver();
+
+  /// AE title answered to the calling hosts (default CTKSTORE)
+  void setAETitle(const QString& AETitle);
+  QString AETitle()const;
+  /// Port listened to, e.g. 11112 (default 11112)
+  void setPort(int port);
+  int port()const;
+  /// Directory the received files are written to. By default, the
+  /// "incoming" subdirectory of the database directory.
+  void setStorageDirectory(const QString& directory);
+  QString storageDirectory()const;
+  /// Number of associations served at the same time (default 4)
+  void setMaximumAssociations(int maximumAssociations);
+  int maximumAssociations()const;
+  /// Seconds an association can stay idle before being aborted (default 30)
+  void setTimeout(int seconds);
+  int timeout()const;
+
+  /// Database the received objects are inserted into, must be set before
+  /// start(). It must be a database file, not in memory: the indexing
+  /// thread inserts through a connection of its own.
+  Q_INVOKABLE void setDatabase(QSharedPointer<ctkDICOMDatabase> dicomDatabase);
+  Q_INVOKABLE QSharedPointer<ctkDICOMDatabase> database()const;
+
+  Q_INVOKABLE bool isListening()const;
+  /// Objects written to disk since start()
+  Q_INVOKABLE int receivedCount()const;
+  /// Received objects inserted into the database since start()
+  Q_INVOKABLE int indexedCount()const;
+  /// Block until all the objects received so far are in the database
+  Q_INVOKABLE void waitForIndexing();
+
+public Q_SLOTS:
+  /// Start listening, returns false if the port can't be opened or no
+  /// database file is set
+  bool start();
+  /// Stop listening, wait for the open associations to end and for the
+  /// received objects to be indexed
+  void stop();
+
+Q_SIGNALS:
+  /// Emitted from the association thread once the file is written
+  void objectReceived(const QString& sopInstanceUID, const QString& filePath);
+  /// Emitted from the indexing thread after each batch is committed
+  void objectsIndexed(int count);
+  void error(const QString& message);
+
+protected:
+  QScopedPointer<ctkDICOMStorageReceiverPrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(ctkDICOMStorageReceiver);
+  Q_DISABLE_COPY(ctkDICOMStorageReceiver);
+};
+
+#endif
@@ -0,0 +1,128 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef CTKDICOMSTORAGERECEIVERPRIVATE_H
+#define CTKDICOMSTORAGERECEIVERPRIVATE_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include "ctkDICOMStorageReceiver.h"
+
+// DCMTK includes
+#include <dcmtk/dcmnet/assoc.h>
+
+class ctkDICOMStorageReceiverPrivate;
+
+//------------------------------------------------------------------------------
+/// Accepts the associations and hands them to the thread pool
+class ctkDICOMStorageReceiverListener : public QThread
+{
+  Q_OBJECT
+public:
+  ctkDICOMStorageReceiverListener(ctkDICOMStorageReceiverPrivate* receiverPrivate);
+
+protected:
+  void run();
+
+  ctkDICOMStorageReceiverPrivate* ReceiverPrivate;
+};
+
+//------------------------------------------------------------------------------
+/// Single thread inserting the received files into the database
+class ctkDICOMStorageReceiverWriter : public QThread
+{
+  Q_OBJECT
+public:
+  ctkDICOMStorageReceiverWriter(ctkDICOMStorageReceiverPrivate* receiverPrivate);
+
+protected:
+  void run();
+
+  ctkDICOMStorageReceiverPrivate* ReceiverPrivate;
+};
+
+//------------------------------------------------------------------------------
+class ctkDICOMStorageReceiverPrivate
+{
+  Q_DECLARE_PUBLIC(ctkDICOMStorageReceiver);
+
+protected:
+  ctkDICOMStorageReceiver* const q_ptr;
+
+public:
+  ctkDICOMStorageReceiverPrivate(ctkDICOMStorageReceiver& obj);
+  ~ctkDICOMStorageReceiverPrivate();
+
+  /// Body of the listener thread
+  void listen();
+  /// Serve the requests of \a association until it is released, called
+  /// from the thread pool
+  void serveAssociation(T_ASC_Association* association);
+  /// Write the object of a C-STORE request to disk and queue it
+  OFCondition store(T_ASC_Association* association, T_DIMSE_Message& message,
+                    T_ASC_PresentationContextID presentationContextID);
+
+  /// Called from the association threads
+  void pushFile(const QString& filePath);
+  /// Called from the writer thread, blocks until at least a file is queued
+  /// and returns up to \a batchSize queued files, empty once stopped and
+  /// drained
+  QStringList takeFiles(int batchSize);
+  /// Body of the writer thread, inserting through its own connection to
+  /// Database (see ctkDICOMDatabase::openSharedDatabase())
+  void writeFiles();
+
+  QString AETitle;
+  int     Port;
+  QString StorageDirectory;
+  int     MaximumAssociations;
+  int     Timeout;
+  QSharedPointer<ctkDICOMDatabase> Database;
+
+  /// directory of the current session, StorageDirectory or its default
+  QString CurrentStorageDirectory;
+  T_ASC_Network* Network;
+  /// read by the listener and the association threads
+  QAtomicInt     Stopping;
+  /// the listener and the associations are done, the writer ends once the
+  /// queue is drained
+  bool           AssociationsDone;
+  QAtomicInt     ActiveAssociations;
+  QAtomicInt     ReceivedCount;
+  QAtomicInt     IndexedCount;
+  QThreadPool    AssociationPool;
+  ctkDICOMStorageReceiverListener Listener;
+  ctkDICOMStorageReceiverWriter   Writer;
+
+  /// files received but not yet indexed, shared with the writer thread
+  QQueue<QString> Files;
+  /// files taken by the writer but not yet committed
+  int             FilesInProgress;
+  QMutex          FilesMutex;
+  QWaitCondition  FilesNotEmpty;
+  QWaitCondition  FilesIndexed;
+};
+
+#endif // CTKDICOMSTORAGERECEIVERPRIVATE_H
@@ -24,11 +24,17 @@
 #include <QFileInfo>
 #include <QProcess>
 #include <QTextStream>
+#include <QVector>
 
 // ctkDICOM includes
+#include "ctkDICOMDatabase.h"
 #include "ctkDICOMTester.h"
 #include "ctkLogger.h"
 
+// DCMTK includes
+#include <dcmtk/dcmdata/dctk.h>
+#include <dcmtk/dcmdata/dcuid.h>
+
 //------------------------------------------------------------------------------
 static ctkLogger logger("org.commontk.dicom.DICOMTester" );
 //------------------------------------------------------------------------------
@@ -346,3 +352,98 @@ bool ctkDICOMTester::storeData(const QStringList& data)
   d->printProcessOutputs("StoreSCU", &storeSCU);
   return res;
 }
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMTester::generateDICOMFiles(const QString& directory,
+                                               int patients, int studiesPerPatient,
+                                               int seriesPerStudy, int imagesPerSeries,
+                                               int rows, int columns)
+{
+  QStringList files;
+  QDir outputDir(directory);
+  if (!outputDir.mkpath("."))
+    {
+    logger.error("Can't create directory " + directory);
+    return files;
+    }
+
+  // a simple ramp so the images are not completely blank
+  QVector<Uint16> pixels(rows * columns);
+  for (int i = 0; i < pixels.size(); ++i)
+    {
+    pixels[i] = static_cast<Uint16>(i % 4096);
+    }
+
+  char uid[100];
+  for (int patient = 0; patient < patients; ++patient)
+    {
+    QString patientID = QString("CTKSYNTH%1").arg(patient);
+    QString patientsName = QString("Synthetic^Patient%1").arg(patient);
+    for (int study = 0; study < studiesPerPatient; ++study)
+      {
+      QString studyInstanceUID(dcmGenerateUniqueIdentifier(uid, SITE_STUDY_UID_ROOT));
+      for (int series = 0; series < seriesPerStudy; ++series)
+        {
+        QString seriesInstanceUID(dcmGenerateUniqueIdentifier(uid, SITE_SERIES_UID_ROOT));
+        QString seriesDirectory = QString("%1/%2/%3").arg(patient).arg(study).arg(series);
+        outputDir.mkpath(seriesDirectory);
+        for (int image = 0; image < imagesPerSeries; ++image)
+          {
+          DcmFileFormat fileFormat;
+          DcmDataset* dataset = fileFormat.getDataset();
+          dataset->putAndInsertString(DCM_SOPClassUID, UID_SecondaryCaptureImageStorage);
+          dataset->putAndInsertString(DCM_SOPInstanceUID, dcmGenerateUniqueIdentifier(uid, SITE_INSTANCE_UID_ROOT));
+          dataset->putAndInsertString(DCM_PatientName, patientsName.toLatin1().data());
+          dataset->putAndInsertString(DCM_PatientID, patientID.toLatin1().data());
+          dataset->putAndInsertString(DCM_PatientBirthDate, "19700101");
+          dataset->putAndInsertString(DCM_StudyInstanceUID, studyInstanceUID.toLatin1().data());
+          dataset->putAndInsertString(DCM_StudyDate, "20120101");
+          dataset->putAndInsertString(DCM_StudyDescription, QString("Study %1").arg(study).toLatin1().data());
+          dataset->putAndInsertString(DCM_SeriesInstanceUID, seriesInstanceUID.toLatin1().data());
+          dataset->putAndInsertString(DCM_SeriesNumber, QString::number(series + 1).toLatin1().data());
+          dataset->putAndInsertString(DCM_SeriesDescription, QString("Series %1").arg(series).toLatin1().data());
+          dataset->putAndInsertString(DCM_Modality, "OT");
+          dataset->putAndInsertString(DCM_InstanceNumber, QString::number(image + 1).toLatin1().data());
+          dataset->putAndInsertUint16(DCM_SamplesPerPixel, 1);
+          dataset->putAndInsertString(DCM_PhotometricInterpretation, "MONOCHROME2");
+          dataset->putAndInsertUint16(DCM_Rows, static_cast<Uint16>(rows));
+          dataset->putAndInsertUint16(DCM_Columns, static_cast<Uint16>(columns));
+          dataset->putAndInsertUint16(DCM_BitsAllocated, 16);
+          dataset->putAndInsertUint16(DCM_BitsStored, 12);
+          dataset->putAndInsertUint16(DCM_HighBit, 11);
+          dataset->putAndInsertUint16(DCM_PixelRepresentation, 0);
+          dataset->putAndInsertUint16Array(DCM_PixelData, pixels.data(), pixels.size());
+
+          QString fileName = outputDir.absoluteFilePath(
+            seriesDirectory + QString("/IMG%1.dcm").arg(image, 5, 10, QLatin1Char('0')));
+          OFCondition status = fileFormat.saveFile(
+            QDir::toNativeSeparators(fileName).toLatin1().data(), EXS_LittleEndianExplicit);
+          if (status.bad())
+            {
+            logger.error("Can't write " + fileName + ": " + QString(status.text()));
+            continue;
+            }
+          files << fileName;
+          }
+        }
+      }
+    }
+  return files;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMTester::imageCount(ctkDICOMDatabase& database)
+{
+  int count = 0;
+  foreach(const QString& patient, database.patients())
+    {
+    foreach(const QString& study, database.studiesForPatient(patient))
+      {
+      foreach(const QString& series, database.seriesForStudy(study))
+        {
+        count += database.filesForSeries(series).count();
+        }
+      }
+    }
+  return count;
+}
@@ -23,10 +23,12 @@
 
 // Qt includes
 #include <QObject>
+#include <QStringList>
 class QProcess;
 
 // CTKDICOMCore includes
 #include "ctkDICOMCoreExport.h"
+class ctkDICOMDatabase;
 class ctkDICOMTesterPrivate;
 
 /// \ingroup DICOM_Core
@@ -89,6 +91,20 @@ public:
   ///
   Q_INVOKABLE bool storeData(const QStringList& data);
 
+  ///  Writes a synthetic DICOM tree into \a directory and returns the list of
+  /// created files. Every image is a small MONOCHROME2 secondary capture with
+  /// freshly generated UIDs, so the data can be imported repeatedly. It is
+  /// meant to feed the benchmarks with a large number of files without
+  /// depending on external test data.
+  static QStringList generateDICOMFiles(const QString& directory,
+                                        int patients, int studiesPerPatient,
+                                        int seriesPerStudy, int imagesPerSeries,
+                                        int rows = 64, int columns = 64);
+
+  /// Number of image files listed by \a database, walking its patients,
+  /// studies and series.
+  static int imageCount(ctkDICOMDatabase& database);
+
 protected:
   QScopedPointer<ctkDICOMTesterPrivate> d_ptr;
 
@@ -0,0 +1,200 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+
+// ctkDICOMCore includes
+#include "ctkDICOMThumbnailStore.h"
+#include "ctkLogger.h"
+
+static ctkLogger logger ( "org.commontk.dicom.DICOMThumbnailStore" );
+
+//------------------------------------------------------------------------------
+class ctkDICOMThumbnailStorePrivate
+{
+public:
+  ctkDICOMThumbnailStorePrivate();
+
+  /// map the whole file, falls back to QFile::read() if it fails
+  void remap();
+  void unmap();
+
+  QFile File;
+  /// guards File, the mapping and Size
+  mutable QMutex Mutex;
+  uchar* Mapping;
+  qint64 MappedSize;
+  qint64 Size;
+};
+
+//------------------------------------------------------------------------------
+ctkDICOMThumbnailStorePrivate::ctkDICOMThumbnailStorePrivate()
+{
+  this->Mapping = 0;
+  this->MappedSize = 0;
+  this->Size = 0;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMThumbnailStorePrivate::remap()
+{
+  this->unmap();
+  if (this->Size == 0)
+    {
+    return;
+    }
+  this->Mapping = this->File.map(0, this->Size);
+  if (this->Mapping)
+    {
+    this->MappedSize = this->Size;
+    }
+  else
+    {
+    logger.warn("Failed to map thumbnail file " + this->File.fileName() + ": "
+                + this->File.errorString());
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMThumbnailStorePrivate::unmap()
+{
+  if (this->Mapping)
+    {
+    this->File.unmap(this->Mapping);
+    }
+  this->Mapping = 0;
+  this->MappedSize = 0;
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMThumbnailStore methods
+
+//------------------------------------------------------------------------------
+ctkDICOMThumbnailStore::ctkDICOMThumbnailStore()
+  : d_ptr(new ctkDICOMThumbnailStorePrivate)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMThumbnailStore::~ctkDICOMThumbnailStore()
+{
+  this->close();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMThumbnailStore::open(const QString& fileName)
+{
+  Q_D(ctkDICOMThumbnailStore);
+  this->close();
+  QMutexLocker locker(&d->Mutex);
+  d->File.setFileName(fileName);
+  if (!d->File.open(QIODevice::ReadWrite))
+    {
+    logger.error("Failed to open thumbnail file " + fileName + ": " + d->File.errorString());
+    return false;
+    }
+  d->Size = d->File.size();
+  d->remap();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMThumbnailStore::close()
+{
+  Q_D(ctkDICOMThumbnailStore);
+  QMutexLocker locker(&d->Mutex);
+  d->unmap();
+  d->File.close();
+  d->Size = 0;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMThumbnailStore::isOpen() const
+{
+  Q_D(const ctkDICOMThumbnailStore);
+  QMutexLocker locker(&d->Mutex);
+  return d->File.isOpen();
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMThumbnailStore::fileName() const
+{
+  Q_D(const ctkDICOMThumbnailStore);
+  QMutexLocker locker(&d->Mutex);
+  return d->File.fileName();
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMThumbnailStore::size() const
+{
+  Q_D(const ctkDICOMThumbnailStore);
+  QMutexLocker locker(&d->Mutex);
+  return d->Size;
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMThumbnailStore::append(const QByteArray& data)
+{
+  Q_D(ctkDICOMThumbnailStore);
+  QMutexLocker locker(&d->Mutex);
+  if (!d->File.isOpen() || !d->File.seek(d->Size))
+    {
+    return -1;
+    }
+  const qint64 offset = d->Size;
+  if (d->File.write(data) != data.size() || !d->File.flush())
+    {
+    logger.error("Failed to write thumbnail file " + d->File.fileName() + ": "
+                 + d->File.errorString());
+    // a partial write is overwritten by the next append
+    return -1;
+    }
+  d->Size += data.size();
+  return offset;
+}
+
+//------------------------------------------------------------------------------
+QByteArray ctkDICOMThumbnailStore::read(qint64 offset, int size)
+{
+  Q_D(ctkDICOMThumbnailStore);
+  QMutexLocker locker(&d->Mutex);
+  if (!d->File.isOpen() || offset < 0 || size <= 0 || offset + size > d->Size)
+    {
+    return QByteArray();
+    }
+  // the file grew since it was mapped, map it again (one mmap() call for
+  // many appends since thumbnails are mostly read after being generated)
+  if (offset + size > d->MappedSize)
+    {
+    d->remap();
+    }
+  if (d->Mapping)
+    {
+    return QByteArray(reinterpret_cast<const char*>(d->Mapping + offset), size);
+    }
+  if (!d->File.seek(offset))
+    {
+    return QByteArray();
+    }
+  return d->File.read(size);
+}
@@ -0,0 +1,73 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMThumbnailStore_h
+#define __ctkDICOMThumbnailStore_h
+
+// Qt includes
+#include <QByteArray>
+#include <QScopedPointer>
+#include <QString>
+
+#include "ctkDICOMCoreExport.h"
+
+class ctkDICOMThumbnailStorePrivate;
+
+/// \ingroup DICOM_Core
+///
+/// \brief Single file holding the encoded thumbnails of a database
+///
+/// Thumbnails are appended one after the other and read back through a
+/// memory mapping of the file, so that reading the thumbnails of a series
+/// does not open any file. The store does not know which thumbnail is
+/// where: ctkDICOMDatabase keeps the offset and size of every thumbnail in
+/// its Thumbnails table. Replaced thumbnails are not overwritten, the space
+/// is reclaimed by ctkDICOMDatabase::compactThumbnails().
+/// All the methods can be called from any thread.
+class CTK_DICOM_CORE_EXPORT ctkDICOMThumbnailStore
+{
+public:
+  ctkDICOMThumbnailStore();
+  virtual ~ctkDICOMThumbnailStore();
+
+  /// Open \a fileName, created if it does not exist
+  bool open(const QString& fileName);
+  void close();
+  bool isOpen() const;
+  QString fileName() const;
+  /// Size of the file in bytes
+  qint64 size() const;
+
+  /// Append \a data to the file
+  /// @Returns the offset of the data in the file, -1 on error
+  qint64 append(const QByteArray& data);
+  /// @Returns the \a size bytes found at \a offset, an empty array if they
+  ///          are not in the file
+  QByteArray read(qint64 offset, int size);
+
+protected:
+  QScopedPointer<ctkDICOMThumbnailStorePrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(ctkDICOMThumbnailStore);
+  Q_DISABLE_COPY(ctkDICOMThumbnailStore);
+};
+
+#endif
@@ -22,10 +22,14 @@
 #include <QApplication>
 #include <QDebug>
 #include <QDir>
+#include <QFileInfo>
+#include <QMouseEvent>
 #include <QTimer>
 
 // ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
 #include "ctkDICOMDatasetView.h"
+#include "ctkDICOMModel.h"
 
 // DCMTK includes
 #include <dcmimage.h>
@@ -33,8 +37,9 @@
 // STD includes
 #include <iostream>
 
-/* Test from build directory:
- ./CTK-build/bin/CTKDICOMWidgetsCxxTests ctkDICOMDatasetViewTest1 test.db ../CTK/Libs/DICOM/Core/Resources/dicom-sample.sql
+/* Test from build directory, the directory of the image must hold a series
+   of at least 12 images (e.g. CTKData/Data/DICOM/MRHEAD):
+ ./CTK-build/bin/CTKDICOMWidgetsCxxTests ctkDICOMDatasetViewTest1 ../CTKData/Data/DICOM/MRHEAD/000055.IMA
 */
 
 int ctkDICOMDatasetViewTest1( int argc, char * argv [] )
@@ -46,11 +51,152 @@ int ctkDICOMDatasetViewTest1( int argc, char * argv [] )
     return EXIT_FAILURE;
     }
   
+  // the images of the series of the given file are displayed from a
+  // database, with a small frame cache
+  QString testDirectory = QDir::temp().absoluteFilePath("ctkDICOMDatasetViewTest1");
+  QDir(testDirectory).remove("ctkDICOM.sql");
+  QDir(testDirectory).mkpath(".");
+  ctkDICOMDatabase database;
+  database.openDatabase(testDirectory + "/ctkDICOM.sql");
+  if (!database.lastError().isEmpty() || !database.initializeDatabase())
+    {
+    std::cerr << "Can't open database: " << qPrintable(database.lastError()) << std::endl;
+    return EXIT_FAILURE;
+    }
+  QDir seriesDirectory = QFileInfo(argv[1]).absoluteDir();
+  const int imageCount = 12;
+  QStringList files = seriesDirectory.entryList(QDir::Files, QDir::Name).mid(0, imageCount);
+  foreach(const QString& file, files)
+    {
+    database.insert(seriesDirectory.absoluteFilePath(file), true, false);
+    }
+
+  ctkDICOMModel model;
+  model.setBackgroundFetch(false);
+  model.setDatabase(database.database());
+  model.fetchAll(QModelIndex());
+  QModelIndex patientIndex = model.index(0, 0);
+  model.fetchAll(patientIndex);
+  QModelIndex studyIndex = model.index(0, 0, patientIndex);
+  model.fetchAll(studyIndex);
+  QModelIndex seriesIndex = model.index(0, 0, studyIndex);
+  model.fetchAll(seriesIndex);
+  if (files.count() != imageCount || model.rowCount(seriesIndex) != imageCount)
+    {
+    std::cerr << "Expected a series of " << imageCount << " images, found "
+              << model.rowCount(seriesIndex) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMDatasetView seriesView;
+  seriesView.setDatabaseDirectory(database.databaseDirectory());
+  seriesView.setFrameCacheSize(64);
+
+  // the next images in the scroll direction are decoded ahead
+  seriesView.setPrefetchCount(3);
+  seriesView.onModelSelected(model.index(0, 0, seriesIndex));
+  seriesView.waitForPrefetch();
+  if (seriesView.frameCacheMisses() != 1 || seriesView.prefetchedFrameCount() != 3
+      || seriesView.cachedFrameCount() != 4)
+    {
+    std::cerr << "Prefetch failed: " << seriesView.frameCacheMisses() << " misses, "
+              << seriesView.prefetchedFrameCount() << " prefetched, "
+              << seriesView.cachedFrameCount() << " cached" << std::endl;
+    return EXIT_FAILURE;
+    }
+  for (int row = 1; row <= 3; ++row)
+    {
+    seriesView.displayImage(row);
+    }
+  seriesView.waitForPrefetch();
+  if (seriesView.frameCacheHits() != 3 || seriesView.frameCacheMisses() != 1)
+    {
+    std::cerr << "Prefetched images not displayed from the cache: "
+              << seriesView.frameCacheHits() << " hits" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // a revisited image is not decoded again
+  seriesView.displayImage(0);
+  seriesView.waitForPrefetch();
+  if (seriesView.frameCacheHits() != 4 || seriesView.frameCacheMisses() != 1)
+    {
+    std::cerr << "Revisited image not displayed from the cache" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // changing the window/level re-renders the decoded image
+  const int cachedFrames = seriesView.cachedFrameCount();
+  QMouseEvent press(QEvent::MouseButtonPress, QPoint(10, 10),
+                    Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+  QApplication::sendEvent(&seriesView, &press);
+  for (int i = 1; i <= 5; ++i)
+    {
+    QMouseEvent move(QEvent::MouseMove, QPoint(10 + 4 * i, 10 + 2 * i),
+                     Qt::NoButton, Qt::LeftButton, Qt::NoModifier);
+    QApplication::sendEvent(&seriesView, &move);
+    }
+  if (seriesView.frameCacheMisses() != 1 || seriesView.cachedFrameCount() != cachedFrames)
+    {
+    std::cerr << "Window/level decoded the image again" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the prefetches of a previous generation never reach the cache: the
+  // cache is emptied, then scrolling forward queues 8 prefetches, whose
+  // generation ends right away
+  seriesView.setPrefetchCount(8);
+  seriesView.resetFrameCacheStatistics();
+  seriesView.setDatabaseDirectory(database.databaseDirectory());
+  seriesView.displayImage(1);
+  seriesView.setDatabaseDirectory(database.databaseDirectory());
+  seriesView.waitForPrefetch();
+  if (seriesView.cachedFrameCount() != 0
+      || seriesView.prefetchedFrameCount() + seriesView.droppedPrefetchCount() != 8)
+    {
+    std::cerr << "Prefetches not dropped: " << seriesView.cachedFrameCount() << " cached, "
+              << seriesView.prefetchedFrameCount() << " prefetched, "
+              << seriesView.droppedPrefetchCount() << " dropped" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the least recently used images are evicted over the budget, which
+  // holds only a few MR images
+  seriesView.setPrefetchCount(0);
+  seriesView.setFrameCacheSize(1);
+  seriesView.resetFrameCacheStatistics();
+  for (int row = 0; row < imageCount; ++row)
+    {
+    seriesView.displayImage(row);
+    }
+  const int budgetFrames = seriesView.cachedFrameCount();
+  if (budgetFrames == 0 || budgetFrames >= imageCount
+      || seriesView.frameCacheMisses() != imageCount)
+    {
+    std::cerr << "Frame cache not evicted: " << budgetFrames << " cached" << std::endl;
+    return EXIT_FAILURE;
+    }
+  seriesView.displayImage(imageCount - 1);
+  seriesView.displayImage(0);
+  if (seriesView.frameCacheHits() != 1 || seriesView.frameCacheMisses() != imageCount + 1)
+    {
+    std::cerr << "Frame cache didn't evict the least recently used image" << std::endl;
+    return EXIT_FAILURE;
+    }
+
   DicomImage    img(argv[1]);
   QImage image;
   QImage image2(200, 200, QImage::Format_RGB32);
   
   ctkDICOMDatasetView datasetView;
+  datasetView.setPrefetchCount(4);
+  datasetView.setFrameCacheSize(16);
+  if (datasetView.prefetchCount() != 4 || datasetView.frameCacheSize() != 16
+      || datasetView.cachedFrameCount() != 0)
+    {
+    std::cerr << "ctkDICOMDatasetView frame cache settings failed" << std::endl;
+    return EXIT_FAILURE;
+    }
   datasetView.addImage(img);
   datasetView.addImage(image);
   datasetView.addImage(image2);
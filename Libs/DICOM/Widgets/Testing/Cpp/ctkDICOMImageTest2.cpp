@@ -0,0 +1,169 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+// Qt includes
+#include <QApplication>
+#include <QDir>
+#include <QStringList>
+#include <QTime>
+
+// ctkDICOMCore includes
+#include "ctkDICOMTester.h"
+
+// ctkDICOMWidgets includes
+#include "ctkDICOMImage.h"
+
+// DCMTK includes
+#include <dcmimage.h>
+
+// STD includes
+#include <iostream>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/// How frames used to be converted: through a PGM file in memory
+QImage renderThroughPGM(DicomImage& dicomImage)
+{
+  QImage image;
+  const unsigned long width = dicomImage.getWidth();
+  const unsigned long height = dicomImage.getHeight();
+  QString header = QString("P5 %1 %2 255\n").arg(width).arg(height);
+  const unsigned long offset = header.length();
+  const unsigned long length = width * height + offset;
+  QByteArray buffer;
+  buffer.append(header);
+  buffer.resize(length);
+  if (dicomImage.getOutputData(static_cast<void *>(buffer.data() + offset), length - offset, 8, 0))
+    {
+    image.loadFromData(buffer);
+    }
+  return image;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Renders a synthetic CT series with ctkDICOMImage::renderFrame() and through
+// a PGM buffer, and reports the frames per second of both.
+// Usage: ctkDICOMImageTest2 [number of images] [rows and columns]
+int ctkDICOMImageTest2( int argc, char * argv [] )
+{
+  QApplication app(argc, argv);
+
+  int images = 300;
+  int size = 512;
+  if (argc > 1)
+    {
+    images = QString(argv[1]).toInt();
+    }
+  if (argc > 2)
+    {
+    size = QString(argv[2]).toInt();
+    }
+
+  QString testDirectory = QDir::temp().absoluteFilePath("ctkDICOMImageTest2");
+  QStringList files = ctkDICOMTester::generateDICOMFiles(
+    testDirectory + "/data", 1, 1, 1, images, size, size);
+  if (files.count() != images)
+    {
+    std::cerr << "Failed to generate synthetic data" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  int pgmMsecs = 0;
+  int directMsecs = 0;
+  QImage frame;
+  QTime timer;
+  foreach(const QString& file, files)
+    {
+    DicomImage dicomImage(QDir::toNativeSeparators(file).toLatin1().data());
+    dicomImage.setMinMaxWindow();
+
+    timer.start();
+    QImage pgmFrame = renderThroughPGM(dicomImage);
+    pgmMsecs += timer.elapsed();
+
+    // the same QImage is reused for all the frames
+    const uchar* pixels = frame.bits();
+    timer.start();
+    if (!ctkDICOMImage::renderFrame(&dicomImage, 0, frame))
+      {
+      std::cerr << "ctkDICOMImage::renderFrame() failed for " << qPrintable(file) << std::endl;
+      return EXIT_FAILURE;
+      }
+    directMsecs += timer.elapsed();
+    if (pixels != 0 && frame.bits() != pixels)
+      {
+      std::cerr << "ctkDICOMImage::renderFrame() reallocated the frame" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    if (frame.size() != pgmFrame.size())
+      {
+      std::cerr << "Frames of different sizes" << std::endl;
+      return EXIT_FAILURE;
+      }
+    for (int y = 0; y < frame.height(); ++y)
+      {
+      for (int x = 0; x < frame.width(); ++x)
+        {
+        if (frame.pixel(x, y) != pgmFrame.pixel(x, y))
+          {
+          std::cerr << "Frames differ at " << x << "," << y << std::endl;
+          return EXIT_FAILURE;
+          }
+        }
+      }
+    }
+
+  std::cout << images << " frames of " << size << "x" << size << ": "
+            << "through PGM " << pgmMsecs << " ms ("
+            << (pgmMsecs > 0 ? (1000. * images) / pgmMsecs : 0.) << " frames/s), "
+            << "direct " << directMsecs << " ms ("
+            << (directMsecs > 0 ? (1000. * images) / directMsecs : 0.) << " frames/s)"
+            << std::endl;
+
+  // rows that aren't 32-bit aligned go through the scratch buffer
+  QStringList oddFiles = ctkDICOMTester::generateDICOMFiles(
+    testDirectory + "/odd", 1, 1, 1, 1, 37, 37);
+  DicomImage oddImage(QDir::toNativeSeparators(oddFiles.value(0)).toLatin1().data());
+  oddImage.setMinMaxWindow();
+  QImage oddFrame;
+  QImage oddPGMFrame = renderThroughPGM(oddImage);
+  if (!ctkDICOMImage::renderFrame(&oddImage, 0, oddFrame) || oddFrame.size() != oddPGMFrame.size()
+      || oddFrame.pixel(36, 36) != oddPGMFrame.pixel(36, 36))
+    {
+    std::cerr << "ctkDICOMImage::renderFrame() failed for unaligned rows" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // full precision
+  QVector<quint16> pixels16;
+  if (!ctkDICOMImage::renderFrame(&oddImage, 0, pixels16) || pixels16.count() != 37 * 37)
+    {
+    std::cerr << "ctkDICOMImage::renderFrame() failed for 16 bits" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QApplication>
+#include <QDir>
+#include <QStringList>
+#include <QTime>
+
+// ctkDICOMCore includes
+#include "ctkDICOMTester.h"
+
+// ctkDICOMWidgets includes
+#include "ctkDICOMImage.h"
+#include "ctkDICOMModalityFrame.h"
+
+// DCMTK includes
+#include <dcmimage.h>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+//------------------------------------------------------------------------------
+// Drags the window/level of a synthetic radiograph through DicomImage and
+// through ctkDICOMModalityFrame, and reports the frames per second of both.
+// Usage: ctkDICOMModalityFrameTest1 [rows and columns] [number of windows]
+int ctkDICOMModalityFrameTest1( int argc, char * argv [] )
+{
+  QApplication app(argc, argv);
+
+  int size = 2048;
+  int windows = 60;
+  if (argc > 1)
+    {
+    size = QString(argv[1]).toInt();
+    }
+  if (argc > 2)
+    {
+    windows = QString(argv[2]).toInt();
+    }
+
+  QString testDirectory = QDir::temp().absoluteFilePath("ctkDICOMModalityFrameTest1");
+  QStringList files = ctkDICOMTester::generateDICOMFiles(
+    testDirectory + "/data", 1, 1, 1, 1, size, size);
+  if (files.count() != 1)
+    {
+    std::cerr << "Failed to generate synthetic data" << std::endl;
+    return EXIT_FAILURE;
+    }
+  DicomImage dicomImage(QDir::toNativeSeparators(files[0]).toLatin1().data());
+
+  ctkDICOMModalityFrame modalityFrame;
+  QImage windowedFrame;
+  if (!modalityFrame.isNull() || modalityFrame.render(0., 1., windowedFrame))
+    {
+    std::cerr << "Empty ctkDICOMModalityFrame rendered" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (!modalityFrame.setFrame(&dicomImage) || modalityFrame.width() != size
+      || modalityFrame.height() != size
+      || modalityFrame.minimumValue() > modalityFrame.maximumValue())
+    {
+    std::cerr << "ctkDICOMModalityFrame::setFrame() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (modalityFrame.setFrame(&dicomImage, 1) || !modalityFrame.isNull())
+    {
+    std::cerr << "ctkDICOMModalityFrame::setFrame() accepted a missing frame" << std::endl;
+    return EXIT_FAILURE;
+    }
+  modalityFrame.setFrame(&dicomImage);
+
+  const double minimum = modalityFrame.minimumValue();
+  const double range = modalityFrame.maximumValue() - minimum;
+  int dicomImageMsecs = 0;
+  int modalityFrameMsecs = 0;
+  QImage dicomImageFrame;
+  QTime timer;
+  for (int i = 0; i < windows; ++i)
+    {
+    // as dragged with the mouse
+    const double center = minimum + range * (i + 1) / (windows + 1);
+    const double width = 1. + range * (i % 7 + 1) / 8;
+
+    timer.start();
+    dicomImage.setWindow(center, width);
+    if (!ctkDICOMImage::renderFrame(&dicomImage, 0, dicomImageFrame))
+      {
+      std::cerr << "ctkDICOMImage::renderFrame() failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    dicomImageMsecs += timer.elapsed();
+
+    const uchar* pixels = windowedFrame.bits();
+    timer.start();
+    if (!modalityFrame.render(center, width, windowedFrame))
+      {
+      std::cerr << "ctkDICOMModalityFrame::render() failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    modalityFrameMsecs += timer.elapsed();
+    if (pixels != 0 && windowedFrame.bits() != pixels)
+      {
+      std::cerr << "ctkDICOMModalityFrame::render() reallocated the frame" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // rounding may differ by one
+    for (int y = 0; y < size; y += 7)
+      {
+      const uchar* expected = static_cast<const QImage&>(dicomImageFrame).scanLine(y);
+      const uchar* actual = static_cast<const QImage&>(windowedFrame).scanLine(y);
+      for (int x = 0; x < size; ++x)
+        {
+        if (qAbs(static_cast<int>(expected[x]) - static_cast<int>(actual[x])) > 1)
+          {
+          std::cerr << "Window " << center << "/" << width << ": "
+                    << static_cast<int>(actual[x]) << " instead of "
+                    << static_cast<int>(expected[x]) << " at " << x << "," << y << std::endl;
+          return EXIT_FAILURE;
+          }
+        }
+      }
+    }
+
+  std::cout << windows << " windows of " << size << "x" << size << ": "
+            << "DicomImage " << dicomImageMsecs << " ms ("
+            << (dicomImageMsecs > 0 ? (1000. * windows) / dicomImageMsecs : 0.) << " frames/s), "
+            << "modality frame " << modalityFrameMsecs << " ms ("
+            << (modalityFrameMsecs > 0 ? (1000. * windows) / modalityFrameMsecs : 0.) << " frames/s)"
+            << std::endl;
+
+  return EXIT_SUCCESS;
+}
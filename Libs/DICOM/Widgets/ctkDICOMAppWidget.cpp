@@ -128,6 +128,7 @@ ctkDICOMAppWidget::ctkDICOMAppWidget(QWidget* _parent):Superclass(_parent),
 
   d->ThumbnailsWidget->setThumbnailSize(
     QSize(d->ThumbnailWidthSlider->value(), d->ThumbnailWidthSlider->value()));
+  d->ThumbnailsWidget->setDICOMDatabase(d->DICOMDatabase.data());
 
   connect(d->TreeView, SIGNAL(collapsed(QModelIndex)), this, SLOT(onTreeCollapsed(QModelIndex)));
   connect(d->TreeView, SIGNAL(expanded(QModelIndex)), this, SLOT(onTreeExpanded(QModelIndex)));
@@ -178,7 +179,10 @@ ctkDICOMAppWidget::ctkDICOMAppWidget(QWidget* _parent):Superclass(_parent),
   connect(d->ImagePreview, SIGNAL(requestPreviousImage()), this, SLOT(onPreviousImage()));
   connect(d->ImagePreview, SIGNAL(imageDisplayed(int,int)), this, SLOT(onImagePreviewDisplayed(int,int)));
 
+  // the query widget already waits for the user to stop typing
+  d->DICOMModel.setSearchDelay(0);
   connect(d->SearchOption, SIGNAL(parameterChanged()), this, SLOT(onSearchParameterChanged()));
+  connect(&d->DICOMModel, SIGNAL(searchParametersChanged()), this, SLOT(onModelSearchParametersChanged()));
 
   connect(d->PlaySlider, SIGNAL(valueChanged(int)), d->ImagePreview, SLOT(displayImage(int)));
 }
@@ -188,6 +192,10 @@ ctkDICOMAppWidget::~ctkDICOMAppWidget()
 {
   Q_D(ctkDICOMAppWidget);  
 
+  // the thumbnail generator is destroyed before the database
+  d->DICOMDatabase->cancelThumbnails();
+  d->DICOMDatabase->waitForThumbnails();
+
   d->QueryRetrieveWidget->deleteLater();
   d->ImportDialog->deleteLater();
 }
@@ -201,7 +209,9 @@ void ctkDICOMAppWidget::setDatabaseDirectory(const QString& directory)
   settings.setValue("DatabaseDirectory", directory);
   settings.sync();
 
-  //close the active DICOM database
+  //close the active DICOM database, the model must release its
+  //read-only connection first
+  d->DICOMModel.setDatabase(d->EmptyDatabase);
   d->DICOMDatabase->closeDatabase();
   
   //open DICOM database on the directory
@@ -217,7 +227,7 @@ void ctkDICOMAppWidget::setDatabaseDirectory(const QString& directory)
     return;
     }
   
-  d->DICOMModel.setDatabase(d->DICOMDatabase->database());
+  d->DICOMModel.setDatabase(d->DICOMDatabase->readOnlyDatabase());
   d->DICOMModel.setEndLevel(ctkDICOMModel::SeriesType);
   d->TreeView->resizeColumnToContents(0);
 
@@ -322,26 +332,34 @@ void ctkDICOMAppWidget::onRemoveAction()
   std::cout << "on remove" << std::endl;
   QModelIndexList selection = d->TreeView->selectionModel()->selectedIndexes();
   std::cout << selection.size() << std::endl;
+  // removed together, one statement per table for the whole selection
+  QStringList seriesUIDs;
+  QStringList studyUIDs;
+  QStringList patientUIDs;
   QModelIndex index;
   foreach(index,selection)
   {
     QModelIndex index0 = index.sibling(index.row(), 0);
+    QString uid = d->DICOMModel.data(index0,ctkDICOMModel::UIDRole).toString();
     if ( d->DICOMModel.data(index0,ctkDICOMModel::TypeRole) == static_cast<int>(ctkDICOMModel::SeriesType))
     {
-      QString seriesUID = d->DICOMModel.data(index0,ctkDICOMModel::UIDRole).toString();
-      d->DICOMDatabase->removeSeries(seriesUID);
-    } 
+      seriesUIDs << uid;
+    }
     else if ( d->DICOMModel.data(index0,ctkDICOMModel::TypeRole) == static_cast<int>(ctkDICOMModel::StudyType))
     {
-      QString studyUID = d->DICOMModel.data(index0,ctkDICOMModel::UIDRole).toString();
-      d->DICOMDatabase->removeStudy(studyUID);
+      studyUIDs << uid;
     }
     else if ( d->DICOMModel.data(index0,ctkDICOMModel::TypeRole) == static_cast<int>(ctkDICOMModel::PatientType))
     {
-      QString patientUID = d->DICOMModel.data(index0,ctkDICOMModel::UIDRole).toString();
-      d->DICOMDatabase->removePatient(patientUID);
+      patientUIDs << uid;
     }
   }
+  seriesUIDs.removeDuplicates();
+  studyUIDs.removeDuplicates();
+  patientUIDs.removeDuplicates();
+  d->DICOMDatabase->removeSeries(seriesUIDs);
+  d->DICOMDatabase->removeStudies(studyUIDs);
+  d->DICOMDatabase->removePatients(patientUIDs);
   d->DICOMModel.reset();
 }
 
@@ -358,7 +376,7 @@ void ctkDICOMAppWidget::resumeModel()
 {
   Q_D(ctkDICOMAppWidget);
 
-  d->DICOMModel.setDatabase(d->DICOMDatabase->database());
+  d->DICOMModel.setDatabase(d->DICOMDatabase->readOnlyDatabase());
 }
 
 //----------------------------------------------------------------------------
@@ -749,8 +767,12 @@ void ctkDICOMAppWidget::onThumbnailWidthSliderValueChanged(int val){
 //----------------------------------------------------------------------------
 void ctkDICOMAppWidget::onSearchParameterChanged(){
   Q_D(ctkDICOMAppWidget);
-  d->DICOMModel.setDatabase(d->DICOMDatabase->database(), d->SearchOption->parameters());
+  d->DICOMModel.setSearchParameters(d->SearchOption->parameters());
+}
 
+//----------------------------------------------------------------------------
+void ctkDICOMAppWidget::onModelSearchParametersChanged(){
+  Q_D(ctkDICOMAppWidget);
   this->onModelSelected(d->DICOMModel.index(0,0));
   d->ThumbnailsWidget->clearThumbnails();
   d->ThumbnailsWidget->onModelSelected(d->DICOMModel.index(0,0));
@@ -112,6 +112,9 @@ protected Q_SLOTS:
     /// To be called when search parameters in query widget changed
     void onSearchParameterChanged();
 
+    /// To be called once the model is filtered with the new search parameters
+    void onModelSearchParametersChanged();
+
     /// To be called after image preview displayed an image
     void onImagePreviewDisplayed(int imageID, int count);
 
@@ -34,17 +34,27 @@
 
 // ctkDICOMWidgets includex
 #include "ctkDICOMDatasetView.h"
+#include "ctkDICOMImage.h"
+#include "ctkDICOMModalityFrame.h"
 
 // Qt includes
+#include <QAtomicInt>
 #include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QHash>
 #include <QHBoxLayout>
 #include <QKeyEvent>
 #include <QLabel>
 #include <QMouseEvent>
+#include <QMutex>
 #include <QPainter>
 #include <QResizeEvent>
+#include <QRunnable>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 static ctkLogger logger("org.commontk.DICOM.Widgets.ctkDICOMDatasetView");
 
@@ -57,6 +67,7 @@ class ctkDICOMDatasetViewPrivate
 public:
 
   ctkDICOMDatasetViewPrivate( ctkDICOMDatasetView& object );
+  ~ctkDICOMDatasetViewPrivate();
 
   QString DatabaseDirectory;
   QModelIndex CurrentImageIndex;
@@ -65,9 +76,62 @@ public:
   double DicomIntensityWindow;
   bool AutoWindowLevel;
 
+  /// Decoded images of the displayed series, most recently used last.
+  /// Shared with the prefetch threads, protected by CacheMutex.
+  QHash<QString, QSharedPointer<DicomImage> > Cache;
+  QList<QString> CacheOrder;
+  qint64 CacheBytes;
+  qint64 CacheSize;
+  /// files queued for prefetching, and the ones being decoded
+  QSet<QString> Prefetching;
+  QSet<QString> Decoding;
+  mutable QMutex CacheMutex;
+  QWaitCondition Decoded;
+  /// prefetches of an older generation are dropped unstarted
+  QAtomicInt PrefetchGeneration;
+  QThreadPool PrefetchThreads;
+  int PrefetchCount;
+  /// +1 when scrolling forward, -1 backward
+  int ScrollDirection;
+  /// statistics, see ctkDICOMDatasetView::frameCacheHits()
+  QAtomicInt FrameCacheHits;
+  QAtomicInt FrameCacheMisses;
+  QAtomicInt PrefetchedFrames;
+  QAtomicInt DroppedPrefetches;
+
+  /// modality values of the displayed image, once the window/level is
+  /// dragged, and the display buffer they are rendered into
+  ctkDICOMModalityFrame ModalityFrame;
+  QString ModalityFramePath;
+  QImage WindowedImage;
+
   void init();
 
   void setImage(const QModelIndex& imageIndex, bool defaultIntensity = true);
+  /// Render the current image with the current window/level from its
+  /// modality values
+  void applyWindowLevel();
+  /// File of \a imageIndex in the database directory
+  QString imagePath(const QModelIndex& imageIndex)const;
+  /// Decoded image of \a path, from the cache if it's there. Waits for the
+  /// prefetch thread decoding it, if any.
+  QSharedPointer<DicomImage> image(const QString& path);
+  /// Run in a prefetch thread, decodes \a path into the cache unless its
+  /// generation is over or the image was decoded meanwhile
+  void prefetch(const QString& path, int generation);
+  /// Queue the next images of \a imageIndex in the scroll direction
+  void schedulePrefetch(const QModelIndex& imageIndex);
+  /// Drop the queued prefetches
+  void cancelPrefetch();
+  /// Add \a image to the cache and evict the least recently used images
+  /// over the budget. CacheMutex must be locked.
+  void cacheImage(const QString& path, QSharedPointer<DicomImage> image);
+  /// Evict the least recently used images until \a bytes more fit in the
+  /// budget. CacheMutex must be locked.
+  void evict(qint64 bytes);
+  void clearCache();
+  /// Approximate memory used by the decoded pixels of \a image
+  static qint64 imageBytes(DicomImage* image);
 
   void onPatientModelSelected(const QModelIndex& index);
   void onStudyModelSelected(const QModelIndex& index);
@@ -86,8 +150,40 @@ ctkDICOMDatasetViewPrivate::ctkDICOMDatasetViewPrivate(
   ctkDICOMDatasetView& object )
   : q_ptr( & object )
 {
+  this->CacheBytes = 0;
+  this->CacheSize = 256 * 1024 * 1024;
+  this->PrefetchCount = 8;
+  this->ScrollDirection = 1;
+  // decoding is mostly disk bound, don't compete with the thumbnails
+  this->PrefetchThreads.setMaxThreadCount(2);
+}
+
+//--------------------------------------------------------------------------
+ctkDICOMDatasetViewPrivate::~ctkDICOMDatasetViewPrivate()
+{
+  this->cancelPrefetch();
+  this->PrefetchThreads.waitForDone();
 }
 
+//--------------------------------------------------------------------------
+class ctkDICOMDatasetViewPrefetcher : public QRunnable
+{
+public:
+  ctkDICOMDatasetViewPrefetcher(ctkDICOMDatasetViewPrivate* d,
+                                const QString& path, int generation)
+    : Private(d), Path(path), Generation(generation)
+  {
+  }
+  virtual void run()
+  {
+    this->Private->prefetch(this->Path, this->Generation);
+  }
+protected:
+  ctkDICOMDatasetViewPrivate* Private;
+  QString Path;
+  int Generation;
+};
+
 //--------------------------------------------------------------------------
 void ctkDICOMDatasetViewPrivate::init()
 {
@@ -118,18 +214,16 @@ void ctkDICOMDatasetViewPrivate::setImage(const QModelIndex &imageIndex, bool de
 
     if(model){
         QModelIndex seriesIndex = imageIndex.parent();
-        QModelIndex studyIndex = seriesIndex.parent();
 
-        QString dicomPath = this->DatabaseDirectory;
-        dicomPath.append("/dicom/").append(model->data(studyIndex ,ctkDICOMModel::UIDRole).toString());
-        dicomPath.append("/").append(model->data(seriesIndex ,ctkDICOMModel::UIDRole).toString());
-        dicomPath.append("/").append(model->data(imageIndex ,ctkDICOMModel::UIDRole).toString());
+        QString dicomPath = this->imagePath(imageIndex);
 
         if (QFile(dicomPath).exists()){
-          DicomImage dcmImage(  QDir::toNativeSeparators(dicomPath).toStdString().c_str() );
+            this->schedulePrefetch(imageIndex);
+            // window/level changes only re-render the decoded image
+            QSharedPointer<DicomImage> dcmImage = this->image(dicomPath);
 
             q->clearImages();
-            q->addImage(dcmImage, defaultIntensity);
+            q->addImage(*dcmImage, defaultIntensity);
             this->CurrentImageIndex = imageIndex;
 
             q->emitImageDisplayedSignal(imageIndex.row(), model->rowCount(seriesIndex));
@@ -139,6 +233,219 @@ void ctkDICOMDatasetViewPrivate::setImage(const QModelIndex &imageIndex, bool de
     }
 }
 
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetViewPrivate::applyWindowLevel()
+{
+  Q_Q(ctkDICOMDatasetView);
+  if (!this->CurrentImageIndex.isValid())
+    {
+    return;
+    }
+  QString path = this->imagePath(this->CurrentImageIndex);
+  if (path != this->ModalityFramePath)
+    {
+    this->ModalityFramePath.clear();
+    QSharedPointer<DicomImage> dcmImage = this->image(path);
+    if (!this->ModalityFrame.setFrame(dcmImage.data()))
+      {
+      // color images go through DicomImage
+      this->setImage(this->CurrentImageIndex, false);
+      return;
+      }
+    this->ModalityFramePath = path;
+    }
+  // release the displayed copy first so the buffer is rendered in place
+  q->clearImages();
+  this->ModalityFrame.render(this->DicomIntensityLevel, this->DicomIntensityWindow,
+                             this->WindowedImage);
+  q->addImage(this->WindowedImage);
+}
+
+// -------------------------------------------------------------------------
+QString ctkDICOMDatasetViewPrivate::imagePath(const QModelIndex& imageIndex)const
+{
+  const QAbstractItemModel* model = imageIndex.model();
+  QModelIndex seriesIndex = imageIndex.parent();
+  QModelIndex studyIndex = seriesIndex.parent();
+
+  QString dicomPath = this->DatabaseDirectory;
+  dicomPath.append("/dicom/").append(model->data(studyIndex ,ctkDICOMModel::UIDRole).toString());
+  dicomPath.append("/").append(model->data(seriesIndex ,ctkDICOMModel::UIDRole).toString());
+  dicomPath.append("/").append(model->data(imageIndex ,ctkDICOMModel::UIDRole).toString());
+  return dicomPath;
+}
+
+// -------------------------------------------------------------------------
+QSharedPointer<DicomImage> ctkDICOMDatasetViewPrivate::image(const QString& path)
+{
+  QMutexLocker locker(&this->CacheMutex);
+  while (this->Decoding.contains(path))
+    {
+    this->Decoded.wait(&this->CacheMutex);
+    }
+  if (this->Cache.contains(path))
+    {
+    this->FrameCacheHits.ref();
+    this->CacheOrder.removeOne(path);
+    this->CacheOrder.append(path);
+    return this->Cache[path];
+    }
+  // still queued, decode it now rather than waiting for the ones before it
+  this->FrameCacheMisses.ref();
+  this->Prefetching.remove(path);
+  locker.unlock();
+
+  QSharedPointer<DicomImage> dcmImage(
+    new DicomImage(QDir::toNativeSeparators(path).toStdString().c_str()));
+
+  locker.relock();
+  if (dcmImage->getStatus() == EIS_Normal)
+    {
+    this->cacheImage(path, dcmImage);
+    }
+  return dcmImage;
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetViewPrivate::prefetch(const QString& path, int generation)
+{
+  {
+  QMutexLocker locker(&this->CacheMutex);
+  if (generation != this->PrefetchGeneration)
+    {
+    this->DroppedPrefetches.ref();
+    return;
+    }
+  // decoded for display while queued
+  if (!this->Prefetching.contains(path))
+    {
+    return;
+    }
+  this->Prefetching.remove(path);
+  if (this->Cache.contains(path))
+    {
+    return;
+    }
+  this->Decoding.insert(path);
+  }
+
+  QSharedPointer<DicomImage> dcmImage(
+    new DicomImage(QDir::toNativeSeparators(path).toStdString().c_str()));
+
+  QMutexLocker locker(&this->CacheMutex);
+  this->Decoding.remove(path);
+  // the series may have changed meanwhile
+  if (generation != this->PrefetchGeneration)
+    {
+    this->DroppedPrefetches.ref();
+    }
+  else if (dcmImage->getStatus() == EIS_Normal)
+    {
+    this->cacheImage(path, dcmImage);
+    this->PrefetchedFrames.ref();
+    }
+  this->Decoded.wakeAll();
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetViewPrivate::schedulePrefetch(const QModelIndex& imageIndex)
+{
+  if (this->PrefetchCount <= 0 || this->CacheSize <= 0)
+    {
+    return;
+    }
+  QModelIndex seriesIndex = imageIndex.parent();
+  if (seriesIndex != this->CurrentImageIndex.parent())
+    {
+    // the images of the previous series aren't needed anymore
+    this->cancelPrefetch();
+    this->clearCache();
+    this->ScrollDirection = 1;
+    }
+  else if (imageIndex.row() != this->CurrentImageIndex.row())
+    {
+    int direction = imageIndex.row() > this->CurrentImageIndex.row() ? 1 : -1;
+    if (direction != this->ScrollDirection)
+      {
+      this->cancelPrefetch();
+      this->ScrollDirection = direction;
+      }
+    }
+
+  int generation = this->PrefetchGeneration;
+  for (int i = 1; i <= this->PrefetchCount; ++i)
+    {
+    QModelIndex nextIndex = imageIndex.sibling(imageIndex.row() + i * this->ScrollDirection, 0);
+    if (!nextIndex.isValid())
+      {
+      break;
+      }
+    QString path = this->imagePath(nextIndex);
+    {
+    QMutexLocker locker(&this->CacheMutex);
+    if (this->Cache.contains(path) || this->Prefetching.contains(path)
+        || this->Decoding.contains(path))
+      {
+      continue;
+      }
+    this->Prefetching.insert(path);
+    }
+    this->PrefetchThreads.start(new ctkDICOMDatasetViewPrefetcher(this, path, generation));
+    }
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetViewPrivate::cancelPrefetch()
+{
+  QMutexLocker locker(&this->CacheMutex);
+  this->PrefetchGeneration.ref();
+  this->Prefetching.clear();
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetViewPrivate::cacheImage(const QString& path, QSharedPointer<DicomImage> dcmImage)
+{
+  qint64 bytes = ctkDICOMDatasetViewPrivate::imageBytes(dcmImage.data());
+  if (bytes > this->CacheSize || this->Cache.contains(path))
+    {
+    return;
+    }
+  this->evict(bytes);
+  this->Cache[path] = dcmImage;
+  this->CacheOrder.append(path);
+  this->CacheBytes += bytes;
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetViewPrivate::evict(qint64 bytes)
+{
+  while (!this->CacheOrder.isEmpty() && this->CacheBytes + bytes > this->CacheSize)
+    {
+    QString evicted = this->CacheOrder.takeFirst();
+    this->CacheBytes -= ctkDICOMDatasetViewPrivate::imageBytes(this->Cache.take(evicted).data());
+    }
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetViewPrivate::clearCache()
+{
+  QMutexLocker locker(&this->CacheMutex);
+  this->Cache.clear();
+  this->CacheOrder.clear();
+  this->CacheBytes = 0;
+}
+
+// -------------------------------------------------------------------------
+qint64 ctkDICOMDatasetViewPrivate::imageBytes(DicomImage* dcmImage)
+{
+  // intermediate representation kept by DicomImage for rendering
+  int depth = dcmImage->getDepth();
+  qint64 bytesPerSample = depth > 16 ? 4 : (depth > 8 ? 2 : 1);
+  qint64 samples = dcmImage->isMonochrome() ? 1 : 3;
+  return static_cast<qint64>(dcmImage->getWidth()) * dcmImage->getHeight()
+    * dcmImage->getFrameCount() * samples * bytesPerSample;
+}
+
 // -------------------------------------------------------------------------
 void ctkDICOMDatasetViewPrivate::onPatientModelSelected(const QModelIndex &index){
     Q_Q(ctkDICOMDatasetView);
@@ -147,11 +454,11 @@ void ctkDICOMDatasetViewPrivate::onPatientModelSelected(const QModelIndex &index
 
     if(model){
         QModelIndex patientIndex = index;
-        model->fetchMore(patientIndex);
+        model->fetchAll(patientIndex);
         QModelIndex studyIndex = patientIndex.child(0,0);
-        model->fetchMore(studyIndex);
+        model->fetchAll(studyIndex);
         QModelIndex seriesIndex = studyIndex.child(0,0);
-        model->fetchMore(seriesIndex);
+        model->fetchAll(seriesIndex);
         int imageCount = model->rowCount(seriesIndex);
         QModelIndex imageIndex = seriesIndex.child(imageCount/2,0);
 
@@ -169,9 +476,9 @@ void ctkDICOMDatasetViewPrivate::onStudyModelSelected(const QModelIndex &index){
 
     if(model){
         QModelIndex studyIndex = index;
-        model->fetchMore(studyIndex);
+        model->fetchAll(studyIndex);
         QModelIndex seriesIndex = studyIndex.child(0,0);
-        model->fetchMore(seriesIndex);
+        model->fetchAll(seriesIndex);
         int imageCount = model->rowCount(seriesIndex);
         QModelIndex imageIndex = seriesIndex.child(imageCount/2,0);
 
@@ -189,7 +496,7 @@ void ctkDICOMDatasetViewPrivate::onSeriesModelSelected(const QModelIndex &index)
 
     if(model){
         QModelIndex seriesIndex = index;
-        model->fetchMore(seriesIndex);
+        model->fetchAll(seriesIndex);
         int imageCount = model->rowCount(seriesIndex);
         QModelIndex imageIndex = seriesIndex.child(imageCount/2,0);
 
@@ -247,6 +554,91 @@ void ctkDICOMDatasetView::setDatabaseDirectory(const QString &directory){
     Q_D(ctkDICOMDatasetView);
 
     d->DatabaseDirectory = directory;
+    d->cancelPrefetch();
+    d->clearCache();
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetView::setPrefetchCount(int count)
+{
+  Q_D(ctkDICOMDatasetView);
+  d->PrefetchCount = count;
+}
+
+// -------------------------------------------------------------------------
+int ctkDICOMDatasetView::prefetchCount()const
+{
+  Q_D(const ctkDICOMDatasetView);
+  return d->PrefetchCount;
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetView::setFrameCacheSize(int megabytes)
+{
+  Q_D(ctkDICOMDatasetView);
+  QMutexLocker locker(&d->CacheMutex);
+  d->CacheSize = static_cast<qint64>(qMax(megabytes, 0)) * 1024 * 1024;
+  d->evict(0);
+}
+
+// -------------------------------------------------------------------------
+int ctkDICOMDatasetView::frameCacheSize()const
+{
+  Q_D(const ctkDICOMDatasetView);
+  return static_cast<int>(d->CacheSize / (1024 * 1024));
+}
+
+// -------------------------------------------------------------------------
+int ctkDICOMDatasetView::cachedFrameCount()const
+{
+  Q_D(const ctkDICOMDatasetView);
+  QMutexLocker locker(&d->CacheMutex);
+  return d->Cache.count();
+}
+
+// -------------------------------------------------------------------------
+int ctkDICOMDatasetView::frameCacheHits()const
+{
+  Q_D(const ctkDICOMDatasetView);
+  return d->FrameCacheHits;
+}
+
+// -------------------------------------------------------------------------
+int ctkDICOMDatasetView::frameCacheMisses()const
+{
+  Q_D(const ctkDICOMDatasetView);
+  return d->FrameCacheMisses;
+}
+
+// -------------------------------------------------------------------------
+int ctkDICOMDatasetView::prefetchedFrameCount()const
+{
+  Q_D(const ctkDICOMDatasetView);
+  return d->PrefetchedFrames;
+}
+
+// -------------------------------------------------------------------------
+int ctkDICOMDatasetView::droppedPrefetchCount()const
+{
+  Q_D(const ctkDICOMDatasetView);
+  return d->DroppedPrefetches;
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetView::resetFrameCacheStatistics()
+{
+  Q_D(ctkDICOMDatasetView);
+  d->FrameCacheHits = 0;
+  d->FrameCacheMisses = 0;
+  d->PrefetchedFrames = 0;
+  d->DroppedPrefetches = 0;
+}
+
+// -------------------------------------------------------------------------
+void ctkDICOMDatasetView::waitForPrefetch()
+{
+  Q_D(ctkDICOMDatasetView);
+  d->PrefetchThreads.waitForDone();
 }
 
 // -------------------------------------------------------------------------
@@ -295,40 +687,9 @@ void ctkDICOMDatasetView::addImage( DicomImage & dcmImage, bool defaultIntensity
     {
       dcmImage.setWindow(d->DicomIntensityLevel, d->DicomIntensityWindow);
     }
-    /* get image extension and prepare image header */
-    const unsigned long width = dcmImage.getWidth();
-    const unsigned long height = dcmImage.getHeight();
-    unsigned long offset = 0;
-    unsigned long length = 0;
-    QString header;
-
-    if (dcmImage.isMonochrome())
+    if (!ctkDICOMImage::renderFrame(&dcmImage, 0, image))
     {
-      // write PGM header (binary monochrome image format)
-      header = QString("P5 %1 %2 255\n").arg(width).arg(height);
-      offset = header.length();
-      length = width * height + offset;
-    }
-    else
-    {
-      // write PPM header (binary color image format)
-      header = QString("P6 %1 %2 255\n").arg(width).arg(height);
-      offset = header.length();
-      length = width * height * 3 /* RGB */ + offset;
-    }
-    /* create output buffer for DicomImage class */
-    QByteArray buffer;
-    /* copy header to output buffer and resize it for pixel data */
-    buffer.append(header);
-    buffer.resize(length);
-
-    /* render pixel data to buffer */
-    if (dcmImage.getOutputData(static_cast<void *>(buffer.data() + offset), length - offset, 8, 0))
-    {  
-      if (!image.loadFromData( buffer ))
-        {
-            logger.error("QImage couldn't created");
-        }
+      logger.error("QImage couldn't created");
     }
     this->addImage(image);
 }
@@ -377,7 +738,7 @@ void ctkDICOMDatasetView::mouseMoveEvent(QMouseEvent* event){
         d->DicomIntensityLevel -= (5*(nowPos.y()-d->OldMousePos.y()));
         d->AutoWindowLevel = false;
 
-        d->setImage(d->CurrentImageIndex, false);
+        d->applyWindowLevel();
 
         d->OldMousePos = event->pos();
     }
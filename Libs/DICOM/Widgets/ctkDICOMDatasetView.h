@@ -37,11 +37,18 @@ class DicomImage;
 /// \ingroup DICOM_Widgets
 ///
 /// ctkDICOMDatasetView is the base class of image viewer widgets.
+///
+/// The decoded images of the displayed series are cached, within
+/// frameCacheSize megabytes, so that changing the window/level only
+/// re-renders them. The prefetchCount images following the displayed one
+/// in the scroll direction are decoded in the background.
 class CTK_DICOM_WIDGETS_EXPORT ctkDICOMDatasetView
 : public ctkQImageView
 {
 
   Q_OBJECT
+  Q_PROPERTY(int prefetchCount READ prefetchCount WRITE setPrefetchCount)
+  Q_PROPERTY(int frameCacheSize READ frameCacheSize WRITE setFrameCacheSize)
 
 public:
 
@@ -58,6 +65,31 @@ public:
 
   QModelIndex currentImageIndex();
 
+  /// Number of images decoded ahead in the scroll direction, 0 disables
+  /// prefetching (default 8)
+  void setPrefetchCount(int count);
+  int prefetchCount()const;
+
+  /// Memory budget of the decoded images in megabytes (default 256)
+  void setFrameCacheSize(int megabytes);
+  int frameCacheSize()const;
+
+  /// Number of decoded images currently cached
+  int cachedFrameCount()const;
+
+  /// Frame cache statistics since the last resetFrameCacheStatistics():
+  /// images displayed from the cache, images decoded for display, images
+  /// decoded ahead into the cache, and prefetches dropped because the
+  /// series, the scroll direction or the database directory changed
+  int frameCacheHits()const;
+  int frameCacheMisses()const;
+  int prefetchedFrameCount()const;
+  int droppedPrefetchCount()const;
+  void resetFrameCacheStatistics();
+
+  /// Block until the queued prefetches are decoded or dropped
+  void waitForPrefetch();
+
 Q_SIGNALS:
 
   void requestNextImage();
@@ -22,6 +22,7 @@
 // Qt includes
 #include <QDebug>
 #include <QString>
+#include <QThreadStorage>
 
 // ctkDICOMCore includes
 #include "ctkDICOMImage.h"
@@ -31,9 +32,17 @@
 #include <dcmimage.h>
 #include <ofbmanip.h>
 
+// STD includes
+#include <cstring>
+
 static ctkLogger logger ( "org.commontk.dicom.DICOMImage" );
 struct Node;
 
+// Rows of DicomImage output are packed, the ones of QImage 32-bit aligned:
+// when they differ, the frame is rendered here first. One per thread as
+// thumbnails are rendered in parallel.
+static QThreadStorage<QByteArray*> ctkDICOMImageScratchBuffers;
+
 //------------------------------------------------------------------------------
 class ctkDICOMImagePrivate
 {
@@ -105,33 +114,76 @@ DicomImage* ctkDICOMImage::dicomImage() const
 QImage ctkDICOMImage::frame(int frame) const
 {
   Q_D(const ctkDICOMImage);
-
-  // this way of converting the dicom image to a qpixmap was adopted from some code from
-  // the DCMTK forum, posted by Joerg Riesmayer, see http://forum.dcmtk.org/viewtopic.php?t=120
   QImage image;
-  if ((d->DicomImage != NULL) && (d->DicomImage->getStatus() == EIS_Normal))
+  ctkDICOMImage::renderFrame(d->DicomImage, frame, image);
+  return image;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMImage::renderFrame(DicomImage* dicomImage, int frame, QImage& image)
+{
+  if (dicomImage == NULL || dicomImage->getStatus() != EIS_Normal)
+    {
+    return false;
+    }
+  const int width = static_cast<int>(dicomImage->getWidth());
+  const int height = static_cast<int>(dicomImage->getHeight());
+  const bool monochrome = dicomImage->isMonochrome();
+  const QImage::Format format = monochrome ? QImage::Format_Indexed8 : QImage::Format_RGB888;
+  if (image.width() != width || image.height() != height || image.format() != format)
     {
-    /* get image extension */
-    const unsigned long width = d->DicomImage->getWidth();
-    const unsigned long height = d->DicomImage->getHeight();
-    QString header = QString("P5 %1 %2 255\n").arg(width).arg(height);
-    const unsigned long offset = header.length();
-    const unsigned long length = width * height + offset;
-    /* create output buffer for DicomImage class */
-    QByteArray buffer;
-    buffer.append(header);
-    buffer.resize(length);
-
-    /* copy PGM header to buffer */
-
-    if (d->DicomImage->getOutputData(static_cast<void *>(buffer.data() + offset), length - offset, 8, frame))
+    image = QImage(width, height, format);
+    if (image.isNull())
       {
-
-      if (!image.loadFromData( buffer ))
-        {
-        logger.error("QImage couldn't created");
-        }
+      logger.error("QImage couldn't be created");
+      return false;
       }
     }
-  return image;
+  if (monochrome && image.colorCount() != 256)
+    {
+    QVector<QRgb> grayscale(256);
+    for (int i = 0; i < 256; ++i)
+      {
+      grayscale[i] = qRgb(i, i, i);
+      }
+    image.setColorTable(grayscale);
+    }
+
+  const int rowLength = width * (monochrome ? 1 : 3 /* RGB */);
+  const unsigned long length = static_cast<unsigned long>(rowLength) * height;
+  if (image.bytesPerLine() == rowLength)
+    {
+    return dicomImage->getOutputData(image.bits(), length, 8, frame) != 0;
+    }
+  if (!ctkDICOMImageScratchBuffers.hasLocalData())
+    {
+    ctkDICOMImageScratchBuffers.setLocalData(new QByteArray);
+    }
+  QByteArray* scratch = ctkDICOMImageScratchBuffers.localData();
+  if (static_cast<unsigned long>(scratch->size()) < length)
+    {
+    scratch->resize(length);
+    }
+  if (!dicomImage->getOutputData(scratch->data(), length, 8, frame))
+    {
+    return false;
+    }
+  const char* row = scratch->constData();
+  for (int y = 0; y < height; ++y, row += rowLength)
+    {
+    memcpy(image.scanLine(y), row, rowLength);
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMImage::renderFrame(DicomImage* dicomImage, int frame, QVector<quint16>& pixels)
+{
+  if (dicomImage == NULL || dicomImage->getStatus() != EIS_Normal
+      || !dicomImage->isMonochrome())
+    {
+    return false;
+    }
+  pixels.resize(dicomImage->getWidth() * dicomImage->getHeight());
+  return dicomImage->getOutputData(pixels.data(), pixels.size() * sizeof(quint16), 16, frame) != 0;
 }
@@ -25,6 +25,7 @@
 // Qt includes
 #include <QObject>
 #include <QImage>
+#include <QVector>
 
 #include "ctkDICOMWidgetsExport.h"
 
@@ -73,6 +74,33 @@ public:
   ///
   unsigned long frameCount() const;
 
+  ///
+  /// \brief Renders a frame of \a dicomImage into \a image
+  ///
+  /// The output of DicomImage is written into the pixels of \a image
+  /// directly, without an intermediate PGM/PPM buffer to parse. Monochrome
+  /// images are rendered into a Format_Indexed8 image with a grayscale
+  /// color table, color images into a Format_RGB888 image. The pixels of
+  /// \a image are reused if it already has the size and format of the
+  /// frame, so rendering the frames of a series one after the other into
+  /// the same QImage doesn't allocate. The current window of \a dicomImage
+  /// is applied.
+  /// Returns false if the frame can't be rendered.
+  ///
+  static bool renderFrame(DicomImage* dicomImage, int frame, QImage& image);
+
+  ///
+  /// \brief Renders a monochrome frame with 16 bits per pixel
+  ///
+  /// Qt 4 has no 16 bit image format: \a pixels receives width * height
+  /// values, row by row, and is reused like the QImage of
+  /// renderFrame(DicomImage*, int, QImage&). The current window of
+  /// \a dicomImage maps the pixel values to 0-65535, see
+  /// DicomImage::setNoVoiTransformation() to get them all.
+  /// Returns false if the frame isn't monochrome or can't be rendered.
+  ///
+  static bool renderFrame(DicomImage* dicomImage, int frame, QVector<quint16>& pixels);
+
 protected:
   QScopedPointer<ctkDICOMImagePrivate> d_ptr;
 
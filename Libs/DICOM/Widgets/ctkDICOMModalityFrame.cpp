@@ -0,0 +1,353 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QVector>
+#include <QtConcurrentMap>
+
+// ctkDICOMWidgets includes
+#include "ctkDICOMModalityFrame.h"
+
+// DCMTK includes
+#include <dcmimage.h>
+#include <dipixel.h>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/// Frames smaller than that are rendered in the calling thread
+const int ParallelPixels = 512 * 512;
+/// Rows rendered per block in parallel
+const int RowsPerBlock = 64;
+
+//------------------------------------------------------------------------------
+struct RowBlock
+{
+  const quint16* Values;
+  const uchar*   Table;
+  uchar*         Output;
+  int            BytesPerLine;
+  int            Width;
+  int            FirstRow;
+  int            Rows;
+};
+
+//------------------------------------------------------------------------------
+void renderRows(RowBlock& block)
+{
+  const quint16* values = block.Values + block.FirstRow * block.Width;
+  const uchar* table = block.Table;
+  uchar* output = block.Output + block.FirstRow * block.BytesPerLine;
+  for (int y = 0; y < block.Rows; ++y)
+    {
+    for (int x = 0; x < block.Width; ++x)
+      {
+      output[x] = table[values[x]];
+      }
+    values += block.Width;
+    output += block.BytesPerLine;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename T>
+void copyValues(const T* data, int count, qint64& minimum, qint64& maximum,
+                int& shift, QVector<quint16>& values)
+{
+  minimum = count > 0 ? data[0] : 0;
+  maximum = minimum;
+  for (int i = 1; i < count; ++i)
+    {
+    const qint64 value = data[i];
+    if (value < minimum)
+      {
+      minimum = value;
+      }
+    else if (value > maximum)
+      {
+      maximum = value;
+      }
+    }
+  shift = 0;
+  while (((maximum - minimum) >> shift) > 0xffff)
+    {
+    ++shift;
+    }
+  values.resize(count);
+  quint16* output = values.data();
+  for (int i = 0; i < count; ++i)
+    {
+    output[i] = static_cast<quint16>((static_cast<qint64>(data[i]) - minimum) >> shift);
+    }
+}
+
+}
+
+//------------------------------------------------------------------------------
+class ctkDICOMModalityFramePrivate
+{
+public:
+  ctkDICOMModalityFramePrivate();
+
+  /// Fill Table for the window, unless it was the last one
+  void updateTable(double center, double width);
+
+  /// (modality value - Minimum) >> Shift, row by row
+  QVector<quint16> Values;
+  int    Width;
+  int    Height;
+  qint64 Minimum;
+  qint64 Maximum;
+  int    Shift;
+  bool   Inverted;
+
+  /// display value of each stored value for the window of the last
+  /// rendering
+  QVector<uchar> Table;
+  double TableCenter;
+  double TableWidth;
+};
+
+//------------------------------------------------------------------------------
+ctkDICOMModalityFramePrivate::ctkDICOMModalityFramePrivate()
+{
+  this->Width = 0;
+  this->Height = 0;
+  this->Minimum = 0;
+  this->Maximum = 0;
+  this->Shift = 0;
+  this->Inverted = false;
+  this->TableCenter = 0.;
+  this->TableWidth = 0.;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModalityFramePrivate::updateTable(double center, double width)
+{
+  const int entries = static_cast<int>((this->Maximum - this->Minimum) >> this->Shift) + 1;
+  if (this->Table.size() == entries
+      && center == this->TableCenter && width == this->TableWidth)
+    {
+    return;
+    }
+  this->Table.resize(entries);
+  this->TableCenter = center;
+  this->TableWidth = width;
+
+  // DICOM PS 3.3 C.11.2.1.2, as DicomImage::setWindow()
+  const double c = center - 0.5;
+  const double w = qMax(width, 1.) - 1.;
+  const double lower = c - w / 2.;
+  const double upper = c + w / 2.;
+  uchar* table = this->Table.data();
+  for (int i = 0; i < entries; ++i)
+    {
+    const double value = static_cast<double>(this->Minimum + (static_cast<qint64>(i) << this->Shift));
+    int display;
+    if (value <= lower)
+      {
+      display = 0;
+      }
+    else if (value > upper)
+      {
+      display = 255;
+      }
+    else
+      {
+      display = static_cast<int>(((value - c) / w + 0.5) * 255. + 0.5);
+      }
+    table[i] = static_cast<uchar>(this->Inverted ? 255 - display : display);
+    }
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMModalityFrame::ctkDICOMModalityFrame()
+  : d_ptr(new ctkDICOMModalityFramePrivate)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMModalityFrame::~ctkDICOMModalityFrame()
+{
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModalityFrame::setFrame(DicomImage* dicomImage, int frame)
+{
+  Q_D(ctkDICOMModalityFrame);
+  this->clear();
+  if (dicomImage == NULL || dicomImage->getStatus() != EIS_Normal
+      || !dicomImage->isMonochrome()
+      || frame < 0 || static_cast<unsigned long>(frame) >= dicomImage->getFrameCount())
+    {
+    return false;
+    }
+  const DiPixel* interData = dicomImage->getInterData();
+  if (interData == NULL || interData->getData() == NULL)
+    {
+    return false;
+    }
+  const int width = static_cast<int>(dicomImage->getWidth());
+  const int height = static_cast<int>(dicomImage->getHeight());
+  const int count = width * height;
+  if (interData->getCount() < static_cast<unsigned long>(count) * (frame + 1))
+    {
+    return false;
+    }
+  const long offset = static_cast<long>(count) * frame;
+  switch (interData->getRepresentation())
+    {
+    case EPR_Uint8:
+      copyValues(static_cast<const Uint8*>(interData->getData()) + offset, count,
+                 d->Minimum, d->Maximum, d->Shift, d->Values);
+      break;
+    case EPR_Sint8:
+      copyValues(static_cast<const Sint8*>(interData->getData()) + offset, count,
+                 d->Minimum, d->Maximum, d->Shift, d->Values);
+      break;
+    case EPR_Uint16:
+      copyValues(static_cast<const Uint16*>(interData->getData()) + offset, count,
+                 d->Minimum, d->Maximum, d->Shift, d->Values);
+      break;
+    case EPR_Sint16:
+      copyValues(static_cast<const Sint16*>(interData->getData()) + offset, count,
+                 d->Minimum, d->Maximum, d->Shift, d->Values);
+      break;
+    case EPR_Uint32:
+      copyValues(static_cast<const Uint32*>(interData->getData()) + offset, count,
+                 d->Minimum, d->Maximum, d->Shift, d->Values);
+      break;
+    case EPR_Sint32:
+      copyValues(static_cast<const Sint32*>(interData->getData()) + offset, count,
+                 d->Minimum, d->Maximum, d->Shift, d->Values);
+      break;
+    default:
+      return false;
+    }
+  d->Width = width;
+  d->Height = height;
+  d->Inverted = dicomImage->getPhotometricInterpretation() == EPI_Monochrome1;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModalityFrame::clear()
+{
+  Q_D(ctkDICOMModalityFrame);
+  d->Values.clear();
+  d->Table.clear();
+  d->Width = 0;
+  d->Height = 0;
+  d->Minimum = 0;
+  d->Maximum = 0;
+  d->Shift = 0;
+  d->Inverted = false;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModalityFrame::isNull()const
+{
+  Q_D(const ctkDICOMModalityFrame);
+  return d->Values.isEmpty();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMModalityFrame::width()const
+{
+  Q_D(const ctkDICOMModalityFrame);
+  return d->Width;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMModalityFrame::height()const
+{
+  Q_D(const ctkDICOMModalityFrame);
+  return d->Height;
+}
+
+//------------------------------------------------------------------------------
+double ctkDICOMModalityFrame::minimumValue()const
+{
+  Q_D(const ctkDICOMModalityFrame);
+  return static_cast<double>(d->Minimum);
+}
+
+//------------------------------------------------------------------------------
+double ctkDICOMModalityFrame::maximumValue()const
+{
+  Q_D(const ctkDICOMModalityFrame);
+  return static_cast<double>(d->Maximum);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModalityFrame::render(double center, double width, QImage& image)const
+{
+  // the table is a cache of the last window
+  ctkDICOMModalityFramePrivate* d = const_cast<ctkDICOMModalityFramePrivate*>(this->d_func());
+  if (d->Values.isEmpty())
+    {
+    return false;
+    }
+  if (image.width() != d->Width || image.height() != d->Height
+      || image.format() != QImage::Format_Indexed8)
+    {
+    image = QImage(d->Width, d->Height, QImage::Format_Indexed8);
+    if (image.isNull())
+      {
+      return false;
+      }
+    }
+  if (image.colorCount() != 256)
+    {
+    QVector<QRgb> grayscale(256);
+    for (int i = 0; i < 256; ++i)
+      {
+      grayscale[i] = qRgb(i, i, i);
+      }
+    image.setColorTable(grayscale);
+    }
+  d->updateTable(center, width);
+
+  RowBlock frameBlock;
+  frameBlock.Values = d->Values.constData();
+  frameBlock.Table = d->Table.constData();
+  frameBlock.Output = image.bits();
+  frameBlock.BytesPerLine = image.bytesPerLine();
+  frameBlock.Width = d->Width;
+  frameBlock.FirstRow = 0;
+  frameBlock.Rows = d->Height;
+  if (d->Width * d->Height < ParallelPixels)
+    {
+    renderRows(frameBlock);
+    return true;
+    }
+  QVector<RowBlock> blocks;
+  for (int row = 0; row < d->Height; row += RowsPerBlock)
+    {
+    RowBlock block = frameBlock;
+    block.FirstRow = row;
+    block.Rows = qMin(RowsPerBlock, d->Height - row);
+    blocks.append(block);
+    }
+  QtConcurrent::blockingMap(blocks, renderRows);
+  return true;
+}
@@ -0,0 +1,90 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMModalityFrame_h
+#define __ctkDICOMModalityFrame_h
+
+// Qt includes
+#include <QImage>
+#include <QScopedPointer>
+
+#include "ctkDICOMWidgetsExport.h"
+
+class ctkDICOMModalityFramePrivate;
+class DicomImage;
+
+/// \ingroup DICOM_Widgets
+///
+/// \brief Modality values of a monochrome frame, to window interactively
+///
+/// The values of the frame, after the modality transformation (rescale
+/// slope and intercept or modality LUT), are copied once from the
+/// DicomImage and kept with 16 bits per pixel. render() then maps them to
+/// the display through a lookup table built for the window, split in
+/// blocks of rows rendered in parallel for large frames. Changing the
+/// window doesn't go through DicomImage anymore, which recomputes its
+/// output from the intermediate data on each call.
+///
+/// Value ranges wider than 16 bits are shifted right to fit, losing the
+/// low bits.
+class CTK_DICOM_WIDGETS_EXPORT ctkDICOMModalityFrame
+{
+public:
+  ctkDICOMModalityFrame();
+  virtual ~ctkDICOMModalityFrame();
+
+  ///
+  /// \brief Copy the modality values of \a frame of \a dicomImage
+  ///
+  /// Returns false, and clears the frame, if \a dicomImage isn't monochrome
+  /// or can't be read. The photometric interpretation is kept to invert
+  /// MONOCHROME1 images when rendering.
+  ///
+  bool setFrame(DicomImage* dicomImage, int frame = 0);
+  void clear();
+  bool isNull()const;
+
+  int width()const;
+  int height()const;
+  /// Range of the modality values of the frame
+  double minimumValue()const;
+  double maximumValue()const;
+
+  ///
+  /// \brief Render the frame through the window \a center / \a width
+  ///
+  /// The window is applied as DICOM linear VOI function, like
+  /// DicomImage::setWindow(). \a image is made a Format_Indexed8 image with
+  /// a grayscale color table, its pixels are reused if it has the size
+  /// and format of the frame already.
+  /// Returns false if the frame is null.
+  ///
+  bool render(double center, double width, QImage& image)const;
+
+protected:
+  QScopedPointer<ctkDICOMModalityFramePrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(ctkDICOMModalityFrame);
+  Q_DISABLE_COPY(ctkDICOMModalityFrame);
+};
+
+#endif
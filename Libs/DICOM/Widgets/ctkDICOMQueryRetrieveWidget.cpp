@@ -20,6 +20,7 @@
 
 //Qt includes
 #include <QDebug>
+#include <QEventLoop>
 #include <QLabel>
 #include <QMessageBox>
 #include <QProgressDialog>
@@ -37,6 +38,7 @@
 #include "ctkDICOMModel.h"
 #include "ctkDICOMQuery.h"
 #include "ctkDICOMRetrieve.h"
+#include "ctkDICOMRetrieveScheduler.h"
 
 // ctkDICOMWidgets includes
 #include "ctkDICOMQueryRetrieveWidget.h"
@@ -266,93 +268,77 @@ void ctkDICOMQueryRetrieveWidget::retrieve()
   progress.show();
 
   QMap<QString,QVariant> serverParameters = d->ServerNodeWidget->parameters();
-  ctkDICOMRetrieve *retrieve = new ctkDICOMRetrieve;
-  // only start new association if connection parameters change
-  retrieve->setKeepAssociationOpen(true);
+  // the series of the studies of a server are retrieved in parallel, the
+  // associations stay open until the server changes
+  ctkDICOMRetrieveScheduler scheduler;
+  scheduler.setDatabase( d->RetrieveDatabase );
   // pull from GUI
-  retrieve->setMoveDestinationAETitle( serverParameters["StorageAETitle"].toString() );
-
-  // do the rerieval for each selected series
+  scheduler.setMoveDestinationAETitle( serverParameters["StorageAETitle"].toString() );
+  connect(&progress, SIGNAL(canceled()), &scheduler, SLOT(cancel()));
+  connect(&scheduler, SIGNAL(progress(QString)),
+          progressLabel, SLOT(setText(QString)));
+  connect(&scheduler, SIGNAL(progress(int)),
+          this, SLOT(updateRetrieveProgress(int)));
+  connect(&scheduler, SIGNAL(transferProgress(int,int,qint64,double)),
+          this, SLOT(onRetrieveTransferProgress(int,int,qint64,double)));
+
+  // group the studies by the server they were found on
+  QMap<ctkDICOMQuery*, QStringList> studiesByQuery;
   foreach( QString studyUID, d->QueriesByStudyUID.keys() )
+    {
+    // TODO: check the model item to see if it is checked
+    // for now, assume all studies queried and shown to the user will be retrieved
+    studiesByQuery[d->QueriesByStudyUID[studyUID]] << studyUID;
+    }
+
+  bool success = true;
+  foreach( ctkDICOMQuery* query, studiesByQuery.keys() )
     {
     if (progress.wasCanceled())
       {
       break;
       }
-
-    progressLabel->setText(QString(tr("Retrieving:\n%1")).arg(studyUID));
+    progressLabel->setText(QString(tr("Retrieving from:\n%1")).arg(query->host()));
     this->updateRetrieveProgress(0);
 
-    // Get information which server we want to get the study from and prepare request accordingly
-    ctkDICOMQuery *query = d->QueriesByStudyUID[studyUID];
-    retrieve->setDatabase( d->RetrieveDatabase );
-    retrieve->setCallingAETitle( query->callingAETitle() );
-    retrieve->setCalledAETitle( query->calledAETitle() );
-    retrieve->setPort( query->port() );
-    retrieve->setHost( query->host() );
-    // TODO: check the model item to see if it is checked
-    // for now, assume all studies queried and shown to the user will be retrieved
-    logger.debug("About to retrieve " + studyUID + " from " + d->QueriesByStudyUID[studyUID]->host());
-    logger.info ( "Starting to retrieve" );
-
-    connect(&progress, SIGNAL(canceled()), retrieve, SLOT(cancel()));
-    connect(retrieve, SIGNAL(progress(QString)),
-            progressLabel, SLOT(setText(QString)));
-    connect(retrieve, SIGNAL(progress(int)),
-            this, SLOT(updateRetrieveProgress(int)));
-
-    try
+    // Get information which server we want to get the studies from and prepare request accordingly
+    scheduler.setCallingAETitle( query->callingAETitle() );
+    scheduler.setCalledAETitle( query->calledAETitle() );
+    scheduler.setPort( query->port() );
+    scheduler.setHost( query->host() );
+    scheduler.setUseCGET( query->preferCGET() );
+    logger.debug("About to retrieve " + QString::number(studiesByQuery[query].count())
+                 + " studies from " + query->host());
+
+    // the scheduler signals from its threads, wait for them in an event loop
+    // unless the studies were retrieved in this thread
+    QEventLoop loop;
+    connect(&scheduler, SIGNAL(finished(bool)), &loop, SLOT(quit()));
+    if (!scheduler.retrieveStudies(studiesByQuery[query]))
       {
-      // perform the retrieve
-      if ( query->preferCGET() )
-        {
-        retrieve->getStudy ( studyUID );
-        }
-      else
-        {
-        retrieve->moveStudy ( studyUID );
-        }
+      success = false;
+      continue;
       }
-    catch (std::exception e)
+    if (scheduler.isRunning())
       {
-      logger.error ( "Retrieve failed" );
-      if ( QMessageBox::question ( this, 
-            tr("Query Retrieve"), tr("Retrieve failed.  Keep trying?"),
-            QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes)
-        {
-        continue;
-        }
-      else
-        {
-        break;
-        }
+      loop.exec();
       }
-
-    disconnect(retrieve, SIGNAL(progress(QString)),
-            progressLabel, SLOT(setText(QString)));
-    disconnect(retrieve, SIGNAL(progress(int)),
-            this, SLOT(updateRetrieveProgress(int)));
-    disconnect(&progress, SIGNAL(canceled()), retrieve, SLOT(cancel()));
-
-    // Store retrieve structure for later use.
-    // Comment MO: I do not think that makes much sense; you store per study one fat
-    // structure including an SCU. Also, I switched the code to re-use the retrieve
-    // SCU in order to not start/stop the association for every study. In general,
-    // it would make most sense in my opinion to have one SCU for each server you
-    // like to retrieve from. There is no good reason to have one for each study.
-    // d->RetrievalsByStudyUID[studyUID] = retrieve;
-    logger.info ( "Retrieve success" );
+    success = success && scheduler.failedSeriesCount() == 0;
     }
+  logger.info ( success ? "Retrieve success" : "Retrieve failed" );
 
   QString message(tr("Retrieve Process Finished"));
-  if (retrieve->wasCanceled())
+  if (progress.wasCanceled())
     {
     message = tr("Retrieve Process Canceled");
     }
+  else if (!success)
+    {
+    message = tr("Some series could not be retrieved");
+    }
   QMessageBox::information ( this, tr("Query Retrieve"), message );
   emit studiesRetrieved(d->RetrievalsByStudyUID.keys());
 
-  delete retrieve;
   d->ProgressDialog = 0;
 }
 
@@ -416,6 +402,26 @@ void ctkDICOMQueryRetrieveWidget::updateRetrieveProgress(int value)
   QApplication::processEvents();
 }
 
+//----------------------------------------------------------------------------
+void ctkDICOMQueryRetrieveWidget::onRetrieveTransferProgress(int retrievedInstances, int instances,
+                                                             qint64 bytes, double bytesPerSecond)
+{
+  Q_D(ctkDICOMQueryRetrieveWidget);
+  if (d->ProgressDialog == 0)
+    {
+    return;
+    }
+  QString text = instances > 0 ?
+    tr("Retrieved %1 of %2 images").arg(retrievedInstances).arg(instances)
+    : tr("Retrieved %1 images").arg(retrievedInstances);
+  if (bytes > 0)
+    {
+    text += tr("\n%1 MB at %2 MB/s").arg(bytes / (1024. * 1024.), 0, 'f', 1)
+      .arg(bytesPerSecond / (1024. * 1024.), 0, 'f', 1);
+    }
+  d->ProgressDialog->setLabelText(text);
+}
+
 //----------------------------------------------------------------------------
 void ctkDICOMQueryRetrieveWidget::onSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
 {
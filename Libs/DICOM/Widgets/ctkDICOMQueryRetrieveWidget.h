@@ -62,6 +62,8 @@ Q_SIGNALS:
 protected Q_SLOTS:
   void onQueryProgressChanged(int value);
   void updateRetrieveProgress(int value);
+  void onRetrieveTransferProgress(int retrievedInstances, int instances,
+                                  qint64 bytes, double bytesPerSecond);
 
 protected:
   QScopedPointer<ctkDICOMQueryRetrieveWidgetPrivate> d_ptr;
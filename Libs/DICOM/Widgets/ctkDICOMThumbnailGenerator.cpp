@@ -23,7 +23,11 @@
 #include "ctkDICOMThumbnailGenerator.h"
 #include "ctkLogger.h"
 
+// ctkDICOMWidgets includes
+#include "ctkDICOMImage.h"
+
 // Qt includes
+#include <QBuffer>
 #include <QImage>
 
 // DCMTK includes
@@ -41,6 +45,9 @@ public:
   ctkDICOMThumbnailGeneratorPrivate(ctkDICOMThumbnailGenerator&);
   virtual ~ctkDICOMThumbnailGeneratorPrivate();
 
+  /// render the image to a 128x128 QImage
+  bool renderThumbnail(DicomImage* dcmImage, QImage& thumbnail);
+
 protected:
   ctkDICOMThumbnailGenerator* const q_ptr;
 
@@ -74,7 +81,7 @@ ctkDICOMThumbnailGenerator::~ctkDICOMThumbnailGenerator()
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMThumbnailGenerator::generateThumbnail(DicomImage *dcmImage, const QString &path){
+bool ctkDICOMThumbnailGeneratorPrivate::renderThumbnail(DicomImage *dcmImage, QImage& thumbnail){
     QImage image;
     // Check whether we have a valid image
     EI_Status result = dcmImage->getStatus();
@@ -96,42 +103,31 @@ bool ctkDICOMThumbnailGenerator::generateThumbnail(DicomImage *dcmImage, const Q
           dcmImage->setMinMaxWindow(OFTrue /* ignore extreme values */);
         }
     }
-    /* get image extension and prepare image header */
-    const unsigned long width = dcmImage->getWidth();
-    const unsigned long height = dcmImage->getHeight();
-    unsigned long offset = 0;
-    unsigned long length = 0;
-    QString header;
-
-    if (dcmImage->isMonochrome())
+    if (!ctkDICOMImage::renderFrame(dcmImage, 0, image))
     {
-      // write PGM header (binary monochrome image format)
-      header = QString("P5 %1 %2 255\n").arg(width).arg(height);
-      offset = header.length();
-      length = width * height + offset;
+      logger.error("QImage couldn't created");
+      return false;
     }
-    else
+    thumbnail = image.scaled(128,128,Qt::KeepAspectRatio);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMThumbnailGenerator::generateThumbnail(DicomImage *dcmImage, const QString &path){
+    Q_D(ctkDICOMThumbnailGenerator);
+    QImage thumbnail;
+    return d->renderThumbnail(dcmImage, thumbnail) && thumbnail.save(path,"PNG");
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMThumbnailGenerator::generateThumbnailData(DicomImage *dcmImage, QByteArray& data){
+    Q_D(ctkDICOMThumbnailGenerator);
+    QImage thumbnail;
+    if (!d->renderThumbnail(dcmImage, thumbnail))
     {
-      // write PPM header (binary color image format)
-      header = QString("P6 %1 %2 255\n").arg(width).arg(height);
-      offset = header.length();
-      length = width * height * 3 /* RGB */ + offset;
-    }
-    /* create output buffer for DicomImage class */
-    QByteArray buffer;
-    /* copy header to output buffer and resize it for pixel data */
-    buffer.append(header);
-    buffer.resize(length);
-
-    /* render pixel data to buffer */
-    if (dcmImage->getOutputData(static_cast<void *>(buffer.data() + offset), length - offset, 8, 0))
-    {  
-      if (!image.loadFromData( buffer ))
-        {
-            logger.error("QImage couldn't created");
-            return false;
-        }
+      return false;
     }
-    image.scaled(128,128,Qt::KeepAspectRatio).save(path,"PNG");
-    return true;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    return thumbnail.save(&buffer,"PNG");
 }
@@ -43,6 +43,8 @@ public:
   virtual ~ctkDICOMThumbnailGenerator();
 
   virtual bool generateThumbnail(DicomImage* dcmImage, const QString& path );
+  /// PNG encoded thumbnail
+  virtual bool generateThumbnailData(DicomImage* dcmImage, QByteArray& data);
 
 protected:
   QScopedPointer<ctkDICOMThumbnailGeneratorPrivate> d_ptr;
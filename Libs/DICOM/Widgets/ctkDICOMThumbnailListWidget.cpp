@@ -67,8 +67,14 @@ public:
   ctkDICOMThumbnailListWidgetPrivate(ctkDICOMThumbnailListWidget* parent);
 
   QString DatabaseDirectory;
+  ctkDICOMDatabase* DICOMDatabase;
+  /// thumbnails of the series being listed, read at once
+  QMap<QString, QByteArray> SeriesThumbnails;
   QModelIndex CurrentSelectedModel;
 
+  /// a thumbnail can be listed if it exists or can be requested
+  bool canShowThumbnail(const QString& thumbnailPath)const;
+
   void addThumbnailWidget(const QModelIndex &imageIndex, const QModelIndex& sourceIndex, const QString& text);
 
   void onPatientModelSelected(const QModelIndex &index);
@@ -86,7 +92,13 @@ private:
 ctkDICOMThumbnailListWidgetPrivate::ctkDICOMThumbnailListWidgetPrivate(ctkDICOMThumbnailListWidget* parent):
   Superclass(parent)
 {
+  this->DICOMDatabase = 0;
+}
 
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailListWidgetPrivate::canShowThumbnail(const QString& thumbnailPath)const
+{
+  return this->DICOMDatabase || QFile(thumbnailPath).exists();
 }
 
 //----------------------------------------------------------------------------
@@ -97,14 +109,15 @@ void ctkDICOMThumbnailListWidgetPrivate::onPatientModelSelected(const QModelInde
 
     if(model)
     {
-        model->fetchMore(patientIndex);
+        model->fetchAll(patientIndex);
         int studyCount = model->rowCount(patientIndex);
 
         for(int i=0; i<studyCount; i++)
         {
             QModelIndex studyIndex = patientIndex.child(i, 0);
+            model->fetchAll(studyIndex);
             QModelIndex seriesIndex = studyIndex.child(0, 0);
-            model->fetchMore(seriesIndex);
+            model->fetchAll(seriesIndex);
             int imageCount = model->rowCount(seriesIndex);
             QModelIndex imageIndex = seriesIndex.child(imageCount/2, 0);
 
@@ -113,7 +126,7 @@ void ctkDICOMThumbnailListWidgetPrivate::onPatientModelSelected(const QModelInde
                                     model->data(seriesIndex ,ctkDICOMModel::UIDRole).toString() + "/" +
                                     model->data(imageIndex, ctkDICOMModel::UIDRole).toString() + ".png";
 
-            if(QFile(thumbnailPath).exists())
+            if(this->canShowThumbnail(thumbnailPath))
             {
                 this->addThumbnailWidget(imageIndex, studyIndex, model->data(studyIndex, Qt::DisplayRole).toString());
             }
@@ -128,13 +141,13 @@ void ctkDICOMThumbnailListWidgetPrivate::onStudyModelSelected(const QModelIndex
 
     if(model)
     {
-        model->fetchMore(studyIndex);
+        model->fetchAll(studyIndex);
         int seriesCount = model->rowCount(studyIndex);
 
         for(int i=0; i<seriesCount; i++)
         {
             QModelIndex seriesIndex = studyIndex.child(i, 0);
-            model->fetchMore(seriesIndex);
+            model->fetchAll(seriesIndex);
             int imageCount = model->rowCount(seriesIndex);
             QModelIndex imageIndex = seriesIndex.child(imageCount/2, 0);
 
@@ -143,7 +156,7 @@ void ctkDICOMThumbnailListWidgetPrivate::onStudyModelSelected(const QModelIndex
                                     model->data(seriesIndex ,ctkDICOMModel::UIDRole).toString() + "/" +
                                     model->data(imageIndex, ctkDICOMModel::UIDRole).toString() + ".png";
 
-            if (QFile(thumbnailPath).exists())
+            if(this->canShowThumbnail(thumbnailPath))
             {
                 this->addThumbnailWidget(imageIndex, seriesIndex, model->data(seriesIndex, Qt::DisplayRole).toString());
             }
@@ -159,7 +172,15 @@ void ctkDICOMThumbnailListWidgetPrivate::onSeriesModelSelected(const QModelIndex
 
     if(model)
     {
-        model->fetchMore(seriesIndex);
+        model->fetchAll(seriesIndex);
+
+        if(this->DICOMDatabase)
+        {
+            QString seriesInstanceUID = model->data(seriesIndex ,ctkDICOMModel::UIDRole).toString();
+            // thumbnails of the displayed series are generated first
+            this->DICOMDatabase->setVisibleThumbnailSeries(QStringList() << seriesInstanceUID);
+            this->SeriesThumbnails = this->DICOMDatabase->seriesThumbnailData(seriesInstanceUID);
+        }
 
         int imageCount = model->rowCount(seriesIndex);
         logger.debug(QString("Thumbs: %1").arg(imageCount));
@@ -172,11 +193,12 @@ void ctkDICOMThumbnailListWidgetPrivate::onSeriesModelSelected(const QModelIndex
                                     model->data(seriesIndex ,ctkDICOMModel::UIDRole).toString() + "/" +
                                     model->data(imageIndex, ctkDICOMModel::UIDRole).toString() + ".png";
 
-            if(QFile(thumbnailPath).exists())
+            if(this->canShowThumbnail(thumbnailPath))
             {
                 this->addThumbnailWidget(imageIndex, imageIndex, QString("Image %1").arg(i));
             }
         }
+        this->SeriesThumbnails.clear();
     }
 }
 
@@ -199,12 +221,32 @@ void ctkDICOMThumbnailListWidgetPrivate::addThumbnailWidget(const QModelIndex& i
 
         QString widgetLabel = text;
         widget->setText( widgetLabel );
-        QPixmap pix(thumbnailPath);
-        logger.debug("Setting pixmap to " + thumbnailPath);
+        QString sopInstanceUID = model->data(imageIndex, ctkDICOMModel::UIDRole).toString();
+        QPixmap pix;
+        if(this->DICOMDatabase)
+        {
+            QByteArray thumbnailData = this->SeriesThumbnails.value(sopInstanceUID);
+            if(thumbnailData.isEmpty())
+            {
+                thumbnailData = this->DICOMDatabase->thumbnailData(sopInstanceUID);
+            }
+            pix.loadFromData(thumbnailData);
+        }
+        else
+        {
+            pix.load(thumbnailPath);
+            logger.debug("Setting pixmap to " + thumbnailPath);
+        }
         if(this->ThumbnailSize.isValid()){
           widget->setFixedSize(this->ThumbnailSize);
         }
         widget->setPixmap(pix);
+        if(pix.isNull() && this->DICOMDatabase)
+        {
+            // shown by onThumbnailGenerated()
+            widget->setProperty("sopInstanceUID", sopInstanceUID);
+            this->DICOMDatabase->requestThumbnail(sopInstanceUID);
+        }
 
         QVariant var;
         var.setValue(QPersistentModelIndex(sourceIndex));
@@ -241,6 +283,41 @@ void ctkDICOMThumbnailListWidget::setDatabaseDirectory(const QString &directory)
     d->DatabaseDirectory = directory;
 }
 
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::setDICOMDatabase(ctkDICOMDatabase* database){
+    Q_D(ctkDICOMThumbnailListWidget);
+
+    if(d->DICOMDatabase)
+    {
+        this->disconnect(d->DICOMDatabase, SIGNAL(thumbnailGenerated(QString)),
+                         this, SLOT(onThumbnailGenerated(QString)));
+    }
+    d->DICOMDatabase = database;
+    if(d->DICOMDatabase)
+    {
+        this->connect(d->DICOMDatabase, SIGNAL(thumbnailGenerated(QString)),
+                      this, SLOT(onThumbnailGenerated(QString)));
+    }
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::onThumbnailGenerated(const QString& sopInstanceUID){
+    Q_D(ctkDICOMThumbnailListWidget);
+
+    int count = d->ScrollAreaContentWidget->layout()->count();
+    for(int i=0; i<count; i++)
+    {
+        ctkThumbnailLabel* thumbnailWidget = qobject_cast<ctkThumbnailLabel*>(d->ScrollAreaContentWidget->layout()->itemAt(i)->widget());
+        if(thumbnailWidget && thumbnailWidget->property("sopInstanceUID").toString() == sopInstanceUID)
+        {
+            QPixmap pix;
+            pix.loadFromData(d->DICOMDatabase->thumbnailData(sopInstanceUID));
+            thumbnailWidget->setPixmap(pix);
+            thumbnailWidget->setProperty("sopInstanceUID", QVariant());
+        }
+    }
+}
+
 //----------------------------------------------------------------------------
 void ctkDICOMThumbnailListWidget::selectThumbnailFromIndex(const QModelIndex &index){
     Q_D(ctkDICOMThumbnailListWidget);
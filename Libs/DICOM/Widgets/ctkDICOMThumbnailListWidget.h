@@ -25,6 +25,7 @@
 #include "ctkThumbnailListWidget.h"
 
 class QModelIndex;
+class ctkDICOMDatabase;
 class ctkDICOMThumbnailListWidgetPrivate;
 class ctkThumbnailWidget;
 
@@ -39,6 +40,11 @@ public:
 
   void setDatabaseDirectory(const QString& directory);
 
+  /// Thumbnails are read from \a database, the missing ones are requested
+  /// and shown when they are generated. Without database, only the PNG
+  /// files of the thumbs directory are listed.
+  void setDICOMDatabase(ctkDICOMDatabase* database);
+
   void selectThumbnailFromIndex(const QModelIndex& index);
 
 private:
@@ -47,6 +53,9 @@ private:
 
 public Q_SLOTS:
   void onModelSelected(const QModelIndex& index);
+
+protected Q_SLOTS:
+  void onThumbnailGenerated(const QString& sopInstanceUID);
 };
 
 #endif
@@ -0,0 +1,142 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+// Qt includes
+#include <QHash>
+#include <QStringList>
+#include <QTime>
+#include <QUuid>
+
+// CTK includes
+#include <ctkDicomObjectLocatorCache.h>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+// Caches the objects of a study, then times isCached(), getData() and the
+// removal of all of them.
+// Usage: ctkDicomObjectLocatorCacheTest2 [number of objects]
+int ctkDicomObjectLocatorCacheTest2(int argc, char* argv[])
+{
+  int objects = 50000;
+  if (argc > 1)
+    {
+    objects = QString(argv[1]).toInt();
+    }
+  const int seriesCount = 10;
+
+  // one patient, one study, the objects spread over the series
+  ctkDicomAppHosting::AvailableData availableData;
+  ctkDicomAppHosting::Patient patient;
+  ctkDicomAppHosting::Study study;
+  QHash<QString, ctkDicomAppHosting::ObjectLocator> objectLocators;
+  QList<QUuid> objectUUIDs;
+  QStringList objectUuids;
+  for (int seriesIndex = 0; seriesIndex < seriesCount; ++seriesIndex)
+    {
+    ctkDicomAppHosting::Series series;
+    for (int i = seriesIndex; i < objects; i += seriesCount)
+      {
+      QUuid uuid = QUuid::createUuid();
+      ctkDicomAppHosting::ObjectDescriptor objectDescriptor;
+      objectDescriptor.descriptorUUID = uuid.toString();
+      series.objectDescriptors << objectDescriptor;
+
+      ctkDicomAppHosting::ObjectLocator objectLocator;
+      objectLocator.locator = uuid.toString();
+      objectLocator.source = QString("/path/to/object%1.dcm").arg(i);
+      objectLocator.length = i;
+      objectLocators.insert(uuid.toString(), objectLocator);
+      objectUUIDs << uuid;
+      objectUuids << uuid.toString();
+      }
+    study.series << series;
+    }
+  patient.studies << study;
+  availableData.patients << patient;
+
+  ctkDicomObjectLocatorCache cache;
+  QTime timer;
+  timer.start();
+  cache.insert(objectLocators);
+  const int insertMsecs = timer.elapsed();
+  if (cache.count() != objects || cache.isTemporary(objectUuids.first()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Problem with insert() method" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  timer.start();
+  const bool cached = cache.isCached(availableData);
+  const int isCachedMsecs = timer.elapsed();
+  if (!cached)
+    {
+    std::cerr << "Line " << __LINE__ << " - Problem with isCached() method" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  timer.start();
+  QList<ctkDicomAppHosting::ObjectLocator> data = cache.getData(objectUUIDs);
+  const int getDataMsecs = timer.elapsed();
+  if (data.count() != objects || data.last() != objectLocators.value(objectUuids.last()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Problem with getData() method" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // a temporary entry stays temporary until a permanent reference is added
+  QString temporaryUuid = QUuid::createUuid().toString();
+  cache.insert(temporaryUuid, ctkDicomAppHosting::ObjectLocator(), true);
+  cache.insert(temporaryUuid, ctkDicomAppHosting::ObjectLocator(), true);
+  if (!cache.isTemporary(temporaryUuid))
+    {
+    std::cerr << "Line " << __LINE__ << " - Problem with isTemporary() method" << std::endl;
+    return EXIT_FAILURE;
+    }
+  cache.insert(temporaryUuid, ctkDicomAppHosting::ObjectLocator());
+  if (cache.isTemporary(temporaryUuid)
+      || cache.remove(QStringList() << temporaryUuid << temporaryUuid << temporaryUuid) != 3
+      || cache.count() != objects)
+    {
+    std::cerr << "Line " << __LINE__ << " - Problem with temporary entries" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // a second reference is kept by the batch remove
+  cache.insert(objectUuids.first(), objectLocators.value(objectUuids.first()));
+
+  timer.start();
+  const int removed = cache.remove(objectUuids);
+  const int removeMsecs = timer.elapsed();
+  if (removed != objects || cache.count() != 1 || cache.isCached(availableData))
+    {
+    std::cerr << "Line " << __LINE__ << " - Problem with remove() method" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::cout << objects << " objects: insert " << insertMsecs << " ms, isCached "
+            << isCachedMsecs << " ms, getData " << getDataMsecs << " ms, remove "
+            << removeMsecs << " ms" << std::endl;
+
+  return EXIT_SUCCESS;
+}
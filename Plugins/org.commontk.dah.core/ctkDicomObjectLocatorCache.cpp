@@ -21,7 +21,6 @@
 // Qt includes
 #include <QHash>
 #include <QUuid>
-#include <QSet>
 #include <QDebug>
 
 // CTK includes
@@ -32,9 +31,10 @@ namespace
 {
 struct ObjectLocatorCacheItem
 {
-  ObjectLocatorCacheItem():RefCount(1){}
+  ObjectLocatorCacheItem():RefCount(1), Temporary(false){}
   ctkDicomAppHosting::ObjectLocator ObjectLocator;
   int RefCount;
+  bool Temporary;
 };
 }
 
@@ -45,8 +45,18 @@ public:
 
   bool find(const QString& objectUuid, ObjectLocatorCacheItem& objectLocatorCacheItem)const;
 
+  /// Add a reference to \a objectUuid, or insert it
+  void insert(const QString& objectUuid, const ctkDicomAppHosting::ObjectLocator& objectLocator,
+              bool temporary);
+  /// Release a reference to \a objectUuid, false if it's not cached
+  bool remove(const QString& objectUuid);
+
+  /// False if the object of one of \a objectDescriptors isn't cached,
+  /// \a hasCachedData is set if there is at least one
+  bool isCached(const QList<ctkDicomAppHosting::ObjectDescriptor>& objectDescriptors,
+                bool& hasCachedData)const;
+
   QHash<QString, ObjectLocatorCacheItem> ObjectLocatorMap;
-  QSet<QString> TemporaryObjectLocatorSet;
 };
 
 //----------------------------------------------------------------------------
@@ -61,11 +71,67 @@ ctkDicomObjectLocatorCachePrivate::ctkDicomObjectLocatorCachePrivate()
 bool ctkDicomObjectLocatorCachePrivate::find(const QString& objectUuid,
                                              ObjectLocatorCacheItem& objectLocatorCacheItem)const
 {
-  if (!this->ObjectLocatorMap.contains(objectUuid))
+  QHash<QString, ObjectLocatorCacheItem>::const_iterator it = this->ObjectLocatorMap.constFind(objectUuid);
+  if (it == this->ObjectLocatorMap.constEnd())
     {
     return false;
     }
-  objectLocatorCacheItem = this->ObjectLocatorMap[objectUuid];
+  objectLocatorCacheItem = it.value();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void ctkDicomObjectLocatorCachePrivate::insert(const QString& objectUuid,
+                                               const ctkDicomAppHosting::ObjectLocator& objectLocator,
+                                               bool temporary)
+{
+  QHash<QString, ObjectLocatorCacheItem>::iterator it = this->ObjectLocatorMap.find(objectUuid);
+  if (it != this->ObjectLocatorMap.end())
+    {
+    Q_ASSERT(objectLocator == it.value().ObjectLocator); // ObjectLocator are expected to match
+    it.value().RefCount++;
+    it.value().Temporary = it.value().Temporary && temporary;
+    return;
+    }
+  ObjectLocatorCacheItem item;
+  item.ObjectLocator = objectLocator;
+  item.Temporary = temporary;
+  this->ObjectLocatorMap.insert(objectUuid, item);
+}
+
+//----------------------------------------------------------------------------
+bool ctkDicomObjectLocatorCachePrivate::remove(const QString& objectUuid)
+{
+  QHash<QString, ObjectLocatorCacheItem>::iterator it = this->ObjectLocatorMap.find(objectUuid);
+  if (it == this->ObjectLocatorMap.end())
+    {
+    return false;
+    }
+  Q_ASSERT(it.value().RefCount > 0);
+  if (--it.value().RefCount == 0)
+    {
+    if (it.value().Temporary)
+      {
+      // Not implemented - Delete the object
+      qDebug() << "ctkDicomObjectLocatorCache::remove - RefCount [1] - Temporary [True] - Not implemented";
+      }
+    this->ObjectLocatorMap.erase(it);
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool ctkDicomObjectLocatorCachePrivate::isCached(
+  const QList<ctkDicomAppHosting::ObjectDescriptor>& objectDescriptors, bool& hasCachedData)const
+{
+  foreach(const ctkDicomAppHosting::ObjectDescriptor& objectDescriptor, objectDescriptors)
+    {
+    hasCachedData = true;
+    if (!this->ObjectLocatorMap.contains(objectDescriptor.descriptorUUID))
+      {
+      return false;
+      }
+    }
   return true;
 }
 
@@ -87,51 +153,31 @@ bool ctkDicomObjectLocatorCache::isCached(const ctkDicomAppHosting::AvailableDat
 {
   Q_D(const ctkDicomObjectLocatorCache);
   bool hasCachedData = false;
-  QList<QString> uuids = d->ObjectLocatorMap.keys();
-  // Loop over top level object descriptors
-  foreach(const ctkDicomAppHosting::ObjectDescriptor& objectDescriptor, availableData.objectDescriptors)
+  // Top level object descriptors
+  if (!d->isCached(availableData.objectDescriptors, hasCachedData))
     {
-    if (!hasCachedData) { hasCachedData = true; }
-    if (!uuids.contains(objectDescriptor.descriptorUUID))
-      {
-      return false;
-      }
+    return false;
     }
   // Loop over patients
   foreach(const ctkDicomAppHosting::Patient& patient, availableData.patients)
     {
-    // Loop over patient level object descriptors
-    foreach(const ctkDicomAppHosting::ObjectDescriptor& objectDescriptor, patient.objectDescriptors)
+    if (!d->isCached(patient.objectDescriptors, hasCachedData))
       {
-      hasCachedData = true;
-      if (!uuids.contains(objectDescriptor.descriptorUUID))
-        {
-        return false;
-        }
+      return false;
       }
     // Loop over studies
     foreach(const ctkDicomAppHosting::Study& study, patient.studies)
-    {
-      // Loop over study level object descriptors
-      foreach(const ctkDicomAppHosting::ObjectDescriptor& objectDescriptor, study.objectDescriptors)
       {
-          if (!hasCachedData) { hasCachedData = true; }
-          if (!uuids.contains(objectDescriptor.descriptorUUID))
-          {
-          return false;
-          }
-      }
+      if (!d->isCached(study.objectDescriptors, hasCachedData))
+        {
+        return false;
+        }
       // Loop over series
       foreach(const ctkDicomAppHosting::Series& series, study.series)
-      {
-        // Loop over series level object descriptors
-        foreach(const ctkDicomAppHosting::ObjectDescriptor& objectDescriptor, series.objectDescriptors)
         {
-            if (!hasCachedData) { hasCachedData = true; }
-            if (!uuids.contains(objectDescriptor.descriptorUUID))
-            {
-            return false;
-            }
+        if (!d->isCached(series.objectDescriptors, hasCachedData))
+          {
+          return false;
           }
         }
       }
@@ -161,21 +207,20 @@ void ctkDicomObjectLocatorCache::insert(const QString& objectUuid,
                                         bool temporary)
 {
   Q_D(ctkDicomObjectLocatorCache);
-  ObjectLocatorCacheItem item;
-  d->find(objectUuid, item);
-  if(d->ObjectLocatorMap.contains(objectUuid))
-    {
-    Q_ASSERT(objectLocator == item.ObjectLocator); // ObjectLocator are expected to match
-    item.RefCount++;
-    d->ObjectLocatorMap.insert(objectUuid, item);
-    return;
-    }
-  item.ObjectLocator = objectLocator;
-  d->ObjectLocatorMap.insert(objectUuid, item);
+  d->insert(objectUuid, objectLocator, temporary);
+}
 
-  if (temporary)
+//----------------------------------------------------------------------------
+void ctkDicomObjectLocatorCache::insert(
+  const QHash<QString, ctkDicomAppHosting::ObjectLocator>& objectLocators, bool temporary)
+{
+  Q_D(ctkDicomObjectLocatorCache);
+  // grow the table once
+  d->ObjectLocatorMap.reserve(d->ObjectLocatorMap.size() + objectLocators.size());
+  QHash<QString, ctkDicomAppHosting::ObjectLocator>::const_iterator it;
+  for (it = objectLocators.constBegin(); it != objectLocators.constEnd(); ++it)
     {
-    d->TemporaryObjectLocatorSet.insert(objectUuid);
+    d->insert(it.key(), it.value(), temporary);
     }
 }
 
@@ -183,45 +228,56 @@ void ctkDicomObjectLocatorCache::insert(const QString& objectUuid,
 bool ctkDicomObjectLocatorCache::remove(const QString& objectUuid)
 {
   Q_D(ctkDicomObjectLocatorCache);
-  ObjectLocatorCacheItem item;
-  bool found = d->find(objectUuid, item);
-  if (!found)
-    {
-    return false;
-    }
-  Q_ASSERT(item.RefCount > 0);
-  item.RefCount--;
-  d->ObjectLocatorMap.insert(objectUuid, item);
-  if (item.RefCount == 0)
+  return d->remove(objectUuid);
+}
+
+//----------------------------------------------------------------------------
+int ctkDicomObjectLocatorCache::remove(const QStringList& objectUuids)
+{
+  Q_D(ctkDicomObjectLocatorCache);
+  int removed = 0;
+  foreach(const QString& objectUuid, objectUuids)
     {
-    if (d->TemporaryObjectLocatorSet.contains(objectUuid))
+    if (d->remove(objectUuid))
       {
-      // Not implemented - Delete the object
-      qDebug() << "ctkDicomObjectLocatorCache::remove - RefCount [1] - Temporary [True] - Not implemented";
-
-      bool removed = d->TemporaryObjectLocatorSet.remove(objectUuid);
-      Q_ASSERT(removed);
+      ++removed;
       }
-    int removed = d->ObjectLocatorMap.remove(objectUuid);
-    Q_ASSERT(removed == 1);
     }
-  return true;
+  return removed;
+}
+
+//----------------------------------------------------------------------------
+int ctkDicomObjectLocatorCache::count()const
+{
+  Q_D(const ctkDicomObjectLocatorCache);
+  return d->ObjectLocatorMap.size();
+}
+
+//----------------------------------------------------------------------------
+bool ctkDicomObjectLocatorCache::isTemporary(const QString& objectUuid)const
+{
+  Q_D(const ctkDicomObjectLocatorCache);
+  QHash<QString, ObjectLocatorCacheItem>::const_iterator it = d->ObjectLocatorMap.constFind(objectUuid);
+  return it != d->ObjectLocatorMap.constEnd() && it.value().Temporary;
 }
 
 //----------------------------------------------------------------------------
 QList<ctkDicomAppHosting::ObjectLocator> ctkDicomObjectLocatorCache::getData(const QList<QUuid>& objectUUIDs)
 {
+  Q_D(ctkDicomObjectLocatorCache);
   QList<ctkDicomAppHosting::ObjectLocator> objectLocators;
   foreach(const QUuid& uuid, objectUUIDs)
     {
-    ctkDicomAppHosting::ObjectLocator objectLocator;
-    bool found = this->find(uuid, objectLocator);
-    if (!found)
+    QHash<QString, ObjectLocatorCacheItem>::const_iterator it =
+      d->ObjectLocatorMap.constFind(uuid.toString());
+    if (it == d->ObjectLocatorMap.constEnd())
       {
       // Use the empty objectLocator
       // TODO Source should be set to NULL
+      objectLocators << ctkDicomAppHosting::ObjectLocator();
+      continue;
       }
-    objectLocators << objectLocator;
+    objectLocators << it.value().ObjectLocator;
     }
   return objectLocators;
 }
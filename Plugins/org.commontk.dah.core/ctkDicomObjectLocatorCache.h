@@ -22,7 +22,9 @@
 #define CTKDICOMEXCHANGEIMPL_H
 
 // Qt includes
+#include <QHash>
 #include <QScopedPointer>
+#include <QStringList>
 
 // CTK includes
 #include "ctkDicomAppHostingTypes.h"
@@ -32,7 +34,13 @@ class ctkDicomObjectLocatorCachePrivate;
 struct QUuid;
 
 /**
+  * Object locators keyed by object UUID, in a hash table: lookups don't
+  * depend on the number of cached objects.
   *
+  * Each entry is reference counted: inserting an UUID already cached adds a
+  * reference, remove() releases one and the entry goes away with the last.
+  * An entry is temporary as long as all its references were inserted as
+  * temporary.
   */
 class org_commontk_dah_core_EXPORT ctkDicomObjectLocatorCache
 {
@@ -42,6 +50,8 @@ public:
   ctkDicomObjectLocatorCache();
   virtual ~ctkDicomObjectLocatorCache();
 
+  /// True if the objects of all the descriptors of \a availableData are
+  /// cached, false if one is missing or there is no descriptor
   bool isCached(const ctkDicomAppHosting::AvailableData& availableData)const;
 
   bool find(const QString& objectUuid, ctkDicomAppHosting::ObjectLocator& objectLocator)const;
@@ -49,8 +59,23 @@ public:
   void insert(
     const QString& objectUuid, const ctkDicomAppHosting::ObjectLocator& objectLocator, bool temporary = false);
 
+  /// Insert the locators keyed by object UUID at once
+  void insert(
+    const QHash<QString, ctkDicomAppHosting::ObjectLocator>& objectLocators, bool temporary = false);
+
   bool remove(const QString& objectUuid);
 
+  /// Release a reference to each object
+  /// \return the number of objects that were cached
+  int remove(const QStringList& objectUuids);
+
+  /// Number of objects cached
+  int count()const;
+
+  bool isTemporary(const QString& objectUuid)const;
+
+  /// Locators of \a objectUUIDs, in the same order. Missing objects have an
+  /// empty locator.
   QList<ctkDicomAppHosting::ObjectLocator> getData(const QList<QUuid>& objectUUIDs);
 
 private: